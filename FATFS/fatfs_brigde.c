@@ -0,0 +1,308 @@
+/**
+ * Copyright (C) 2022 Deadpool, Hao Huang
+ *
+ * This file is part of NORENV.
+ *
+ * NORENV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * NORENV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with NORENV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "FreeRTOS.h"
+#include "fatfs_brigde.h"
+#include "ff.h"
+#include "norftl.h"
+#include "malloc.h"
+#include "nfvfs.h"
+#include "string.h"
+#include "stdio.h"
+
+#define FATFS_PATH_LEN  128
+
+struct fatfs_dir {
+    DIR dir;
+    FILINFO info;                       /* readdir: name of the last entry */
+};
+
+struct fatfs_file {
+    FIL fil;
+    int flags;
+};
+
+static FATFS fatfs;
+static uint8_t fatfs_mounted;
+
+/* "1:/path" */
+static int fatfs_path(const char *path, char *fpath)
+{
+    uint32_t len = strlen(path);
+
+    if (len + sizeof(FATFS_DRIVE) + 1 > FATFS_PATH_LEN) {
+        return -1;
+    }
+    strcpy(fpath, FATFS_DRIVE);
+    if (path[0] != '/') {
+        strcat(fpath, "/");
+    }
+    strcat(fpath, path);
+    return 0;
+}
+
+int fatfs_mount_wrp()
+{
+    FRESULT res;
+    void *work;
+
+    res = f_mount(&fatfs, FATFS_DRIVE, 1);
+    if (res == FR_NO_FILESYSTEM) {
+        work = mymalloc(SRAMIN, FF_MAX_SS);
+        if (work == NULL) {
+            return -1;
+        }
+        printf("%s: no filesystem, formatting\r\n", __func__);
+        res = f_mkfs(FATFS_DRIVE, FM_ANY, 0, work, FF_MAX_SS);
+        myfree(SRAMIN, work);
+        if (res == FR_OK) {
+            res = f_mount(&fatfs, FATFS_DRIVE, 1);
+        }
+    }
+    if (res != FR_OK) {
+        printf("mount fail is %d\r\n", res);
+        return -1;
+    }
+    fatfs_mounted = 1;
+    return 0;
+}
+
+int fatfs_unmount_wrp()
+{
+    fatfs_mounted = 0;
+    f_mount(NULL, FATFS_DRIVE, 0);
+    return NORFTL_Sync() ? -1 : 0;
+}
+
+int fatfs_set_device(NORDEV *dev)
+{
+    if (fatfs_mounted) {
+        printf("%s: unmount first\r\n", __func__);
+        return -1;
+    }
+    return NORFTL_Set_Device(dev) ? -1 : 0;
+}
+
+static int fatfs_open_dir(const char *fpath, int flags, struct nfvfs_context *context)
+{
+    struct fatfs_dir *dir;
+    FRESULT res;
+
+    dir = (struct fatfs_dir *)pvPortMalloc(sizeof(struct fatfs_dir));
+    if (dir == NULL) {
+        return -1;
+    }
+    res = f_opendir(&dir->dir, fpath);
+    if (res == FR_NO_PATH && IF_O_CREAT(flags)) {
+        res = f_mkdir(fpath);
+        if (res == FR_OK) {
+            res = f_opendir(&dir->dir, fpath);
+        }
+    }
+    if (res != FR_OK) {
+        vPortFree(dir);
+        return -1;
+    }
+    context->out_data = dir;
+    return 0;
+}
+
+int fatfs_open_wrp(const char *path, int flags, int mode, struct nfvfs_context *context)
+{
+    struct fatfs_file *file;
+    int fentry = *(int *)context->in_data;
+    char fpath[FATFS_PATH_LEN];
+    BYTE fa = 0;
+    FRESULT res;
+
+    if (!fatfs_mounted || fatfs_path(path, fpath) < 0) {
+        return -1;
+    }
+    if (S_IFDIR(mode)) {
+        return fatfs_open_dir(fpath, flags, context) < 0 ? -1 : fentry;
+    }
+
+    fa |= (IF_O_RDONLY(flags) ? FA_READ : 0);
+    fa |= (IF_O_WRONLY(flags) ? FA_WRITE : 0);
+    if (IF_O_CREAT(flags) && IF_O_EXCL(flags)) {
+        fa |= FA_CREATE_NEW;
+    } else if (IF_O_CREAT(flags) && IF_O_TRUNC(flags)) {
+        fa |= FA_CREATE_ALWAYS;
+    } else if (IF_O_CREAT(flags)) {
+        fa |= FA_OPEN_ALWAYS;
+    } else {
+        fa |= FA_OPEN_EXISTING;
+    }
+
+    file = (struct fatfs_file *)pvPortMalloc(sizeof(struct fatfs_file));
+    if (file == NULL) {
+        return -1;
+    }
+    res = f_open(&file->fil, fpath, fa);
+    if (res == FR_OK && IF_O_TRUNC(flags) && !IF_O_CREAT(flags)) {
+        res = f_truncate(&file->fil);
+        if (res != FR_OK) {
+            f_close(&file->fil);
+        }
+    }
+    if (res != FR_OK) {
+        vPortFree(file);
+        return -1;
+    }
+    file->flags = flags;
+    context->out_data = file;
+
+    return fentry;
+}
+
+int fatfs_close_wrp(int fd)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    FRESULT res;
+
+    if (entry == NULL) {
+        return -1;
+    }
+    if (S_IFREG(entry->mode)) {
+        res = f_close(&((struct fatfs_file *)entry->f)->fil);
+    } else {
+        res = f_closedir(&((struct fatfs_dir *)entry->f)->dir);
+    }
+    vPortFree(entry->f);
+    NORFTL_Poll();
+    return res == FR_OK ? 0 : -1;
+}
+
+int fatfs_read_wrp(int fd, void *buf, uint32_t size)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    UINT br;
+
+    if (entry == NULL || !S_IFREG(entry->mode)) {
+        return -1;
+    }
+    if (f_read(&((struct fatfs_file *)entry->f)->fil, buf, size, &br) != FR_OK) {
+        return -1;
+    }
+    return br;
+}
+
+int fatfs_write_wrp(int fd, void *buf, uint32_t size)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    struct fatfs_file *file;
+    UINT bw;
+
+    if (entry == NULL || !S_IFREG(entry->mode)) {
+        return -1;
+    }
+    file = (struct fatfs_file *)entry->f;
+    if (IF_O_APPEND(file->flags) && f_lseek(&file->fil, f_size(&file->fil)) != FR_OK) {
+        return -1;
+    }
+    if (f_write(&file->fil, buf, size, &bw) != FR_OK) {
+        return -1;
+    }
+    return bw;
+}
+
+int fatfs_lseek_wrp(int fd, uint32_t offset, int whence)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    FIL *fil;
+    int32_t pos;
+
+    if (entry == NULL || !S_IFREG(entry->mode)) {
+        return -1;
+    }
+    fil = &((struct fatfs_file *)entry->f)->fil;
+
+    switch (whence) {
+    case NFVFS_SEEK_CUR:
+        pos = (int32_t)f_tell(fil) + (int32_t)offset;
+        break;
+    case NFVFS_SEEK_SET:
+        pos = (int32_t)offset;
+        break;
+    case NFVFS_SEEK_END:
+        pos = (int32_t)f_size(fil) + (int32_t)offset;
+        break;
+    default:
+        return -1;
+    }
+    /* beyond the end FATFS extends the file only in a write mode */
+    if (pos < 0 || f_lseek(fil, pos) != FR_OK) {
+        return -1;
+    }
+    return pos;
+}
+
+/* FATFS file and directory entry to the FTL, then an erase in the background */
+int fatfs_fsync_wrp(int fd)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    FRESULT res;
+
+    if (entry == NULL || !S_IFREG(entry->mode)) {
+        return -1;
+    }
+    res = f_sync(&((struct fatfs_file *)entry->f)->fil);
+    NORFTL_Poll();
+    return res == FR_OK ? 0 : -1;
+}
+
+int fatfs_unlink_wrp(const char *path)
+{
+    char fpath[FATFS_PATH_LEN];
+
+    if (!fatfs_mounted || fatfs_path(path, fpath) < 0) {
+        return -1;
+    }
+    return f_unlink(fpath) == FR_OK ? 0 : -1;
+}
+
+/* entries of a directory opened with S_ISDIR, 0 per entry, -1 at the end */
+int fatfs_readdir_wrp(int fd, struct nfvfs_dentry *buf)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    struct fatfs_dir *dir;
+
+    if (entry == NULL || !S_IFDIR(entry->mode)) {
+        return -1;
+    }
+    dir = (struct fatfs_dir *)entry->f;
+    if (f_readdir(&dir->dir, &dir->info) != FR_OK || dir->info.fname[0] == 0) {
+        return -1;
+    }
+    buf->type = (dir->info.fattrib & AM_DIR) ? 2 : 1;  /* as littlefs and ramfs */
+    buf->name = dir->info.fname;
+    return 0;
+}
+
+struct nfvfs_operations fatfs_ops = {
+    .mount = fatfs_mount_wrp,
+    .unmount = fatfs_unmount_wrp,
+    .open = fatfs_open_wrp,
+    .close = fatfs_close_wrp,
+    .read = fatfs_read_wrp,
+    .write = fatfs_write_wrp,
+    .lseek = fatfs_lseek_wrp,
+    .fsync = fatfs_fsync_wrp,
+    .unlink = fatfs_unlink_wrp,
+    .readdir = fatfs_readdir_wrp,
+};
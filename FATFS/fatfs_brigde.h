@@ -0,0 +1,35 @@
+// Copyright (C) 2022 Deadpool, Hao Huang
+//
+// This file is part of NORENV.
+//
+// NORENV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// NORENV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NORENV.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __FATFS_BRIGDE_H
+#define __FATFS_BRIGDE_H
+
+#include "nordev.h"
+
+/* FATFS on the EX_FLASH volume "1:" of diskio.c, which goes through the NOR
+ * flash translation layer (HARDWARE/NORFTL). The first mount formats the
+ * volume when it has no filesystem. Open with S_ISDIR opens a directory for
+ * readdir, with O_CREAT it is made first. fsync and close also start the
+ * erase of a dirty FTL block, which runs on while the application works. */
+#define FATFS_DRIVE     "1:"
+
+extern struct nfvfs_operations fatfs_ops;
+
+/* Device for the next mount, default NORDEV_W25QXX */
+int fatfs_set_device(NORDEV *dev);
+
+#endif /* __FATFS_BRIGDE_H */
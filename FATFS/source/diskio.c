@@ -12,6 +12,7 @@
 #include "malloc.h"	 
 #include "nand.h"	 
 #include "ftl.h"	
+#include "norftl.h"
 
 //////////////////////////////////////////////////////////////////////////////////	 
 //ֻѧϰʹãδɣκ;
@@ -31,11 +32,10 @@
 #define EX_FLASH 	1			//ⲿspi flash,Ϊ1
 #define EX_NAND  	2			//ⲿnand flash,Ϊ2
 
-//W25Q256
-//ǰ25Mֽڸfatfs,25Mֽں,ڴֿ,ֿռ6.01M.	ʣಿ,ͻԼ	 
+//W25QXX through the NOR flash translation layer (HARDWARE/NORFTL), on the
+//device of NORFTL_Set_Device(), the whole chip by default. The FTL remaps the
+//sectors, so FATFS needs no erase block alignment.
 #define SPI_FLASH_SECTOR_SIZE 	512	
-#define SPI_FLASH_SECTOR_COUNT 	1024*25*2	//W25Q256,ǰ25MֽڸFATFSռ	
-#define SPI_FLASH_BLOCK_SIZE   	8     		//ÿBLOCK8		
   
   
   
@@ -60,7 +60,7 @@ DSTATUS disk_initialize (
 			res=SD_Init();	//SDʼ 
   			break;
 		case EX_FLASH:		//ⲿflash
-			W25QXX_Init();  //W25QXXʼ
+			res=NORFTL_Init();	//mount the FTL, W25QXX_Init() is done in board_init()
  			break;
 		case EX_NAND:		//ⲿNAND
 			res=FTL_Init();	//NANDʼ
@@ -97,13 +97,7 @@ DRESULT disk_read (
 			}
 			break;
 		case EX_FLASH://ⲿflash
-			for(;count>0;count--)
-			{
-				W25QXX_Read(buff,sector*SPI_FLASH_SECTOR_SIZE,SPI_FLASH_SECTOR_SIZE);
-				sector++;
-				buff+=SPI_FLASH_SECTOR_SIZE;
-			}
-			res=0;
+			res=NORFTL_ReadSectors(buff,sector,count);
 			break;
 		case EX_NAND:		//ⲿNAND
 			res=FTL_ReadSectors(buff,sector,512,count);	//ȡ			
@@ -141,13 +135,7 @@ DRESULT disk_write (
 			}
 			break;
 		case EX_FLASH://ⲿflash
-			for(;count>0;count--)
-			{										    
-				W25QXX_Write((u8*)buff,sector*SPI_FLASH_SECTOR_SIZE,SPI_FLASH_SECTOR_SIZE);
-				sector++;
-				buff+=SPI_FLASH_SECTOR_SIZE;
-			}
-			res=0;
+			res=NORFTL_WriteSectors((u8*)buff,sector,count);
 			break;
 		case EX_NAND:		//ⲿNAND
 			res=FTL_WriteSectors((u8*)buff,sector,512,count);//д
@@ -198,20 +186,23 @@ DRESULT res;
 	    switch(cmd)
 	    {
 		    case CTRL_SYNC:
-				res = RES_OK; 
+				res = NORFTL_Sync() ? RES_ERROR : RES_OK;	//write buffer of the FTL to the flash
 		        break;	 
 		    case GET_SECTOR_SIZE:
 		        *(WORD*)buff = SPI_FLASH_SECTOR_SIZE;
 		        res = RES_OK;
 		        break;	 
 		    case GET_BLOCK_SIZE:
-		        *(WORD*)buff = SPI_FLASH_BLOCK_SIZE;
+		        *(DWORD*)buff = 1;
 		        res = RES_OK;
 		        break;	 
 		    case GET_SECTOR_COUNT:
-		        *(DWORD*)buff = SPI_FLASH_SECTOR_COUNT;
+		        *(DWORD*)buff = NORFTL_Sectors();
 		        res = RES_OK;
 		        break;
+		    case CTRL_TRIM:		//sectors no longer used, the FTL does not move them
+				res = NORFTL_Trim(((DWORD*)buff)[0],((DWORD*)buff)[1]) ? RES_ERROR : RES_OK;
+		        break;
 		    default:
 		        res = RES_PARERR;
 		        break;
@@ -0,0 +1,323 @@
+#include "nordev.h"
+#include "w25qxx.h"
+#ifdef NORDEV_QSPI
+#include "norflash.h"
+#endif
+
+//W25QXX_Read() takes 16 bit lengths
+static void NORDEV_W25QXX_Read(NORDEV *dev, u32 addr, u8 *buf, u32 len)
+{
+    u32 n;
+
+    while (len) {
+        n = len > 0x8000 ? 0x8000 : len;
+        W25QXX_Read(buf, addr, n);
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void NORDEV_W25QXX_Prog(NORDEV *dev, u32 addr, u8 *buf, u32 len)
+{
+    W25QXX_Write_Page(buf, addr, len); //pipelined, returns while programming
+}
+
+//a single sector erase returns at once, more take the block erases and wait
+static void NORDEV_W25QXX_Erase(NORDEV *dev, u32 addr, u32 len)
+{
+    if (len == 4096)
+        W25QXX_Erase_Sector_Start(addr / 4096);
+    else
+        W25QXX_Erase(addr, len);
+}
+
+static u8 NORDEV_W25QXX_Running(NORDEV *dev)
+{
+    return W25QXX_Running();
+}
+
+static void NORDEV_W25QXX_Sync(NORDEV *dev)
+{
+    W25QXX_Sync();
+}
+
+NORDEV NORDEV_W25QXX = {
+    0, 4096, NORDEV_W25QXX_Read, NORDEV_W25QXX_Prog, NORDEV_W25QXX_Erase,
+    NORDEV_W25QXX_Running, NORDEV_W25QXX_Sync, NULL};
+
+#ifdef NORDEV_QSPI
+//the NORFLASH functions do not wait for a running erase themselves
+static void NORDEV_Norflash_Read(NORDEV *dev, u32 addr, u8 *buf, u32 len)
+{
+    u32 n;
+
+    NORFLASH_Wait_Busy();
+    addr += NORDEV_QSPI_BASE;
+    while (len) {
+        n = len > 0x8000 ? 0x8000 : len;
+        NORFLASH_Read(buf, addr, n);
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void NORDEV_Norflash_Prog(NORDEV *dev, u32 addr, u8 *buf, u32 len)
+{
+    NORFLASH_Wait_Busy();
+    NORFLASH_Write_Page(buf, NORDEV_QSPI_BASE + addr, len);
+}
+
+static void NORDEV_Norflash_Erase(NORDEV *dev, u32 addr, u32 len)
+{
+    for (addr += NORDEV_QSPI_BASE; len; addr += 4096, len -= 4096)
+        NORFLASH_Erase_Sector_Start(addr / 4096); //waits for the previous one
+}
+
+static u8 NORDEV_Norflash_Running(NORDEV *dev)
+{
+    return NORFLASH_Running();
+}
+
+static void NORDEV_Norflash_Sync(NORDEV *dev)
+{
+    NORFLASH_Wait_Busy();
+}
+
+NORDEV NORDEV_Norflash = {
+    0, 4096, NORDEV_Norflash_Read, NORDEV_Norflash_Prog, NORDEV_Norflash_Erase,
+    NORDEV_Norflash_Running, NORDEV_Norflash_Sync, NULL};
+#endif
+
+void NORDEV_Init(void)
+{
+#ifdef NORDEV_QSPI
+    u32 size = 0;
+
+#endif
+    NORDEV_W25QXX.size = W25QXX_Geo.size;
+#ifdef NORDEV_QSPI
+    if (NORFLASH_TYPE >= W25Q80 && NORFLASH_TYPE <= W25Q256)
+        size = (1024 * 1024) << (NORFLASH_TYPE - W25Q80);
+    NORDEV_Norflash.size = size > NORDEV_QSPI_BASE ? size - NORDEV_QSPI_BASE : 0; //0: chip too small
+#endif
+}
+
+void NORDEV_Read(NORDEV *dev, u32 addr, u8 *buf, u32 len)
+{
+    dev->read(dev, addr, buf, len);
+}
+
+//the pages of up to NORDEV_STRIPE_MAX erase units are issued in turn, so on a
+//striped device every chip programs a page at the same time
+void NORDEV_Prog(NORDEV *dev, u32 addr, u8 *buf, u32 len)
+{
+    u32 pos[NORDEV_STRIPE_MAX], end[NORDEV_STRIPE_MAX];
+    u32 start = addr, step;
+    u8 n, i, more;
+
+    while (len) {
+        for (n = 0; n < NORDEV_STRIPE_MAX && len; n++) {
+            step = dev->erase_size - addr % dev->erase_size;
+            if (step > len)
+                step = len;
+            pos[n] = addr;
+            end[n] = addr + step;
+            addr += step;
+            len -= step;
+        }
+        do {
+            more = 0;
+            for (i = 0; i < n; i++) {
+                if (pos[i] == end[i])
+                    continue;
+                step = NORDEV_PAGE_SIZE - pos[i] % NORDEV_PAGE_SIZE;
+                if (step > end[i] - pos[i])
+                    step = end[i] - pos[i];
+                dev->prog(dev, pos[i], buf + (pos[i] - start), step);
+                pos[i] += step;
+                more = 1;
+            }
+        } while (more);
+    }
+}
+
+u8 NORDEV_Erase(NORDEV *dev, u32 addr, u32 len)
+{
+    if (addr % dev->erase_size || len % dev->erase_size)
+        return 1;
+    if (len)
+        dev->erase(dev, addr, len);
+    return 0;
+}
+
+void NORDEV_Sync(NORDEV *dev)
+{
+    dev->sync(dev);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//partition
+static void NORDEV_Part_Read(NORDEV *dev, u32 addr, u8 *buf, u32 len)
+{
+    NORDEV_PART *part = (NORDEV_PART *)dev;
+    part->parent->read(part->parent, part->base + addr, buf, len);
+}
+
+static void NORDEV_Part_Prog(NORDEV *dev, u32 addr, u8 *buf, u32 len)
+{
+    NORDEV_PART *part = (NORDEV_PART *)dev;
+    part->parent->prog(part->parent, part->base + addr, buf, len);
+}
+
+static void NORDEV_Part_Erase(NORDEV *dev, u32 addr, u32 len)
+{
+    NORDEV_PART *part = (NORDEV_PART *)dev;
+    part->parent->erase(part->parent, part->base + addr, len);
+}
+
+static u8 NORDEV_Part_Running(NORDEV *dev)
+{
+    NORDEV_PART *part = (NORDEV_PART *)dev;
+    return part->parent->running(part->parent);
+}
+
+static void NORDEV_Part_Sync(NORDEV *dev)
+{
+    NORDEV_PART *part = (NORDEV_PART *)dev;
+    part->parent->sync(part->parent);
+}
+
+int NORDEV_Part_Init(NORDEV_PART *part, NORDEV *parent, u32 base, u32 size)
+{
+    if ((base | size) % parent->erase_size || !size || base > parent->size || size > parent->size - base)
+        return -1;
+    part->dev.size = size;
+    part->dev.erase_size = parent->erase_size;
+    part->dev.read = NORDEV_Part_Read;
+    part->dev.prog = NORDEV_Part_Prog;
+    part->dev.erase = NORDEV_Part_Erase;
+    part->dev.running = NORDEV_Part_Running;
+    part->dev.sync = NORDEV_Part_Sync;
+    part->dev.ctx = NULL;
+    part->parent = parent;
+    part->base = base;
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//stripe
+//member and member address of addr, *len is cut to what is contiguous there
+static NORDEV *NORDEV_Stripe_Map(NORDEV_STRIPE *stripe, u32 addr, u32 *maddr, u32 *len)
+{
+    u32 unit = stripe->dev.erase_size, block, rest;
+    u8 i;
+
+    if (stripe->mode == NORDEV_INTERLEAVE) {
+        block = addr / unit;
+        rest = unit - addr % unit;
+        *maddr = block / stripe->n * unit + addr % unit;
+        if (*len > rest)
+            *len = rest;
+        return stripe->member[block % stripe->n];
+    }
+    for (i = 0; i < stripe->n - 1 && addr >= stripe->member[i]->size; i++)
+        addr -= stripe->member[i]->size;
+    rest = stripe->member[i]->size - addr;
+    *maddr = addr;
+    if (*len > rest)
+        *len = rest;
+    return stripe->member[i];
+}
+
+static void NORDEV_Stripe_Read(NORDEV *dev, u32 addr, u8 *buf, u32 len)
+{
+    NORDEV *m;
+    u32 maddr, n;
+
+    while (len) {
+        n = len;
+        m = NORDEV_Stripe_Map((NORDEV_STRIPE *)dev, addr, &maddr, &n);
+        m->read(m, maddr, buf, n);
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void NORDEV_Stripe_Prog(NORDEV *dev, u32 addr, u8 *buf, u32 len)
+{
+    NORDEV *m;
+    u32 maddr;
+
+    m = NORDEV_Stripe_Map((NORDEV_STRIPE *)dev, addr, &maddr, &len); //a page is inside one unit
+    m->prog(m, maddr, buf, len);
+}
+
+//interleaved, consecutive units are on different chips and erase at the same time
+static void NORDEV_Stripe_Erase(NORDEV *dev, u32 addr, u32 len)
+{
+    NORDEV *m;
+    u32 maddr, n;
+
+    while (len) {
+        n = len;
+        m = NORDEV_Stripe_Map((NORDEV_STRIPE *)dev, addr, &maddr, &n);
+        m->erase(m, maddr, n);
+        addr += n;
+        len -= n;
+    }
+}
+
+static u8 NORDEV_Stripe_Running(NORDEV *dev)
+{
+    NORDEV_STRIPE *stripe = (NORDEV_STRIPE *)dev;
+    u8 i;
+
+    for (i = 0; i < stripe->n; i++) {
+        if (stripe->member[i]->running(stripe->member[i]))
+            return 1;
+    }
+    return 0;
+}
+
+static void NORDEV_Stripe_Sync(NORDEV *dev)
+{
+    NORDEV_STRIPE *stripe = (NORDEV_STRIPE *)dev;
+    u8 i;
+
+    for (i = 0; i < stripe->n; i++)
+        stripe->member[i]->sync(stripe->member[i]);
+}
+
+//the members must have the same erase size, interleaved they all contribute
+//the size of the smallest one
+int NORDEV_Stripe_Init(NORDEV_STRIPE *stripe, NORDEV **member, u8 n, u8 mode)
+{
+    u32 min_size = 0xFFFFFFFF, size = 0;
+    u8 i;
+
+    if (!n || n > NORDEV_STRIPE_MAX || mode > NORDEV_CONCAT)
+        return -1;
+    for (i = 0; i < n; i++) {
+        if (!member[i]->size || member[i]->erase_size != member[0]->erase_size)
+            return -1;
+        if (member[i]->size < min_size)
+            min_size = member[i]->size;
+        size += member[i]->size;
+        stripe->member[i] = member[i];
+    }
+    min_size -= min_size % member[0]->erase_size;
+    stripe->dev.size = mode == NORDEV_INTERLEAVE ? min_size * n : size;
+    stripe->dev.erase_size = member[0]->erase_size;
+    stripe->dev.read = NORDEV_Stripe_Read;
+    stripe->dev.prog = NORDEV_Stripe_Prog;
+    stripe->dev.erase = NORDEV_Stripe_Erase;
+    stripe->dev.running = NORDEV_Stripe_Running;
+    stripe->dev.sync = NORDEV_Stripe_Sync;
+    stripe->dev.ctx = NULL;
+    stripe->n = n;
+    stripe->mode = mode;
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef __NORDEV_H
+#define __NORDEV_H
+#include "sys.h"
+//////////////////////////////////////////////////////////////////////////////////
+//NOR block devices for the filesystem bridges
+//A NORDEV is a chip, a partition of one, or several chips striped together.
+//prog only programs (erased area, bits 1->0) and may return while the page is
+//still programming, erase may return at once. read and the next prog/erase
+//wait for the device themselves, so only sync is needed before power down.
+//erase takes whole erase units, a chip uses its largest fitting erase command.
+//
+//NORDEV_QSPI adds the QSPI NOR (HARDWARE/NORFLASH) as second chip. The firmware
+//normally executes from it (memory mapped), then it cannot take commands: only
+//define NORDEV_QSPI in a build that runs from internal flash/RAM and has
+//norflash.c and qspi.c in the project.
+//////////////////////////////////////////////////////////////////////////////////
+
+//#define NORDEV_QSPI
+#define NORDEV_QSPI_BASE   0x600000 //QSPI NOR from 6MB on, below are the code image and ROMFS
+
+#define NORDEV_PAGE_SIZE   256
+#define NORDEV_STRIPE_MAX  4
+
+#define NORDEV_INTERLEAVE  0        //erase block i on member i % n: one chip erases, the other works
+#define NORDEV_CONCAT      1        //members one after another
+
+typedef struct nordev
+{
+    u32 size;                                                     //bytes
+    u32 erase_size;                                               //one erase unit
+    void (*read)(struct nordev *dev, u32 addr, u8 *buf, u32 len);
+    void (*prog)(struct nordev *dev, u32 addr, u8 *buf, u32 len); //inside one page
+    void (*erase)(struct nordev *dev, u32 addr, u32 len);         //erase units
+    u8 (*running)(struct nordev *dev);                            //1: prog/erase not done, no wait
+    void (*sync)(struct nordev *dev);                             //wait for prog/erase
+    void *ctx;
+} NORDEV;
+
+typedef struct
+{
+    NORDEV dev;                                                   //pass &part.dev
+    NORDEV *parent;
+    u32 base;
+} NORDEV_PART;
+
+typedef struct
+{
+    NORDEV dev;                                                   //pass &stripe.dev
+    NORDEV *member[NORDEV_STRIPE_MAX];
+    u8 n;
+    u8 mode;                                                      //NORDEV_INTERLEAVE/NORDEV_CONCAT
+} NORDEV_STRIPE;
+
+extern NORDEV NORDEV_W25QXX;                                      //SPI2 W25QXX, whole chip
+#ifdef NORDEV_QSPI
+extern NORDEV NORDEV_Norflash;                                    //QSPI NOR from NORDEV_QSPI_BASE on
+#endif
+
+void NORDEV_Init(void);                                           //sizes of the chips, after W25QXX_Init()
+void NORDEV_Read(NORDEV *dev, u32 addr, u8 *buf, u32 len);
+void NORDEV_Prog(NORDEV *dev, u32 addr, u8 *buf, u32 len);       //split in pages
+u8 NORDEV_Erase(NORDEV *dev, u32 addr, u32 len);                  //erase units, 1: not aligned
+void NORDEV_Sync(NORDEV *dev);
+int NORDEV_Part_Init(NORDEV_PART *part, NORDEV *parent, u32 base, u32 size);       //0 or -1
+int NORDEV_Stripe_Init(NORDEV_STRIPE *stripe, NORDEV **member, u8 n, u8 mode);    //0 or -1
+
+#endif
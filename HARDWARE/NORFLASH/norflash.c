@@ -289,6 +289,22 @@ void NORFLASH_Erase_Sector(u32 Dst_Addr)
 	NORFLASH_Wait_Busy();				//ȴ
 }
 
+//start a sector erase and return at once, Dst_Addr: sector number
+//the next command must wait for it (NORFLASH_Wait_Busy)
+void NORFLASH_Erase_Sector_Start(u32 Dst_Addr)
+{
+	Dst_Addr*=4096;
+	NORFLASH_Write_Enable();
+	NORFLASH_Wait_Busy();
+	QSPI_Send_CMD(W25X_SectorErase,Dst_Addr,(0<<6)|(2<<4)|(3<<2)|(3<<0),0);
+}
+
+//program or erase still running? one status read, no wait
+u8 NORFLASH_Running(void)
+{
+	return NORFLASH_ReadSR(1)&0x01;
+}
+
 //ȴ
 void NORFLASH_Wait_Busy(void)   
 {   
@@ -68,11 +68,14 @@ void NORFLASH_4ByteAddr_Enable(void);	//ʹ
 void NORFLASH_Write_SR(u8 regno,u8 sr);	//д״̬Ĵ
 void NORFLASH_Write_Enable(void);  		//дʹ 
 void NORFLASH_Write_Disable(void);		//д
+void NORFLASH_Write_Page(u8* pBuffer,u32 WriteAddr,u16 NumByteToWrite);	//inside one page, erased
 void NORFLASH_Write_NoCheck(u8* pBuffer,u32 WriteAddr,u16 NumByteToWrite);	//дflash,У
 void NORFLASH_Read(u8* pBuffer,u32 ReadAddr,u16 NumByteToRead);   			//ȡflash
 void NORFLASH_Write(u8* pBuffer,u32 WriteAddr,u16 NumByteToWrite);			//дflash
 void NORFLASH_Erase_Chip(void);    	  		//Ƭ
 void NORFLASH_Erase_Sector(u32 Dst_Addr);	//
+void NORFLASH_Erase_Sector_Start(u32 Dst_Addr);	//start a sector erase, returns at once
+u8 NORFLASH_Running(void);					//1: program/erase still running
 void NORFLASH_Wait_Busy(void);           	//ȴ
 #endif
 
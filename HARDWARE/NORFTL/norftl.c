@@ -0,0 +1,463 @@
+#include "norftl.h"
+#include "malloc.h"
+#include "string.h"
+#include "stdio.h"
+
+//block states
+#define NORFTL_FREE     0               //erased
+#define NORFTL_DIRTY    1               //no valid slot, to erase
+#define NORFTL_USED     2               //has a header
+
+//slot number: block*64+slot
+#define NORFTL_PHYS(b, s)   ((b) * (NORFTL_SLOTS_MAX + 1) + (s))
+#define NORFTL_BLK(p)       ((p) / (NORFTL_SLOTS_MAX + 1))
+#define NORFTL_SLOT(p)      ((p) % (NORFTL_SLOTS_MAX + 1))
+#define NORFTL_HDR_SIZE     (12 + 4 * NORFTL_Slots)
+
+typedef struct
+{
+    u32 ec;
+    u32 seq;
+    u8 state;
+    u8 valid;                           //slots holding the newest copy of their lba
+    u8 next;                            //next slot to program
+    u8 pad;
+} NORFTL_BLOCK;
+
+NORFTL_STAT NORFTL_Stat;
+
+static NORDEV *NORFTL_Dev = &NORDEV_W25QXX;
+static NORDEV *NORFTL_Mounted;          //NULL: not mounted
+static u32 NORFTL_Blocks, NORFTL_Slots, NORFTL_Cap;
+static u32 NORFTL_Seq;
+static u32 NORFTL_Head = NORFTL_NONE;   //block the slots are programmed to
+static u32 NORFTL_EcMax;
+static u32 NORFTL_WlCount;              //erases since the last wear leveling check
+static u32 NORFTL_Count[3];             //blocks per state
+static u32 *NORFTL_Map;                 //lba -> slot number
+static NORFTL_BLOCK *NORFTL_Blk;
+
+//write buffer of NORFTL_Slots sectors
+static u8 *NORFTL_Buf;
+static u32 NORFTL_BufLba[NORFTL_SLOTS_MAX];
+static u32 NORFTL_BufN;
+
+static NORFTL_HEADER NORFTL_Hdr;
+static u8 NORFTL_Tmp[NORFTL_SECTOR_SIZE];
+
+static u8 NORFTL_Alloc(void);
+
+static u32 NORFTL_Addr(u32 phys)
+{
+    return NORFTL_BLK(phys) * NORFTL_Mounted->erase_size + (NORFTL_SLOT(phys) + 1) * NORFTL_SECTOR_SIZE;
+}
+
+static void NORFTL_SetState(u32 b, u8 state)
+{
+    NORFTL_Count[NORFTL_Blk[b].state]--;
+    NORFTL_Blk[b].state = state;
+    NORFTL_Count[state]++;
+}
+
+static void NORFTL_Free(void)
+{
+    if (NORFTL_Map) myfree(SRAMEX, NORFTL_Map);
+    if (NORFTL_Blk) myfree(SRAMEX, NORFTL_Blk);
+    if (NORFTL_Buf) myfree(SRAMEX, NORFTL_Buf);
+    NORFTL_Map = NULL;
+    NORFTL_Blk = NULL;
+    NORFTL_Buf = NULL;
+    NORFTL_Mounted = NULL;
+}
+
+u8 NORFTL_Set_Device(NORDEV *dev)
+{
+    if (dev->erase_size % NORFTL_SECTOR_SIZE || dev->erase_size < 2 * NORFTL_SECTOR_SIZE ||
+        dev->erase_size / NORFTL_SECTOR_SIZE - 1 > NORFTL_SLOTS_MAX) {
+        printf("%s: erase size %d does not fit\r\n", __func__, dev->erase_size);
+        return 1;
+    }
+    if (NORFTL_Mounted) {
+        NORFTL_Sync();
+        NORFTL_Free();
+    }
+    NORFTL_Dev = dev;
+    return 0;
+}
+
+//the newest copy of every lba from the block headers
+static void NORFTL_Scan(void)
+{
+    NORDEV *dev = NORFTL_Mounted;
+    NORFTL_BLOCK *blk;
+    u32 b, s, i, lba, old, ob;
+    u32 ec_sum = 0, ec_n = 0;
+
+    NORFTL_Seq = 0;
+    NORFTL_EcMax = 0;
+    NORFTL_Head = NORFTL_NONE;
+    for (b = 0; b < NORFTL_Blocks; b++) {
+        blk = &NORFTL_Blk[b];
+        NORDEV_Read(dev, b * dev->erase_size, (u8 *)&NORFTL_Hdr, NORFTL_HDR_SIZE);
+        if (NORFTL_Hdr.magic != NORFTL_MAGIC || NORFTL_Hdr.seq == NORFTL_NONE) {
+            blk->state = NORFTL_DIRTY;  //erased, never allocated or torn: erase before use
+            blk->ec = NORFTL_NONE;
+            continue;
+        }
+        blk->state = NORFTL_USED;
+        blk->ec = NORFTL_Hdr.ec;
+        blk->seq = NORFTL_Hdr.seq;
+        blk->next = 0;
+        ec_sum += blk->ec;
+        ec_n++;
+        for (s = 0; s < NORFTL_Slots; s++) {
+            lba = NORFTL_Hdr.lba[s];
+            if (lba != NORFTL_NONE) blk->next = s + 1;
+            if (lba >= NORFTL_Cap) continue;
+            old = NORFTL_Map[lba];
+            if (old != NORFTL_NONE) {
+                ob = NORFTL_BLK(old);
+                if (ob != b && NORFTL_Blk[ob].seq > blk->seq) continue;  //already have a newer one
+                NORFTL_Blk[ob].valid--;
+            }
+            NORFTL_Map[lba] = NORFTL_PHYS(b, s);
+            blk->valid++;
+        }
+        //a cut during a program may have left data without its lba
+        for (s = blk->next; s < NORFTL_Slots; s++) {
+            NORDEV_Read(dev, NORFTL_Addr(NORFTL_PHYS(b, s)), NORFTL_Tmp, NORFTL_SECTOR_SIZE);
+            for (i = 0; i < NORFTL_SECTOR_SIZE && NORFTL_Tmp[i] == 0xFF; i++);
+            if (i < NORFTL_SECTOR_SIZE) blk->next = s + 1;
+        }
+        if (blk->seq > NORFTL_Seq) {
+            NORFTL_Seq = blk->seq;
+            NORFTL_Head = b;            //go on in the newest block
+        }
+    }
+    if (NORFTL_Head != NORFTL_NONE && NORFTL_Blk[NORFTL_Head].next >= NORFTL_Slots) NORFTL_Head = NORFTL_NONE;
+    memset(NORFTL_Count, 0, sizeof(NORFTL_Count));
+    for (b = 0; b < NORFTL_Blocks; b++) {
+        blk = &NORFTL_Blk[b];
+        if (blk->ec == NORFTL_NONE) blk->ec = ec_n ? ec_sum / ec_n : 0;
+        if (blk->state == NORFTL_USED && blk->valid == 0 && b != NORFTL_Head) blk->state = NORFTL_DIRTY;
+        if (blk->ec > NORFTL_EcMax) NORFTL_EcMax = blk->ec;
+        NORFTL_Count[blk->state]++;
+    }
+}
+
+u8 NORFTL_Init(void)
+{
+    NORDEV *dev = NORFTL_Dev;
+    u32 spare;
+
+    if (NORFTL_Mounted == dev) return 0;
+    if (NORFTL_Mounted) {
+        NORFTL_Sync();
+        NORFTL_Free();
+    }
+    NORFTL_Slots = dev->erase_size / NORFTL_SECTOR_SIZE - 1;
+    NORFTL_Blocks = dev->size / dev->erase_size;
+    spare = NORFTL_Blocks / 16 + NORFTL_RESERVE + 2;  //over provisioning for the garbage collection
+    if (NORFTL_Slots < 1 || NORFTL_Slots > NORFTL_SLOTS_MAX || NORFTL_Blocks <= spare) {
+        printf("%s: device does not fit\r\n", __func__);
+        return 1;
+    }
+    NORFTL_Cap = (NORFTL_Blocks - spare) * NORFTL_Slots;
+
+    NORFTL_Map = mymalloc(SRAMEX, NORFTL_Cap * 4);
+    NORFTL_Blk = mymalloc(SRAMEX, NORFTL_Blocks * sizeof(NORFTL_BLOCK));
+    NORFTL_Buf = mymalloc(SRAMEX, NORFTL_Slots * NORFTL_SECTOR_SIZE);
+    if (NORFTL_Map == NULL || NORFTL_Blk == NULL || NORFTL_Buf == NULL) {
+        NORFTL_Free();
+        return 1;
+    }
+    memset(NORFTL_Map, 0xFF, NORFTL_Cap * 4);
+    memset(NORFTL_Blk, 0, NORFTL_Blocks * sizeof(NORFTL_BLOCK));
+    NORFTL_Mounted = dev;
+    NORFTL_BufN = 0;
+    NORFTL_WlCount = 0;
+    NORFTL_Scan();
+    return 0;
+}
+
+u32 NORFTL_Sectors(void)
+{
+    return NORFTL_Mounted ? NORFTL_Cap : 0;
+}
+
+//lowest erase count of a state, not the head
+static u32 NORFTL_Pick(u8 state)
+{
+    u32 b, best = NORFTL_NONE;
+
+    if (NORFTL_Count[state] == 0) return NORFTL_NONE;
+    for (b = 0; b < NORFTL_Blocks; b++) {
+        if (NORFTL_Blk[b].state != state || b == NORFTL_Head) continue;
+        if (best == NORFTL_NONE || NORFTL_Blk[b].ec < NORFTL_Blk[best].ec) best = b;
+    }
+    return best;
+}
+
+//returns at once on a W25QXX, the next prog/erase waits for it
+static void NORFTL_Erase(u32 b)
+{
+    NORFTL_BLOCK *blk = &NORFTL_Blk[b];
+
+    NORDEV_Erase(NORFTL_Mounted, b * NORFTL_Mounted->erase_size, NORFTL_Mounted->erase_size);
+    blk->ec++;
+    blk->valid = 0;
+    blk->next = 0;
+    if (blk->ec > NORFTL_EcMax) NORFTL_EcMax = blk->ec;
+    NORFTL_SetState(b, NORFTL_FREE);
+    NORFTL_Stat.erases++;
+    NORFTL_WlCount++;
+}
+
+//new head block from the free ones, else a dirty one is erased now
+static u8 NORFTL_Take(void)
+{
+    u32 b, hdr[3];
+
+    b = NORFTL_Pick(NORFTL_FREE);
+    if (b == NORFTL_NONE) {
+        b = NORFTL_Pick(NORFTL_DIRTY);
+        if (b == NORFTL_NONE) return 1;
+        NORFTL_Erase(b);
+    }
+    if (NORFTL_Head != NORFTL_NONE && NORFTL_Blk[NORFTL_Head].valid == 0)
+        NORFTL_SetState(NORFTL_Head, NORFTL_DIRTY);
+
+    hdr[0] = NORFTL_MAGIC;
+    hdr[1] = NORFTL_Blk[b].ec;
+    hdr[2] = ++NORFTL_Seq;
+    NORDEV_Prog(NORFTL_Mounted, b * NORFTL_Mounted->erase_size, (u8 *)hdr, sizeof(hdr));
+    NORFTL_Blk[b].seq = hdr[2];
+    NORFTL_Blk[b].valid = 0;
+    NORFTL_Blk[b].next = 0;
+    NORFTL_SetState(b, NORFTL_USED);
+    NORFTL_Head = b;
+    return 0;
+}
+
+//a slot does not hold the newest copy of its lba any more
+static void NORFTL_Unref(u32 phys)
+{
+    u32 b = NORFTL_BLK(phys);
+
+    NORFTL_Blk[b].valid--;
+    if (NORFTL_Blk[b].valid == 0 && b != NORFTL_Head && NORFTL_Blk[b].state == NORFTL_USED)
+        NORFTL_SetState(b, NORFTL_DIRTY);
+}
+
+//program a sector to the next slot, gc: no garbage collection for a new head
+static u8 NORFTL_Put(u32 lba, u8 *data, u8 gc)
+{
+    NORDEV *dev = NORFTL_Mounted;
+    u32 b, s, phys;
+
+    if (NORFTL_Head == NORFTL_NONE || NORFTL_Blk[NORFTL_Head].next >= NORFTL_Slots) {
+        if (gc ? NORFTL_Take() : NORFTL_Alloc()) return 1;
+    }
+    b = NORFTL_Head;
+    s = NORFTL_Blk[b].next++;
+    phys = NORFTL_PHYS(b, s);
+    NORDEV_Prog(dev, NORFTL_Addr(phys), data, NORFTL_SECTOR_SIZE);
+    NORDEV_Prog(dev, b * dev->erase_size + 12 + 4 * s, (u8 *)&lba, 4);  //after the data
+    if (NORFTL_Map[lba] != NORFTL_NONE) NORFTL_Unref(NORFTL_Map[lba]);
+    NORFTL_Map[lba] = phys;
+    NORFTL_Blk[b].valid++;
+    NORFTL_Stat.prog_sectors++;
+    return 0;
+}
+
+//valid slots of a block to the head, the block becomes dirty
+static u8 NORFTL_Move(u32 b, u32 *moved)
+{
+    u32 s, lba, phys;
+
+    NORDEV_Read(NORFTL_Mounted, b * NORFTL_Mounted->erase_size, (u8 *)&NORFTL_Hdr, NORFTL_HDR_SIZE);
+    for (s = 0; s < NORFTL_Blk[b].next && NORFTL_Blk[b].valid; s++) {
+        lba = NORFTL_Hdr.lba[s];
+        phys = NORFTL_PHYS(b, s);
+        if (lba >= NORFTL_Cap || NORFTL_Map[lba] != phys) continue;
+        NORDEV_Read(NORFTL_Mounted, NORFTL_Addr(phys), NORFTL_Tmp, NORFTL_SECTOR_SIZE);
+        if (NORFTL_Put(lba, NORFTL_Tmp, 1)) return 1;
+        (*moved)++;
+    }
+    return 0;
+}
+
+//greedy: the used block with the fewest valid slots
+static u8 NORFTL_GC(void)
+{
+    u32 b, victim = NORFTL_NONE;
+
+    for (b = 0; b < NORFTL_Blocks; b++) {
+        if (NORFTL_Blk[b].state != NORFTL_USED || b == NORFTL_Head) continue;
+        if (victim == NORFTL_NONE || NORFTL_Blk[b].valid < NORFTL_Blk[victim].valid) victim = b;
+    }
+    if (victim == NORFTL_NONE || NORFTL_Blk[victim].valid >= NORFTL_Slots) return 1;
+    NORFTL_Stat.gc_runs++;
+    return NORFTL_Move(victim, &NORFTL_Stat.gc_moved);
+}
+
+//static wear leveling: cold data out of the least erased block
+static void NORFTL_WearLevel(void)
+{
+    u32 b, cold = NORFTL_NONE;
+
+    if (NORFTL_WlCount < NORFTL_WL_PERIOD) return;
+    NORFTL_WlCount = 0;
+    for (b = 0; b < NORFTL_Blocks; b++) {
+        if (NORFTL_Blk[b].state != NORFTL_USED || b == NORFTL_Head) continue;
+        if (cold == NORFTL_NONE || NORFTL_Blk[b].ec < NORFTL_Blk[cold].ec) cold = b;
+    }
+    if (cold != NORFTL_NONE && NORFTL_Blk[cold].ec + NORFTL_WL_DELTA < NORFTL_EcMax)
+        NORFTL_Move(cold, &NORFTL_Stat.wl_moved);
+}
+
+//head for host writes, keeps NORFTL_RESERVE blocks for the garbage collection
+static u8 NORFTL_Alloc(void)
+{
+    while (NORFTL_Count[NORFTL_FREE] + NORFTL_Count[NORFTL_DIRTY] < NORFTL_RESERVE)
+        if (NORFTL_GC()) return 1;
+    NORFTL_WearLevel();
+    while (NORFTL_Count[NORFTL_FREE] + NORFTL_Count[NORFTL_DIRTY] < NORFTL_RESERVE)
+        if (NORFTL_GC()) return 1;
+    if (NORFTL_Head != NORFTL_NONE && NORFTL_Blk[NORFTL_Head].next < NORFTL_Slots) return 0;  //room left by the moves
+    return NORFTL_Take();
+}
+
+static u32 NORFTL_BufFind(u32 lba)
+{
+    u32 i;
+
+    for (i = 0; i < NORFTL_BufN; i++)
+        if (NORFTL_BufLba[i] == lba) return i;
+    return NORFTL_NONE;
+}
+
+static u8 NORFTL_Flush(void)
+{
+    u32 i;
+
+    for (i = 0; i < NORFTL_BufN; i++)
+        if (NORFTL_Put(NORFTL_BufLba[i], NORFTL_Buf + i * NORFTL_SECTOR_SIZE, 0)) return 1;
+    NORFTL_BufN = 0;
+    return 0;
+}
+
+u8 NORFTL_ReadSectors(u8 *pBuffer, u32 SectorNo, u32 SectorCount)
+{
+    u32 i, n, phys;
+
+    if (NORFTL_Mounted == NULL || SectorNo >= NORFTL_Cap || SectorCount > NORFTL_Cap - SectorNo) return 1;
+    while (SectorCount) {
+        i = NORFTL_BufFind(SectorNo);
+        phys = NORFTL_Map[SectorNo];
+        n = 1;
+        if (i != NORFTL_NONE) {
+            memcpy(pBuffer, NORFTL_Buf + i * NORFTL_SECTOR_SIZE, NORFTL_SECTOR_SIZE);
+        } else if (phys == NORFTL_NONE) {
+            memset(pBuffer, 0xFF, NORFTL_SECTOR_SIZE);  //never written
+        } else {
+            //sectors written in a row are in consecutive slots
+            while (n < SectorCount && NORFTL_SLOT(phys) + n < NORFTL_Slots &&
+                   NORFTL_Map[SectorNo + n] == phys + n && NORFTL_BufFind(SectorNo + n) == NORFTL_NONE)
+                n++;
+            NORDEV_Read(NORFTL_Mounted, NORFTL_Addr(phys), pBuffer, n * NORFTL_SECTOR_SIZE);
+        }
+        pBuffer += n * NORFTL_SECTOR_SIZE;
+        SectorNo += n;
+        SectorCount -= n;
+    }
+    return 0;
+}
+
+u8 NORFTL_WriteSectors(u8 *pBuffer, u32 SectorNo, u32 SectorCount)
+{
+    u32 i;
+
+    if (NORFTL_Mounted == NULL || SectorNo >= NORFTL_Cap || SectorCount > NORFTL_Cap - SectorNo) return 1;
+    for (; SectorCount > 0; SectorCount--) {
+        i = NORFTL_BufFind(SectorNo);
+        if (i != NORFTL_NONE) {
+            NORFTL_Stat.buf_merged++;
+        } else {
+            if (NORFTL_BufN == NORFTL_Slots && NORFTL_Flush()) return 1;
+            i = NORFTL_BufN++;
+            NORFTL_BufLba[i] = SectorNo;
+        }
+        memcpy(NORFTL_Buf + i * NORFTL_SECTOR_SIZE, pBuffer, NORFTL_SECTOR_SIZE);
+        NORFTL_Stat.host_writes++;
+        pBuffer += NORFTL_SECTOR_SIZE;
+        SectorNo++;
+    }
+    return 0;
+}
+
+u8 NORFTL_Sync(void)
+{
+    u8 res;
+
+    if (NORFTL_Mounted == NULL) return 1;
+    res = NORFTL_Flush();
+    NORDEV_Sync(NORFTL_Mounted);
+    return res;
+}
+
+u8 NORFTL_Trim(u32 StartSector, u32 EndSector)
+{
+    u32 lba, i;
+
+    if (NORFTL_Mounted == NULL || StartSector > EndSector) return 1;
+    if (EndSector >= NORFTL_Cap) EndSector = NORFTL_Cap - 1;
+    for (lba = StartSector; lba <= EndSector; lba++) {
+        i = NORFTL_BufFind(lba);
+        if (i != NORFTL_NONE) {
+            NORFTL_BufN--;
+            NORFTL_BufLba[i] = NORFTL_BufLba[NORFTL_BufN];
+            memcpy(NORFTL_Buf + i * NORFTL_SECTOR_SIZE, NORFTL_Buf + NORFTL_BufN * NORFTL_SECTOR_SIZE, NORFTL_SECTOR_SIZE);
+        }
+        if (NORFTL_Map[lba] != NORFTL_NONE) {
+            NORFTL_Unref(NORFTL_Map[lba]);
+            NORFTL_Map[lba] = NORFTL_NONE;
+        }
+    }
+    return 0;
+}
+
+//background erase: one dirty block while the device is idle
+u8 NORFTL_Poll(void)
+{
+    u32 b;
+
+    if (NORFTL_Mounted == NULL || NORFTL_Mounted->running(NORFTL_Mounted)) return 0;
+    b = NORFTL_Pick(NORFTL_DIRTY);
+    if (b == NORFTL_NONE) return 0;
+    NORFTL_Erase(b);
+    NORFTL_Stat.bg_erases++;
+    return 1;
+}
+
+void NORFTL_Info(void)
+{
+    u32 b, ec_min = NORFTL_NONE, ec_sum = 0;
+
+    if (NORFTL_Mounted == NULL) {
+        printf("%s: not mounted\r\n", __func__);
+        return;
+    }
+    for (b = 0; b < NORFTL_Blocks; b++) {
+        if (NORFTL_Blk[b].ec < ec_min) ec_min = NORFTL_Blk[b].ec;
+        ec_sum += NORFTL_Blk[b].ec;
+    }
+    printf("norftl: %d sectors on %d blocks of %d slots, %d free %d dirty %d used, %d buffered\r\n",
+           NORFTL_Cap, NORFTL_Blocks, NORFTL_Slots, NORFTL_Count[NORFTL_FREE],
+           NORFTL_Count[NORFTL_DIRTY], NORFTL_Count[NORFTL_USED], NORFTL_BufN);
+    printf("erase count min %d avg %d max %d, %d erases (%d in background)\r\n",
+           ec_min, ec_sum / NORFTL_Blocks, NORFTL_EcMax, NORFTL_Stat.erases, NORFTL_Stat.bg_erases);
+    printf("%d sectors written, %d merged in the buffer, %d programmed (%d moved by %d gc, %d by wear leveling)\r\n",
+           NORFTL_Stat.host_writes, NORFTL_Stat.buf_merged, NORFTL_Stat.prog_sectors,
+           NORFTL_Stat.gc_moved, NORFTL_Stat.gc_runs, NORFTL_Stat.wl_moved);
+}
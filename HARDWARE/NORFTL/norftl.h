@@ -0,0 +1,69 @@
+#ifndef __NORFTL_H
+#define __NORFTL_H
+#include "sys.h"
+#include "nordev.h"
+//////////////////////////////////////////////////////////////////////////////////
+//NOR flash translation layer for 512 byte sectors (FATFS EX_FLASH volume)
+//A sector is never rewritten in place. Writes go to a log of slots: every erase
+//unit of the NORDEV has a header in its first 512 bytes (magic, erase count,
+//sequence, lba of every slot) and erase_size/512-1 data slots after it. The slot
+//data is programmed before its lba entry, the newest copy of an lba (block
+//sequence, slot) wins at mount. The lba->slot map lives in the SDRAM.
+//
+//Writes are collected in a RAM buffer of one block (a rewrite of a buffered
+//sector replaces it) and programmed when it is full or at NORFTL_Sync(), i.e.
+//CTRL_SYNC of f_sync/f_close. The garbage collection moves the valid slots of
+//the block with the fewest of them, new blocks are the free ones with the
+//lowest erase count, and every NORFTL_WL_PERIOD erases the block with the
+//lowest erase count is moved when it lags NORFTL_WL_DELTA behind the highest.
+//NORFTL_Poll() starts the erase of one dirty block when the device is idle,
+//the W25QXX erases it in the background (reads suspend it).
+//
+//Trims only clear the map in RAM, after a reset the trimmed sectors hold old
+//data again until they are written. A block that has no header at mount (also
+//a torn erase) is erased before use, the newest block is written further from
+//its first erased slot on.
+//////////////////////////////////////////////////////////////////////////////////
+
+#define NORFTL_SECTOR_SIZE  512
+#define NORFTL_SLOTS_MAX    63          //erase units up to 32KB
+#define NORFTL_MAGIC        0x4C54464E  //"NFTL"
+#define NORFTL_NONE         0xFFFFFFFF
+#define NORFTL_RESERVE      2           //free/dirty blocks kept for the garbage collection
+#define NORFTL_WL_PERIOD    64          //erases between the wear leveling checks
+#define NORFTL_WL_DELTA     256         //erase count difference that moves a block
+
+//first sector of a block
+typedef struct
+{
+    u32 magic;
+    u32 ec;                             //erase count
+    u32 seq;                            //allocation order
+    u32 lba[NORFTL_SLOTS_MAX];          //per slot, NORFTL_NONE: not written
+} NORFTL_HEADER;
+
+typedef struct
+{
+    u32 host_writes;                    //sectors from FATFS
+    u32 buf_merged;                     //rewrites of buffered sectors
+    u32 prog_sectors;                   //slots programmed, with the moved ones
+    u32 gc_runs;
+    u32 gc_moved;                       //slots moved by the garbage collection
+    u32 wl_moved;                       //slots moved by the wear leveling
+    u32 erases;
+    u32 bg_erases;                      //started by NORFTL_Poll()
+} NORFTL_STAT;
+
+extern NORFTL_STAT NORFTL_Stat;
+
+u8 NORFTL_Set_Device(NORDEV *dev);      //device of the next NORFTL_Init(), default NORDEV_W25QXX
+u8 NORFTL_Init(void);                   //mount, 0: ok, nothing to do when mounted
+u8 NORFTL_ReadSectors(u8 *pBuffer, u32 SectorNo, u32 SectorCount);
+u8 NORFTL_WriteSectors(u8 *pBuffer, u32 SectorNo, u32 SectorCount);
+u8 NORFTL_Sync(void);                   //buffer to flash and wait for the device
+u8 NORFTL_Trim(u32 StartSector, u32 EndSector);  //both included
+u8 NORFTL_Poll(void);                   //1: started an erase
+u32 NORFTL_Sectors(void);               //capacity
+void NORFTL_Info(void);
+
+#endif
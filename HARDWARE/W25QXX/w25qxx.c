@@ -3,6 +3,8 @@
 #include "spi.h"
 #include "usart.h"
 #include "stdio.h"
+#include "string.h"
+#include "nfvfs_trace.h"
 //////////////////////////////////////////////////////////////////////////////////
 //ֻѧϰʹãδɣκ;
 // ALIENTEK STM32F429
@@ -16,6 +18,23 @@
 // All rights reserved
 //////////////////////////////////////////////////////////////////////////////////
 
+u8 W25QXX_Pipeline = 1;     //deferred busy wait after page program
+u8 W25QXX_ReadMode = W25QXX_READ_FAST; //fast read works at every clock
+u8 W25QXX_Suspend = 1;      //reads suspend an erase started by W25QXX_Erase_Sector_Start()
+static u8 W25QXX_Busy = 0;  //page program or erase started, busy not checked yet
+static u32 W25QXX_Erase_Addr; //sector of the running erase (W25QXX_Busy == W25QXX_BUSY_ERASE)
+static u8 W25QXX_Resumed;     //the running erase was suspended and resumed
+static u32 W25QXX_Resume_Cyc; //DWT cycle counter at the last resume
+
+#define W25QXX_BUSY_PROGRAM 1
+#define W25QXX_BUSY_ERASE   2
+
+static u8 W25QXX_Erase_Suspend(void);
+static void W25QXX_Erase_Resume(void);
+W25QXX_GEOMETRY W25QXX_Geo = {
+    32 * 1024 * 1024, 256, 4, W25QXX_FR_112 | W25QXX_FR_122 | W25QXX_FR_114 | W25QXX_FR_144, 3,
+    {{4096, W25X_SectorErase, 45}, {32768, W25X_BlockErase32K, 120}, {65536, W25X_BlockErase, 150}},
+    0};
 u16 W25QXX_TYPE = W25Q256; //ĬW25Q256
 
 // 4KbytesΪһSector
@@ -40,9 +59,13 @@ void W25QXX_Init(void)
 
     W25QXX_CS(1);                           // SPI FLASHѡ
     SPI2_Init();                            //ʼSPI
-    SPI2_SetSpeed(SPI_BAUDRATEPRESCALER_8); //Ϊ50Mʱ,ģʽ
+    W25QXX_SetSpeed(SPI_BAUDRATEPRESCALER_8); //Ϊ50Mʱ,ģʽ
     W25QXX_TYPE = W25QXX_ReadID();          //ȡFLASH ID
-    if (W25QXX_TYPE == W25Q256)             // SPI FLASHΪW25Q256
+    W25QXX_Probe();                         //geometry from SFDP
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; //cycle counter for the suspend spacing
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    if (W25QXX_Geo.addr_bytes == 4)         //above 16MB
     {
         temp = W25QXX_ReadSR(3); //ȡ״̬Ĵ3жϵַģʽ
         if ((temp & 0X01) == 0)  //4ֽڵַģʽ,4ֽڵַģʽ
@@ -98,6 +121,7 @@ u8 W25QXX_ReadSR(u8 regno)
 void W25QXX_Write_SR(u8 regno, u8 sr)
 {
     u8 command = 0;
+    W25QXX_Sync();
     switch (regno) {
     case 1:
         command = W25X_WriteStatusReg1; //д״̬Ĵ1ָ
@@ -121,6 +145,7 @@ void W25QXX_Write_SR(u8 regno, u8 sr)
 //WELλ
 void W25QXX_Write_Enable(void)
 {
+    W25QXX_Sync();
     W25QXX_CS(0);                         //ʹ
     SPI2_ReadWriteByte(W25X_WriteEnable); //дʹ
     W25QXX_CS(1);                         //ȡƬѡ
@@ -129,6 +154,7 @@ void W25QXX_Write_Enable(void)
 //WEL
 void W25QXX_Write_Disable(void)
 {
+    W25QXX_Sync();
     W25QXX_CS(0);                          //ʹ
     SPI2_ReadWriteByte(W25X_WriteDisable); //дָֹ
     W25QXX_CS(1);                          //ȡƬѡ
@@ -145,6 +171,7 @@ void W25QXX_Write_Disable(void)
 u16 W25QXX_ReadID(void)
 {
     u16 Temp = 0;
+    W25QXX_Sync();
     W25QXX_CS(0);
     SPI2_ReadWriteByte(0x90); //ͶȡID
     SPI2_ReadWriteByte(0x00);
@@ -162,20 +189,34 @@ u16 W25QXX_ReadID(void)
 // NumByteToRead:Ҫȡֽ(65535)
 void W25QXX_Read(u8 *pBuffer, u32 ReadAddr, u16 NumByteToRead)
 {
-    u16 i;
-    W25QXX_CS(0);                      //ʹ
-    SPI2_ReadWriteByte(W25X_ReadData); //Ͷȡ
-    if (W25QXX_TYPE == W25Q256)        //W25Q256ĻַΪ4ֽڵģҪ8λ
+    u32 tr = NFVFS_TRACE_BEGIN(NFVFS_TR_FLASH_READ, -1, ReadAddr);
+    u8 cmd[6], n = 1;
+    u8 suspended = 0;
+    //a running erase of another sector is suspended for the read, else wait for it
+    if (W25QXX_Busy == W25QXX_BUSY_ERASE && W25QXX_Suspend &&
+        (ReadAddr + NumByteToRead <= W25QXX_Erase_Addr || ReadAddr >= W25QXX_Erase_Addr + 4096))
+        suspended = W25QXX_Erase_Suspend();
+    else
+        W25QXX_Sync();
+    cmd[0] = W25QXX_ReadMode == W25QXX_READ_FAST ? W25X_FastReadData : W25X_ReadData;
+    if (W25QXX_Geo.addr_bytes == 4) //4-byte address opcode, independent of the address mode
     {
-        SPI2_ReadWriteByte((u8)((ReadAddr) >> 24));
-    }
-    SPI2_ReadWriteByte((u8)((ReadAddr) >> 16)); //24bitַ
-    SPI2_ReadWriteByte((u8)((ReadAddr) >> 8));
-    SPI2_ReadWriteByte((u8)ReadAddr);
-    for (i = 0; i < NumByteToRead; i++) {
-        pBuffer[i] = SPI2_ReadWriteByte(0XFF); //ѭ
+        cmd[0] = W25QXX_ReadMode == W25QXX_READ_FAST ? W25X_FastReadData4B : W25X_ReadData4B;
+        cmd[n++] = (u8)((ReadAddr) >> 24);
     }
+    cmd[n++] = (u8)((ReadAddr) >> 16);
+    cmd[n++] = (u8)((ReadAddr) >> 8);
+    cmd[n++] = (u8)ReadAddr;
+    if (W25QXX_ReadMode == W25QXX_READ_FAST)
+        cmd[n++] = 0xFF; //8 dummy clocks
+    W25QXX_CS(0);
+    SPI2_WriteBytes(cmd, n);
+    if (NumByteToRead)
+        SPI2_ReadBytes(pBuffer, NumByteToRead); //one HAL call, the per-byte overhead would hide the clock
     W25QXX_CS(1);
+    if (suspended)
+        W25QXX_Erase_Resume();
+    (void)NFVFS_TRACE_END(tr, NumByteToRead);
 }
 // SPIһҳ(0~65535)д256ֽڵ
 //ַָʼд256ֽڵ
@@ -184,11 +225,12 @@ void W25QXX_Read(u8 *pBuffer, u32 ReadAddr, u16 NumByteToRead)
 // NumByteToWrite:Ҫдֽ(256),Ӧóҳʣֽ!!!
 void W25QXX_Write_Page(u8 *pBuffer, u32 WriteAddr, u16 NumByteToWrite)
 {
+    u32 tr = NFVFS_TRACE_BEGIN(NFVFS_TR_FLASH_PROG, -1, WriteAddr);
     u16 i;
     W25QXX_Write_Enable();                // SET WEL
     W25QXX_CS(0);                         //ʹ
     SPI2_ReadWriteByte(W25X_PageProgram); //дҳ
-    if (W25QXX_TYPE == W25Q256)           //W25Q256ĻַΪ4ֽڵģҪ8λ
+    if (W25QXX_Geo.addr_bytes == 4)       //W25Q256ĻַΪ4ֽڵģҪ8λ
     {
         SPI2_ReadWriteByte((u8)((WriteAddr) >> 24));
     }
@@ -198,7 +240,11 @@ void W25QXX_Write_Page(u8 *pBuffer, u32 WriteAddr, u16 NumByteToWrite)
     for (i = 0; i < NumByteToWrite; i++)
         SPI2_ReadWriteByte(pBuffer[i]); //ѭд
     W25QXX_CS(1);                       //ȡƬѡ
-    W25QXX_Wait_Busy();                 //ȴд
+    if (W25QXX_Pipeline)
+        W25QXX_Busy = W25QXX_BUSY_PROGRAM; //checked by the next command
+    else
+        W25QXX_Wait_Busy();
+    (void)NFVFS_TRACE_END(tr, NumByteToWrite);
 }
 //޼дSPI FLASH
 //ȷдĵַΧڵȫΪ0XFF,ڷ0XFFдݽʧ!
@@ -291,18 +337,23 @@ void W25QXX_Write(u8 *pBuffer, u32 WriteAddr, u16 NumByteToWrite)
 //ȴʱ䳬...
 void W25QXX_Erase_Chip(void)
 {
+    u32 tr = NFVFS_TRACE_BEGIN(NFVFS_TR_FLASH_ERASE, -1, 0);
+
     W25QXX_Write_Enable(); // SET WEL
     W25QXX_Wait_Busy();
     W25QXX_CS(0);                       //ʹ
     SPI2_ReadWriteByte(W25X_ChipErase); //Ƭ
     W25QXX_CS(1);                       //ȡƬѡ
     W25QXX_Wait_Busy();                 //ȴоƬ
+    (void)NFVFS_TRACE_END(tr, W25X_ChipErase);
 }
 //һ
 // Dst_Addr:ַ ʵ
 //һʱ:150ms
 void W25QXX_Erase_Sector(u32 Dst_Addr)
 {
+    u32 tr = NFVFS_TRACE_BEGIN(NFVFS_TR_FLASH_ERASE, -1, Dst_Addr * 4096);
+
     //falsh,
     // printf("fe:%x\r\n",Dst_Addr);
     Dst_Addr *= 4096;
@@ -310,7 +361,7 @@ void W25QXX_Erase_Sector(u32 Dst_Addr)
     W25QXX_Wait_Busy();
     W25QXX_CS(0);                         //ʹ
     SPI2_ReadWriteByte(W25X_SectorErase); //ָ
-    if (W25QXX_TYPE == W25Q256)           //W25Q256ĻַΪ4ֽڵģҪ8λ
+    if (W25QXX_Geo.addr_bytes == 4)       //W25Q256ĻַΪ4ֽڵģҪ8λ
     {
         SPI2_ReadWriteByte((u8)((Dst_Addr) >> 24));
     }
@@ -319,16 +370,111 @@ void W25QXX_Erase_Sector(u32 Dst_Addr)
     SPI2_ReadWriteByte((u8)Dst_Addr);
     W25QXX_CS(1);       //ȡƬѡ
     W25QXX_Wait_Busy(); //ȴ
+    (void)NFVFS_TRACE_END(tr, W25X_SectorErase);
+}
+//start an erase with cmd at byte address Dst_Addr
+static void W25QXX_Erase_Cmd(u8 Cmd, u32 Dst_Addr)
+{
+    u32 tr = NFVFS_TRACE_BEGIN(NFVFS_TR_FLASH_ERASE, -1, Dst_Addr);
+
+    W25QXX_Write_Enable(); // SET WEL
+    W25QXX_Wait_Busy();
+    W25QXX_CS(0);
+    SPI2_ReadWriteByte(Cmd);
+    if (W25QXX_Geo.addr_bytes == 4)
+    {
+        SPI2_ReadWriteByte((u8)((Dst_Addr) >> 24));
+    }
+    SPI2_ReadWriteByte((u8)((Dst_Addr) >> 16));
+    SPI2_ReadWriteByte((u8)((Dst_Addr) >> 8));
+    SPI2_ReadWriteByte((u8)Dst_Addr);
+    W25QXX_CS(1);
+    (void)NFVFS_TRACE_END(tr, Cmd);
+}
+//erase a 32K block, Dst_Addr: block number, W25Q256 typ. 120ms
+void W25QXX_Erase_Block32K(u32 Dst_Addr)
+{
+    W25QXX_Erase_Cmd(W25X_BlockErase32K, Dst_Addr * 32768);
+    W25QXX_Wait_Busy();
+}
+//erase a 64K block, Dst_Addr: block number, W25Q256 typ. 150ms
+void W25QXX_Erase_Block64K(u32 Dst_Addr)
+{
+    W25QXX_Erase_Cmd(W25X_BlockErase, Dst_Addr * 65536);
+    W25QXX_Wait_Busy();
+}
+//start a sector erase and return at once, Dst_Addr: sector number
+//the next command waits for it, except reads of other sectors (W25QXX_Suspend)
+void W25QXX_Erase_Sector_Start(u32 Dst_Addr)
+{
+    W25QXX_Erase_Cmd(W25X_SectorErase, Dst_Addr * 4096);
+    W25QXX_Erase_Addr = Dst_Addr * 4096;
+    W25QXX_Busy = W25QXX_BUSY_ERASE;
+    W25QXX_Resumed = 0;
+}
+//page program or erase that returned at once still running? one status read, no wait
+u8 W25QXX_Running(void)
+{
+    if (!W25QXX_Busy)
+        return 0;
+    if (W25QXX_ReadSR(1) & 0x01)
+        return 1;
+    W25QXX_Busy = 0;
+    return 0;
+}
+//erase started by W25QXX_Erase_Sector_Start() still running?
+u8 W25QXX_Erase_Running(void)
+{
+    if (W25QXX_Busy != W25QXX_BUSY_ERASE)
+        return 0;
+    return W25QXX_Running();
+}
+//suspend the running erase (0x75), 1: suspended, 0: erase was already done
+//back to back reads would suspend it again right after each resume and it
+//would never finish: the erase runs W25QXX_RESUME_US after a resume first
+static u8 W25QXX_Erase_Suspend(void)
+{
+    if (W25QXX_Resumed)
+        while (DWT->CYCCNT - W25QXX_Resume_Cyc < W25QXX_RESUME_US * (SystemCoreClock / 1000000))
+            ;
+    if (!W25QXX_Erase_Running())
+        return 0;
+    W25QXX_CS(0);
+    SPI2_ReadWriteByte(W25X_EraseSuspend);
+    W25QXX_CS(1);
+    while (W25QXX_ReadSR(1) & 0x01)
+        ; //tSUS max 20us, then BUSY=0 and SUS=1
+    return 1;
+}
+//resume the suspended erase (0x7A), it is running again
+static void W25QXX_Erase_Resume(void)
+{
+    W25QXX_CS(0);
+    SPI2_ReadWriteByte(W25X_EraseResume);
+    W25QXX_CS(1);
+    W25QXX_Resume_Cyc = DWT->CYCCNT;
+    W25QXX_Resumed = 1;
 }
 //ȴ
 void W25QXX_Wait_Busy(void)
 {
+    u32 tr = NFVFS_TRACE_BEGIN(NFVFS_TR_FLASH_WAIT, -1, 0);
+
     while ((W25QXX_ReadSR(1) & 0x01) == 0x01)
         ; // ȴBUSYλ
+    W25QXX_Busy = 0;
+    (void)NFVFS_TRACE_END(tr, 0);
+}
+//wait for a page program started in pipeline mode, before any other command
+void W25QXX_Sync(void)
+{
+    if (W25QXX_Busy)
+        W25QXX_Wait_Busy();
 }
 //ģʽ
 void W25QXX_PowerDown(void)
 {
+    W25QXX_Sync();
     W25QXX_CS(0);                       //ʹ
     SPI2_ReadWriteByte(W25X_PowerDown); //͵
     W25QXX_CS(1);                       //ȡƬѡ
@@ -342,3 +488,129 @@ void W25QXX_WAKEUP(void)
     W25QXX_CS(1);                              //ȡƬѡ
     delay_us(3);                               //ȴTRES1
 }
+//set the SPI2 clock, prescaler: SPI_BAUDRATEPRESCALER_2~SPI_BAUDRATEPRESCALER_256
+//above W25QXX_READ_MAX_HZ only the fast read command works
+//return: SPI clock in Hz
+u32 W25QXX_SetSpeed(u32 prescaler)
+{
+    u32 hz = W25QXX_SPI_KERNEL_HZ / (2 << (prescaler >> 28));
+    W25QXX_Sync();
+    SPI2_SetSpeed(prescaler);
+    if (hz > W25QXX_READ_MAX_HZ)
+        W25QXX_ReadMode = W25QXX_READ_FAST;
+    return hz;
+}
+//read the SFDP tables (0x5A), always 3-byte address and 8 dummy clocks
+void W25QXX_ReadSFDP(u8 *pBuffer, u32 ReadAddr, u16 NumByteToRead)
+{
+    W25QXX_Sync();
+    W25QXX_CS(0);
+    SPI2_ReadWriteByte(W25X_ReadSFDP);
+    SPI2_ReadWriteByte((u8)((ReadAddr) >> 16));
+    SPI2_ReadWriteByte((u8)((ReadAddr) >> 8));
+    SPI2_ReadWriteByte((u8)ReadAddr);
+    SPI2_ReadWriteByte(0xFF);
+    SPI2_ReadBytes(pBuffer, NumByteToRead);
+    W25QXX_CS(1);
+}
+//little endian SFDP DWORD
+static u32 W25QXX_SFDP_DW(const u8 *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+//fill W25QXX_Geo from the JEDEC basic flash parameter table (JESD216)
+//without SFDP the size comes from the ID (W25Q80~W25Q256), the rest stays W25Q256
+//return: 0: from SFDP, 1: defaults
+u8 W25QXX_Probe(void)
+{
+    static const u16 units[4] = {1, 16, 128, 1000}; //erase time units in ms
+    u8 raw[16 * 4];
+    u32 bfpt[16], dw, len, i, n;
+    W25QXX_GEOMETRY geo;
+    W25QXX_ERASE e;
+
+    W25QXX_ReadSFDP(raw, 0, 16);
+    //"SFDP" signature, first parameter header is the basic table 1.x with at least 9 DWORDs
+    if (W25QXX_SFDP_DW(raw) != 0x50444653 || raw[8] != 0x00 || raw[10] != 1 || raw[11] < 9) {
+        if (W25QXX_TYPE >= W25Q80 && W25QXX_TYPE <= W25Q256) {
+            W25QXX_Geo.size = (1024 * 1024) << (W25QXX_TYPE - W25Q80);
+            W25QXX_Geo.addr_bytes = W25QXX_Geo.size > 0x1000000 ? 4 : 3;
+        }
+        return 1;
+    }
+    len = raw[11] > 16 ? 16 : raw[11];
+    W25QXX_ReadSFDP(raw, raw[12] | (raw[13] << 8) | (raw[14] << 16), len * 4);
+    for (i = 0; i < len; i++)
+        bfpt[i] = W25QXX_SFDP_DW(raw + i * 4);
+
+    memset(&geo, 0, sizeof(geo));
+    dw = bfpt[1]; //density in bits
+    if (dw & 0x80000000) {
+        dw &= 0x7FFFFFFF;
+        if (dw < 3 || dw > 34)
+            return 1;
+        geo.size = 1UL << (dw - 3);
+    } else {
+        geo.size = dw / 8 + 1;
+    }
+    geo.addr_bytes = geo.size > 0x1000000 ? 4 : 3;
+    dw = bfpt[0];
+    geo.fast_read = ((dw >> 16) & 1 ? W25QXX_FR_112 : 0) | ((dw >> 20) & 1 ? W25QXX_FR_122 : 0) |
+                    ((dw >> 22) & 1 ? W25QXX_FR_114 : 0) | ((dw >> 21) & 1 ? W25QXX_FR_144 : 0);
+    //erase types 1~4: size 2^N and opcode in DWORD 8/9, typical times in DWORD 10 (JESD216A)
+    for (i = 0; i < W25QXX_ERASE_TYPES; i++) {
+        dw = bfpt[7 + i / 2] >> (16 * (i & 1));
+        if (!(dw & 0xFF) || (dw & 0xFF) > 31)
+            continue;
+        e.size = 1UL << (dw & 0xFF);
+        e.cmd = (dw >> 8) & 0xFF;
+        e.typ_ms = 0;
+        if (len >= 10) {
+            dw = bfpt[9] >> (7 * i);
+            e.typ_ms = (((dw >> 4) & 0x1F) + 1) * units[(dw >> 9) & 3];
+        }
+        for (n = geo.erase_n; n && geo.erase[n - 1].size > e.size; n--)
+            geo.erase[n] = geo.erase[n - 1];
+        geo.erase[n] = e;
+        geo.erase_n++;
+    }
+    if (!geo.size || !geo.erase_n)
+        return 1;
+    geo.page_size = len >= 11 ? 1 << ((bfpt[10] >> 4) & 0xF) : 256;
+    geo.sfdp = 1;
+    W25QXX_Geo = geo;
+    return 0;
+}
+//erase type of this size, NULL: the flash has none
+const W25QXX_ERASE *W25QXX_Erase_Type(u32 Size)
+{
+    u8 i;
+    for (i = 0; i < W25QXX_Geo.erase_n; i++) {
+        if (W25QXX_Geo.erase[i].size == Size)
+            return &W25QXX_Geo.erase[i];
+    }
+    return NULL;
+}
+//erase Len bytes at byte address Dst_Addr, each step with the largest erase type
+//that is aligned and fits, both must be multiples of the smallest erase size
+//return: 0: ok, 1: not aligned
+u8 W25QXX_Erase(u32 Dst_Addr, u32 Len)
+{
+    const W25QXX_ERASE *e;
+    u8 i;
+
+    if ((Dst_Addr | Len) & (W25QXX_Geo.erase[0].size - 1))
+        return 1;
+    while (Len) {
+        for (i = W25QXX_Geo.erase_n; i > 0; i--) {
+            e = &W25QXX_Geo.erase[i - 1];
+            if (!(Dst_Addr & (e->size - 1)) && e->size <= Len)
+                break;
+        }
+        W25QXX_Erase_Cmd(e->cmd, Dst_Addr);
+        W25QXX_Wait_Busy();
+        Dst_Addr += e->size;
+        Len -= e->size;
+    }
+    return 0;
+}
@@ -32,7 +32,47 @@
 #define W25Q256_ERASE_GRAN              4096
 #define W25Q256_NUM_GRAN                8192
 
+//flash geometry, read from the JEDEC SFDP basic parameter table by W25QXX_Init()
+//without SFDP: size from the ID, W25Q256 erase types and timings
+#define W25QXX_ERASE_TYPES  4
+#define W25QXX_FR_112       0x01            //fast read modes besides 1-1-1 (cmd-addr-data lines)
+#define W25QXX_FR_122       0x02
+#define W25QXX_FR_114       0x04
+#define W25QXX_FR_144       0x08
+
+typedef struct
+{
+    u32 size;                               //bytes
+    u8 cmd;
+    u16 typ_ms;                             //typical erase time, 0: unknown
+} W25QXX_ERASE;
+
+typedef struct
+{
+    u32 size;                               //bytes
+    u16 page_size;
+    u8 addr_bytes;                          //3 or 4 (above 16MB)
+    u8 fast_read;                           //W25QXX_FR_xx
+    u8 erase_n;
+    W25QXX_ERASE erase[W25QXX_ERASE_TYPES]; //ascending size
+    u8 sfdp;                                //1: from SFDP
+} W25QXX_GEOMETRY;
+
+extern W25QXX_GEOMETRY W25QXX_Geo;
+
 extern u16 W25QXX_TYPE;					//W25QXXоƬͺ		   
+extern u8 W25QXX_Pipeline;              //1: page program returns at once, the next command waits for busy
+//read commands, W25QXX_Read() uses the 4-byte address opcode (0x13/0x0C) above 16MB
+#define W25QXX_READ_NORMAL  0               //0x03, no dummy clocks, max. 50MHz
+#define W25QXX_READ_FAST    1               //0x0B + 8 dummy clocks, max. 133MHz
+//dual output (0x3B/0x3C) needs IO1 as second data line, SPI2 only has MISO
+
+#define W25QXX_SPI_KERNEL_HZ 200000000      //SPI2 kernel clock (PLL1Q)
+#define W25QXX_READ_MAX_HZ   50000000       //fR of W25X_ReadData
+
+extern u8 W25QXX_ReadMode;              //W25QXX_READ_xx
+extern u8 W25QXX_Suspend;               //1: reads suspend an erase started by W25QXX_Erase_Sector_Start()
+#define W25QXX_RESUME_US    200             //min. time from an erase resume to the next suspend (tRS)
 
 //W25QXXƬѡź
 #define W25QXX_CS(n)  (n?HAL_GPIO_WritePin(GPIOF,GPIO_PIN_10,GPIO_PIN_SET):HAL_GPIO_WritePin(GPIOF,GPIO_PIN_10,GPIO_PIN_RESET))
@@ -50,8 +90,14 @@ extern u16 W25QXX_TYPE;					//
 #define W25X_ReadData			0x03 
 #define W25X_FastReadData		0x0B 
 #define W25X_FastReadDual		0x3B 
+#define W25X_ReadData4B			0x13
+#define W25X_FastReadData4B		0x0C
+#define W25X_FastReadDual4B		0x3C
 #define W25X_PageProgram		0x02 
 #define W25X_BlockErase			0xD8 
+#define W25X_BlockErase32K		0x52
+#define W25X_EraseSuspend		0x75
+#define W25X_EraseResume		0x7A
 #define W25X_SectorErase		0x20 
 #define W25X_ChipErase			0xC7 
 #define W25X_PowerDown			0xB9 
@@ -61,6 +107,7 @@ extern u16 W25QXX_TYPE;					//
 #define W25X_JedecDeviceID		0x9F 
 #define W25X_Enable4ByteAddr    0xB7
 #define W25X_Exit4ByteAddr      0xE9
+#define W25X_ReadSFDP			0x5A
 
 void W25QXX_Init(void);
 u16  W25QXX_ReadID(void);  	    		//ȡFLASH ID
@@ -70,12 +117,24 @@ void W25QXX_Write_SR(u8 regno,u8 sr);   //д״̬
 void W25QXX_Write_Enable(void);  		//дʹ 
 void W25QXX_Write_Disable(void);		//д
 void W25QXX_Write_NoCheck(u8* pBuffer,u32 WriteAddr,u16 NumByteToWrite);
+void W25QXX_Write_Page(u8* pBuffer,u32 WriteAddr,u16 NumByteToWrite); //inside one page, erased
 void W25QXX_Read(u8* pBuffer,u32 ReadAddr,u16 NumByteToRead);   //ȡflash
 void W25QXX_Write(u8* pBuffer,u32 WriteAddr,u16 NumByteToWrite);//дflash
 void W25QXX_Erase_Chip(void);    	  	//Ƭ
 void W25QXX_Erase_Sector(u32 Dst_Addr);	//
+void W25QXX_Erase_Block32K(u32 Dst_Addr);  //erase 32K block (block number)
+void W25QXX_Erase_Block64K(u32 Dst_Addr);  //erase 64K block (block number)
+void W25QXX_Erase_Sector_Start(u32 Dst_Addr); //start a sector erase, returns at once
+u8 W25QXX_Erase_Running(void);           //1: started erase not done yet
+u8 W25QXX_Running(void);                 //1: started program or erase not done yet
+u8 W25QXX_Erase(u32 Dst_Addr, u32 Len);  //erase bytes with the largest fitting erase types, 1: not aligned
+const W25QXX_ERASE *W25QXX_Erase_Type(u32 Size); //erase type of this size or NULL
+void W25QXX_ReadSFDP(u8 *pBuffer, u32 ReadAddr, u16 NumByteToRead);
+u8 W25QXX_Probe(void);                   //fill W25QXX_Geo, 0: from SFDP, 1: defaults
 void W25QXX_Wait_Busy(void);           	//ȴ
+void W25QXX_Sync(void);                 //wait for a page program started in pipeline mode
 void W25QXX_PowerDown(void);        	//ģʽ
 void W25QXX_WAKEUP(void);				//
+u32 W25QXX_SetSpeed(u32 prescaler);     //SPI_BAUDRATEPRESCALER_xx, picks the read command, returns Hz
 
 #endif
@@ -0,0 +1,161 @@
+#include "w25qxx_async.h"
+#include "w25qxx.h"
+#include "queue.h"
+
+static QueueHandle_t W25QXX_Queue;
+static TaskHandle_t W25QXX_Task;
+static W25QXX_REQ *W25QXX_Cur;     //program or erase in progress
+static W25QXX_REQ *W25QXX_Next;    //taken from the queue during an erase, waits for it
+static volatile u32 W25QXX_Flight; //submitted, not done
+
+//W25QXX_Flight last: a flush must not return while done() still runs
+static void W25QXX_Async_Complete(W25QXX_REQ *req)
+{
+    if (req->done)
+        req->done(req);
+    req->complete = 1;
+    if (req->notify)
+        xTaskNotifyGive(req->notify);
+    taskENTER_CRITICAL();
+    W25QXX_Flight--;
+    taskEXIT_CRITICAL();
+}
+
+//W25QXX_Read() takes 16 bit lengths
+static void W25QXX_Async_Read(W25QXX_REQ *req)
+{
+    u32 pos, n;
+
+    for (pos = 0; pos < req->len; pos += n) {
+        n = req->len - pos;
+        if (n > 0x8000)
+            n = 0x8000;
+        W25QXX_Read(req->buf + pos, req->addr + pos, n);
+    }
+    W25QXX_Async_Complete(req);
+}
+
+//start the next page of a program request, 0: all pages done
+static u8 W25QXX_Async_Page(W25QXX_REQ *req)
+{
+    u32 n;
+
+    if (req->pos >= req->len)
+        return 0;
+    n = 256 - ((req->addr + req->pos) & 255);
+    if (n > req->len - req->pos)
+        n = req->len - req->pos;
+    W25QXX_Write_Page(req->buf + req->pos, req->addr + req->pos, n);
+    req->pos += n;
+    return 1;
+}
+
+int W25QXX_Async_Poll(void)
+{
+    W25QXX_REQ *req;
+
+    if (W25QXX_Cur) {
+        //reads are served while the erase runs, anything else waits for it. Each
+        //suspends the erase, W25QXX_Read() keeps W25QXX_RESUME_US between them
+        while (W25QXX_Cur->op == W25QXX_REQ_ERASE && !W25QXX_Next &&
+               xQueueReceive(W25QXX_Queue, &req, 0) == pdTRUE) {
+            if (req->op == W25QXX_REQ_READ)
+                W25QXX_Async_Read(req);
+            else
+                W25QXX_Next = req;
+        }
+        if (W25QXX_Running())
+            return W25QXX_Flight;
+        req = W25QXX_Cur;
+        if (req->op == W25QXX_REQ_PROGRAM && W25QXX_Async_Page(req))
+            return W25QXX_Flight;
+        W25QXX_Cur = NULL;
+        W25QXX_Async_Complete(req);
+    }
+
+    if (W25QXX_Next) {
+        req = W25QXX_Next;
+        W25QXX_Next = NULL;
+    } else if (!W25QXX_Queue || xQueueReceive(W25QXX_Queue, &req, 0) != pdTRUE) {
+        return W25QXX_Flight;
+    }
+    switch (req->op) {
+    case W25QXX_REQ_READ:
+        W25QXX_Async_Read(req);
+        break;
+    case W25QXX_REQ_PROGRAM:
+        req->pos = 0;
+        if (W25QXX_Async_Page(req))
+            W25QXX_Cur = req;
+        else
+            W25QXX_Async_Complete(req);
+        break;
+    case W25QXX_REQ_ERASE:
+        W25QXX_Erase_Sector_Start(req->addr / 4096);
+        W25QXX_Cur = req;
+        break;
+    default:
+        W25QXX_Async_Complete(req);
+        break;
+    }
+    return W25QXX_Flight;
+}
+
+//sleeps on the queue when idle, polls once per tick during an erase
+static void W25QXX_Async_Task(void *arg)
+{
+    W25QXX_REQ *req;
+
+    for (;;) {
+        if (!W25QXX_Async_Poll())
+            xQueuePeek(W25QXX_Queue, &req, portMAX_DELAY);
+        else if (W25QXX_Cur && W25QXX_Cur->op == W25QXX_REQ_ERASE && !W25QXX_Next)
+            xQueuePeek(W25QXX_Queue, &req, 1); //a new read is served at once
+        else if (W25QXX_Cur && W25QXX_Cur->op == W25QXX_REQ_ERASE)
+            vTaskDelay(1);
+        else
+            taskYIELD(); //page program, < 1ms
+    }
+}
+
+int W25QXX_Async_Init(UBaseType_t priority)
+{
+    if (W25QXX_Queue)
+        return 0;
+    W25QXX_Queue = xQueueCreate(W25QXX_ASYNC_DEPTH, sizeof(W25QXX_REQ *));
+    if (!W25QXX_Queue)
+        return -1;
+    if (xTaskCreate(W25QXX_Async_Task, "w25qxx", W25QXX_ASYNC_STACK, NULL, priority, &W25QXX_Task) != pdPASS) {
+        vQueueDelete(W25QXX_Queue);
+        W25QXX_Queue = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int W25QXX_Async_Submit(W25QXX_REQ *req)
+{
+    if (!W25QXX_Queue)
+        return -1;
+    req->complete = 0;
+    taskENTER_CRITICAL();
+    W25QXX_Flight++;
+    taskEXIT_CRITICAL();
+    if (xQueueSend(W25QXX_Queue, &req, 0) != pdTRUE) {
+        taskENTER_CRITICAL();
+        W25QXX_Flight--;
+        taskEXIT_CRITICAL();
+        return -1;
+    }
+    return 0;
+}
+
+void W25QXX_Async_Flush(void)
+{
+    while (W25QXX_Flight) {
+        if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+            vTaskDelay(1);
+        else
+            W25QXX_Async_Poll();
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef __W25QXX_ASYNC_H
+#define __W25QXX_ASYNC_H
+#include "sys.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+//////////////////////////////////////////////////////////////////////////////////
+//asynchronous W25QXX requests
+//W25QXX_Async_Submit() returns at once, the flash task executes the requests in order
+//and polls the busy bit once per tick during erases instead of spinning. Reads are
+//served while an erase runs (it is suspended for them, see W25QXX_Suspend).
+//Before the scheduler runs, W25QXX_Async_Poll() from a loop does the work of the task.
+//While requests are in flight, do not call the synchronous W25QXX functions
+//(W25QXX_Async_Flush() first).
+//////////////////////////////////////////////////////////////////////////////////
+
+#define W25QXX_REQ_READ    0 //len bytes at addr to buf
+#define W25QXX_REQ_PROGRAM 1 //len bytes from buf to erased flash at addr, split in pages
+#define W25QXX_REQ_ERASE   2 //4K sector containing addr
+
+#define W25QXX_ASYNC_DEPTH 16  //max. requests in the queue
+#define W25QXX_ASYNC_STACK 256 //flash task stack (words)
+
+typedef struct w25qxx_req
+{
+    u8 op;                                //W25QXX_REQ_xx
+    u32 addr;
+    u8 *buf;
+    u32 len;
+    void (*done)(struct w25qxx_req *req); //called when done (flash task), or NULL
+    TaskHandle_t notify;                  //task notified (xTaskNotifyGive) when done, or NULL
+    void *priv;                           //for the submitter
+    volatile u8 complete;                 //set when done
+    u32 pos;                              //internal: bytes programmed
+} W25QXX_REQ;
+
+int W25QXX_Async_Init(UBaseType_t priority); //queue and flash task, 0 or -1
+int W25QXX_Async_Submit(W25QXX_REQ *req);    //0 or -1 (queue full), req must stay valid until done
+int W25QXX_Async_Poll(void);                 //one step without the task, returns requests in flight
+void W25QXX_Async_Flush(void);               //wait until all requests are done
+
+#endif
@@ -16,6 +16,14 @@
 * 1.8 / 25.09.2020 added fs_set_static_secs() to set a static time for JesFs
 * 1.9 / 22.02.2021 added/edited Devicelist, added new Flash Family GD25WD
 * 1.10 / 28.02.2021 added/edited Devicelist, added new Flash Family GD25WQ
+* 1.11 / 01.09.2022 added RAM name index (SF_NAME_INDEX) and fs_name_index_enable()
+* 1.12 / 05.09.2022 added fs_seek() and sector chain cache (SF_SEEK_CACHE)
+* 1.13 / 08.09.2022 added write combining buffer (SF_WRITE_COMBINE) and fs_flush()
+* 1.14 / 12.09.2022 added RAM sector map (SF_SECTOR_MAP) and fs_maintenance()
+* 1.15 / 15.09.2022 added pipelined page programming (SF_PIPELINE_WRITE)
+* 1.16 / 15.09.2022 added volumes (JESFS_VOL) on devices/partitions (JESFS_DEV), fsv_xx()
+* 1.17 / 18.09.2022 added fs_format_fast() (block erase, blank check buffer)
+* 1.18 / 20.09.2022 added mount snapshot (SF_SNAPSHOT) and fs_snapshot()
 *
 *******************************************************************************/
 
@@ -65,6 +73,8 @@
 -141: Other Commands: Filesystem sleeping!
 -142: Illegal file system structure (-> run recover, Index defect points to illegal HEAD)
 -143: Illegal file system structure (-> run recover, Index defect)
+-144: Seek position outside of file
+-145: No snapshot area on this disk (formatted without SF_SNAPSHOT)
  */
 
 #ifdef __cplusplus
@@ -94,6 +104,52 @@ extern "C"{
 #define GIGADEV_MANU_TYP_WD     0xC864  // GigaDevices (same as MX25R, e.g. GD25WD80C)
 #define GIGADEV_MANU_TYP_WQ     0xC865  // GigaDevices (same as MX25R,e.g. GD25WQ64E)
 #define W25QXX_MANU_TYP			0xEF18  // Winbond W25Qxx
+
+// If defined, fs_start() builds a RAM copy of the file index (name hash and
+// head sector, 4 bytes per entry) so fs_open() reads only the matching header
+// instead of 2 flash reads per file. Costs ca. 4kB RAM. Flash up to 256 MB.
+#define SF_NAME_INDEX
+
+// If defined, a buffer can be attached to an open file with fs_seek_cache().
+// It is filled with the sector chain while the file is read or seeked, so
+// fs_seek() starts the walk at the nearest known sector instead of the head.
+// Adds 12 bytes to FS_DESC.
+#define SF_SEEK_CACHE
+
+// If defined, a buffer of SF_WBUF_SIZE bytes can be attached to a file open for
+// writing with fs_write_buffer(). Small writes are collected until a flash page
+// is full, fs_flush() or fs_close() is called. Until then the data is only in RAM!
+// Adds 8 bytes to FS_DESC.
+#define SF_WRITE_COMBINE
+#define SF_WBUF_SIZE 256 // Flash page size
+
+// If defined, fs_start() builds a RAM bitmap of free and to-delete sectors (2 Bits
+// per sector), so fs_write() finds the next free sector without Flash reads.
+// fs_maintenance() (e.g. from the idle loop) erases to-delete sectors in advance,
+// so fs_write() does not have to wait for an erase at a sector border.
+#define SF_SECTOR_MAP
+#define SF_MAP_MAX_SECTORS  8192 // 32 MB, costs 2kB RAM
+#define SF_PREERASE_SECTORS 8    // fs_maintenance() keeps this many erased sectors ahead
+
+// If defined, sflash_SectorWrite() returns after starting the last page program
+// and the busy check is done before the next Flash command. CPU work between
+// two writes (e.g. CRC, preparing the next record) overlaps the programming time.
+#define SF_PIPELINE_WRITE
+
+// Typical erase times (W25Q256), fs_format_fast() uses them to choose between
+// 64k, 32k and 4k erases for the dirty sectors of a 64k block
+#define SF_ERASE_4K_MS  45
+#define SF_ERASE_32K_MS 120
+#define SF_ERASE_64K_MS 150
+
+// If defined, the last SF_SNAP_SECTORS sectors of a disk hold a CRC protected copy
+// of the state fs_start() builds by scanning every sector (counters, name index,
+// sector map). fs_snapshot() and fs_deepsleep() write it, the first change of the
+// disk after that invalidates it. A cold fs_start() with a valid snapshot only reads
+// the snapshot. Disks formatted without SF_SNAPSHOT still work (without snapshot).
+// All firmware writing the disk must use SF_SNAPSHOT, else the snapshot may be stale!
+#define SF_SNAPSHOT
+#define SF_SNAP_SECTORS 2 // Max. 48 Bytes + name index (4kB) + sector map (2kB)
 //------------------- Area for User Settings END -------------------------------
 
 
@@ -129,6 +185,7 @@ extern "C"{
 
 // Filedescriptor
 typedef struct{
+	struct jesfs_vol *_vol;   // Hidden, volume of the file (set by fs_open)
 	uint32_t    _head_sadr;   // Hidden, head of file
 	uint32_t    _wrk_sadr; // Hidden, working
 	uint32_t    file_pos; // end pos is the current file len
@@ -138,6 +195,16 @@ typedef struct{
 
 	uint16_t    _sadr_rel;   // Hidden, relative
 	uint8_t     open_flags;  // current file flags (set by fs_open) OR  file_flags on disk OR (opt) SF_XOPEN_UNCLOSED
+#ifdef SF_SEEK_CACHE
+	uint8_t     _chain_shift; // Hidden, entry i of _chain is sector (i<<_chain_shift) of the file
+	uint16_t    _chain_max;  // Hidden, size of _chain in entries
+	uint16_t    _chain_cnt;  // Hidden, known entries (always from the head on)
+	uint32_t    *_chain;     // Hidden, sector chain cache (set by fs_seek_cache()) or NULL
+#endif
+#ifdef SF_WRITE_COMBINE
+	uint8_t     *_wbuf;      // Hidden, write combining buffer (set by fs_write_buffer()) or NULL
+	uint16_t    _wbuf_len;   // Hidden, bytes in _wbuf, not yet in Flash (end at _wrk_sadr+_sadr_rel)
+#endif
 } FS_DESC;
 
 // Statistic descriptor
@@ -195,7 +262,61 @@ typedef struct{
     uint8_t state_flags;      // Currently only STATE_DEEPSLEEP used, 8Bit (at end of struct)
 } SFLASH_INFO;
 
-extern SFLASH_INFO sflash_info; //Describes Flash
+// Flash device: all Flash access of a volume goes through these ops. ctx is passed to each op.
+// Addresses are relative to the device (e.g. a partition), write/erase return 0 or -1xx
+typedef struct{
+	int16_t (*wakeup)(void *ctx);    // Interface init and release from deep power down
+	void (*sleep)(void *ctx);        // Deep power down and interface close
+	uint32_t (*identify)(void *ctx); // Flash ID
+	int16_t (*size)(void *ctx, uint32_t id, uint32_t *psize); // Usable size for this ID
+	void (*read)(void *ctx, uint32_t sadr, uint8_t *sbuf, uint16_t len);
+	int16_t (*write)(void *ctx, uint32_t sadr, uint8_t *sbuf, uint32_t len); // Inside one sector
+	int16_t (*erase)(void *ctx, uint32_t sadr);  // 4k sector
+	int16_t (*erase_block)(void *ctx, uint32_t sadr, uint32_t len); // 32k/64k block, 1: not possible here. NULL: not supported
+	int16_t (*erase_all)(void *ctx);
+	void *ctx;
+} JESFS_DEV;
+
+// Partition of the SPI Flash, as ctx for the ops of sflash_dev (ctx NULL: whole Flash)
+typedef struct{
+	uint32_t base;  // Start, multiple of SF_SECTOR_PH
+	uint32_t size;  // Size, multiple of SF_SECTOR_PH
+} JESFS_PART;
+
+#ifdef SF_NAME_INDEX
+typedef struct{
+	uint16_t hash;  // SF_NIDX_ACTIVE | name hash, 0: deleted
+	uint16_t sect;  // Head sector
+} SF_NIDX;
+#define SF_NIDX_ENTRIES ((SF_SECTOR_PH - 12) / 4) // Index entries in sector 0
+#endif
+
+// Volume: a JesFs on a device. All state of the filesystem is here, so
+// several volumes can be used at the same time (each file knows its volume)
+typedef struct jesfs_vol{
+	const JESFS_DEV *dev;
+	SFLASH_INFO info;   // Describes Flash
+#ifdef SF_NAME_INDEX
+	SF_NIDX name_index[SF_NIDX_ENTRIES];
+	uint8_t name_index_valid;
+	uint8_t name_index_off;  // Set by fsv_name_index_enable(vol, 0)
+#endif
+#ifdef SF_SECTOR_MAP
+	uint32_t map_free[SF_MAP_MAX_SECTORS / 32];  // Bit set: sector is erased
+	uint32_t map_todel[SF_MAP_MAX_SECTORS / 32]; // Bit set: sector is to delete
+	uint16_t map_sectors;  // 0: Map not used (Flash larger than SF_MAP_MAX_SECTORS)
+	uint16_t erase_ms;     // Last measured sector erase time
+#endif
+#ifdef SF_SNAPSHOT
+	uint32_t snap_adr;  // Snapshot area (after the disk), 0: None
+	uint8_t snap_valid; // Snapshot on Flash is valid, clear it before the next change
+#endif
+} JESFS_VOL;
+
+extern const JESFS_DEV sflash_dev; // SPI Flash (jesfs_ml.c)
+void sflash_dev_part(JESFS_DEV *pdev, JESFS_PART *part); // sflash_dev on a partition
+extern JESFS_VOL fs_vol0;          // Default volume for the fs_xx() functions
+#define sflash_info (fs_vol0.info) // Describes Flash (of fs_vol0)
 
 // required by fs_sec1970_to_date()
 typedef struct{ // Structure for a full date (readable)
@@ -212,11 +333,20 @@ int16_t fs_start(uint8_t mode);
 int16_t fs_deepsleep(void);
 
 int16_t fs_format(uint8_t fmode);
+int16_t fs_format_fast(uint32_t *pbuf, uint32_t buf_size); // Soft format, pbuf: blank check buffer or NULL
 int32_t fs_read(FS_DESC *pdesc, uint8_t *pdest, uint32_t anz);
 int16_t fs_rewind(FS_DESC *pdesc);
+int16_t fs_seek(FS_DESC *pdesc, uint32_t pos);
+#ifdef SF_SEEK_CACHE
+int16_t fs_seek_cache(FS_DESC *pdesc, uint32_t *pbuf, uint16_t entries);
+#endif
 int16_t fs_open(FS_DESC *pdesc, char* pname, uint8_t flags);
 int16_t fs_write(FS_DESC *pdesc, uint8_t *pdata, uint32_t len);
 int16_t fs_close(FS_DESC *pdesc);
+#ifdef SF_WRITE_COMBINE
+int16_t fs_write_buffer(FS_DESC *pdesc, uint8_t *pbuf);
+int16_t fs_flush(FS_DESC *pdesc);
+#endif
 int16_t fs_delete(FS_DESC *pdesc);
 int16_t fs_rename(FS_DESC *pd_odesc, FS_DESC *pd_ndesc);
 uint32_t fs_get_crc32(FS_DESC *pdesc);
@@ -225,10 +355,39 @@ int16_t fs_info(FS_STAT *pstat, uint16_t fno);
 void fs_sec1970_to_date(uint32_t asecs, FS_DATE *pd);
 uint32_t fs_date2sec1970(FS_DATE *pd);
 void fs_set_static_secs(uint32_t newsecs);
+#ifdef SF_NAME_INDEX
+void fs_name_index_enable(uint8_t enable); // 0: fs_open() scans the flash index (for comparison)
+#endif
 
 
+#ifdef SF_SECTOR_MAP
+int16_t fs_maintenance(uint32_t budget_ms);
+#endif
+#ifdef SF_SNAPSHOT
+int16_t fs_snapshot(void); // Write the mount snapshot (if changed)
+#endif
+
 int16_t fs_check_disk(void cb_printf(char* fmt, ...), uint8_t *pline, uint32_t line_size);
 
+// Same on a volume. fsv_init() once before fsv_start(). The FS_DESC functions find the volume in the descriptor
+void fsv_init(JESFS_VOL *vol, const JESFS_DEV *dev);
+int16_t fsv_start(JESFS_VOL *vol, uint8_t mode);
+int16_t fsv_deepsleep(JESFS_VOL *vol);
+int16_t fsv_format(JESFS_VOL *vol, uint8_t fmode);
+int16_t fsv_format_fast(JESFS_VOL *vol, uint32_t *pbuf, uint32_t buf_size);
+int16_t fsv_open(JESFS_VOL *vol, FS_DESC *pdesc, char* pname, uint8_t flags);
+int16_t fsv_info(JESFS_VOL *vol, FS_STAT *pstat, uint16_t fno);
+#ifdef SF_NAME_INDEX
+void fsv_name_index_enable(JESFS_VOL *vol, uint8_t enable);
+#endif
+#ifdef SF_SECTOR_MAP
+int16_t fsv_maintenance(JESFS_VOL *vol, uint32_t budget_ms);
+#endif
+#ifdef SF_SNAPSHOT
+int16_t fsv_snapshot(JESFS_VOL *vol);
+#endif
+int16_t fsv_check_disk(JESFS_VOL *vol, void cb_printf(char* fmt, ...), uint8_t *pline, uint32_t line_size);
+
 
 #ifdef __cplusplus
 }
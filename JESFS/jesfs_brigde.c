@@ -21,6 +21,91 @@
 #include "delay.h"
 #include "jesfs.h"
 #include "nfvfs.h"
+#include "nordev.h"
+
+/* sector chain cache allocated with every descriptor, see fs_seek_cache() */
+#define JESFS_SEEK_CACHE_ENTRIES 64
+
+#ifdef SF_WRITE_COMBINE
+#define JESFS_WBUF_SIZE SF_WBUF_SIZE
+#else
+#define JESFS_WBUF_SIZE 0
+#endif
+
+/* descriptor, chain cache and write combining buffer in one allocation */
+#define JESFS_DESC_SIZE (sizeof(FS_DESC) + JESFS_SEEK_CACHE_ENTRIES * sizeof(uint32_t) + JESFS_WBUF_SIZE)
+
+/* JesFs device ops on a NORDEV (ctx), for volumes on other devices than sflash_dev */
+static int16_t jesfs_nordev_wakeup(void *ctx)
+{
+    return 0;
+}
+
+static void jesfs_nordev_sleep(void *ctx)
+{
+    NORDEV_Sync(ctx);
+}
+
+/* no JEDEC ID behind a NORDEV: 'N' and the density, stored in the header */
+static uint32_t jesfs_nordev_identify(void *ctx)
+{
+    uint32_t h;
+
+    for (h = 0; (1UL << h) < ((NORDEV *)ctx)->size; h++)
+        ;
+    return 0x4E0000 | h;
+}
+
+static int16_t jesfs_nordev_size(void *ctx, uint32_t id, uint32_t *psize)
+{
+    *psize = ((NORDEV *)ctx)->size & ~(SF_SECTOR_PH - 1);
+    return *psize < 2 * SF_SECTOR_PH ? -105 : 0;
+}
+
+static void jesfs_nordev_read(void *ctx, uint32_t sadr, uint8_t *sbuf, uint16_t len)
+{
+    NORDEV_Read(ctx, sadr, sbuf, len);
+}
+
+static int16_t jesfs_nordev_write(void *ctx, uint32_t sadr, uint8_t *sbuf, uint32_t len)
+{
+    NORDEV_Prog(ctx, sadr, sbuf, len);
+    return 0;
+}
+
+static int16_t jesfs_nordev_erase(void *ctx, uint32_t sadr)
+{
+    return NORDEV_Erase(ctx, sadr, SF_SECTOR_PH) ? -105 : 0;
+}
+
+static int16_t jesfs_nordev_erase_block(void *ctx, uint32_t sadr, uint32_t len)
+{
+    return NORDEV_Erase(ctx, sadr, len); // 1: not aligned, per sector
+}
+
+static int16_t jesfs_nordev_erase_all(void *ctx)
+{
+    NORDEV_Erase(ctx, 0, ((NORDEV *)ctx)->size & ~(SF_SECTOR_PH - 1));
+    NORDEV_Sync(ctx);
+    return 0;
+}
+
+static JESFS_DEV jesfs_nordev = {
+    jesfs_nordev_wakeup, jesfs_nordev_sleep, jesfs_nordev_identify, jesfs_nordev_size,
+    jesfs_nordev_read, jesfs_nordev_write, jesfs_nordev_erase, jesfs_nordev_erase_block,
+    jesfs_nordev_erase_all, NULL};
+
+int jesfs_set_device(NORDEV *dev)
+{
+    if (dev && SF_SECTOR_PH % dev->erase_size) {
+        printf("%s: erase size %d does not fit the sectors\r\n", __func__, dev->erase_size);
+        return -1;
+    }
+    jesfs_nordev.ctx = dev;
+    fs_vol0.dev = dev ? &jesfs_nordev : &sflash_dev;
+    fs_vol0.info.total_flash_size = 0; // identify again at the next start
+    return 0;
+}
 
 int jesfs_mount_wrp()
 {
@@ -51,6 +136,11 @@ int jesfs_mount_wrp()
 
 int jesfs_unmount_wrp()
 {
+#ifdef SF_SNAPSHOT
+    int err = fs_snapshot(); // next cold mount reads the snapshot instead of scanning
+    if (err && err != -145)
+        printf("%s: snapshot failed: %d\r\n", __func__, err);
+#endif
     return 0;
 }
 
@@ -76,8 +166,18 @@ int jesfs_open_wrp(const char *path, int flags, int mode, struct nfvfs_context *
     }
 
     if (S_IFREG(mode)) {
-        fs_desc = (FS_DESC *)pvPortMalloc(sizeof(FS_DESC));
+        fs_desc = (FS_DESC *)pvPortMalloc(JESFS_DESC_SIZE);
         ret = fs_open(fs_desc, (char *)path, jesfs_flags);
+#ifdef SF_SEEK_CACHE
+        if (ret == 0) {
+            fs_seek_cache(fs_desc, (uint32_t *)(fs_desc + 1), JESFS_SEEK_CACHE_ENTRIES);
+        }
+#endif
+#ifdef SF_WRITE_COMBINE
+        if (ret == 0 && (jesfs_flags & SF_OPEN_WRITE)) {
+            fs_write_buffer(fs_desc, (uint8_t *)(fs_desc + 1) + JESFS_SEEK_CACHE_ENTRIES * sizeof(uint32_t));
+        }
+#endif
         context->out_data = fs_desc;
     } else {
         printf("%s: unsupported directory\r\n", __func__);
@@ -139,45 +239,79 @@ int jesfs_lseek_wrp(int fd, uint32_t offset, int whence)
 {
     struct nfvfs_fentry *entry = ftable_get_entry(fd);
     FS_DESC *fd_desc;
+    int32_t pos;
+    int ret;
     if (entry == NULL) {
         return -1;
     }
+    if (!S_IFREG(entry->mode)) {
+        return -1;
+    }
     
     fd_desc = (FS_DESC *)entry->f;
 
-    switch (whence)
-    {
-    case NFVFS_SEEK_CUR:
-        if (offset != -fd_desc->file_pos) {
+    /* files open for writing only can just be rewound */
+    if (!(fd_desc->open_flags & (SF_OPEN_READ | SF_OPEN_RAW))) {
+        if (whence != NFVFS_SEEK_SET || offset != 0) {
             printf("%s: unsupported offset\r\n", __func__);
             return -1;
         }
+        return fs_rewind(fd_desc);
+    }
+
+    switch (whence)
+    {
+    case NFVFS_SEEK_CUR:
+        pos = (int32_t)fd_desc->file_pos + (int32_t)offset;
         break;
     case NFVFS_SEEK_SET:
-        if (offset != 0) {
-            printf("%s: unsupported offset\r\n", __func__);
-            return -1;
-        }
+        pos = (int32_t)offset;
         break;
     case NFVFS_SEEK_END:
-        if (offset != fd_desc->file_pos) {
-            printf("%s: unsupported offset\r\n", __func__);
-            return -1;
+        if (fd_desc->file_len == 0xFFFFFFFF) {
+            /* unclosed file, reading without destination finds the end */
+            ret = fs_read(fd_desc, NULL, 0xFFFFFFFF);
+            if (ret < 0) {
+                return ret;
+            }
         }
+        pos = (int32_t)fd_desc->file_len + (int32_t)offset;
         break;
     default:
-        break;
+        return -1;
     }
 
-    if (S_IFREG(entry->mode)) {
-        return fs_rewind((FS_DESC *)entry->f);
-    } else {
+    if (pos < 0) {
+        printf("%s: unsupported offset\r\n", __func__);
         return -1;
     }
+
+    ret = fs_seek(fd_desc, (uint32_t)pos);
+    if (ret < 0) {
+        return ret;
+    }
+    return pos;
 }
 
 
 
+int jesfs_fsync_wrp(int fd)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    if (entry == NULL) {
+        return -1;
+    }
+    if (S_IFREG(entry->mode)) {
+#ifdef SF_WRITE_COMBINE
+        return fs_flush((FS_DESC *)entry->f);
+#else
+        return 0;
+#endif
+    } else {
+        return -1;
+    }
+}
+
 struct nfvfs_operations jesfs_ops = {
     .mount = jesfs_mount_wrp,
     .unmount = jesfs_unmount_wrp,
@@ -186,4 +320,5 @@ struct nfvfs_operations jesfs_ops = {
     .read = jesfs_read_wrp,
     .write = jesfs_write_wrp,
     .lseek = jesfs_lseek_wrp,
+    .fsync = jesfs_fsync_wrp,
 };
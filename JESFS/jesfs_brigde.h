@@ -18,6 +18,11 @@
 #ifndef __JESFS_BRIGDE_H
 #define __JESFS_BRIGDE_H
 
+#include "nordev.h"
+
 extern struct nfvfs_operations jesfs_ops;
 
+/* Device for the next mount, NULL: the whole SPI Flash (sflash_dev, default) */
+int jesfs_set_device(NORDEV *dev);
+
 #endif /* __JESFS_BRIGDE_H */
@@ -16,6 +16,13 @@
  * 1.85 / 17.03.2022 added check (Warren)
  * 1.86 / 18.03.2022 corrected bug in fs_date2sec1970()
  * 1.87 / 02.04.2022 fs_strcpy()->fsstrncpy() and some minor opts.
+ * 1.88 / 01.09.2022 RAM name index for fs_open() (SF_NAME_INDEX)
+ * 1.89 / 05.09.2022 fs_seek() with optional sector chain cache (SF_SEEK_CACHE)
+ * 1.90 / 08.09.2022 Write combining buffer for fs_write() (SF_WRITE_COMBINE), fs_flush()
+ * 1.91 / 12.09.2022 RAM sector map and pre-erase with fs_maintenance() (SF_SECTOR_MAP)
+ * 1.92 / 15.09.2022 All state in a volume (JESFS_VOL) on a device (JESFS_DEV), fsv_xx()
+ * 1.93 / 18.09.2022 fs_format_fast() with block erase and blank check buffer
+ * 1.94 / 20.09.2022 Mount snapshot (SF_SNAPSHOT), fs_snapshot()
  *
  *******************************************************************************/
 
@@ -61,6 +68,10 @@ void fs_memset(uint8_t *p, uint8_t v, uint32_t n) {
   while (n--)
     *p++ = v;
 }
+void fs_memcpy(uint8_t *d, uint8_t *s, uint32_t n) {
+  while (n--)
+    *d++ = *s++;
+}
 int16_t fs_strcmp(char *s1, char *s2) { // Only required for equal(0) or !equal(!0)
   for (;;) {
     if (*s1 == 0 || *s1 != *s2)
@@ -188,42 +199,336 @@ uint32_t fs_track_crc32(uint8_t *pdata, uint32_t wlen, uint32_t crc_run) {
   return crc_run;
 }
 
-static int16_t sflash_sadr_invalid(uint32_t sadr) {
+// Default volume, used by the fs_xx() functions
+JESFS_VOL fs_vol0 = {&sflash_dev};
+
+#ifdef SF_SNAPSHOT
+// Clear the valid word of the snapshot on Flash (NOR: only bits cleared), before the disk is changed
+static int16_t fs_snap_invalidate(JESFS_VOL *vol) {
+  uint32_t zero = 0;
+
+  vol->snap_valid = 0;
+  return vol->dev->write(vol->dev->ctx, vol->snap_adr + 4, (uint8_t *)&zero, 4);
+}
+#endif
+
+// Flash access of a volume
+static void vol_read(JESFS_VOL *vol, uint32_t sadr, uint8_t *sbuf, uint16_t len) {
+  vol->dev->read(vol->dev->ctx, sadr, sbuf, len);
+}
+static int16_t vol_write(JESFS_VOL *vol, uint32_t sadr, uint8_t *sbuf, uint32_t len) {
+  if (sadr >= vol->info.total_flash_size)
+    return -105; // Flash Full! Illegal Address
+  if (len > SF_SECTOR_PH - (sadr & (SF_SECTOR_PH - 1)))
+    return -106; // Sektorviolation
+#ifdef SF_SNAPSHOT
+  if (vol->snap_valid && fs_snap_invalidate(vol))
+    return -137;
+#endif
+  return vol->dev->write(vol->dev->ctx, sadr, sbuf, len);
+}
+static int16_t vol_erase(JESFS_VOL *vol, uint32_t sadr) {
+#ifdef SF_SNAPSHOT
+  if (vol->snap_valid && fs_snap_invalidate(vol))
+    return -137;
+#endif
+  return vol->dev->erase(vol->dev->ctx, sadr);
+}
+
+/* Prepare a volume on a device, before fsv_start() */
+void fsv_init(JESFS_VOL *vol, const JESFS_DEV *dev) {
+  fs_memset((uint8_t *)vol, 0, sizeof(JESFS_VOL));
+  vol->dev = dev;
+}
+
+#ifdef SF_NAME_INDEX
+#define SF_NIDX_ACTIVE  0x8000 // Entry is an active head, low 15 bits: name hash
+
+void fsv_name_index_enable(JESFS_VOL *vol, uint8_t enable) {
+  vol->name_index_off = !enable;
+}
+
+// FNV-1a, folded to 15 bits
+static uint16_t fs_name_hash(char *pname) {
+  uint32_t h = 2166136261u;
+  while (*pname) {
+    h ^= (uint8_t)*pname++;
+    h *= 16777619u;
+  }
+  return (uint16_t)((h ^ (h >> 15)) & ~SF_NIDX_ACTIVE);
+}
+
+// Set entry of the slot with head sadr, pname==NULL: Head deleted
+static void fs_name_index_update(JESFS_VOL *vol, uint32_t sadr, char *pname) {
+  uint16_t i;
+  uint16_t sect = (uint16_t)(sadr / SF_SECTOR_PH);
+  for (i = 0; i < vol->info.files_used; i++) {
+    if (vol->name_index[i].sect == sect) {
+      vol->name_index[i].hash = pname ? (fs_name_hash(pname) | SF_NIDX_ACTIVE) : 0;
+      return;
+    }
+  }
+}
+#endif
+
+#ifdef SF_SECTOR_MAP
+#define SF_MAP_SET(m, s) ((m)[(s) >> 5] |= (1UL << ((s)&31)))
+#define SF_MAP_CLR(m, s) ((m)[(s) >> 5] &= ~(1UL << ((s)&31)))
+#define SF_MAP_TST(m, s) ((m)[(s) >> 5] & (1UL << ((s)&31)))
+
+// Next free or to-delete sector after sect (circular, sector 0 is the index). 0: None
+static uint16_t sf_map_next(JESFS_VOL *vol, uint16_t sect) {
+  uint16_t n;
+
+  for (n = 1; n < vol->map_sectors; n++) {
+    if (++sect >= vol->map_sectors)
+      sect = 1;
+    if (!(sect & 31) && !(vol->map_free[sect >> 5] | vol->map_todel[sect >> 5])) {
+      sect += 31; // Skip empty word
+      n += 31;
+      continue;
+    }
+    if (SF_MAP_TST(vol->map_free, sect) || SF_MAP_TST(vol->map_todel, sect))
+      return sect;
+  }
+  return 0;
+}
+#endif
+
+#ifdef SF_SNAPSHOT
+// Snapshot header, followed by the name index (files_used entries) and the sector maps (map_sectors bits each)
+typedef struct {
+  uint32_t magic; // SNAP_MAGIC
+  uint32_t valid; // 0xFFFFFFFF: Valid, cleared before the first change of the disk
+  uint32_t crc32; // From creation_date to the end of the snapshot
+  uint32_t creation_date;
+  uint32_t identification;
+  uint32_t total_flash_size;
+  uint32_t lusect_adr;
+  uint32_t available_disk_size;
+  uint16_t files_used;
+  uint16_t files_active;
+  uint16_t sectors_todelete;
+  uint16_t sectors_clear;
+  uint16_t sectors_unknown;
+  uint16_t layout; // SF_SNAP_LAYOUT of the writer
+  uint16_t map_sectors;
+  uint16_t name_index_valid;
+} SF_SNAP_HDR;
+
+#define SF_SNAP_HDR_CRC_OFS 12 // CRC starts at creation_date
+#define SF_SNAP_LAYOUT (1 | (SF_SNAP_NIDX << 1) | (SF_SNAP_MAP << 2) | (SF_SNAP_JSTAT << 3))
+#ifdef SF_NAME_INDEX
+#define SF_SNAP_NIDX 1
+#else
+#define SF_SNAP_NIDX 0
+#endif
+#ifdef SF_SECTOR_MAP
+#define SF_SNAP_MAP 1
+#else
+#define SF_SNAP_MAP 0
+#endif
+#ifdef JSTAT
+#define SF_SNAP_JSTAT 1
+#else
+#define SF_SNAP_JSTAT 0
+#endif
+
+// Write len Bytes to the snapshot area at *padr (crossing sectors) and track the CRC
+static int16_t fs_snap_put(JESFS_VOL *vol, uint32_t *padr, uint8_t *pdata, uint32_t len, uint32_t *pcrc) {
+  int16_t res;
+  uint32_t wlen;
+
+  *pcrc = fs_track_crc32(pdata, len, *pcrc);
+  while (len) {
+    wlen = SF_SECTOR_PH - (*padr & (SF_SECTOR_PH - 1));
+    if (wlen > len)
+      wlen = len;
+    res = vol->dev->write(vol->dev->ctx, *padr, pdata, wlen);
+    if (res)
+      return res;
+    *padr += wlen;
+    pdata += wlen;
+    len -= wlen;
+  }
+  return 0;
+}
+
+// Read len Bytes of the snapshot at *padr and track the CRC
+static void fs_snap_get(JESFS_VOL *vol, uint32_t *padr, uint8_t *pdata, uint32_t len, uint32_t *pcrc) {
+  vol->dev->read(vol->dev->ctx, *padr, pdata, (uint16_t)len);
+  *pcrc = fs_track_crc32(pdata, len, *pcrc);
+  *padr += len;
+}
+
+/* Restore the state of the last scan from the snapshot. 0: OK, else full scan required */
+static int16_t fs_snap_restore(JESFS_VOL *vol) {
+  SF_SNAP_HDR *ph = (SF_SNAP_HDR *)&vol->info.databuf;
+  uint32_t adr = vol->snap_adr + sizeof(SF_SNAP_HDR);
+  uint32_t crc, len = 0;
+
+  vol->dev->read(vol->dev->ctx, vol->snap_adr, (uint8_t *)ph, sizeof(SF_SNAP_HDR));
+  if (ph->magic != SNAP_MAGIC || ph->valid != 0xFFFFFFFF)
+    return -1;
+  if (ph->creation_date != vol->info.creation_date || ph->identification != vol->info.identification || ph->total_flash_size != vol->info.total_flash_size || ph->layout != SF_SNAP_LAYOUT)
+    return -1; // Other disk or other settings
+#ifdef SF_NAME_INDEX
+  len += (uint32_t)ph->files_used * sizeof(SF_NIDX);
+  if (ph->files_used > SF_NIDX_ENTRIES)
+    return -1;
+#endif
+#ifdef SF_SECTOR_MAP
+  len += 2 * ((ph->map_sectors + 31) / 32) * 4;
+  if (ph->map_sectors > SF_MAP_MAX_SECTORS)
+    return -1;
+#endif
+  if (sizeof(SF_SNAP_HDR) + len > SF_SNAP_SECTORS * SF_SECTOR_PH)
+    return -1;
+
+  vol->info.lusect_adr = ph->lusect_adr;
+  vol->info.available_disk_size = ph->available_disk_size;
+  vol->info.files_used = ph->files_used;
+  vol->info.files_active = ph->files_active;
+#ifdef JSTAT
+  vol->info.sectors_todelete = ph->sectors_todelete;
+  vol->info.sectors_clear = ph->sectors_clear;
+  vol->info.sectors_unknown = ph->sectors_unknown;
+#endif
+  crc = fs_track_crc32((uint8_t *)ph + SF_SNAP_HDR_CRC_OFS, sizeof(SF_SNAP_HDR) - SF_SNAP_HDR_CRC_OFS, 0xFFFFFFFF);
+  len = ph->crc32;
+#ifdef SF_NAME_INDEX
+  vol->name_index_valid = (uint8_t)ph->name_index_valid;
+  fs_snap_get(vol, &adr, (uint8_t *)vol->name_index, (uint32_t)vol->info.files_used * sizeof(SF_NIDX), &crc);
+#endif
+#ifdef SF_SECTOR_MAP
+  vol->map_sectors = ph->map_sectors;
+  fs_memset((uint8_t *)vol->map_free, 0, sizeof(vol->map_free));
+  fs_memset((uint8_t *)vol->map_todel, 0, sizeof(vol->map_todel));
+  fs_snap_get(vol, &adr, (uint8_t *)vol->map_free, ((vol->map_sectors + 31) / 32) * 4, &crc);
+  fs_snap_get(vol, &adr, (uint8_t *)vol->map_todel, ((vol->map_sectors + 31) / 32) * 4, &crc);
+#endif
+  if (crc != len)
+    return -1; // Caller scans and overwrites all again
+  vol->snap_valid = 1;
+  return 0;
+}
+
+/* Write the snapshot of the current state. Only after a change of the disk */
+int16_t fsv_snapshot(JESFS_VOL *vol) {
+  SF_SNAP_HDR *ph = (SF_SNAP_HDR *)&vol->info.databuf;
+  uint32_t adr, crc;
+  int16_t res;
+  uint8_t i;
+
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
+    return -141;
+  if (!vol->snap_adr)
+    return -145;
+  if (vol->info.creation_date == 0xFFFFFFFF)
+    return -108; // No valid disk
+  if (vol->snap_valid)
+    return 0; // Unchanged
+
+  // First sector last and its SNAP_MAGIC at once: fs_start() finds the area after a power loss at any point
+  for (i = SF_SNAP_SECTORS; i > 0; i--) {
+    res = vol->dev->erase(vol->dev->ctx, vol->snap_adr + (i - 1) * SF_SECTOR_PH);
+    if (res)
+      return res;
+  }
+  fs_memset((uint8_t *)ph, 0, sizeof(SF_SNAP_HDR));
+  ph->magic = SNAP_MAGIC;
+  res = vol->dev->write(vol->dev->ctx, vol->snap_adr, (uint8_t *)&ph->magic, 4);
+  if (res)
+    return res;
+  ph->valid = 0xFFFFFFFF;
+  ph->creation_date = vol->info.creation_date;
+  ph->identification = vol->info.identification;
+  ph->total_flash_size = vol->info.total_flash_size;
+  ph->lusect_adr = vol->info.lusect_adr;
+  ph->available_disk_size = vol->info.available_disk_size;
+  ph->files_used = vol->info.files_used;
+  ph->files_active = vol->info.files_active;
+#ifdef JSTAT
+  ph->sectors_todelete = vol->info.sectors_todelete;
+  ph->sectors_clear = vol->info.sectors_clear;
+  ph->sectors_unknown = vol->info.sectors_unknown;
+#endif
+  ph->layout = SF_SNAP_LAYOUT;
+#ifdef SF_SECTOR_MAP
+  ph->map_sectors = vol->map_sectors;
+#endif
+#ifdef SF_NAME_INDEX
+  ph->name_index_valid = vol->name_index_valid;
+#endif
+  crc = fs_track_crc32((uint8_t *)ph + SF_SNAP_HDR_CRC_OFS, sizeof(SF_SNAP_HDR) - SF_SNAP_HDR_CRC_OFS, 0xFFFFFFFF);
+
+  // Data first, the header makes it valid
+  adr = vol->snap_adr + sizeof(SF_SNAP_HDR);
+#ifdef SF_NAME_INDEX
+  res = fs_snap_put(vol, &adr, (uint8_t *)vol->name_index, (uint32_t)vol->info.files_used * sizeof(SF_NIDX), &crc);
+  if (res)
+    return res;
+#endif
+#ifdef SF_SECTOR_MAP
+  res = fs_snap_put(vol, &adr, (uint8_t *)vol->map_free, ((vol->map_sectors + 31) / 32) * 4, &crc);
+  if (res)
+    return res;
+  res = fs_snap_put(vol, &adr, (uint8_t *)vol->map_todel, ((vol->map_sectors + 31) / 32) * 4, &crc);
+  if (res)
+    return res;
+#endif
+  ph->crc32 = crc;
+  res = vol->dev->write(vol->dev->ctx, vol->snap_adr, (uint8_t *)ph, sizeof(SF_SNAP_HDR));
+  if (res)
+    return res;
+  vol->snap_valid = 1;
+  return 0;
+}
+#endif
+
+static int16_t sflash_sadr_invalid(JESFS_VOL *vol, uint32_t sadr) {
   if (sadr == 0xFFFFFFFF)
     return 0; // OK
   if (!sadr)
     return -1;
   if (sadr & (SF_SECTOR_PH - 1))
     return -2; // FATAL
-  if (sadr >= sflash_info.total_flash_size)
+  if (sadr >= vol->info.total_flash_size)
     return -3; // FATAL
   return 0;    // Ok
 }
 
-static int16_t flash_set2delete(uint32_t sadr) {
+static int16_t flash_set2delete(JESFS_VOL *vol, uint32_t sadr) {
   int16_t res;
   uint32_t thdr[3];
   uint32_t max_sect;
   uint32_t oadr;
   oadr = sadr;
-  max_sect = (sflash_info.total_flash_size / SF_SECTOR_PH);
+  max_sect = (vol->info.total_flash_size / SF_SECTOR_PH);
   while (--max_sect) {
-    if (sflash_sadr_invalid(sadr))
+    if (sflash_sadr_invalid(vol, sadr))
       return -120;
-    sflash_read(sadr, (uint8_t *)thdr, 12);
+    vol_read(vol, sadr, (uint8_t *)thdr, 12);
     if (thdr[0] == SECTOR_MAGIC_HEAD_ACTIVE) {
       if (thdr[1] != 0xFFFFFFFF)
         return -122;
       thdr[0] = SECTOR_MAGIC_HEAD_DELETED;
-      sflash_info.files_active--;
+      vol->info.files_active--;
+#ifdef SF_NAME_INDEX
+      fs_name_index_update(vol, sadr, NULL);
+#endif
     } else if (thdr[0] == SECTOR_MAGIC_DATA) {
       if (thdr[1] != oadr)
         return -122;
       thdr[0] = SECTOR_MAGIC_TODELETE;
-      sflash_info.available_disk_size += SF_SECTOR_PH;
+      vol->info.available_disk_size += SF_SECTOR_PH;
+#ifdef SF_SECTOR_MAP
+      if (vol->map_sectors)
+        SF_MAP_SET(vol->map_todel, sadr / SF_SECTOR_PH);
+#endif
     } else
       return -123; // Illegal
-    res = sflash_SectorWrite(sadr, (uint8_t *)thdr, 4);
+    res = vol_write(vol, sadr, (uint8_t *)thdr, 4);
     if (res)
       return res;
     sadr = thdr[2];
@@ -233,7 +538,7 @@ static int16_t flash_set2delete(uint32_t sadr) {
   return -121;
 }
 // Find last used byte index in a sector (max_sec_rd<=SF_SECTOR_PH). Returns 0 is sector is totaly empty (all bytes FF)
-static uint16_t sflash_find_mlen(uint32_t sadr, uint16_t max_sec_rd) {
+static uint16_t sflash_find_mlen(JESFS_VOL *vol, uint32_t sadr, uint16_t max_sec_rd) {
   uint16_t wlen;
   uint16_t used_len = max_sec_rd;
   sadr += max_sec_rd;
@@ -243,9 +548,9 @@ static uint16_t sflash_find_mlen(uint32_t sadr, uint16_t max_sec_rd) {
       wlen = SF_BUFFER_SIZE_B;
     max_sec_rd -= wlen;
     sadr -= wlen;
-    sflash_read(sadr, (uint8_t *)&sflash_info.databuf, wlen);
+    vol_read(vol, sadr, (uint8_t *)&vol->info.databuf, wlen);
     while (wlen--) {
-      if (sflash_info.databuf.u8[wlen] != 0xFF)
+      if (vol->info.databuf.u8[wlen] != 0xFF)
         return used_len;
       used_len--;
     }
@@ -254,7 +559,7 @@ static uint16_t sflash_find_mlen(uint32_t sadr, uint16_t max_sec_rd) {
 }
 
 // Copy IntraFlash and Page-Safe
-static int16_t flash_intrasec_copy(uint32_t sadr, uint32_t dadr, uint16_t clen) {
+static int16_t flash_intrasec_copy(JESFS_VOL *vol, uint32_t sadr, uint32_t dadr, uint16_t clen) {
   int16_t res;
   uint16_t blen;
   while (clen) {
@@ -262,8 +567,8 @@ static int16_t flash_intrasec_copy(uint32_t sadr, uint32_t dadr, uint16_t clen)
     if (blen > SF_BUFFER_SIZE_B)
       blen = SF_BUFFER_SIZE_B;
 
-    sflash_read(sadr, (uint8_t *)&sflash_info.databuf, blen);
-    res = sflash_SectorWrite(dadr, (uint8_t *)&sflash_info.databuf, blen);
+    vol_read(vol, sadr, (uint8_t *)&vol->info.databuf, blen);
+    res = vol_write(vol, dadr, (uint8_t *)&vol->info.databuf, blen);
     if (res)
       return res;
     sadr += blen;
@@ -276,7 +581,7 @@ static int16_t flash_intrasec_copy(uint32_t sadr, uint32_t dadr, uint16_t clen)
 //--------------------------- Frm here User Functions ----------------------------------------
 
 /* Start Filesystem - Fill structurs and check basic parameters */
-int16_t fs_start(uint8_t mode) {
+int16_t fsv_start(JESFS_VOL *vol, uint8_t mode) {
   int16_t res;
   uint32_t id;
   uint32_t sadr;
@@ -284,108 +589,161 @@ int16_t fs_start(uint8_t mode) {
   uint32_t dir_typ;
   uint16_t err;
 
-  res = sflash_spi_init();
+  // Interface init and Flash wakeup
+  res = vol->dev->wakeup(vol->dev->ctx);
   if (res) {
-    sflash_info.creation_date = 0xFFFFFFFF; // Invalidate Disk
+    vol->info.creation_date = 0xFFFFFFFF; // Invalidate Disk
     return res;                             // Error 2 User
   }
-
-  // Flash wakeup
-  sflash_ReleaseFromDeepPowerDown();
-  sflash_wait_usec(45);
-  sflash_info.state_flags &= ~(STATE_DEEPSLEEP);
+  vol->info.state_flags &= ~(STATE_DEEPSLEEP);
 
   // ID read and get setup
-  id = sflash_QuickScanIdentification();
+  id = vol->dev->identify(vol->dev->ctx);
   printf("Flash ID: %08X\r\n", id);
   if (mode & FS_START_RESTART) {
-    if (sflash_info.total_flash_size && id == sflash_info.identification) {
+    if (vol->info.total_flash_size && id == vol->info.identification) {
       return 0; // Wake only
     }
   }
-  sflash_info.creation_date = 0xFFFFFFFF; // Assume Invalid Disk
+  vol->info.creation_date = 0xFFFFFFFF; // Assume Invalid Disk
 
-  res = sflash_interpret_id(id);
+  vol->info.identification = id;
+  vol->info.total_flash_size = 0;
+  res = vol->dev->size(vol->dev->ctx, id, &vol->info.total_flash_size);
   if (res)
     return res;
+#ifdef SF_SNAPSHOT
+  // Snapshot area at the end, if not used by the disk (formatted without SF_SNAPSHOT)
+  vol->snap_adr = 0;
+  vol->snap_valid = 0;
+  if (vol->info.total_flash_size >= 16 * SF_SNAP_SECTORS * SF_SECTOR_PH) {
+    // SNAP_MAGIC in the first sector marks the area, the other sectors may start with any snapshot data.
+    // Else all sectors must be erased (fresh disk)
+    sadr = vol->info.total_flash_size - SF_SNAP_SECTORS * SF_SECTOR_PH;
+    vol_read(vol, sadr, (uint8_t *)&dir_typ, 4);
+    err = SF_SNAP_SECTORS;
+    if (dir_typ == 0xFFFFFFFF) {
+      for (err = 1; err < SF_SNAP_SECTORS; err++) {
+        vol_read(vol, sadr + err * SF_SECTOR_PH, (uint8_t *)&dir_typ, 4);
+        if (dir_typ != 0xFFFFFFFF)
+          break;
+      }
+    } else if (dir_typ != SNAP_MAGIC) {
+      err = 0;
+    }
+    if (err == SF_SNAP_SECTORS) {
+      vol->snap_adr = sadr;
+      vol->info.total_flash_size = sadr;
+    }
+  }
+#endif
 
   // OK, Flash is known
-  sflash_read(0, (uint8_t *)&sflash_info.databuf, HEADER_SIZE_B);
+  vol_read(vol, 0, (uint8_t *)&vol->info.databuf, HEADER_SIZE_B);
 
-  if (sflash_info.databuf.u32[0] != HEADER_MAGIC)
+  if (vol->info.databuf.u32[0] != HEADER_MAGIC)
     return -108;
-  if (sflash_info.databuf.u32[1] != sflash_info.identification)
+  if (vol->info.databuf.u32[1] != vol->info.identification)
     return -109;
 
-  sflash_info.creation_date = sflash_info.databuf.u32[2]; // Creation date must be anyting different from 0xFFFFFFFF
+  vol->info.creation_date = vol->info.databuf.u32[2]; // Creation date must be anyting different from 0xFFFFFFFF
+
+#ifdef SF_SNAPSHOT
+  if (vol->snap_adr) {
+    if (!fs_snap_restore(vol))
+      return 0; // OK, no scan
+    vol->dev->read(vol->dev->ctx, vol->snap_adr + 4, (uint8_t *)&dir_typ, 4);
+    if (dir_typ == 0xFFFFFFFF) {
+      res = fs_snap_invalidate(vol); // Stale, clear it now (vol_write() would not know)
+      if (res)
+        return res;
+    }
+  }
+#endif
 
   err = 0;
-  sflash_info.available_disk_size = sflash_info.total_flash_size - SF_SECTOR_PH;
+  vol->info.available_disk_size = vol->info.total_flash_size - SF_SECTOR_PH;
 
 #ifdef JSTAT
-  sflash_info.sectors_todelete = 0; // Not really required, just for statistics
-  sflash_info.sectors_clear = 0;
-  sflash_info.sectors_unknown = 0;
+  vol->info.sectors_todelete = 0; // Not really required, just for statistics
+  vol->info.sectors_clear = 0;
+  vol->info.sectors_unknown = 0;
 #endif
 
-  sflash_info.files_used = 0;
-  sflash_info.files_active = 0;
+  vol->info.files_used = 0;
+  vol->info.files_active = 0;
+#ifdef SF_NAME_INDEX
+  vol->name_index_valid = 0;
+#endif
+#ifdef SF_SECTOR_MAP
+  vol->map_sectors = 0;
+  fs_memset((uint8_t *)vol->map_free, 0, sizeof(vol->map_free));
+  fs_memset((uint8_t *)vol->map_todel, 0, sizeof(vol->map_todel));
+#endif
 
-  sflash_info.lusect_adr = 0;
+  vol->info.lusect_adr = 0;
   // Scan  Takes on 1M-Flash 12msec, 16M-Flash: 200msec (12 MHz SPI)
-  for (sadr = SF_SECTOR_PH; sadr < sflash_info.total_flash_size; sadr += SF_SECTOR_PH) {
-    sflash_read(sadr, (uint8_t *)&sflash_info.databuf, (mode & FS_START_FAST) ? 4 : 12);
-    switch (sflash_info.databuf.u32[0]) {
+  for (sadr = SF_SECTOR_PH; sadr < vol->info.total_flash_size; sadr += SF_SECTOR_PH) {
+    vol_read(vol, sadr, (uint8_t *)&vol->info.databuf, (mode & FS_START_FAST) ? 4 : 12);
+    switch (vol->info.databuf.u32[0]) {
     case 0xFFFFFFFF:
 #ifdef JSTAT
-      sflash_info.sectors_clear++;
+      vol->info.sectors_clear++;
+#endif
+#ifdef SF_SECTOR_MAP
+      if (sadr / SF_SECTOR_PH < SF_MAP_MAX_SECTORS)
+        SF_MAP_SET(vol->map_free, sadr / SF_SECTOR_PH);
 #endif
       break;
     case SECTOR_MAGIC_TODELETE:
 #ifdef JSTAT
-      sflash_info.sectors_todelete++;
+      vol->info.sectors_todelete++;
+#endif
+#ifdef SF_SECTOR_MAP
+      if (sadr / SF_SECTOR_PH < SF_MAP_MAX_SECTORS)
+        SF_MAP_SET(vol->map_todel, sadr / SF_SECTOR_PH);
 #endif
-      sflash_info.lusect_adr = sadr;
+      vol->info.lusect_adr = sadr;
       break;
 
     case SECTOR_MAGIC_HEAD_ACTIVE:
-      sflash_info.files_active++;
-      sflash_info.lusect_adr = sadr;
+      vol->info.files_active++;
+      vol->info.lusect_adr = sadr;
     case SECTOR_MAGIC_HEAD_DELETED:
-      sflash_info.files_used++;
-      sflash_info.lusect_adr = sadr;
+      vol->info.files_used++;
+      vol->info.lusect_adr = sadr;
 
     case SECTOR_MAGIC_DATA:
-      sflash_info.available_disk_size -= SF_SECTOR_PH;
-      sflash_info.lusect_adr = sadr;
+      vol->info.available_disk_size -= SF_SECTOR_PH;
+      vol->info.lusect_adr = sadr;
       break;
 
     default:
 #ifdef JSTAT
-      sflash_info.sectors_unknown++; // !!! Big Failure
+      vol->info.sectors_unknown++; // !!! Big Failure
 #endif
       err++;
     }
 
     if (!(mode & FS_START_FAST)) {
-      switch (sflash_info.databuf.u32[0]) {
+      switch (vol->info.databuf.u32[0]) {
       case 0xFFFFFFFF:
-        if (sflash_info.databuf.u32[1] != 0xFFFFFFFF || sflash_info.databuf.u32[2] != 0xFFFFFFFF)
+        if (vol->info.databuf.u32[1] != 0xFFFFFFFF || vol->info.databuf.u32[2] != 0xFFFFFFFF)
           err++;
         break;
       case SECTOR_MAGIC_HEAD_ACTIVE:
       case SECTOR_MAGIC_HEAD_DELETED:
-        if (sflash_info.databuf.u32[1] != 0xFFFFFFFF)
+        if (vol->info.databuf.u32[1] != 0xFFFFFFFF)
           err++;
-        if (sflash_sadr_invalid(sflash_info.databuf.u32[2]))
+        if (sflash_sadr_invalid(vol, vol->info.databuf.u32[2]))
           err++;
         break;
       case SECTOR_MAGIC_DATA:
       case SECTOR_MAGIC_TODELETE:
-        idx_adr = sflash_info.databuf.u32[1];
-        if (idx_adr == 0xFFFFFFFF || sflash_sadr_invalid(idx_adr))
+        idx_adr = vol->info.databuf.u32[1];
+        if (idx_adr == 0xFFFFFFFF || sflash_sadr_invalid(vol, idx_adr))
           err++;
-        if (sflash_sadr_invalid(sflash_info.databuf.u32[2]))
+        if (sflash_sadr_invalid(vol, vol->info.databuf.u32[2]))
           err++;
         break;
       }
@@ -395,14 +753,24 @@ int16_t fs_start(uint8_t mode) {
   sadr = HEADER_SIZE_B;
   id = 0;
   while (sadr != SF_SECTOR_PH) {
-    sflash_read(sadr, (uint8_t *)&idx_adr, 4);
+    vol_read(vol, sadr, (uint8_t *)&idx_adr, 4);
     if (idx_adr == 0xFFFFFFFF)
       break;
     else {
-      if (sflash_sadr_invalid(idx_adr))
+      if (sflash_sadr_invalid(vol, idx_adr))
         err++;
       else {
-        sflash_read(idx_adr, (uint8_t *)&dir_typ, 4);
+#ifdef SF_NAME_INDEX
+        // Same transfer, but with the name
+        vol_read(vol, idx_adr, (uint8_t *)&vol->info.databuf, HEADER_SIZE_B + FINFO_SIZE_B);
+        dir_typ = vol->info.databuf.u32[0];
+        if (id < SF_NIDX_ENTRIES) {
+          vol->name_index[id].sect = (uint16_t)(idx_adr / SF_SECTOR_PH);
+          vol->name_index[id].hash = (dir_typ == SECTOR_MAGIC_HEAD_ACTIVE) ? (fs_name_hash((char *)&vol->info.databuf.u8[HEADER_SIZE_B + 12]) | SF_NIDX_ACTIVE) : 0;
+        }
+#else
+        vol_read(vol, idx_adr, (uint8_t *)&dir_typ, 4);
+#endif
         if (dir_typ == SECTOR_MAGIC_HEAD_ACTIVE || dir_typ == SECTOR_MAGIC_HEAD_DELETED)
           id++;
         else
@@ -412,124 +780,335 @@ int16_t fs_start(uint8_t mode) {
     sadr += 4;
   }
 
-  if (err || (uint16_t)id != sflash_info.files_used) {
-    printf("err: %d, id: %d, sflash_info.files_used: %d\r\n", err, id, sflash_info.files_used);
+  if (err || (uint16_t)id != vol->info.files_used) {
+    printf("err: %d, id: %d, vol->info.files_used: %d\r\n", err, id, vol->info.files_used);
     return -107; // Corrupt Data?
   }
+#ifdef SF_NAME_INDEX
+  // Sector numbers are 16 Bit
+  if (vol->info.total_flash_size <= 0x10000 * SF_SECTOR_PH)
+    vol->name_index_valid = 1;
+#endif
+#ifdef SF_SECTOR_MAP
+  if (vol->info.total_flash_size <= SF_MAP_MAX_SECTORS * SF_SECTOR_PH)
+    vol->map_sectors = (uint16_t)(vol->info.total_flash_size / SF_SECTOR_PH);
+#endif
   return 0;      // OK
 }
 
 /* Set Flash to Ultra-Low-Power mode. Call fs_start(FS_RESTART) to continue/wake */
-int16_t fs_deepsleep(void) {
-  if (sflash_info.state_flags & STATE_DEEPSLEEP)
+int16_t fsv_deepsleep(JESFS_VOL *vol) {
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
     return -140; // Already sleeping, 2.nd command could wake FS again
-  sflash_info.state_flags |= (STATE_DEEPSLEEP);
-  sflash_DeepPowerDown();
-  sflash_spi_close(); // Added V1.51
+#ifdef SF_SNAPSHOT
+  if (vol->snap_adr && !vol->snap_valid)
+    fsv_snapshot(vol); // Next cold fs_start() is fast. Not essential, so errors are ignored
+#endif
+  vol->info.state_flags |= (STATE_DEEPSLEEP);
+  vol->dev->sleep(vol->dev->ctx); // Deep power down and interface close (V1.51)
   return 0;
 }
 
+// Write the disk header to the erased index sector and start
+static int16_t fs_format_header(JESFS_VOL *vol) {
+  uint32_t sbuf[3];
+  int16_t res;
+
+  sbuf[0] = HEADER_MAGIC;
+  sbuf[1] = vol->info.identification;
+  sbuf[2] = fs_get_secs(); // Creation Date of Disk is NOW
+
+  res = vol_write(vol, 0, (uint8_t *)sbuf, 12); // Header V1.0
+  if (res)
+    return res;
+  
+  sbuf[0] = 0;
+  sbuf[1] = 0;
+  sbuf[2] = 0;
+  vol_read(vol, 0, (uint8_t *)sbuf, HEADER_SIZE_B);
+  printf("Header: %08X %08X %08X\r\n", sbuf[0], sbuf[1], sbuf[2]);
+  if (sbuf[0] != HEADER_MAGIC || sbuf[1] != vol->info.identification)
+    return -103; // Header not written correctly
+
+  return fsv_start(vol, FS_START_NORMAL);
+}
+
 /* Format Filesystem. May require between 30-240 seconds (even more, see Datasheet) for a 512k-16 MB Flash) (changed in V1.1)
  * Warning: fmode=FS_FORMAT_FULL ('Bulk Erase') might need VERY long on some (larger) Chips (> 240 secs,  which is Default Timeout).
  * Better to use fmode=FS_FORMAT_SOFT (which erases only non-empty 4k sectors). */
-int16_t fs_format(uint8_t fmode) {
+int16_t fsv_format(JESFS_VOL *vol, uint8_t fmode) {
   uint32_t sbuf[3];
   int16_t res;
   uint32_t sadr;
 
-  if (sflash_info.state_flags & STATE_DEEPSLEEP)
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
     return -141;
   if (fmode == FS_FORMAT_SOFT) {
-    for (sadr = 0; sadr < sflash_info.total_flash_size; sadr += SF_SECTOR_PH) {
-      sflash_read(sadr, (uint8_t *)&sbuf, 8); // Read the 8 byte header: Magic and owner (owner for later...)
+    for (sadr = 0; sadr < vol->info.total_flash_size; sadr += SF_SECTOR_PH) {
+      vol_read(vol, sadr, (uint8_t *)&sbuf, 8); // Read the 8 byte header: Magic and owner (owner for later...)
       if (sbuf[0] == 0xFFFFFFFF) {            // Header says: Empty
-        res = sflash_find_mlen(sadr, SF_SECTOR_PH);
+        res = sflash_find_mlen(vol, sadr, SF_SECTOR_PH);
         if (!res)
           continue; // yes.
       }             // else if(sbuf[0]==SECTOR_MAGIC_DATA || sbuf[0]==SECTOR_MAGIC_HEAD_ACTIVE){... // reserved for JesFs V1.2, e.g. keep System Files
-      res = sflash_SectorErase(sadr);
+      res = vol_erase(vol, sadr);
       if (res)
         return res;
     }
   } else if (fmode == FS_FORMAT_FULL) {
-    if (sflash_WaitWriteEnabled())
-      return -102; // Wait enabled until OK, Fehler 1:1
-    sflash_BulkErase();
-    if (sflash_WaitBusy(240000))
-      return -101; //
+    res = vol->dev->erase_all(vol->dev->ctx); // -102: not write enabled, -101: timeout
+    if (res)
+      return res;
   } else
     return -139; // Parameter
 
-  sbuf[0] = HEADER_MAGIC;
-  sbuf[1] = sflash_info.identification;
-  sbuf[2] = fs_get_secs(); // Creation Date of Disk is NOW
+  return fs_format_header(vol);
+}
 
-  res = sflash_SectorWrite(0, (uint8_t *)sbuf, 12); // Header V1.0
-  if (res)
-    return res;
-  
-  sbuf[0] = 0;
-  sbuf[1] = 0;
-  sbuf[2] = 0;
-  sflash_read(0, (uint8_t *)sbuf, HEADER_SIZE_B);
-  printf("Header: %08X %08X %08X\r\n", sbuf[0], sbuf[1], sbuf[2]);
-  if (sbuf[0] != HEADER_MAGIC || sbuf[1] != sflash_info.identification)
-    return -103; // Header not written correctly
+// Sector blank? Checked in chunks of buf_size (pbuf NULL: databuf), first chunk contains the header
+static int16_t fs_sector_blank(JESFS_VOL *vol, uint32_t sadr, uint32_t *pbuf, uint32_t buf_size) {
+  uint32_t rlen, i;
+  uint32_t rest = SF_SECTOR_PH;
+
+  if (!pbuf) {
+    pbuf = vol->info.databuf.u32;
+    buf_size = SF_BUFFER_SIZE_B;
+  }
+  while (rest) {
+    rlen = (buf_size < rest) ? buf_size : rest;
+    vol_read(vol, sadr, (uint8_t *)pbuf, (uint16_t)rlen);
+    for (i = 0; i < rlen / 4; i++) {
+      if (pbuf[i] != 0xFFFFFFFF)
+        return 0;
+    }
+    sadr += rlen;
+    rest -= rlen;
+  }
+  return 1;
+}
+
+// Typ. time to erase the dirty sectors of a 32k half block, one 32k or n 4k erases
+static uint16_t fs_half_cost(uint8_t dirty) {
+  uint16_t cost = 0;
+  while (dirty) {
+    if (dirty & 1)
+      cost += SF_ERASE_4K_MS;
+    dirty >>= 1;
+  }
+  return (cost > SF_ERASE_32K_MS) ? SF_ERASE_32K_MS : cost;
+}
+
+// Erase the dirty sectors (bit i: sector i) of the 32k half block at badr
+static int16_t fs_erase_half(JESFS_VOL *vol, uint32_t badr, uint8_t dirty) {
+  int16_t res;
+  uint8_t i;
+
+  if (!dirty)
+    return 0;
+  if (vol->dev->erase_block && fs_half_cost(dirty) == SF_ERASE_32K_MS && badr + 32768 <= vol->info.total_flash_size) {
+    res = vol->dev->erase_block(vol->dev->ctx, badr, 32768);
+    if (res <= 0)
+      return res; // 1: Not aligned, erase per sector
+  }
+  for (i = 0; i < 8; i++) {
+    if (dirty & (1 << i)) {
+      res = vol_erase(vol, badr + i * SF_SECTOR_PH);
+      if (res)
+        return res;
+    }
+  }
+  return 0;
+}
 
-  return fs_start(FS_START_NORMAL);
+/* Soft format with block erase. All sectors of a 64k block are blank checked in pbuf (buf_size Bytes,
+ * up to 4096 are used. pbuf NULL: internal 128 Bytes), then the dirty sectors are erased with the
+ * fastest combination of 64k, 32k and 4k erases (see SF_ERASE_xx_MS).
+ * Same result as fs_format(FS_FORMAT_SOFT), but much faster on a filled Flash. */
+int16_t fsv_format_fast(JESFS_VOL *vol, uint32_t *pbuf, uint32_t buf_size) {
+  int16_t res;
+  uint32_t badr;
+  uint16_t dirty;
+  uint8_t i;
+
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
+    return -141;
+  buf_size &= ~3;
+  if (pbuf && !buf_size)
+    return -139; // Parameter
+  for (badr = 0; badr < vol->info.total_flash_size; badr += 65536) {
+    dirty = 0;
+    for (i = 0; i < 16 && badr + i * SF_SECTOR_PH < vol->info.total_flash_size; i++) {
+      if (!fs_sector_blank(vol, badr + i * SF_SECTOR_PH, pbuf, buf_size))
+        dirty |= (1 << i);
+    }
+    if (!dirty)
+      continue;
+    if (vol->dev->erase_block && fs_half_cost((uint8_t)dirty) + fs_half_cost((uint8_t)(dirty >> 8)) > SF_ERASE_64K_MS && badr + 65536 <= vol->info.total_flash_size) {
+      res = vol->dev->erase_block(vol->dev->ctx, badr, 65536);
+      if (res < 0)
+        return res;
+      if (!res)
+        continue; // else 1: Not aligned
+    }
+    res = fs_erase_half(vol, badr, (uint8_t)dirty);
+    if (res)
+      return res;
+    res = fs_erase_half(vol, badr + 32768, (uint8_t)(dirty >> 8));
+    if (res)
+      return res;
+  }
+  return fs_format_header(vol);
 }
 
-static uint32_t sflash_get_free_sector(void) {
+static uint32_t sflash_get_free_sector(JESFS_VOL *vol) {
   uint32_t thdr;
   uint32_t max_sect;
+#ifdef SF_SECTOR_MAP
+  uint16_t sect;
+
+  if (vol->map_sectors) {
+    sect = sf_map_next(vol, (uint16_t)(vol->info.lusect_adr / SF_SECTOR_PH));
+    if (!sect)
+      return 0;
+    vol->info.lusect_adr = (uint32_t)sect * SF_SECTOR_PH;
+    if (SF_MAP_TST(vol->map_todel, sect)) {
+      if (vol_erase(vol, vol->info.lusect_adr))
+        return 0;
+      SF_MAP_CLR(vol->map_todel, sect);
+    }
+    SF_MAP_CLR(vol->map_free, sect);
+    return vol->info.lusect_adr;
+  }
+#endif
   // Some embedded compilers complain about the Division. In fact, it will result in a shift. So it might be ignored
-  max_sect = (sflash_info.total_flash_size / SF_SECTOR_PH);
+  max_sect = (vol->info.total_flash_size / SF_SECTOR_PH);
   while (--max_sect) {
-    sflash_info.lusect_adr += SF_SECTOR_PH;
-    if (sflash_info.lusect_adr >= sflash_info.total_flash_size)
-      sflash_info.lusect_adr = SF_SECTOR_PH;
-    sflash_read(sflash_info.lusect_adr, (uint8_t *)&thdr, 4);
+    vol->info.lusect_adr += SF_SECTOR_PH;
+    if (vol->info.lusect_adr >= vol->info.total_flash_size)
+      vol->info.lusect_adr = SF_SECTOR_PH;
+    vol_read(vol, vol->info.lusect_adr, (uint8_t *)&thdr, 4);
 
     if (thdr == SECTOR_MAGIC_TODELETE || thdr == 0xFFFFFFFF) {
       if (thdr == SECTOR_MAGIC_TODELETE) {
-        if (sflash_SectorErase(sflash_info.lusect_adr))
+        if (vol_erase(vol, vol->info.lusect_adr))
           return 0;
       }
-      return sflash_info.lusect_adr;
+      return vol->info.lusect_adr;
     }
   }
   return 0;
 }
 
+#ifdef SF_SECTOR_MAP
+/* Erase to-delete sectors ahead of the allocation, until the next SF_PREERASE_SECTORS
+ * sectors fs_write() will take are erased, or until the next erase would exceed budget_ms.
+ * Returns the number of erased sectors ahead (<0: Error) */
+int16_t fsv_maintenance(JESFS_VOL *vol, uint32_t budget_ms) {
+  int16_t res;
+  uint32_t t0, t;
+  uint16_t sect, first = 0;
+  int16_t ahead = 0;
+
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
+    return -141;
+  if (!vol->map_sectors)
+    return 0;
+  t0 = sflash_get_msec();
+  sect = (uint16_t)(vol->info.lusect_adr / SF_SECTOR_PH);
+  while (ahead < SF_PREERASE_SECTORS) {
+    sect = sf_map_next(vol, sect);
+    if (!sect || sect == first)
+      break; // Wrapped around
+    if (!first)
+      first = sect;
+    if (SF_MAP_TST(vol->map_todel, sect)) {
+      t = sflash_get_msec();
+      if (t - t0 + (vol->erase_ms ? vol->erase_ms : 50) > budget_ms) // 50: not measured yet
+        break;
+      res = vol_erase(vol, (uint32_t)sect * SF_SECTOR_PH);
+      if (res)
+        return res;
+      vol->erase_ms = (uint16_t)(sflash_get_msec() - t);
+      SF_MAP_CLR(vol->map_todel, sect);
+      SF_MAP_SET(vol->map_free, sect);
+    }
+    ahead++;
+  }
+  return ahead;
+}
+#endif
+
+// Sector number in the chain (0: head) and offset in this sector for file position pos.
+// A position on a sector border is kept at the end of the sector before (as fs_read() does at the end)
+static uint16_t fs_pos_to_sector(uint32_t pos, uint16_t *prel) {
+  uint16_t sect;
+
+  if (pos <= SF_SECTOR_PH - HEADER_SIZE_B - FINFO_SIZE_B) {
+    *prel = HEADER_SIZE_B + FINFO_SIZE_B + pos;
+    return 0;
+  }
+  pos -= SF_SECTOR_PH - HEADER_SIZE_B - FINFO_SIZE_B;
+  sect = (uint16_t)((pos - 1) / (SF_SECTOR_PH - HEADER_SIZE_B));
+  *prel = HEADER_SIZE_B + (pos - sect * (SF_SECTOR_PH - HEADER_SIZE_B));
+  return sect + 1;
+}
+
+#ifdef SF_SEEK_CACHE
+// Remember sadr as sector number sect of the chain. Entries are only appended, if the
+// cache is full, every 2nd entry is dropped and only every 2nd sector is kept from now on
+static void fs_chain_note(FS_DESC *pdesc, uint16_t sect, uint32_t sadr) {
+  uint16_t i;
+
+  if (!pdesc->_chain)
+    return;
+  if (pdesc->_chain_cnt == pdesc->_chain_max && (sect >> pdesc->_chain_shift) == pdesc->_chain_max) {
+    for (i = 0; i < (pdesc->_chain_cnt + 1) / 2; i++)
+      pdesc->_chain[i] = pdesc->_chain[i * 2];
+    pdesc->_chain_cnt = i;
+    pdesc->_chain_shift++;
+  }
+  if (sect & ((1 << pdesc->_chain_shift) - 1))
+    return;
+  if ((sect >> pdesc->_chain_shift) != pdesc->_chain_cnt)
+    return;
+  pdesc->_chain[pdesc->_chain_cnt++] = sadr;
+}
+#endif
+
 // --- fs_read() ---
 int32_t fs_read(FS_DESC *pdesc, uint8_t *pdest, uint32_t anz) {
+  JESFS_VOL *vol;
   uint32_t h;
   uint32_t next_sect;
   int32_t total_rd = 0; // max 2GB
   uint16_t max_sec_rd;
   uint16_t uc_mlen;
+#ifdef SF_SEEK_CACHE
+  uint16_t sect, rel;
+#endif
 
-  if (sflash_info.state_flags & STATE_DEEPSLEEP)
-    return -141;
   if (!pdesc->_head_sadr)
     return -117;
+  vol = pdesc->_vol;
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
+    return -141;
   if (!(pdesc->open_flags & (SF_OPEN_READ | SF_OPEN_RAW))) // Warren mod. 17.03.2022
     return -125;
 
   while (anz) {
-    sflash_read(pdesc->_wrk_sadr, (uint8_t *)&sflash_info.databuf, HEADER_SIZE_B + FINFO_SIZE_B);
-    h = sflash_info.databuf.u32[0];
+    vol_read(vol, pdesc->_wrk_sadr, (uint8_t *)&vol->info.databuf, HEADER_SIZE_B + FINFO_SIZE_B);
+    h = vol->info.databuf.u32[0];
     if (h == SECTOR_MAGIC_HEAD_ACTIVE) {
-      if (sflash_info.databuf.u32[1] != 0xFFFFFFFF)
+      if (vol->info.databuf.u32[1] != 0xFFFFFFFF)
         return -128;
     } else if (h == SECTOR_MAGIC_DATA) {
-      if (sflash_info.databuf.u32[1] != pdesc->_head_sadr)
+      if (vol->info.databuf.u32[1] != pdesc->_head_sadr)
         return -122;
     } else
       return -123;
 
-    next_sect = sflash_info.databuf.u32[2];
-    if (sflash_sadr_invalid(next_sect))
+    next_sect = vol->info.databuf.u32[2];
+    if (sflash_sadr_invalid(vol, next_sect))
       return -120;
 
     while (anz) {
@@ -543,7 +1122,7 @@ int32_t fs_read(FS_DESC *pdesc, uint8_t *pdest, uint32_t anz) {
           anz = h;
 
       } else if (next_sect == 0xFFFFFFFF) {
-        uc_mlen = sflash_find_mlen(pdesc->_wrk_sadr + pdesc->_sadr_rel, max_sec_rd);
+        uc_mlen = sflash_find_mlen(vol, pdesc->_wrk_sadr + pdesc->_sadr_rel, max_sec_rd);
         pdesc->file_len = pdesc->file_pos + uc_mlen; // Now we know the End
         if (anz > (uint32_t)uc_mlen)
           anz = uc_mlen;
@@ -557,7 +1136,7 @@ int32_t fs_read(FS_DESC *pdesc, uint8_t *pdest, uint32_t anz) {
       if ((uint32_t)max_sec_rd > anz)
         max_sec_rd = anz;
       if (pdest) {
-        sflash_read(pdesc->_wrk_sadr + pdesc->_sadr_rel, pdest, max_sec_rd);
+        vol_read(vol, pdesc->_wrk_sadr + pdesc->_sadr_rel, pdest, max_sec_rd);
         if (pdesc->open_flags & SF_OPEN_CRC)
           pdesc->file_crc32 = fs_track_crc32(pdest, max_sec_rd, pdesc->file_crc32);
         pdest += max_sec_rd;
@@ -569,6 +1148,10 @@ int32_t fs_read(FS_DESC *pdesc, uint8_t *pdest, uint32_t anz) {
       total_rd += max_sec_rd;
       if (pdesc->_sadr_rel == SF_SECTOR_PH) {
         if (next_sect != 0xFFFFFFFF) {
+#ifdef SF_SEEK_CACHE
+          sect = fs_pos_to_sector(pdesc->file_pos, &rel) + 1;
+          fs_chain_note(pdesc, sect, next_sect);
+#endif
           pdesc->_wrk_sadr = next_sect;
           pdesc->_sadr_rel = HEADER_SIZE_B;
         }
@@ -585,6 +1168,9 @@ int16_t fs_rewind(FS_DESC *pdesc) {
     return -117;
   if (!(pdesc->open_flags & SF_OPEN_WRITE))
     return -118;
+#ifdef SF_WRITE_COMBINE
+  pdesc->_wbuf_len = 0; // Rewritten anyway
+#endif
   pdesc->_wrk_sadr = pdesc->_head_sadr;
   pdesc->file_pos = 0;
   pdesc->_sadr_rel = HEADER_SIZE_B + FINFO_SIZE_B;
@@ -592,31 +1178,145 @@ int16_t fs_rewind(FS_DESC *pdesc) {
   return 0;
 }
 
+/* Set the read position of a file open for READ or RAW, 0..file_len
+ * For unclosed files the position is only checked against the last sector.
+ * The CRC is only tracked for reads starting at 0 */
+int16_t fs_seek(FS_DESC *pdesc, uint32_t pos) {
+  JESFS_VOL *vol;
+  uint32_t sadr;
+  uint32_t next_sect;
+  uint16_t sect, cur, tsect;
+  uint16_t rel, trel;
+#ifdef SF_SEEK_CACHE
+  uint16_t i;
+#endif
+
+  if (!pdesc->_head_sadr)
+    return -117;
+  vol = pdesc->_vol;
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
+    return -141;
+  if (!(pdesc->open_flags & (SF_OPEN_READ | SF_OPEN_RAW)))
+    return -125;
+  if (pdesc->file_len != 0xFFFFFFFF && pos > pdesc->file_len)
+    return -144;
+
+  tsect = fs_pos_to_sector(pos, &trel);
+
+  // Start at the head, the current sector or the nearest cached one
+  sect = 0;
+  sadr = pdesc->_head_sadr;
+  cur = fs_pos_to_sector(pdesc->file_pos, &rel);
+  if (pdesc->_sadr_rel == HEADER_SIZE_B) // fs_read() already stepped over the border
+    cur++;
+  if (cur <= tsect) {
+    sect = cur;
+    sadr = pdesc->_wrk_sadr;
+  }
+#ifdef SF_SEEK_CACHE
+  if (pdesc->_chain_cnt) {
+    i = tsect >> pdesc->_chain_shift;
+    if (i >= pdesc->_chain_cnt)
+      i = pdesc->_chain_cnt - 1;
+    if ((uint16_t)(i << pdesc->_chain_shift) > sect) {
+      sect = i << pdesc->_chain_shift;
+      sadr = pdesc->_chain[i];
+    }
+  }
+#endif
+
+  while (sect < tsect) {
+    vol_read(vol, sadr + 8, (uint8_t *)&next_sect, 4);
+    if (next_sect == 0xFFFFFFFF)
+      return -144;
+    if (sflash_sadr_invalid(vol, next_sect))
+      return -120;
+    sadr = next_sect;
+    sect++;
+#ifdef SF_SEEK_CACHE
+    fs_chain_note(pdesc, sect, sadr);
+#endif
+  }
+
+  pdesc->_wrk_sadr = sadr;
+  pdesc->_sadr_rel = trel;
+  pdesc->file_pos = pos;
+  if (!pos)
+    pdesc->file_crc32 = 0xFFFFFFFF; // Reset CRC
+  return 0;
+}
+
+#ifdef SF_SEEK_CACHE
+/* Attach a buffer of entries (>=2) sector addresses as chain cache to an open file,
+ * NULL detaches it. The buffer is used until the file is closed or reopened */
+int16_t fs_seek_cache(FS_DESC *pdesc, uint32_t *pbuf, uint16_t entries) {
+  if (!pdesc->_head_sadr)
+    return -117;
+  if (pbuf && entries < 2)
+    return -119;
+  pdesc->_chain = pbuf;
+  pdesc->_chain_max = entries;
+  pdesc->_chain_shift = 0;
+  pdesc->_chain_cnt = 0;
+  if (pbuf)
+    pbuf[pdesc->_chain_cnt++] = pdesc->_head_sadr;
+  return 0;
+}
+#endif
+
 /* Open File, if flag OPEN_CREATE is set, it will be generated, if already exists, it will be deleted
  * Flag OPEN_RAW will  not delete existing files, even if OPEN_CREATE is set */
-int16_t fs_open(FS_DESC *pdesc, char *pname, uint8_t flags) {
+int16_t fsv_open(JESFS_VOL *vol, FS_DESC *pdesc, char *pname, uint8_t flags) {
   int16_t res;
   uint16_t i;
   uint32_t sadr = 0;
   uint32_t sfun_adr = 0;
 
-  if (sflash_info.state_flags & STATE_DEEPSLEEP)
+  pdesc->_vol = vol;
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
     return -141;
   pdesc->_head_sadr = 0;
   pdesc->file_crc32 = 0xFFFFFFFF;
-  if (sflash_info.creation_date == 0xFFFFFFFF)
+#ifdef SF_SEEK_CACHE
+  pdesc->_chain = NULL;
+  pdesc->_chain_cnt = 0;
+#endif
+#ifdef SF_WRITE_COMBINE
+  pdesc->_wbuf = NULL;
+  pdesc->_wbuf_len = 0;
+#endif
+  if (vol->info.creation_date == 0xFFFFFFFF)
     return -108; // Disk not formatted
   if (!*pname || fs_strlen(pname) > FNAMELEN)
     return -110;
 
-  for (i = 0; i < sflash_info.files_used; i++) {
-    sflash_read(HEADER_SIZE_B + i * 4, (uint8_t *)&sadr, 4);
-    sflash_read(sadr, (uint8_t *)&sflash_info.databuf, HEADER_SIZE_B + FINFO_SIZE_B);
-    if (sflash_info.databuf.u32[0] == SECTOR_MAGIC_HEAD_DELETED) {
+#ifdef SF_NAME_INDEX
+  if (vol->name_index_valid && !vol->name_index_off) {
+    // Only headers with matching hash are read
+    uint16_t hash = fs_name_hash(pname) | SF_NIDX_ACTIVE;
+    for (i = 0; i < vol->info.files_used; i++) {
+      sadr = (uint32_t)vol->name_index[i].sect * SF_SECTOR_PH;
+      if (!(vol->name_index[i].hash & SF_NIDX_ACTIVE)) {
+        sfun_adr = sadr;
+      } else if (vol->name_index[i].hash == hash) {
+        vol_read(vol, sadr, (uint8_t *)&vol->info.databuf, HEADER_SIZE_B + FINFO_SIZE_B);
+        if (vol->info.databuf.u32[0] != SECTOR_MAGIC_HEAD_ACTIVE)
+          return -114;
+        if (!fs_strcmp(pname, (char *)&vol->info.databuf.u8[HEADER_SIZE_B + 12]))
+          break;
+      }
+      sadr = 0;
+    }
+  } else
+#endif
+  for (i = 0; i < vol->info.files_used; i++) {
+    vol_read(vol, HEADER_SIZE_B + i * 4, (uint8_t *)&sadr, 4);
+    vol_read(vol, sadr, (uint8_t *)&vol->info.databuf, HEADER_SIZE_B + FINFO_SIZE_B);
+    if (vol->info.databuf.u32[0] == SECTOR_MAGIC_HEAD_DELETED) {
       sfun_adr = sadr;
-    } else if (sflash_info.databuf.u32[0] != SECTOR_MAGIC_HEAD_ACTIVE)
+    } else if (vol->info.databuf.u32[0] != SECTOR_MAGIC_HEAD_ACTIVE)
       return -114;
-    else if (!fs_strcmp(pname, (char *)&sflash_info.databuf.u8[HEADER_SIZE_B + 12])) {
+    else if (!fs_strcmp(pname, (char *)&vol->info.databuf.u8[HEADER_SIZE_B + 12])) {
       break;
     }
     sadr = 0;
@@ -630,14 +1330,14 @@ int16_t fs_open(FS_DESC *pdesc, char *pname, uint8_t flags) {
     pdesc->_head_sadr = sadr;
     pdesc->_wrk_sadr = sadr;
     if (flags & (SF_OPEN_READ | SF_OPEN_RAW)) {
-      pdesc->file_len = sflash_info.databuf.u32[HEADER_SIZE_L + 0]; // informative data (only for existing files)
+      pdesc->file_len = vol->info.databuf.u32[HEADER_SIZE_L + 0]; // informative data (only for existing files)
       if (pdesc->file_len == 0xFFFFFFFF)
         pdesc->open_flags |= SF_XOPEN_UNCLOSED;
-      pdesc->open_flags |= (sflash_info.databuf.u8[HEADER_SIZE_B + 34] & (SF_OPEN_EXT_SYNC | _SF_OPEN_RES));
-      pdesc->file_ctime = sflash_info.databuf.u32[HEADER_SIZE_L + 2]; // get file creation time
+      pdesc->open_flags |= (vol->info.databuf.u8[HEADER_SIZE_B + 34] & (SF_OPEN_EXT_SYNC | _SF_OPEN_RES));
+      pdesc->file_ctime = vol->info.databuf.u32[HEADER_SIZE_L + 2]; // get file creation time
       return 0;
     }
-    res = flash_set2delete(sadr);
+    res = flash_set2delete(vol, sadr);
     if (res)
       return res;
     sfun_adr = sadr;
@@ -647,50 +1347,59 @@ int16_t fs_open(FS_DESC *pdesc, char *pname, uint8_t flags) {
   }
 
   if (!sfun_adr) {
-    sfun_adr = sflash_get_free_sector();
+    sfun_adr = sflash_get_free_sector(vol);
     if (!sfun_adr)
       return -113;
-    if (HEADER_SIZE_B + sflash_info.files_used * 4 >= (SF_SECTOR_PH - 4))
+    if (HEADER_SIZE_B + vol->info.files_used * 4 >= (SF_SECTOR_PH - 4))
       return -111;
-    res = sflash_SectorWrite(HEADER_SIZE_B + sflash_info.files_used * 4, (uint8_t *)&sfun_adr, 4);
+    res = vol_write(vol, HEADER_SIZE_B + vol->info.files_used * 4, (uint8_t *)&sfun_adr, 4);
     if (res)
       return res;
-    sflash_info.available_disk_size -= SF_SECTOR_PH;
-    sflash_info.files_used++;
+#ifdef SF_NAME_INDEX
+    vol->name_index[vol->info.files_used].sect = (uint16_t)(sfun_adr / SF_SECTOR_PH);
+    vol->name_index[vol->info.files_used].hash = 0;
+#endif
+    vol->info.available_disk_size -= SF_SECTOR_PH;
+    vol->info.files_used++;
   } else {
-    res = sflash_SectorErase(sfun_adr);
+    res = vol_erase(vol, sfun_adr);
     if (res)
       return res;
   }
 
-  fs_memset((uint8_t *)&sflash_info.databuf, 0xFF, HEADER_SIZE_B + FINFO_SIZE_B);
-  sflash_info.databuf.u32[0] = SECTOR_MAGIC_HEAD_ACTIVE;
-  fs_strncpy((char *)&sflash_info.databuf.u8[HEADER_SIZE_B + 12], pname, FNAMELEN);
+  fs_memset((uint8_t *)&vol->info.databuf, 0xFF, HEADER_SIZE_B + FINFO_SIZE_B);
+  vol->info.databuf.u32[0] = SECTOR_MAGIC_HEAD_ACTIVE;
+  fs_strncpy((char *)&vol->info.databuf.u8[HEADER_SIZE_B + 12], pname, FNAMELEN);
   pdesc->file_ctime = fs_get_secs();
-  sflash_info.databuf.u32[HEADER_SIZE_L + 2] = pdesc->file_ctime;
-  sflash_info.databuf.u8[HEADER_SIZE_B + 34] = flags;
-  res = sflash_SectorWrite(sfun_adr, (uint8_t *)&sflash_info.databuf, HEADER_SIZE_B + FINFO_SIZE_B);
+  vol->info.databuf.u32[HEADER_SIZE_L + 2] = pdesc->file_ctime;
+  vol->info.databuf.u8[HEADER_SIZE_B + 34] = flags;
+  res = vol_write(vol, sfun_adr, (uint8_t *)&vol->info.databuf, HEADER_SIZE_B + FINFO_SIZE_B);
   if (res)
     return res;
 
   pdesc->_head_sadr = sfun_adr;
   pdesc->_wrk_sadr = sfun_adr;
 
-  sflash_info.files_active++;
+#ifdef SF_NAME_INDEX
+  fs_name_index_update(vol, sfun_adr, pname);
+#endif
+  vol->info.files_active++;
   return 0;
 }
 
 /* Write to File */
 int16_t fs_write(FS_DESC *pdesc, uint8_t *pdata, uint32_t len) {
+  JESFS_VOL *vol;
   int16_t res;
   uint32_t maxwrite;
   uint32_t wlen;
   uint32_t newsect;
 
-  if (sflash_info.state_flags & STATE_DEEPSLEEP)
-    return -141;
   if (!pdesc->_head_sadr)
     return -117;
+  vol = pdesc->_vol;
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
+    return -141;
   if (pdesc->open_flags & SF_OPEN_RAW) {
     if (pdesc->file_pos != pdesc->file_len)
       return -130;
@@ -702,60 +1411,131 @@ int16_t fs_write(FS_DESC *pdesc, uint8_t *pdata, uint32_t len) {
     if (maxwrite > SF_SECTOR_PH)
       return -112;
     if (!maxwrite) {
-      newsect = sflash_get_free_sector();
+      newsect = sflash_get_free_sector(vol);
       if (!newsect)
         return -113;
 
-      res = sflash_SectorWrite(pdesc->_wrk_sadr + 8, (uint8_t *)&newsect, 4);
+      res = vol_write(vol, pdesc->_wrk_sadr + 8, (uint8_t *)&newsect, 4);
       if (res)
         return res;
 
       pdesc->_wrk_sadr = newsect;
       pdesc->_sadr_rel = HEADER_SIZE_B;
       maxwrite = SF_SECTOR_PH - HEADER_SIZE_B;
-      sflash_info.databuf.u32[0] = SECTOR_MAGIC_DATA;
-      sflash_info.databuf.u32[1] = pdesc->_head_sadr;
-      res = sflash_SectorWrite(pdesc->_wrk_sadr, (uint8_t *)&sflash_info.databuf, 8);
+      vol->info.databuf.u32[0] = SECTOR_MAGIC_DATA;
+      vol->info.databuf.u32[1] = pdesc->_head_sadr;
+      res = vol_write(vol, pdesc->_wrk_sadr, (uint8_t *)&vol->info.databuf, 8);
       if (res)
         return res;
-      sflash_info.available_disk_size -= SF_SECTOR_PH;
+      vol->info.available_disk_size -= SF_SECTOR_PH;
     }
 
     wlen = len;
     if (wlen > maxwrite)
       wlen = maxwrite;
+#ifdef SF_WRITE_COMBINE
+    if (pdesc->_wbuf) {
+      // Data up to the next page border: buffered. If the buffer is empty, whole pages go directly
+      maxwrite = SF_WBUF_SIZE - (pdesc->_sadr_rel & (SF_WBUF_SIZE - 1));
+      if (pdesc->_wbuf_len || wlen < maxwrite) {
+        if (wlen > maxwrite)
+          wlen = maxwrite;
+        fs_memcpy(pdesc->_wbuf + pdesc->_wbuf_len, pdata, wlen);
+        pdesc->_wbuf_len += wlen;
+        maxwrite = 0; // Flag: buffered
+      } else
+        wlen -= (wlen - maxwrite) & (SF_WBUF_SIZE - 1);
+    }
+    if (pdesc->open_flags & SF_OPEN_CRC)
+      pdesc->file_crc32 = fs_track_crc32(pdata, wlen, pdesc->file_crc32);
+    if (!pdesc->_wbuf || maxwrite) {
+      res = vol_write(vol, pdesc->_wrk_sadr + pdesc->_sadr_rel, pdata, wlen);
+      if (res)
+        return res;
+    }
+#else
     if (pdesc->open_flags & SF_OPEN_CRC)
       pdesc->file_crc32 = fs_track_crc32(pdata, wlen, pdesc->file_crc32);
-    res = sflash_SectorWrite(pdesc->_wrk_sadr + pdesc->_sadr_rel, pdata, wlen);
+    res = vol_write(vol, pdesc->_wrk_sadr + pdesc->_sadr_rel, pdata, wlen);
     if (res)
       return res;
+#endif
     len -= wlen;
     pdata += wlen;
     pdesc->_sadr_rel += wlen;
     pdesc->file_pos += wlen;
     if (pdesc->file_len != 0xFFFFFFFF)
       pdesc->file_len = pdesc->file_pos;
+#ifdef SF_WRITE_COMBINE
+    if (pdesc->_wbuf_len && !(pdesc->_sadr_rel & (SF_WBUF_SIZE - 1))) {
+      res = fs_flush(pdesc); // Page full
+      if (res)
+        return res;
+    }
+#endif
   }
   return 0;
 }
 
+#ifdef SF_WRITE_COMBINE
+/* Attach a buffer of SF_WBUF_SIZE bytes to a file open for writing (NULL: detach).
+ * The buffer is used until the file is closed or reopened */
+int16_t fs_write_buffer(FS_DESC *pdesc, uint8_t *pbuf) {
+  int16_t res;
+
+  res = fs_flush(pdesc);
+  if (res)
+    return res;
+  if (!(pdesc->open_flags & (SF_OPEN_WRITE | SF_OPEN_RAW)))
+    return -118;
+  pdesc->_wbuf = pbuf;
+  return 0;
+}
+
+/* Write buffered data to the Flash */
+int16_t fs_flush(FS_DESC *pdesc) {
+  JESFS_VOL *vol;
+  int16_t res;
+
+  if (!pdesc->_head_sadr)
+    return -117;
+  vol = pdesc->_vol;
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
+    return -141;
+  if (!pdesc->_wbuf_len)
+    return 0;
+  res = vol_write(vol, pdesc->_wrk_sadr + pdesc->_sadr_rel - pdesc->_wbuf_len, pdesc->_wbuf, pdesc->_wbuf_len);
+  if (res)
+    return res;
+  pdesc->_wbuf_len = 0;
+  return 0;
+}
+#endif
+
 int16_t fs_close(FS_DESC *pdesc) {
+  JESFS_VOL *vol;
   int16_t res;
   uint32_t s0adr;
   uint32_t hinfo[2];
 
-  if (sflash_info.state_flags & STATE_DEEPSLEEP)
-    return -141;
   if (!pdesc->_head_sadr)
     return -117;
+  vol = pdesc->_vol;
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
+    return -141;
+#ifdef SF_WRITE_COMBINE
+  res = fs_flush(pdesc);
+  if (res)
+    return res;
+#endif
   s0adr = pdesc->_head_sadr;
   pdesc->_head_sadr = 0; // Invalidate descriptor
   if (pdesc->open_flags & SF_OPEN_WRITE) {
-    if (sflash_sadr_invalid(s0adr))
+    if (sflash_sadr_invalid(vol, s0adr))
       return -120;
     hinfo[0] = pdesc->file_pos;
     hinfo[1] = pdesc->file_crc32;
-    res = sflash_SectorWrite(s0adr + HEADER_SIZE_B + 0, (uint8_t *)hinfo, 8);
+    res = vol_write(vol, s0adr + HEADER_SIZE_B + 0, (uint8_t *)hinfo, 8);
     if (res)
       return res;
   }
@@ -763,26 +1543,30 @@ int16_t fs_close(FS_DESC *pdesc) {
 }
 
 uint32_t fs_get_crc32(FS_DESC *pdesc) {
+  JESFS_VOL *vol;
   uint32_t rd_crc;
 
-  if (sflash_info.state_flags & STATE_DEEPSLEEP)
-    return 0; // Be. values not possible
   if (!pdesc->_head_sadr)
     return 0;
-  sflash_read(pdesc->_head_sadr + HEADER_SIZE_B + 4, (uint8_t *)&rd_crc, 4);
+  vol = pdesc->_vol;
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
+    return 0; // Be. values not possible
+  vol_read(vol, pdesc->_head_sadr + HEADER_SIZE_B + 4, (uint8_t *)&rd_crc, 4);
   return rd_crc;
 }
 
 int16_t fs_delete(FS_DESC *pdesc) {
+  JESFS_VOL *vol;
   int16_t res;
 
-  if (sflash_info.state_flags & STATE_DEEPSLEEP)
-    return -141;
   if (!pdesc->_head_sadr)
     return -117;
+  vol = pdesc->_vol;
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
+    return -141;
   if (pdesc->open_flags & SF_OPEN_WRITE)
     return -125;
-  res = flash_set2delete(pdesc->_head_sadr);
+  res = flash_set2delete(vol, pdesc->_head_sadr);
   if (res)
     return res;
   pdesc->_head_sadr = (uint32_t)0; // No Close!
@@ -792,21 +1576,30 @@ int16_t fs_delete(FS_DESC *pdesc) {
 /* Rename a File. Can also be used to change the File's Management Flags (e.g Hidden, Sync), but not CRC LEN or DATE
  * But always a new name must be used, see docu */
 int16_t fs_rename(FS_DESC *pd_odesc, FS_DESC *pd_ndesc) {
+  JESFS_VOL *vol;
   uint16_t mlen;
   uint32_t thdr[6];
   int16_t res;
 
-  if (sflash_info.state_flags & STATE_DEEPSLEEP)
-    return -141;
   if (!pd_odesc->_head_sadr || !pd_ndesc->_head_sadr)
     return -135;
+  vol = pd_odesc->_vol;
+  if (pd_ndesc->_vol != vol)
+    return -135; // Both files must be on the same volume
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
+    return -141;
   if (pd_ndesc->open_flags & (SF_OPEN_READ | SF_OPEN_RAW))
     return -133;
   if (pd_ndesc->file_len)
     return -134;
+#ifdef SF_WRITE_COMBINE
+  res = fs_flush(pd_odesc); // Data is copied from Flash
+  if (res)
+    return res;
+#endif
 
   if (pd_odesc->file_len == 0xFFFFFFFF)
-    mlen = sflash_find_mlen(pd_odesc->_head_sadr + HEADER_SIZE_B + FINFO_SIZE_B, SF_SECTOR_PH - HEADER_SIZE_B - FINFO_SIZE_B);
+    mlen = sflash_find_mlen(vol, pd_odesc->_head_sadr + HEADER_SIZE_B + FINFO_SIZE_B, SF_SECTOR_PH - HEADER_SIZE_B - FINFO_SIZE_B);
   else if (pd_odesc->file_len > SF_SECTOR_PH - HEADER_SIZE_B - FINFO_SIZE_B)
     mlen = SF_SECTOR_PH - HEADER_SIZE_B - FINFO_SIZE_B;
   else
@@ -814,22 +1607,28 @@ int16_t fs_rename(FS_DESC *pd_odesc, FS_DESC *pd_ndesc) {
 
   thdr[0] = SECTOR_MAGIC_HEAD_ACTIVE;
   thdr[1] = 0xFFFFFFFF;
-  sflash_read(pd_odesc->_head_sadr + 8, (uint8_t *)&thdr[2], 16); // Nx Ln CRC Dt
+  vol_read(vol, pd_odesc->_head_sadr + 8, (uint8_t *)&thdr[2], 16); // Nx Ln CRC Dt
 
-  res = flash_intrasec_copy(pd_odesc->_head_sadr + HEADER_SIZE_B + FINFO_SIZE_B, pd_ndesc->_head_sadr + HEADER_SIZE_B + FINFO_SIZE_B, mlen); // S D
+  res = flash_intrasec_copy(vol, pd_odesc->_head_sadr + HEADER_SIZE_B + FINFO_SIZE_B, pd_ndesc->_head_sadr + HEADER_SIZE_B + FINFO_SIZE_B, mlen); // S D
   if (res)
     return res;
-  res = sflash_SectorErase(pd_odesc->_head_sadr);
+  res = vol_erase(vol, pd_odesc->_head_sadr);
   if (res)
     return res;
-  res = flash_intrasec_copy(pd_ndesc->_head_sadr + HEADER_SIZE_B + 12, pd_odesc->_head_sadr + HEADER_SIZE_B + 12, mlen + FINFO_SIZE_B - 12); // S D
+  res = flash_intrasec_copy(vol, pd_ndesc->_head_sadr + HEADER_SIZE_B + 12, pd_odesc->_head_sadr + HEADER_SIZE_B + 12, mlen + FINFO_SIZE_B - 12); // S D
   if (res)
     return res;
 
-  res = sflash_SectorWrite(pd_odesc->_head_sadr, (uint8_t *)thdr, 24);
+  res = vol_write(vol, pd_odesc->_head_sadr, (uint8_t *)thdr, 24);
   if (res)
     return res;
 
+#ifdef SF_NAME_INDEX
+  vol_read(vol, pd_odesc->_head_sadr + HEADER_SIZE_B + 12, (uint8_t *)&vol->info.databuf, FNAMELEN + 1);
+  vol->info.databuf.u8[FNAMELEN] = 0;
+  fs_name_index_update(vol, pd_odesc->_head_sadr, (char *)&vol->info.databuf);
+#endif
+
   pd_ndesc->open_flags = 0;
   res = fs_delete(pd_ndesc);
   if (res)
@@ -839,25 +1638,25 @@ int16_t fs_rename(FS_DESC *pd_odesc, FS_DESC *pd_ndesc) {
   return 0;
 }
 
-int16_t fs_info(FS_STAT *pstat, uint16_t fno) {
+int16_t fsv_info(JESFS_VOL *vol, FS_STAT *pstat, uint16_t fno) {
   uint32_t sadr, idx_adr;
   int16_t ret;
 
-  if (sflash_info.state_flags & STATE_DEEPSLEEP)
+  if (vol->info.state_flags & STATE_DEEPSLEEP)
     return -141;
   idx_adr = HEADER_SIZE_B + fno * 4;
   if (idx_adr > SF_SECTOR_PH - 4)
     return FS_STAT_INDEX;
-  sflash_read(idx_adr, (uint8_t *)&sadr, 4); // Read Sector, where Index(fno) points to
+  vol_read(vol, idx_adr, (uint8_t *)&sadr, 4); // Read Sector, where Index(fno) points to
   if (sadr == 0xFFFFFFFF)  return 0;  // This Index-Entry is unused
   if( !sadr) return -143; // Index is taboo!
-  if (sadr >= sflash_info.total_flash_size) // Points to outside? Severe Error
+  if (sadr >= vol->info.total_flash_size) // Points to outside? Severe Error
     return -115;
 
-  sflash_read(sadr, (uint8_t *)&sflash_info.databuf, HEADER_SIZE_B + FINFO_SIZE_B);
+  vol_read(vol, sadr, (uint8_t *)&vol->info.databuf, HEADER_SIZE_B + FINFO_SIZE_B);
 
   // Each Index-Entry points to a HEAD: Either ACTIVE or DELETED. All other is an Error
-  switch (sflash_info.databuf.u32[0]) {
+  switch (vol->info.databuf.u32[0]) {
   case SECTOR_MAGIC_HEAD_ACTIVE:
     ret = FS_STAT_ACTIVE;
     break;
@@ -874,11 +1673,11 @@ int16_t fs_info(FS_STAT *pstat, uint16_t fno) {
   }
 
   pstat->_head_sadr = sadr;
-  fs_strncpy(pstat->fname, (char *)&sflash_info.databuf.u8[HEADER_SIZE_B + 12], FNAMELEN);
-  pstat->file_crc32 = sflash_info.databuf.u32[HEADER_SIZE_L + 1];
-  pstat->file_ctime = sflash_info.databuf.u32[HEADER_SIZE_L + 2];
-  pstat->disk_flags = sflash_info.databuf.u8[HEADER_SIZE_B + 34];
-  sadr = sflash_info.databuf.u32[HEADER_SIZE_L];
+  fs_strncpy(pstat->fname, (char *)&vol->info.databuf.u8[HEADER_SIZE_B + 12], FNAMELEN);
+  pstat->file_crc32 = vol->info.databuf.u32[HEADER_SIZE_L + 1];
+  pstat->file_ctime = vol->info.databuf.u32[HEADER_SIZE_L + 2];
+  pstat->disk_flags = vol->info.databuf.u8[HEADER_SIZE_B + 34];
+  sadr = vol->info.databuf.u32[HEADER_SIZE_L];
   if (sadr == 0xFFFFFFFF) { // Unclosed File
     ret |= FS_STAT_UNCLOSED;
     pstat->disk_flags |= SF_XOPEN_UNCLOSED; // informativ
@@ -890,7 +1689,7 @@ int16_t fs_info(FS_STAT *pstat, uint16_t fno) {
 /* Careful Disk Check
  * Returns:  0: No error <0: Critical Error, See JesFS  >0: Non-Critical Errors
  * If cb_printf() <> NULL: Output Diagnostics, pline[line_size) is a temp bffer */
-int16_t fs_check_disk(void cb_printf(char *fmt, ...), uint8_t *pline, uint32_t line_size) {
+int16_t fsv_check_disk(JESFS_VOL *vol, void cb_printf(char *fmt, ...), uint8_t *pline, uint32_t line_size) {
   int16_t res;
   uint16_t i;
   int32_t lres;
@@ -904,24 +1703,24 @@ int16_t fs_check_disk(void cb_printf(char *fmt, ...), uint8_t *pline, uint32_t l
   if (cb_printf)
     cb_printf("Check Disk...\n");
 
-  res = fs_start(FS_START_NORMAL);
+  res = fsv_start(vol, FS_START_NORMAL);
   if (res) {
     if (cb_printf)
       cb_printf("ERROR: Disc Error:%d\n", res); // -107 .. -109
     err++;
   }
 #ifdef JSTAT
-  if (sflash_info.sectors_unknown) {
+  if (vol->info.sectors_unknown) {
     if (cb_printf)
-      cb_printf("ERROR: Unknown Sectors: %d\n", sflash_info.sectors_unknown);
+      cb_printf("ERROR: Unknown Sectors: %d\n", vol->info.sectors_unknown);
     err++;
   }
 #endif
 
   for (i = 0;; i++) {
-    res = fs_info(&lfs_stat, i);
+    res = fsv_info(vol, &lfs_stat, i);
 
-    if (i >= sflash_info.files_used) { 
+    if (i >= vol->info.files_used) { 
       if (res == FS_STAT_INDEX)
         break;
       if (!res)
@@ -941,7 +1740,7 @@ int16_t fs_check_disk(void cb_printf(char *fmt, ...), uint8_t *pline, uint32_t l
 
     if (res & FS_STAT_ACTIVE) {
       if (res & FS_STAT_UNCLOSED) {
-        res = fs_open(&lfs_desc, lfs_stat.fname, SF_OPEN_READ | SF_OPEN_RAW);
+        res = fsv_open(vol, &lfs_desc, lfs_stat.fname, SF_OPEN_READ | SF_OPEN_RAW);
         if (res < 0) {
           if (cb_printf)
             cb_printf("ERROR: Open '%s':%d\n", lfs_stat.fname, res);
@@ -961,14 +1760,14 @@ int16_t fs_check_disk(void cb_printf(char *fmt, ...), uint8_t *pline, uint32_t l
           }
         }
       } else if (lfs_stat.disk_flags & SF_OPEN_CRC) {
-        res = fs_open(&lfs_desc, lfs_stat.fname, SF_OPEN_READ | SF_OPEN_CRC);
+        res = fsv_open(vol, &lfs_desc, lfs_stat.fname, SF_OPEN_READ | SF_OPEN_CRC);
         if (res < 0) {
           if (cb_printf)
             cb_printf("ERROR: Open '%s':%d\n", lfs_stat.fname, res);
           err++;
         } else {
           aval = lfs_stat.file_len;
-          if (aval > sflash_info.total_flash_size) {
+          if (aval > vol->info.total_flash_size) {
             if (cb_printf)
               cb_printf("ERROR: Illegal File Size '%s':%u Bytes\n", lfs_stat.fname, aval);
             err++;
@@ -1002,6 +1801,45 @@ int16_t fs_check_disk(void cb_printf(char *fmt, ...), uint8_t *pline, uint32_t l
   return err;
 }
 
+//------------------- Default volume ------------------------
+// The classic fs_xx() API works on fs_vol0 (the whole sflash_dev)
+int16_t fs_start(uint8_t mode) {
+  return fsv_start(&fs_vol0, mode);
+}
+int16_t fs_deepsleep(void) {
+  return fsv_deepsleep(&fs_vol0);
+}
+int16_t fs_format(uint8_t fmode) {
+  return fsv_format(&fs_vol0, fmode);
+}
+int16_t fs_format_fast(uint32_t *pbuf, uint32_t buf_size) {
+  return fsv_format_fast(&fs_vol0, pbuf, buf_size);
+}
+int16_t fs_open(FS_DESC *pdesc, char *pname, uint8_t flags) {
+  return fsv_open(&fs_vol0, pdesc, pname, flags);
+}
+int16_t fs_info(FS_STAT *pstat, uint16_t fno) {
+  return fsv_info(&fs_vol0, pstat, fno);
+}
+int16_t fs_check_disk(void cb_printf(char *fmt, ...), uint8_t *pline, uint32_t line_size) {
+  return fsv_check_disk(&fs_vol0, cb_printf, pline, line_size);
+}
+#ifdef SF_NAME_INDEX
+void fs_name_index_enable(uint8_t enable) {
+  fsv_name_index_enable(&fs_vol0, enable);
+}
+#endif
+#ifdef SF_SECTOR_MAP
+int16_t fs_maintenance(uint32_t budget_ms) {
+  return fsv_maintenance(&fs_vol0, budget_ms);
+}
+#endif
+#ifdef SF_SNAPSHOT
+int16_t fs_snapshot(void) {
+  return fsv_snapshot(&fs_vol0);
+}
+#endif
+
 //------------------- HighLevel FS OK ------------------------
 
 //----------------------------------------------- JESFS-End ----------------------
@@ -37,6 +37,7 @@ extern "C"{
 #define SECTOR_MAGIC_HEAD_DELETED   0xFFFF2130
 #define SECTOR_MAGIC_DATA           0xFFFF5D5B
 #define SECTOR_MAGIC_TODELETE       0xFFFF4040
+#define SNAP_MAGIC                  0x70616E53   //'Snap' (SF_SNAPSHOT)
 
 // Easy Access B W L
 typedef union{
@@ -47,6 +48,7 @@ typedef union{
 
 //------------------- LowLevel SPI Functions Depending on Hardware! -------
 void sflash_wait_usec(uint32_t usec);
+uint32_t sflash_get_msec(void); // Free running msec counter, only for time budgets
 
 int16_t sflash_spi_init(void);
 void sflash_spi_close(void);
@@ -60,6 +62,7 @@ void sflash_spi_write(const uint8_t *buf, uint16_t len); // len is 16Bit!
 uint32_t fs_strlen(char *s);
 void fs_strncpy(char *d, char *s, uint8_t maxchar);
 void fs_memset(uint8_t *p, uint8_t v, uint32_t n);
+void fs_memcpy(uint8_t *d, uint8_t *s, uint32_t n);
 int16_t fs_strcmp(char *s1, char *s2);
 uint32_t fs_track_crc32(uint8_t *pdata, uint32_t wlen, uint32_t crc_run);
 uint32_t fs_get_secs(void); // Unix-Secs
@@ -67,7 +70,7 @@ uint32_t fs_get_secs(void); // Unix-Secs
 //------------------- MediumLevel SPI Functions ------------------------
 void sflash_bytecmd(uint8_t cmd, uint8_t more);
 uint32_t sflash_QuickScanIdentification(void);
-int16_t sflash_interpret_id(uint32_t id);
+int16_t sflash_interpret_id(uint32_t id, uint32_t *psize);
 void sflash_DeepPowerDown(void);
 void sflash_ReleaseFromDeepPowerDown(void);
 void sflash_read(uint32_t sadr, uint8_t* sbuf, uint16_t len);
@@ -80,6 +83,8 @@ int16_t sflash_WaitBusy(uint32_t msec);
 int16_t sflash_WaitWriteEnabled(void);
 int16_t sflash_SectorWrite(uint32_t sflash_adr, uint8_t* sbuf, uint32_t len);
 int16_t sflash_SectorErase(uint32_t sadr); // High-Level
+void sflash_llBlockErase(uint32_t sadr, uint32_t len); // LowLevel, 32k or 64k
+int16_t sflash_BlockErase(uint32_t sadr, uint32_t len); // High-Level
 #ifdef __cplusplus
 }
 #endif
@@ -20,7 +20,18 @@
 #include "w25qxx.h"
 #include "delay.h"
 
-SFLASH_INFO sflash_info; // Describes the Flash
+#ifdef SF_PIPELINE_WRITE
+static uint8_t sflash_busy_pending = 0; // Page program started, busy not yet checked
+
+// Before the next command: wait for a page program sflash_SectorWrite() did not wait for
+static int16_t sflash_sync(void)
+{
+    if (!sflash_busy_pending)
+        return 0;
+    sflash_busy_pending = 0;
+    return sflash_WaitBusy(100);
+}
+#endif
 
 //------------------- MediumLevel SPI Start ------------------------
 //* Send SPUI Singlebyte-Command. More might follow
@@ -42,6 +53,9 @@ void sflash_bytecmd(uint8_t cmd, uint8_t more)
 uint32_t sflash_QuickScanIdentification(void)
 {
     uint32_t id;
+#ifdef SF_PIPELINE_WRITE
+    sflash_sync();
+#endif
 #ifndef __W25QXX_H
     uint8_t buf[3];
     sflash_bytecmd(CMD_RDID, 1); // More
@@ -54,21 +68,21 @@ uint32_t sflash_QuickScanIdentification(void)
     id <<= 8;     // Type
     id |= buf[2]; // Density
 #else
+    uint8_t h;
     id = W25QXX_ReadID();
     id <<= 8;
-    id |= 0x0019;
+    for (h = 0; (1UL << h) < W25QXX_Geo.size; h++)
+        ;
+    id |= h; // Density from the SFDP geometry
 #endif
     return id;
 }
 
-/* Analyse ID of the flash */
-int16_t sflash_interpret_id(uint32_t id)
+/* Analyse ID of the flash, size in *psize */
+int16_t sflash_interpret_id(uint32_t id, uint32_t *psize)
 {
     uint8_t h;
-    sflash_info.total_flash_size = 0;
 
-    // Keep Flash-ID for optional Analysis
-    sflash_info.identification = id;
     switch (id >> 8) { // Check Without Density
     default:
         return -104; // Unknown Type (!!: e.g. Micron has otherTypes th. Macronix, but identical Fkts (Quiescent Current for Macronix is the lowest..)
@@ -88,7 +102,7 @@ int16_t sflash_interpret_id(uint32_t id)
                   // if (h < MIN_DENSITY || h > MAX_DENSITY)
                   //     return -103; // Unknown Density! 8*512kB-8*16MB ist OK
 #endif
-    sflash_info.total_flash_size = 1 << (h); // All OK for JesFs: 8k-16MB OK fuer 3B-SPI Flash, opt.
+    *psize = 1UL << (h); // All OK for JesFs: 8k-16MB OK fuer 3B-SPI Flash, opt.
     return 0;                                // OK
 }
 
@@ -97,6 +111,9 @@ int16_t sflash_interpret_id(uint32_t id)
 #define CMD_DEEPPOWERDOWN 0xB9
 void sflash_DeepPowerDown(void)
 {
+#ifdef SF_PIPELINE_WRITE
+    sflash_sync();
+#endif
 #ifndef __W25QXX_H
     sflash_bytecmd(CMD_DEEPPOWERDOWN, 0); // NoMore
 #else
@@ -125,6 +142,9 @@ void sflash_ReleaseFromDeepPowerDown(void)
 #define CMD_READDATA 0x03
 void sflash_read(uint32_t sadr, uint8_t *sbuf, uint16_t len)
 {
+#ifdef SF_PIPELINE_WRITE
+    sflash_sync();
+#endif
 #ifndef __W25QXX_H
     uint8_t buf[4];
     buf[0] = CMD_READDATA;
@@ -184,7 +204,7 @@ void sflash_PageWrite(uint32_t sadr, uint8_t *sbuf, uint16_t len)
     sflash_spi_write(sbuf, len);
     sflash_deselect();
 #else
-    return;
+    W25QXX_Write_Page(sbuf, sadr, len);
 #endif
 }
 
@@ -220,7 +240,28 @@ void sflash_llSectorErase4k(uint32_t sadr)
     sflash_spi_write(buf, 4);
     sflash_deselect();
 #else
-    W25QXX_Erase_Sector(sadr);
+    W25QXX_Erase_Sector(sadr / SF_SECTOR_PH); // Takes the sector number
+#endif
+}
+
+/* Block Erase 32k (0x52) or 64k (0xD8), sadr aligned to the block size
+ * W25Q256: 120/150 typ, 1600/2000 max msec
+ */
+#define CMD_BLOCK32K_ERASE 0x52
+#define CMD_BLOCK64K_ERASE 0xD8
+void sflash_llBlockErase(uint32_t sadr, uint32_t len)
+{
+#ifndef __W25QXX_H
+    uint8_t buf[4]; //
+    buf[0] = (len == 32768) ? CMD_BLOCK32K_ERASE : CMD_BLOCK64K_ERASE;
+    buf[1] = (uint8_t)(sadr >> 16);
+    buf[2] = (uint8_t)(sadr >> 8);
+    buf[3] = (uint8_t)(sadr);
+    sflash_select();
+    sflash_spi_write(buf, 4);
+    sflash_deselect();
+#else
+    W25QXX_Erase(sadr, len); // Opcode from the SFDP geometry
 #endif
 }
 
@@ -244,6 +285,10 @@ int16_t sflash_WaitBusy(uint32_t msec)
 int16_t sflash_WaitWriteEnabled(void)
 {
     // if(m_voltage()< MIN_VDD_SFLASH) return -1;  // Voltage too low! Systemabhaengig
+#ifdef SF_PIPELINE_WRITE
+    if (sflash_sync())
+        return -101;
+#endif
 #ifndef __W25QXX_H
     sflash_WriteEnable();
     if (sflash_ReadStatusReg() & 2)
@@ -273,16 +318,22 @@ void sflash_wait_usec(uint32_t usec)
     delay_us(usec);
 }
 
-/* Write Sector up to maximum. Write in Pages. Attention: Pageprog keeps the SFlash busy for a few mesec. Theoretically
- * the check yould be retarded for better performance, but thie makes the software more difficult. Maybe in a later version.
+/* HAL_GetTick() does not run without the scheduler */
+uint32_t sflash_get_msec(void)
+{
+    return delay_get_ms();
+}
+
+/* Write Sector up to maximum. Write in Pages. Attention: Pageprog keeps the SFlash busy for a few mesec.
+ * With SF_PIPELINE_WRITE the busy check is retarded until the next command (see sflash_sync()), so the
+ * caller can prepare the next data while the last page is programmed.
+ * Only erased (or bitwise cleared) areas are written, so the W25QXX driver is used without its
+ * read-verify-erase W25QXX_Write()
  */
 int16_t sflash_SectorWrite(uint32_t sflash_adr, uint8_t *sbuf, uint32_t len)
 {
-#ifndef __W25QXX_H
     uint32_t maxwrite;
 
-    if (sflash_adr >= sflash_info.total_flash_size)
-        return -105; // Flash Full! Illegal Address
     maxwrite = SF_SECTOR_PH - (sflash_adr & (SF_SECTOR_PH - 1));
     if (len > maxwrite)
         return -106; // Sektorviolation
@@ -298,26 +349,162 @@ int16_t sflash_SectorWrite(uint32_t sflash_adr, uint8_t *sbuf, uint32_t len)
         if (sflash_WaitWriteEnabled())
             return -102; // Wait unt. OK, Fehler 1:1
         sflash_PageWrite(sflash_adr, sbuf, maxwrite);
+#ifdef SF_PIPELINE_WRITE
+        sflash_busy_pending = 1;
+#else
         if (sflash_WaitBusy(100))
             return -101; // 100 msec unt. Page OK
+#endif
         sbuf += maxwrite;
         sflash_adr += maxwrite;
         len -= maxwrite;
     }
-#else
-    W25QXX_Write(sbuf, sflash_adr, len);
-#endif
     return 0; // Alles OK
 }
 
 // HighLevel SectorErase (inc. Error Check and
+// With SF_PIPELINE_WRITE on the W25QXX the erase runs in the background: the next command waits
+// for it, but reads of other sectors suspend it (W25QXX_Suspend)
 int16_t sflash_SectorErase(uint32_t sadr)
 {
     if (sflash_WaitWriteEnabled())
         return -102;
+#if defined(__W25QXX_H) && defined(SF_PIPELINE_WRITE)
+    W25QXX_Erase_Sector_Start(sadr / SF_SECTOR_PH);
+#else
     sflash_llSectorErase4k(sadr);
     if (sflash_WaitBusy(400))
         return -101; // 400 msec max page
+#endif
+    return 0;
+}
+
+// HighLevel BlockErase, len 32k or 64k
+int16_t sflash_BlockErase(uint32_t sadr, uint32_t len)
+{
+    if (sflash_WaitWriteEnabled())
+        return -102;
+    sflash_llBlockErase(sadr, len);
+    if (sflash_WaitBusy(2000))
+        return -101; // 2 secs max 64k block
+    return 0;
+}
+
+//------------------- Device ops (JESFS_DEV) ------------------------
+// ctx is a JESFS_PART (addresses relative to its base) or NULL for the whole Flash
+#define SF_PART_BASE(ctx) ((ctx) ? ((JESFS_PART *)(ctx))->base : 0)
+
+static int16_t sflash_dev_wakeup(void *ctx)
+{
+    int16_t res;
+
+    res = sflash_spi_init();
+    if (res)
+        return res;
+    sflash_ReleaseFromDeepPowerDown();
+    sflash_wait_usec(45);
+    return 0;
+}
+
+static void sflash_dev_sleep(void *ctx)
+{
+    if (ctx)
+        return; // Other partitions of the Flash may still be in use
+    sflash_DeepPowerDown();
+    sflash_spi_close();
+}
+
+static uint32_t sflash_dev_identify(void *ctx)
+{
+    return sflash_QuickScanIdentification();
+}
+
+static int16_t sflash_dev_size(void *ctx, uint32_t id, uint32_t *psize)
+{
+    JESFS_PART *part = (JESFS_PART *)ctx;
+    uint32_t chip_size;
+    int16_t res;
+
+    res = sflash_interpret_id(id, &chip_size);
+    if (res)
+        return res;
+    if (!part) {
+        *psize = chip_size;
+        return 0;
+    }
+    if ((part->base | part->size) & (SF_SECTOR_PH - 1))
+        return -105;
+    if (part->size < 2 * SF_SECTOR_PH || part->base > chip_size || part->size > chip_size - part->base)
+        return -105; // Partition not on this Flash
+    *psize = part->size;
     return 0;
 }
+
+static void sflash_dev_read(void *ctx, uint32_t sadr, uint8_t *sbuf, uint16_t len)
+{
+    sflash_read(SF_PART_BASE(ctx) + sadr, sbuf, len);
+}
+
+static int16_t sflash_dev_write(void *ctx, uint32_t sadr, uint8_t *sbuf, uint32_t len)
+{
+    return sflash_SectorWrite(SF_PART_BASE(ctx) + sadr, sbuf, len);
+}
+
+static int16_t sflash_dev_erase(void *ctx, uint32_t sadr)
+{
+    return sflash_SectorErase(SF_PART_BASE(ctx) + sadr);
+}
+
+static int16_t sflash_dev_erase_block(void *ctx, uint32_t sadr, uint32_t len)
+{
+    sadr += SF_PART_BASE(ctx);
+    if (sadr & (len - 1))
+        return 1; // Partition not aligned: not possible here
+#ifdef __W25QXX_H
+    if (!W25QXX_Erase_Type(len))
+        return 1; // No erase of this size on this Flash
+#endif
+    return sflash_BlockErase(sadr, len);
+}
+
+static int16_t sflash_dev_erase_all(void *ctx)
+{
+    JESFS_PART *part = (JESFS_PART *)ctx;
+    uint32_t sadr;
+    int16_t res;
+
+    if (!part) {
+        if (sflash_WaitWriteEnabled())
+            return -102; // Wait enabled until OK, Fehler 1:1
+        sflash_BulkErase();
+        if (sflash_WaitBusy(240000))
+            return -101; // 240 secs for the whole chip
+        return 0;
+    }
+    for (sadr = 0; sadr < part->size; sadr += SF_SECTOR_PH) {
+        res = sflash_SectorErase(part->base + sadr);
+        if (res)
+            return res;
+    }
+    return 0;
+}
+
+const JESFS_DEV sflash_dev = {
+    sflash_dev_wakeup,
+    sflash_dev_sleep,
+    sflash_dev_identify,
+    sflash_dev_size,
+    sflash_dev_read,
+    sflash_dev_write,
+    sflash_dev_erase,
+    sflash_dev_erase_block,
+    sflash_dev_erase_all,
+    NULL};
+
+/* Device for a partition of the SPI Flash, part must stay valid while in use */
+void sflash_dev_part(JESFS_DEV *pdev, JESFS_PART *part)
+{
+    *pdev = sflash_dev;
+    pdev->ctx = part;
+}
 //------------------- MediumLevel SPI OK ------------------------
@@ -21,19 +21,22 @@
 #include "delay.h"
 #include "lfs.h"
 #include "nfvfs.h"
-#include "w25qxx.h"
+#include "nordev.h"
 
 lfs_t lfs;
 
+/* device of the next mount */
+static NORDEV *lfs_dev = &NORDEV_W25QXX;
+
 int W25Qxx_readlfs(const struct lfs_config *c, lfs_block_t block,
                         lfs_off_t off, void *buffer, lfs_size_t size)
 {
-    if (block >= W25Q256_NUM_GRAN) // error
+    if (block >= c->block_count) // error
     {
         return LFS_ERR_IO;
     }
 
-    W25QXX_Read(buffer, block * W25Q256_ERASE_GRAN + off, size);
+    NORDEV_Read(c->context, block * c->block_size + off, buffer, size);
 
     return LFS_ERR_OK;
 }
@@ -41,33 +44,35 @@ int W25Qxx_readlfs(const struct lfs_config *c, lfs_block_t block,
 int W25Qxx_writelfs(const struct lfs_config *c, lfs_block_t block,
                          lfs_off_t off, void *buffer, lfs_size_t size)
 {
-    if (block >= W25Q256_NUM_GRAN) // error
+    if (block >= c->block_count) // error
     {
         return LFS_ERR_IO;
     }
 
-    W25QXX_Write(buffer, block * W25Q256_ERASE_GRAN + off, size);
+    NORDEV_Prog(c->context, block * c->block_size + off, buffer, size);
 
     return LFS_ERR_OK;
 }
 
 int W25Qxx_eraselfs(const struct lfs_config *c, lfs_block_t block)
 {
-    if (block >= W25Q256_NUM_GRAN) // error
+    if (block >= c->block_count) // error
     {
         return LFS_ERR_IO;
     }
 
-    W25QXX_Erase_Sector(block);
+    NORDEV_Erase(c->context, block * c->block_size, c->block_size);
     return LFS_ERR_OK;
 }
 
 int W25Qxx_synclfs(const struct lfs_config *c)
 {
+    /* the last page program may still be running in pipeline mode */
+    NORDEV_Sync(c->context);
     return LFS_ERR_OK;
 }
 
-const struct lfs_config lfs_cfg = {
+struct lfs_config lfs_cfg = {
     // block device operations
     .read = W25Qxx_readlfs,
     .prog = W25Qxx_writelfs,
@@ -77,8 +82,9 @@ const struct lfs_config lfs_cfg = {
     // block device configuration
     .read_size = 256,
     .prog_size = 256,
-    .block_size = W25Q256_ERASE_GRAN,
-    .block_count = W25Q256_NUM_GRAN,
+    // context, block_size and block_count are set from the device at mount
+    .block_size = 4096,
+    .block_count = 0,
     .cache_size = 512,
     .lookahead_size = 512,
     .block_cycles = 500,
@@ -89,6 +95,11 @@ int lfs_mount_wrp()
     int err = -1;
     int tries = 0;
 
+    /* erase unit of the device as block, littlefs wants many small blocks */
+    lfs_cfg.context = lfs_dev;
+    lfs_cfg.block_size = lfs_dev->erase_size;
+    lfs_cfg.block_count = lfs_dev->size / lfs_cfg.block_size;
+
     err = lfs_mount(&lfs, &lfs_cfg);
     while (err) {
         lfs_format(&lfs, &lfs_cfg);
@@ -109,6 +120,16 @@ int lfs_unmount_wrp()
     return lfs_unmount(&lfs);
 }
 
+int lfs_set_device(NORDEV *dev)
+{
+    if (dev->erase_size < lfs_cfg.cache_size || dev->erase_size % lfs_cfg.cache_size) {
+        printf("%s: erase size %d does not fit the cache\r\n", __func__, dev->erase_size);
+        return -1;
+    }
+    lfs_dev = dev;
+    return 0;
+}
+
 int lfs_open_wrp(const char *path, int flags, int mode, struct nfvfs_context *context)
 {
     struct lfs_file *file;
@@ -183,6 +204,46 @@ int lfs_write_wrp(int fd, void *buf, uint32_t size)
     }
 }
 
+/* the pieces go to the file cache of littlefs, which programs them together */
+int lfs_readv_wrp(int fd, const struct nfvfs_iovec *iov, int iovcnt)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    int ret, done = 0, i;
+
+    if (entry == NULL || !S_IFREG(entry->mode)) {
+        return -1;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        ret = lfs_file_read(&lfs, (lfs_file_t *)entry->f, iov[i].iov_base, iov[i].iov_len);
+        if (ret < 0) {
+            return done ? done : ret;
+        }
+        done += ret;
+        if (ret < iov[i].iov_len) {
+            break;
+        }
+    }
+    return done;
+}
+
+int lfs_writev_wrp(int fd, const struct nfvfs_iovec *iov, int iovcnt)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    int ret, done = 0, i;
+
+    if (entry == NULL || !S_IFREG(entry->mode)) {
+        return -1;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        ret = lfs_file_write(&lfs, (lfs_file_t *)entry->f, iov[i].iov_base, iov[i].iov_len);
+        if (ret < 0) {
+            return done ? done : ret;
+        }
+        done += ret;
+    }
+    return done;
+}
+
 int lfs_lseek_wrp(int fd, uint32_t offset, int whence)
 {
     struct nfvfs_fentry *entry = ftable_get_entry(fd);
@@ -220,5 +281,7 @@ struct nfvfs_operations lfs_ops = {
     .close = lfs_close_wrp,
     .read = lfs_read_wrp,
     .write = lfs_write_wrp,
+    .readv = lfs_readv_wrp,
+    .writev = lfs_writev_wrp,
     .lseek = lfs_lseek_wrp,
 };
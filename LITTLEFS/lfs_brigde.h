@@ -18,6 +18,11 @@
 #ifndef __LFS_BRIGDE_H
 #define __LFS_BRIGDE_H
 
+#include "nordev.h"
+
 extern struct nfvfs_operations lfs_ops;
 
+/* Device for the next mount, default NORDEV_W25QXX */
+int lfs_set_device(NORDEV *dev);
+
 #endif /* __LFS_BRIGDE_H */
@@ -0,0 +1,678 @@
+/**
+ * Copyright (C) 2022 Deadpool, Hao Huang
+ *
+ * This file is part of NORENV.
+ *
+ * NORENV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * NORENV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with NORENV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "FreeRTOS.h"
+#include "ramfs_brigde.h"
+#include "nfvfs.h"
+#include "string.h"
+#include "stdio.h"
+
+struct ramfs_file {
+    uint16_t ino;
+    uint16_t next;                      /* readdir: next entry */
+    uint32_t pos;
+    int flags;
+};
+
+static struct ramfs_super *const ramfs = (struct ramfs_super *)RAMFS_BASE;
+static uint8_t *const ramfs_data = (uint8_t *)(RAMFS_BASE + RAMFS_META);
+static uint8_t ramfs_formatted;         /* cleared at reset, the SDRAM is not */
+static uint8_t ramfs_mounted;
+
+/* snapshot device */
+static NORDEV *ramfs_dev;
+
+#define RAMFS_USED(b)  (ramfs->bitmap[(b) / 32] & (1u << ((b) % 32)))
+
+static uint32_t ramfs_hash(uint16_t parent, const char *name, uint32_t len)
+{
+    uint32_t h = 2166136261u ^ parent;
+    uint32_t i;
+
+    for (i = 0; i < len; i++)
+        h = (h ^ (uint8_t)name[i]) * 16777619u;
+    return h & (RAMFS_HASH - 1);
+}
+
+static void ramfs_format(void)
+{
+    struct ramfs_inode *root = &ramfs->inode[0];
+    uint32_t i;
+
+    memset(ramfs, 0, sizeof(*ramfs));
+    memset(ramfs->hash, 0xFF, sizeof(ramfs->hash));
+    ramfs->magic = RAMFS_MAGIC;
+    ramfs->free_blocks = RAMFS_BLOCKS;
+    for (i = 0; i < RAMFS_INODES; i++) {
+        ramfs->inode[i].hash_next = RAMFS_NONE;
+        ramfs->inode[i].child = RAMFS_NONE;
+        ramfs->inode[i].sibling = RAMFS_NONE;
+    }
+    root->type = RAMFS_DIR;
+    root->parent = 0;
+}
+
+static int ramfs_restore(void)
+{
+    struct ramfs_snap_header hdr;
+    uint32_t addr, b, n = 0;
+
+    NORDEV_Read(ramfs_dev, 0, (u8 *)&hdr, sizeof(hdr));
+    if (hdr.magic != RAMFS_SNAP_MAGIC || hdr.super_size != sizeof(struct ramfs_super) ||
+        hdr.block_size != RAMFS_BLOCK || hdr.blocks > RAMFS_BLOCKS ||
+        RAMFS_SNAP_SUPER + sizeof(struct ramfs_super) + hdr.blocks * RAMFS_BLOCK > ramfs_dev->size) {
+        return -1;
+    }
+    NORDEV_Read(ramfs_dev, RAMFS_SNAP_SUPER, (u8 *)ramfs, sizeof(struct ramfs_super));
+    if (ramfs->magic != RAMFS_MAGIC || ramfs->free_blocks != RAMFS_BLOCKS - hdr.blocks) {
+        ramfs_format();
+        return -1;
+    }
+    addr = RAMFS_SNAP_SUPER + sizeof(struct ramfs_super);
+    for (b = 0; b < RAMFS_BLOCKS && n < hdr.blocks; b++) {
+        if (!RAMFS_USED(b))
+            continue;
+        NORDEV_Read(ramfs_dev, addr, ramfs_data + b * RAMFS_BLOCK, RAMFS_BLOCK);
+        addr += RAMFS_BLOCK;
+        n++;
+    }
+    for (b = 0; b < RAMFS_INODES; b++)
+        ramfs->inode[b].opens = 0;
+    return 0;
+}
+
+int ramfs_mount_wrp()
+{
+    if (!ramfs_formatted) {
+        if (!ramfs_dev || ramfs_restore() < 0)
+            ramfs_format();
+        else
+            printf("%s: snapshot restored, %d blocks free\r\n", __func__, ramfs->free_blocks);
+        ramfs_formatted = 1;
+    }
+    ramfs_mounted = 1;
+    return 0;
+}
+
+int ramfs_unmount_wrp()
+{
+    ramfs_mounted = 0;
+    return 0;
+}
+
+int ramfs_set_device(NORDEV *dev)
+{
+    if (dev && dev->size < RAMFS_SNAP_SUPER + sizeof(struct ramfs_super)) {
+        printf("%s: device of %d bytes too small\r\n", __func__, dev->size);
+        return -1;
+    }
+    ramfs_dev = dev;
+    return 0;
+}
+
+/* the last kb KB of a chip, from USMART before the first mount */
+int ramfs_set_snapshot(int dev, int kb)
+{
+    static NORDEV_PART part;
+    NORDEV *chip;
+
+    switch (dev) {
+    case RAMFS_SNAP_NONE:
+        return ramfs_set_device(NULL);
+    case RAMFS_SNAP_W25QXX:
+        chip = &NORDEV_W25QXX;
+        break;
+#ifdef NORDEV_QSPI
+    case RAMFS_SNAP_NORFLASH:
+        chip = &NORDEV_Norflash;
+        break;
+#endif
+    default:
+        printf("%s: no device %d\r\n", __func__, dev);
+        return -1;
+    }
+    if (kb <= 0 || NORDEV_Part_Init(&part, chip, chip->size - kb * 1024, kb * 1024) < 0) {
+        printf("%s: %d KB do not fit the %d KB chip in erase units\r\n", __func__, kb, chip->size / 1024);
+        return -1;
+    }
+    return ramfs_set_device(&part.dev);
+}
+
+int ramfs_snapshot(void)
+{
+    struct ramfs_snap_header hdr;
+    uint32_t size, addr, b;
+
+    if (!ramfs_dev) {
+        printf("%s: no device\r\n", __func__);
+        return -1;
+    }
+    if (!ramfs_formatted) {
+        printf("%s: not mounted yet\r\n", __func__);
+        return -1;
+    }
+    hdr.magic = RAMFS_SNAP_MAGIC;
+    hdr.super_size = sizeof(struct ramfs_super);
+    hdr.block_size = RAMFS_BLOCK;
+    hdr.blocks = RAMFS_BLOCKS - ramfs->free_blocks;
+    size = RAMFS_SNAP_SUPER + sizeof(struct ramfs_super) + hdr.blocks * RAMFS_BLOCK;
+    if (size > ramfs_dev->size) {
+        printf("%s: %d bytes do not fit the device\r\n", __func__, size);
+        return -1;
+    }
+
+    NORDEV_Erase(ramfs_dev, 0, (size + ramfs_dev->erase_size - 1) / ramfs_dev->erase_size * ramfs_dev->erase_size);
+    NORDEV_Prog(ramfs_dev, RAMFS_SNAP_SUPER, (u8 *)ramfs, sizeof(struct ramfs_super));
+    addr = RAMFS_SNAP_SUPER + sizeof(struct ramfs_super);
+    for (b = 0; b < RAMFS_BLOCKS; b++) {
+        if (!RAMFS_USED(b))
+            continue;
+        NORDEV_Prog(ramfs_dev, addr, ramfs_data + b * RAMFS_BLOCK, RAMFS_BLOCK);
+        addr += RAMFS_BLOCK;
+    }
+    /* a snapshot cut short has no header */
+    NORDEV_Prog(ramfs_dev, 0, (u8 *)&hdr, sizeof(hdr));
+    NORDEV_Sync(ramfs_dev);
+    return 0;
+}
+
+void ramfs_info(void)
+{
+    uint32_t i, files = 0, dirs = 0, bytes = 0;
+
+    if (!ramfs_formatted) {
+        printf("%s: not mounted yet\r\n", __func__);
+        return;
+    }
+    for (i = 0; i < RAMFS_INODES; i++) {
+        if (ramfs->inode[i].type == RAMFS_FILE) {
+            files++;
+            bytes += ramfs->inode[i].size;
+        } else if (ramfs->inode[i].type == RAMFS_DIR) {
+            dirs++;
+        }
+    }
+    printf("ramfs at %08X: %d files (%d bytes), %d directories, %d of %d blocks of %d bytes free\r\n",
+           RAMFS_BASE, files, bytes, dirs, ramfs->free_blocks, RAMFS_BLOCKS, RAMFS_BLOCK);
+}
+
+static uint16_t ramfs_lookup(uint16_t parent, const char *name, uint32_t len)
+{
+    uint16_t i;
+
+    if (len >= RAMFS_NAME_LEN)
+        return RAMFS_NONE;
+    i = ramfs->hash[ramfs_hash(parent, name, len)];
+    while (i != RAMFS_NONE) {
+        struct ramfs_inode *inode = &ramfs->inode[i];
+        if (inode->parent == parent && strncmp(inode->name, name, len) == 0 && inode->name[len] == 0)
+            return i;
+        i = inode->hash_next;
+    }
+    return RAMFS_NONE;
+}
+
+/* inode of path, or of its directory with *name, *len the last component */
+static uint16_t ramfs_walk(const char *path, int want_parent, const char **name, uint32_t *len)
+{
+    uint16_t ino = 0, next;
+    const char *end;
+    uint32_t n;
+
+    while (*path == '/')
+        path++;
+    while (*path) {
+        for (end = path; *end && *end != '/'; end++)
+            ;
+        n = end - path;
+        while (*end == '/')
+            end++;
+        if (want_parent && *end == 0) {
+            *name = path;
+            *len = n;
+            return ino;
+        }
+        if (ramfs->inode[ino].type != RAMFS_DIR)
+            return RAMFS_NONE;
+        next = ramfs_lookup(ino, path, n);
+        if (next == RAMFS_NONE)
+            return RAMFS_NONE;
+        ino = next;
+        path = end;
+    }
+    if (want_parent) {
+        *name = path;
+        *len = 0;                       /* the root */
+    }
+    return ino;
+}
+
+static uint16_t ramfs_create(uint16_t parent, const char *name, uint32_t len, uint8_t type)
+{
+    struct ramfs_inode *inode;
+    uint32_t h;
+    uint16_t i;
+
+    if (len == 0 || len >= RAMFS_NAME_LEN)
+        return RAMFS_NONE;
+    for (i = 1; i < RAMFS_INODES; i++) {
+        if (ramfs->inode[i].type == RAMFS_FREE)
+            break;
+    }
+    if (i == RAMFS_INODES)
+        return RAMFS_NONE;
+
+    inode = &ramfs->inode[i];
+    memset(inode, 0, sizeof(*inode));
+    memcpy(inode->name, name, len);
+    inode->type = type;
+    inode->parent = parent;
+    inode->child = RAMFS_NONE;
+    h = ramfs_hash(parent, name, len);
+    inode->hash_next = ramfs->hash[h];
+    ramfs->hash[h] = i;
+    inode->sibling = ramfs->inode[parent].child;
+    ramfs->inode[parent].child = i;
+    return i;
+}
+
+static void ramfs_free_blocks(uint32_t start, uint32_t count)
+{
+    uint32_t b;
+
+    for (b = start; b < start + count; b++)
+        ramfs->bitmap[b / 32] &= ~(1u << (b % 32));
+    ramfs->free_blocks += count;
+}
+
+static void ramfs_truncate(struct ramfs_inode *inode)
+{
+    uint32_t i;
+
+    for (i = 0; i < inode->nextents; i++)
+        ramfs_free_blocks(inode->ext[i].start, inode->ext[i].count);
+    inode->nextents = 0;
+    inode->size = 0;
+}
+
+static int ramfs_remove(uint16_t ino)
+{
+    struct ramfs_inode *inode = &ramfs->inode[ino];
+    uint16_t *link;
+
+    if (ino == 0 || inode->opens || (inode->type == RAMFS_DIR && inode->child != RAMFS_NONE))
+        return -1;
+    ramfs_truncate(inode);
+    for (link = &ramfs->hash[ramfs_hash(inode->parent, inode->name, strlen(inode->name))];
+         *link != ino; link = &ramfs->inode[*link].hash_next)
+        ;
+    *link = inode->hash_next;
+    for (link = &ramfs->inode[inode->parent].child; *link != ino; link = &ramfs->inode[*link].sibling)
+        ;
+    *link = inode->sibling;
+    inode->type = RAMFS_FREE;
+    return 0;
+}
+
+/* up to want free blocks from block b on, the run is not taken */
+static uint32_t ramfs_run(uint32_t b, uint32_t want)
+{
+    uint32_t n = 0;
+
+    while (n < want && b + n < RAMFS_BLOCKS && !RAMFS_USED(b + n))
+        n++;
+    return n;
+}
+
+static void ramfs_take(uint32_t start, uint32_t count)
+{
+    uint32_t b;
+
+    for (b = start; b < start + count; b++)
+        ramfs->bitmap[b / 32] |= 1u << (b % 32);
+    ramfs->free_blocks -= count;
+    ramfs->rover = (start + count) % RAMFS_BLOCKS;
+}
+
+/* blocks for size bytes: the last extent grows in place, else a new extent
+ * of at least the blocks the file has (few extents for growing files) */
+static int ramfs_reserve(struct ramfs_inode *inode, uint32_t size)
+{
+    struct ramfs_extent *last;
+    uint32_t have = 0, need, want, b, n, scanned, i;
+
+    for (i = 0; i < inode->nextents; i++)
+        have += inode->ext[i].count;
+    if ((uint64_t)have * RAMFS_BLOCK >= size)
+        return 0;
+    need = (size - have * RAMFS_BLOCK + RAMFS_BLOCK - 1) / RAMFS_BLOCK;
+    if (need > ramfs->free_blocks)
+        return -1;
+
+    if (inode->nextents) {
+        last = &inode->ext[inode->nextents - 1];
+        n = ramfs_run(last->start + last->count, need);
+        if (n && last->count + n <= 0xFFFF) {
+            ramfs_take(last->start + last->count, n);
+            last->count += n;
+            have += n;
+            need -= n;
+        }
+    }
+    while (need) {
+        if (inode->nextents == RAMFS_EXTENTS)
+            return -1;
+        want = need > have ? need : have;
+        if (want > ramfs->free_blocks)
+            want = ramfs->free_blocks;
+        if (want > 0xFFFF)
+            want = 0xFFFF;
+        /* first run of want blocks from the rover on, else the longest */
+        b = ramfs->rover;
+        for (scanned = 0, i = 0, n = 0; scanned < RAMFS_BLOCKS; ) {
+            uint32_t run;
+
+            if (ramfs->bitmap[b / 32] == 0xFFFFFFFF) {
+                scanned += 32 - b % 32;
+                b = (b / 32 + 1) * 32 % RAMFS_BLOCKS;
+                continue;
+            }
+            run = ramfs_run(b, want);
+            if (run > n) {
+                n = run;
+                i = b;
+                if (n == want)
+                    break;
+            }
+            run = run ? run : 1;
+            scanned += run;
+            b = (b + run) % RAMFS_BLOCKS;
+        }
+        if (n == 0)
+            return -1;
+        ramfs_take(i, n);
+        inode->ext[inode->nextents].start = i;
+        inode->ext[inode->nextents].count = n;
+        inode->nextents++;
+        have += n;
+        need = n >= need ? 0 : need - n;
+    }
+    return 0;
+}
+
+/* data at pos and the bytes up to the end of its extent */
+static uint8_t *ramfs_map(struct ramfs_inode *inode, uint32_t pos, uint32_t *contig)
+{
+    uint32_t i, len;
+
+    for (i = 0; i < inode->nextents; i++) {
+        len = inode->ext[i].count * RAMFS_BLOCK;
+        if (pos < len) {
+            *contig = len - pos;
+            return ramfs_data + inode->ext[i].start * RAMFS_BLOCK + pos;
+        }
+        pos -= len;
+    }
+    *contig = 0;
+    return NULL;
+}
+
+int ramfs_open_wrp(const char *path, int flags, int mode, struct nfvfs_context *context)
+{
+    struct ramfs_file *file;
+    struct ramfs_inode *inode;
+    int fentry = *(int *)context->in_data;
+    const char *name;
+    uint32_t len;
+    uint16_t dir, ino;
+    uint8_t type = S_IFDIR(mode) ? RAMFS_DIR : RAMFS_FILE;
+
+    if (!ramfs_mounted) {
+        return -1;
+    }
+    dir = ramfs_walk(path, 1, &name, &len);
+    if (dir == RAMFS_NONE || ramfs->inode[dir].type != RAMFS_DIR) {
+        return -1;
+    }
+    ino = len ? ramfs_lookup(dir, name, len) : dir;
+    if (ino == RAMFS_NONE) {
+        if (!IF_O_CREAT(flags)) {
+            return -1;
+        }
+        ino = ramfs_create(dir, name, len, type);
+        if (ino == RAMFS_NONE) {
+            printf("%s: can not create %s\r\n", __func__, path);
+            return -1;
+        }
+    } else if (IF_O_CREAT(flags) && IF_O_EXCL(flags)) {
+        return -1;
+    }
+    inode = &ramfs->inode[ino];
+    if (inode->type != type) {
+        return -1;
+    }
+    if (type == RAMFS_FILE && IF_O_TRUNC(flags)) {
+        ramfs_truncate(inode);
+    }
+
+    file = (struct ramfs_file *)pvPortMalloc(sizeof(struct ramfs_file));
+    if (file == NULL) {
+        return -1;
+    }
+    file->ino = ino;
+    file->next = inode->child;
+    file->pos = 0;
+    file->flags = flags;
+    inode->opens++;
+    context->out_data = file;
+
+    return fentry;
+}
+
+int ramfs_close_wrp(int fd)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    struct ramfs_file *file;
+
+    if (entry == NULL) {
+        return -1;
+    }
+    file = (struct ramfs_file *)entry->f;
+    ramfs->inode[file->ino].opens--;
+    vPortFree(file);
+    return 0;
+}
+
+int ramfs_read_wrp(int fd, void *buf, uint32_t size)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    struct ramfs_file *file;
+    struct ramfs_inode *inode;
+    uint32_t done, n;
+    uint8_t *p;
+
+    if (entry == NULL || !S_IFREG(entry->mode)) {
+        return -1;
+    }
+    file = (struct ramfs_file *)entry->f;
+    if (!IF_O_RDONLY(file->flags)) {
+        return -1;
+    }
+    inode = &ramfs->inode[file->ino];
+    if (file->pos >= inode->size) {
+        return 0;
+    }
+    if (size > inode->size - file->pos) {
+        size = inode->size - file->pos;
+    }
+    for (done = 0; done < size; done += n) {
+        p = ramfs_map(inode, file->pos + done, &n);
+        if (n > size - done)
+            n = size - done;
+        memcpy((uint8_t *)buf + done, p, n);
+    }
+    file->pos += size;
+    return size;
+}
+
+int ramfs_write_wrp(int fd, void *buf, uint32_t size)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    struct ramfs_file *file;
+    struct ramfs_inode *inode;
+    uint32_t done, n, end;
+    uint8_t *p;
+
+    if (entry == NULL || !S_IFREG(entry->mode)) {
+        return -1;
+    }
+    file = (struct ramfs_file *)entry->f;
+    if (!IF_O_WRONLY(file->flags)) {
+        return -1;
+    }
+    inode = &ramfs->inode[file->ino];
+    if (IF_O_APPEND(file->flags)) {
+        file->pos = inode->size;
+    }
+    end = file->pos + size;
+    if (end < file->pos || ramfs_reserve(inode, end) < 0) {
+        return -1;                      /* full */
+    }
+    /* a gap left by a seek beyond the end reads as zeros */
+    for (done = inode->size; done < file->pos; done += n) {
+        p = ramfs_map(inode, done, &n);
+        if (n > file->pos - done)
+            n = file->pos - done;
+        memset(p, 0, n);
+    }
+    for (done = 0; done < size; done += n) {
+        p = ramfs_map(inode, file->pos + done, &n);
+        if (n > size - done)
+            n = size - done;
+        memcpy(p, (const uint8_t *)buf + done, n);
+    }
+    file->pos = end;
+    if (end > inode->size) {
+        inode->size = end;
+    }
+    return size;
+}
+
+int ramfs_lseek_wrp(int fd, uint32_t offset, int whence)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    struct ramfs_file *file;
+    int32_t pos;
+
+    if (entry == NULL) {
+        return -1;
+    }
+    file = (struct ramfs_file *)entry->f;
+
+    switch (whence) {
+    case NFVFS_SEEK_CUR:
+        pos = (int32_t)file->pos + (int32_t)offset;
+        break;
+    case NFVFS_SEEK_SET:
+        pos = (int32_t)offset;
+        break;
+    case NFVFS_SEEK_END:
+        pos = (int32_t)ramfs->inode[file->ino].size + (int32_t)offset;
+        break;
+    default:
+        return -1;
+    }
+    if (pos < 0) {
+        return -1;
+    }
+    file->pos = pos;
+    return pos;
+}
+
+int ramfs_unlink_wrp(const char *path)
+{
+    uint16_t ino;
+
+    if (!ramfs_mounted) {
+        return -1;
+    }
+    ino = ramfs_walk(path, 0, NULL, NULL);
+    if (ino == RAMFS_NONE) {
+        return -1;
+    }
+    return ramfs_remove(ino);
+}
+
+/* entries of a directory opened with S_ISDIR, 0 per entry, -1 at the end */
+int ramfs_readdir_wrp(int fd, struct nfvfs_dentry *buf)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    struct ramfs_file *file;
+    struct ramfs_inode *inode;
+
+    if (entry == NULL) {
+        return -1;
+    }
+    file = (struct ramfs_file *)entry->f;
+    if (ramfs->inode[file->ino].type != RAMFS_DIR || file->next == RAMFS_NONE) {
+        return -1;
+    }
+    inode = &ramfs->inode[file->next];
+    buf->type = inode->type;
+    buf->name = inode->name;
+    file->next = inode->sibling;
+    return 0;
+}
+
+/* the range is in SDRAM as it is, when it is inside one extent */
+int ramfs_mmap_wrp(int fd, uint32_t offset, uint32_t len, const void **addr)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    struct ramfs_file *file;
+    struct ramfs_inode *inode;
+    uint32_t contig;
+    uint8_t *p;
+
+    if (entry == NULL) {
+        return -1;
+    }
+    file = (struct ramfs_file *)entry->f;
+    inode = &ramfs->inode[file->ino];
+    if (offset > inode->size || len > inode->size - offset) {
+        return -1;
+    }
+    p = ramfs_map(inode, offset, &contig);
+    if (p == NULL || contig < len) {
+        return -1;
+    }
+    *addr = p;
+    return 0;
+}
+
+struct nfvfs_operations ramfs_ops = {
+    .mount = ramfs_mount_wrp,
+    .unmount = ramfs_unmount_wrp,
+    .open = ramfs_open_wrp,
+    .close = ramfs_close_wrp,
+    .read = ramfs_read_wrp,
+    .write = ramfs_write_wrp,
+    .lseek = ramfs_lseek_wrp,
+    .unlink = ramfs_unlink_wrp,
+    .readdir = ramfs_readdir_wrp,
+    .mmap = ramfs_mmap_wrp,
+};
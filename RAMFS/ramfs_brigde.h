@@ -0,0 +1,105 @@
+// Copyright (C) 2022 Deadpool, Hao Huang
+//
+// This file is part of NORENV.
+//
+// NORENV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// NORENV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NORENV.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __RAMFS_BRIGDE_H
+#define __RAMFS_BRIGDE_H
+
+#include <stdint.h>
+#include "nordev.h"
+
+/* Filesystem in the SDRAM above the malloc pool (MALLOC/malloc.c), the
+ * ceiling for the flash filesystems behind nfvfs and a tmpfs for scratch
+ * data. Names are looked up in a hash of (directory, name), a file is up to
+ * RAMFS_EXTENTS runs of contiguous blocks, so mmap returns a pointer into
+ * the SDRAM when the range is in one run. Open with O_CREAT and S_ISDIR
+ * makes a directory.
+ *
+ * The content stays over unmount/mount and is lost at reset. With a device
+ * (ramfs_set_device, or ramfs_set_snapshot from USMART), ramfs_snapshot()
+ * copies it to the NOR and the first mount after a reset restores the last
+ * snapshot, so set the device again after a reset before anything mounts. */
+#define RAMFS_BASE      0xC1000000      /* upper 16MB of the SDRAM */
+#define RAMFS_SIZE      0x1000000
+#define RAMFS_META      0x20000         /* struct ramfs_super, data blocks after it */
+#define RAMFS_BLOCK     1024
+#define RAMFS_BLOCKS    ((RAMFS_SIZE - RAMFS_META) / RAMFS_BLOCK)
+#define RAMFS_INODES    1024            /* files and directories */
+#define RAMFS_HASH      256             /* power of 2 */
+#define RAMFS_EXTENTS   12
+#define RAMFS_NAME_LEN  32              /* of one path component, with the 0 */
+#define RAMFS_NONE      0xFFFF
+#define RAMFS_MAGIC     0x53464D52      /* "RMFS" */
+#define RAMFS_SNAP_MAGIC 0x50534D52     /* "RMSP" */
+
+enum RAMFS_TYPE
+{
+    RAMFS_FREE,
+    RAMFS_FILE,
+    RAMFS_DIR,                          /* also struct nfvfs_dentry.type */
+};
+
+struct ramfs_extent {
+    uint16_t start;                     /* block */
+    uint16_t count;
+};
+
+struct ramfs_inode {
+    char name[RAMFS_NAME_LEN];
+    uint16_t parent;
+    uint16_t hash_next;                 /* same bucket */
+    uint16_t child;                     /* first entry of a directory */
+    uint16_t sibling;                   /* next entry of the parent */
+    uint8_t type;                       /* RAMFS_xx */
+    uint8_t opens;
+    uint16_t nextents;
+    uint32_t size;                      /* bytes, the extents may hold more */
+    struct ramfs_extent ext[RAMFS_EXTENTS];
+};
+
+struct ramfs_super {
+    uint32_t magic;
+    uint32_t free_blocks;
+    uint32_t rover;                     /* next block to look at */
+    uint32_t bitmap[(RAMFS_BLOCKS + 31) / 32];  /* 1: used */
+    uint16_t hash[RAMFS_HASH];
+    struct ramfs_inode inode[RAMFS_INODES];     /* 0: root directory */
+};
+
+/* on the device: this, the struct ramfs_super from RAMFS_SNAP_SUPER on,
+ * then the used blocks in block order; the header is programmed last */
+#define RAMFS_SNAP_SUPER 256
+
+/* devices of ramfs_set_snapshot */
+#define RAMFS_SNAP_NONE     0
+#define RAMFS_SNAP_W25QXX   1
+#define RAMFS_SNAP_NORFLASH 2           /* builds with NORDEV_QSPI */
+
+struct ramfs_snap_header {
+    uint32_t magic;
+    uint32_t super_size;                /* sizeof(struct ramfs_super) */
+    uint32_t block_size;
+    uint32_t blocks;                    /* used blocks saved */
+};
+
+extern struct nfvfs_operations ramfs_ops;
+
+int ramfs_set_device(NORDEV *dev);      /* snapshot device, NULL: none (default) */
+int ramfs_set_snapshot(int dev, int kb);  /* RAMFS_SNAP_xx, the last kb KB of it */
+int ramfs_snapshot(void);               /* 0 or -1 */
+void ramfs_info(void);
+
+#endif /* __RAMFS_BRIGDE_H */
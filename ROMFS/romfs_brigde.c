@@ -0,0 +1,206 @@
+/**
+ * Copyright (C) 2022 Deadpool, Hao Huang
+ *
+ * This file is part of NORENV.
+ *
+ * NORENV is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * NORENV is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with NORENV.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "FreeRTOS.h"
+#include "romfs_brigde.h"
+#include "nordev.h"
+#include "nfvfs.h"
+#include "string.h"
+#include "stdio.h"
+
+#if ROMFS_BASE - 0x90000000 + ROMFS_MAX_SIZE > NORDEV_QSPI_BASE
+#error "ROMFS image overlaps the writable QSPI area of NORDEV_QSPI"
+#endif
+
+struct romfs_file {
+    const struct romfs_entry *entry;
+    uint32_t pos;
+};
+
+static const struct romfs_header *romfs_hdr = (const struct romfs_header *)ROMFS_BASE;
+static uint8_t romfs_mounted;
+
+int romfs_mount_wrp()
+{
+    const struct romfs_header *hdr = romfs_hdr;
+    const struct romfs_entry *entry = (const struct romfs_entry *)(hdr + 1);
+    uint32_t i;
+
+    if (hdr->magic != ROMFS_MAGIC || hdr->size > ROMFS_MAX_SIZE ||
+        hdr->count > (ROMFS_MAX_SIZE - sizeof(*hdr)) / sizeof(struct romfs_entry) ||
+        sizeof(*hdr) + hdr->count * sizeof(struct romfs_entry) > hdr->size) {
+        printf("%s: no image at %08X\r\n", __func__, ROMFS_BASE);
+        return -1;
+    }
+    for (i = 0; i < hdr->count; i++, entry++) {
+        if (entry->offset > hdr->size || entry->size > hdr->size - entry->offset) {
+            printf("%s: entry %d out of the image\r\n", __func__, i);
+            return -1;
+        }
+    }
+    romfs_mounted = 1;
+    return 0;
+}
+
+int romfs_unmount_wrp()
+{
+    romfs_mounted = 0;
+    return 0;
+}
+
+static const struct romfs_entry *romfs_find(const char *path)
+{
+    const struct romfs_entry *entry = (const struct romfs_entry *)(romfs_hdr + 1);
+    uint32_t i;
+
+    while (*path == '/')
+        path++;
+    for (i = 0; i < romfs_hdr->count; i++, entry++) {
+        if (strncmp(entry->name, path, ROMFS_NAME_LEN) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+int romfs_open_wrp(const char *path, int flags, int mode, struct nfvfs_context *context)
+{
+    struct romfs_file *file;
+    const struct romfs_entry *entry;
+    int fentry = *(int *)context->in_data;
+
+    if (!romfs_mounted) {
+        return -1;
+    }
+    if (IF_O_WRONLY(flags) || IF_O_CREAT(flags) || IF_O_TRUNC(flags) || IF_O_APPEND(flags)) {
+        printf("%s: read only\r\n", __func__);
+        return -1;
+    }
+    if (!S_IFREG(mode)) {
+        printf("%s: unsupported directory\r\n", __func__);
+        return -1;
+    }
+
+    entry = romfs_find(path);
+    if (entry == NULL) {
+        return -1;
+    }
+    file = (struct romfs_file *)pvPortMalloc(sizeof(struct romfs_file));
+    if (file == NULL) {
+        return -1;
+    }
+    file->entry = entry;
+    file->pos = 0;
+    context->out_data = file;
+
+    return fentry;
+}
+
+int romfs_close_wrp(int fd)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    if (entry == NULL) {
+        return -1;
+    }
+    vPortFree(entry->f);
+    return 0;
+}
+
+int romfs_read_wrp(int fd, void *buf, uint32_t size)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    struct romfs_file *file;
+
+    if (entry == NULL) {
+        return -1;
+    }
+    file = (struct romfs_file *)entry->f;
+    if (file->pos >= file->entry->size) {
+        return 0;
+    }
+    if (size > file->entry->size - file->pos) {
+        size = file->entry->size - file->pos;
+    }
+    memcpy(buf, (const uint8_t *)ROMFS_BASE + file->entry->offset + file->pos, size);
+    file->pos += size;
+    return size;
+}
+
+int romfs_write_wrp(int fd, void *buf, uint32_t size)
+{
+    return -1;
+}
+
+int romfs_lseek_wrp(int fd, uint32_t offset, int whence)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    struct romfs_file *file;
+    int32_t pos;
+
+    if (entry == NULL) {
+        return -1;
+    }
+    file = (struct romfs_file *)entry->f;
+
+    switch (whence) {
+    case NFVFS_SEEK_CUR:
+        pos = (int32_t)file->pos + (int32_t)offset;
+        break;
+    case NFVFS_SEEK_SET:
+        pos = (int32_t)offset;
+        break;
+    case NFVFS_SEEK_END:
+        pos = (int32_t)file->entry->size + (int32_t)offset;
+        break;
+    default:
+        return -1;
+    }
+    if (pos < 0) {
+        return -1;
+    }
+    file->pos = pos;
+    return pos;
+}
+
+/* the data of a file is in one piece in the QSPI window */
+int romfs_mmap_wrp(int fd, uint32_t offset, uint32_t len, const void **addr)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+    struct romfs_file *file;
+
+    if (entry == NULL) {
+        return -1;
+    }
+    file = (struct romfs_file *)entry->f;
+    if (offset > file->entry->size || len > file->entry->size - offset) {
+        return -1;
+    }
+    *addr = (const uint8_t *)ROMFS_BASE + file->entry->offset + offset;
+    return 0;
+}
+
+struct nfvfs_operations romfs_ops = {
+    .mount = romfs_mount_wrp,
+    .unmount = romfs_unmount_wrp,
+    .open = romfs_open_wrp,
+    .close = romfs_close_wrp,
+    .read = romfs_read_wrp,
+    .write = romfs_write_wrp,
+    .lseek = romfs_lseek_wrp,
+    .mmap = romfs_mmap_wrp,
+};
@@ -0,0 +1,48 @@
+// Copyright (C) 2022 Deadpool, Hao Huang
+// 
+// This file is part of NORENV.
+// 
+// NORENV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// NORENV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with NORENV.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __ROMFS_BRIGDE_H
+#define __ROMFS_BRIGDE_H
+
+#include <stdint.h>
+
+/* Read-only image in the memory mapped QSPI Flash, built by SCRIPT/mkromfs.py
+ * and programmed together with the code. Every file is stored in one piece,
+ * so mmap returns a pointer into the QSPI window. The firmware executes from
+ * the same Flash, it can not write the image. */
+#define ROMFS_BASE      0x90400000      /* after the code image, m_qspiflash_size of the .scf */
+#define ROMFS_MAX_SIZE  0x200000        /* up to NORDEV_QSPI_BASE */
+#define ROMFS_MAGIC     0x464D4F52      /* "ROMF" */
+#define ROMFS_NAME_LEN  24
+#define ROMFS_ALIGN     32              /* file data, one cache line */
+
+struct romfs_header {
+    uint32_t magic;
+    uint32_t count;                     /* entries after the header */
+    uint32_t size;                      /* image bytes */
+    uint32_t reserved;
+};
+
+struct romfs_entry {
+    char name[ROMFS_NAME_LEN];          /* 0 terminated */
+    uint32_t offset;                    /* from ROMFS_BASE */
+    uint32_t size;
+};
+
+extern struct nfvfs_operations romfs_ops;
+
+#endif /* __ROMFS_BRIGDE_H */
@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+# Build the read-only ROMFS image (ROMFS/romfs_brigde.h) from the files of a
+# directory. Program it to the QSPI Flash at ROMFS_BASE (0x90400000) with
+# the external loader, together with the code.
+#
+# usage: mkromfs.py <dir> <image.bin>
+
+import os
+import struct
+import sys
+
+ROMFS_MAGIC = 0x464D4F52
+ROMFS_NAME_LEN = 24
+ROMFS_ALIGN = 32
+ROMFS_MAX_SIZE = 0x200000
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: mkromfs.py <dir> <image.bin>")
+    src, out = sys.argv[1], sys.argv[2]
+    names = sorted(n for n in os.listdir(src) if os.path.isfile(os.path.join(src, n)))
+
+    offset = 16 + 32 * len(names)
+    entries, data = b"", b""
+    for name in names:
+        raw = name.encode()
+        if len(raw) >= ROMFS_NAME_LEN:
+            sys.exit("%s: name longer than %d bytes" % (name, ROMFS_NAME_LEN - 1))
+        with open(os.path.join(src, name), "rb") as f:
+            content = f.read()
+        pad = -(offset + len(data)) % ROMFS_ALIGN
+        data += b"\xff" * pad
+        entries += struct.pack("<%dsII" % ROMFS_NAME_LEN, raw, offset + len(data), len(content))
+        data += content
+
+    size = offset + len(data)
+    if size > ROMFS_MAX_SIZE:
+        sys.exit("image of %d bytes larger than %d" % (size, ROMFS_MAX_SIZE))
+    with open(out, "wb") as f:
+        f.write(struct.pack("<IIII", ROMFS_MAGIC, len(names), size, 0xFFFFFFFF))
+        f.write(entries)
+        f.write(data)
+    print("%s: %d files, %d bytes" % (out, len(names), size))
+
+
+if __name__ == "__main__":
+    main()
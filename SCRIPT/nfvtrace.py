@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Extract an nfvfs capture (USER/nfvfs_replay.h) from a UART log of
+# nfvfs_capture_dump() and summarize it: calls by type, bytes, sizes and
+# gaps between the calls. With <out.nfvt> the capture is also written as a
+# file for nfvfs_capture_load() (copy it to a filesystem of the board).
+#
+# usage: nfvtrace.py <uart.log | capture.nfvt> [out.nfvt]
+
+import struct
+import sys
+
+NFVFS_CAP_MAGIC = 0x5456464E
+OPS = {0: "open", 1: "close", 2: "read", 3: "write", 4: "lseek",
+       5: "fsync", 6: "unlink", 7: "readv", 8: "writev"}
+
+
+def from_log(text):
+    lines = text.splitlines()
+    for i, line in enumerate(lines):
+        if line.startswith("nfvfs capture ") and "records" in line:
+            break
+    else:
+        sys.exit("no nfvfs_capture_dump() output found")
+    hexdata = ""
+    for line in lines[i + 1:]:
+        line = line.strip()
+        if line == "end":
+            return bytes.fromhex(hexdata)
+        hexdata += line
+    sys.exit("dump is truncated")
+
+
+def percentile(values, p):
+    return values[(len(values) - 1) * p // 100] if values else 0
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.exit("usage: nfvtrace.py <uart.log | capture.nfvt> [out.nfvt]")
+    with open(sys.argv[1], "rb") as f:
+        raw = f.read()
+    if raw[:4] != struct.pack("<I", NFVFS_CAP_MAGIC):
+        raw = from_log(raw.decode("latin-1"))
+    magic, count, size, lost = struct.unpack_from("<IIII", raw)
+    if magic != NFVFS_CAP_MAGIC or len(raw) < 16 + size:
+        sys.exit("not an nfvfs capture")
+
+    calls, nbytes, sizes, gaps = {}, {}, [], []
+    pos = 16
+    for _ in range(count):
+        op, fd, path_len, arg2, delta_us, arg, ret = struct.unpack_from("<BbBBIii", raw, pos)
+        pos += 16 + ((path_len + 3) & ~3)
+        name = OPS.get(op, "op%d" % op)
+        calls[name] = calls.get(name, 0) + 1
+        if name in ("read", "write", "readv", "writev") and ret > 0:
+            nbytes[name] = nbytes.get(name, 0) + ret
+            sizes.append(ret)
+        gaps.append(delta_us)
+
+    print("%d calls, %d lost" % (count, lost))
+    for name in sorted(calls, key=calls.get, reverse=True):
+        print("%-8s %8d calls %10d bytes" % (name, calls[name], nbytes.get(name, 0)))
+    sizes.sort()
+    gaps = sorted(gaps[1:])
+    print("size  p50 %d p90 %d max %d bytes" % (percentile(sizes, 50), percentile(sizes, 90), sizes[-1] if sizes else 0))
+    print("gap   p50 %d p90 %d max %d us" % (percentile(gaps, 50), percentile(gaps, 90), gaps[-1] if gaps else 0))
+
+    if len(sys.argv) == 3:
+        with open(sys.argv[2], "wb") as f:
+            f.write(raw[:16 + size])
+        print("%s: %d bytes" % (sys.argv[2], 16 + size))
+
+
+if __name__ == "__main__":
+    main()
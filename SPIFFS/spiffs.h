@@ -62,6 +62,8 @@ extern "C" {
 
 #define SPIFFS_ERR_SEEK_BOUNDS -10040
 
+#define SPIFFS_ERR_NO_SUMMARY -10041
+
 #define SPIFFS_ERR_INTERNAL -10050
 
 #define SPIFFS_ERR_TEST -10100
@@ -124,6 +126,21 @@ typedef void (*spiffs_check_callback)(spiffs_check_type type, spiffs_check_repor
                                       u32_t arg1, u32_t arg2);
 #endif // SPIFFS_HAL_CALLBACK_EXTRA
 
+/* state of a file system check run in steps */
+typedef struct {
+  // working memory for the temporary object index and the page bitmap
+  u8_t *map;
+  u32_t map_size;
+  // spiffs_check_type being run, higher when all are done
+  u8_t phase;
+  // next block to visit in this phase
+  spiffs_block_ix block;
+  // first page covered by the page bitmap
+  u32_t pix_offset;
+  // temporary object index fifo position
+  u32_t log_ix;
+} spiffs_check_state;
+
 /* file system listener callback operation */
 typedef enum {
     /* the file has been created */
@@ -264,6 +281,8 @@ typedef struct spiffs_t {
     u8_t cleaning;
     // max erase count amongst all blocks
     spiffs_obj_id max_erase_count;
+    // highest object id in use, new ids are searched below this + 1
+    spiffs_obj_id max_obj_id;
 
 #if SPIFFS_GC_STATS
     u32_t stats_gc_runs;
@@ -277,6 +296,8 @@ typedef struct spiffs_t {
 #if SPIFFS_CACHE_STATS
     u32_t cache_hits;
     u32_t cache_misses;
+    u32_t cache_evictions;
+    u32_t cache_writebacks;
 #endif
 #endif
 
@@ -603,6 +624,31 @@ struct spiffs_dirent *SPIFFS_readdir(spiffs_DIR *d, struct spiffs_dirent *e);
  */
 s32_t SPIFFS_check(spiffs *fs);
 
+/**
+ * Prepares a consistency check that is run in steps by SPIFFS_check_step.
+ * The larger the given memory the fewer passes over the flash are needed:
+ * half a byte per page lets the page check finish in a single pass and
+ * SPIFFS_OBJ_ID_IX_FLAG/4 bytes turn the object index check into a bitmap
+ * lookup. Progress is reported through the check callback given at mount.
+ * @param fs            the file system struct
+ * @param st            the check state, kept by the caller between steps
+ * @param map           working memory, if null or smaller than a logical
+ *                      page the file system work buffer is used
+ * @param map_size      size of map in bytes
+ */
+s32_t SPIFFS_check_begin(spiffs *fs, spiffs_check_state *st, void *map, u32_t map_size);
+
+/**
+ * Continues a consistency check prepared by SPIFFS_check_begin. The file
+ * system must not be modified between the steps of a check, and if map is
+ * null no other call may be made until the check is done.
+ * @param fs            the file system struct
+ * @param st            the check state
+ * @param blocks        maximum number of blocks to visit in this step
+ * @returns 1 if more steps are needed, 0 when the check is done
+ */
+s32_t SPIFFS_check_step(spiffs *fs, spiffs_check_state *st, u32_t blocks);
+
 /**
  * Returns number of total bytes available and number of used bytes.
  * This is an estimation, and depends on if there a many files with little
@@ -1,49 +1,149 @@
 #include "spiffs_brigde.h"
 #include "nfvfs.h"
 #include "spiffs.h"
-#include "w25qxx.h"
+#include "spiffs_nucleus.h"
+#include "nordev.h"
+#include "FreeRTOS.h"
 #include "delay.h"
 
 #define LOG_PAGE_SIZE       256
-#define W25Q256_SECTOR_SIZE 4096
-#define W25Q256_SIZE        (W25Q256_SECTOR_SIZE * W25Q256_NUM_GRAN)
+#define LOG_BLOCK_SIZE      65536
 
 spiffs fs;
 
+/* device of the next mount */
+static NORDEV *spiffs_dev = &NORDEV_W25QXX;
+
 static uint8_t spiffs_work_buf[LOG_PAGE_SIZE * 2];
 static uint8_t spiffs_fds[32 * 4];
 static uint8_t spiffs_cache_buf[(LOG_PAGE_SIZE + 32) * 4];
 
+/* cache used by the next mount, defaults to the small static buffer */
+static void *spiffs_cache_mem = spiffs_cache_buf;
+static uint32_t spiffs_cache_mem_size = sizeof(spiffs_cache_buf);
+
+uint32_t spiffs_cache_bytes(uint32_t pages)
+{
+    spiffs probe;
+
+    probe.cfg.log_page_size = LOG_PAGE_SIZE;
+    return SPIFFS_buffer_bytes_for_cache(&probe, pages);
+}
+
+int spiffs_cache_config(void *buf, uint32_t size)
+{
+    if (SPIFFS_mounted(&fs)) {
+        printf("%s: unmount spiffs before changing its cache\r\n", __func__);
+        return -1;
+    }
+
+    /* spiffs_cache_init() leaves a smaller cache uninitialized */
+    if (buf != NULL && size < spiffs_cache_bytes(1)) {
+        printf("%s: %d bytes, a cache page needs %d\r\n", __func__, size, spiffs_cache_bytes(1));
+        return -1;
+    }
+    if (buf == NULL) {
+        spiffs_cache_mem = spiffs_cache_buf;
+        spiffs_cache_mem_size = sizeof(spiffs_cache_buf);
+    } else {
+        spiffs_cache_mem = buf;
+        spiffs_cache_mem_size = size;
+    }
+
+    return 0;
+}
+
+void spiffs_cache_stats(void)
+{
+    spiffs_cache *cache = (spiffs_cache *)fs.cache;
+
+    if (!SPIFFS_mounted(&fs)) {
+        printf("spiffs cache: not mounted\r\n");
+        return;
+    }
+    if (cache == NULL || cache->cpage_count == 0) {
+        printf("spiffs cache: none\r\n");
+        return;
+    }
+    printf("spiffs cache: %d pages (%d lookup/index, max %d), hits %u, misses %u, evictions %u, writebacks %u\r\n",
+           cache->cpage_count, cache->cpage_meta, cache->cpage_meta_max,
+           fs.cache_hits, fs.cache_misses, fs.cache_evictions, fs.cache_writebacks);
+}
+
+static spiffs_check_state spiffs_check_st;
+static spiffs_check_progress_t spiffs_check_progress;
+
+static void spiffs_check_cb(spiffs_check_type type, spiffs_check_report report, u32_t arg1, u32_t arg2)
+{
+    if (report == SPIFFS_CHECK_PROGRESS) {
+        if (spiffs_check_progress)
+            spiffs_check_progress(type, arg1);
+    } else if (report == SPIFFS_CHECK_ERROR) {
+        printf("%s: check phase %d failed %d\r\n", __func__, type, (int)arg1);
+    }
+}
+
+int spiffs_check_begin_wrp(void *map, uint32_t map_size, spiffs_check_progress_t progress)
+{
+    spiffs_check_progress = progress;
+    if (SPIFFS_check_begin(&fs, &spiffs_check_st, map, map_size) != SPIFFS_OK) {
+        printf("%s: spiffs not mounted\r\n", __func__);
+        return -1;
+    }
+
+    return 0;
+}
+
+int spiffs_check_step_wrp(uint32_t blocks)
+{
+    int ret = SPIFFS_check_step(&fs, &spiffs_check_st, blocks);
+    if (ret < 0) {
+        printf("%s: check failed %d\r\n", __func__, ret);
+        return -1;
+    }
+
+    return ret;
+}
+
+void spiffs_cache_stats_reset(void)
+{
+    fs.cache_hits = 0;
+    fs.cache_misses = 0;
+    fs.cache_evictions = 0;
+    fs.cache_writebacks = 0;
+}
+
 int W25Qxx_readspiffs(u32_t addr, u32_t size, u8_t *dst)
 {
-    if (addr >= W25Q256_SIZE) {
+    if (addr >= spiffs_dev->size) {
         return SPIFFS_ERR_IO;
     }
 
-    W25QXX_Read(dst, addr, size);
+    NORDEV_Read(spiffs_dev, addr, dst, size);
 
     return SPIFFS_OK;
 }
 
 int W25Qxx_writespiffs(u32_t addr, u32_t size, u8_t *src)
 {
-    if (addr >= W25Q256_SIZE) {
+    if (addr >= spiffs_dev->size) {
         return SPIFFS_ERR_IO;
     }
 
-    W25QXX_Write(src, addr, size);
+    NORDEV_Prog(spiffs_dev, addr, src, size);
 
     return SPIFFS_OK;
 }
 
 int W25Qxx_erasespiffs(u32_t addr, u32_t size)
 {
-    if (addr >= W25Q256_SIZE) // error
+    if (addr >= spiffs_dev->size) // error
     {
         return SPIFFS_ERR_IO;
     }
 
-    W25QXX_Erase_Sector(addr);
+    if (NORDEV_Erase(spiffs_dev, addr, size))
+        return SPIFFS_ERR_IO;
     return SPIFFS_OK;
 }
 
@@ -51,10 +151,10 @@ int spiffs_mount_wrp()
 {
     int err, tries = 0;
     spiffs_config cfg;
-    cfg.phys_size = W25Q256_SIZE;              // use all spi flash
+    cfg.phys_size = spiffs_dev->size;          // use all of the device
     cfg.phys_addr = 0;                         // start spiffs at start of spi flash
-    cfg.phys_erase_block = W25Q256_ERASE_GRAN; // according to datasheet
-    cfg.log_block_size = 65536;                // let us not complicate things
+    cfg.phys_erase_block = LOG_BLOCK_SIZE;     // the device picks its largest erase commands
+    cfg.log_block_size = LOG_BLOCK_SIZE;       // let us not complicate things
     cfg.log_page_size = LOG_PAGE_SIZE;         // as we said
 
     cfg.hal_read_f = W25Qxx_readspiffs;
@@ -67,9 +167,9 @@ int spiffs_mount_wrp()
                        spiffs_work_buf,
                        spiffs_fds,
                        sizeof(spiffs_fds),
-                       spiffs_cache_buf,
-                       sizeof(spiffs_cache_buf),
-                       NULL);
+                       spiffs_cache_mem,
+                       spiffs_cache_mem_size,
+                       spiffs_check_cb);
     while (err) {
         printf("try clean and remount %d\r\n", err);
         SPIFFS_format(&fs);
@@ -78,9 +178,9 @@ int spiffs_mount_wrp()
                            spiffs_work_buf,
                            spiffs_fds,
                            sizeof(spiffs_fds),
-                           spiffs_cache_buf,
-                           sizeof(spiffs_cache_buf),
-                           NULL);
+                           spiffs_cache_mem,
+                           spiffs_cache_mem_size,
+                           spiffs_check_cb);
         delay_ms(1000);
         tries++;
         if (tries >= 2) {
@@ -97,6 +197,21 @@ int spiffs_mount_wrp()
 int spiffs_unmount_wrp()
 {
     SPIFFS_unmount(&fs);
+    NORDEV_Sync(spiffs_dev);
+    return 0;
+}
+
+int spiffs_set_device(NORDEV *dev)
+{
+    if (SPIFFS_mounted(&fs)) {
+        printf("%s: unmount spiffs before changing its device\r\n", __func__);
+        return -1;
+    }
+    if (LOG_BLOCK_SIZE % dev->erase_size) {
+        printf("%s: erase size %d does not fit the block size\r\n", __func__, dev->erase_size);
+        return -1;
+    }
+    spiffs_dev = dev;
     return 0;
 }
 
@@ -18,6 +18,27 @@
 #ifndef __SPIFFS_BRIDGE_H
 #define __SPIFFS_BRIDGE_H
 
+#include <stdint.h>
+#include "nordev.h"
+
 extern struct nfvfs_operations spiffs_ops;
 
+/* Device for the next mount, default NORDEV_W25QXX */
+int spiffs_set_device(NORDEV *dev);
+
+/* Cache placement, takes effect on the next mount. buf == NULL restores
+ * the built-in 4-page cache. */
+uint32_t spiffs_cache_bytes(uint32_t pages);
+int spiffs_cache_config(void *buf, uint32_t size);
+void spiffs_cache_stats(void);
+void spiffs_cache_stats_reset(void);
+
+/* Consistency check run in steps of at most blocks blocks, map is the
+ * check memory (NULL for the work buffer). progress gets the phase
+ * (lookup, index, page) and 0..256 within it. step returns 1 while
+ * there is more to do. */
+typedef void (*spiffs_check_progress_t)(int phase, int progress);
+int spiffs_check_begin_wrp(void *map, uint32_t map_size, spiffs_check_progress_t progress);
+int spiffs_check_step_wrp(uint32_t blocks);
+
 #endif /* __SPIFFS_BRIDGE_H */
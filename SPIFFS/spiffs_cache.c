@@ -10,20 +10,46 @@
 
 #if SPIFFS_CACHE
 
+// hash bucket of given page index
+#define spiffs_cache_bucket(c, pix) \
+  (&(c)->hbuckets[(pix) % (c)->cpage_count])
+
+// links a read cache page into the page index hash
+static void spiffs_cache_hash_add(spiffs *fs, spiffs_cache_page *cp) {
+  spiffs_cache *cache = spiffs_get_cache(fs);
+  u16_t *bucket = spiffs_cache_bucket(cache, cp->pix);
+  cp->hnext = *bucket;
+  *bucket = cp->ix;
+}
+
+// unlinks a read cache page from the page index hash
+static void spiffs_cache_hash_remove(spiffs *fs, spiffs_cache_page *cp) {
+  spiffs_cache *cache = spiffs_get_cache(fs);
+  u16_t *link = spiffs_cache_bucket(cache, cp->pix);
+  while (*link != SPIFFS_CACHE_NO_PAGE) {
+    spiffs_cache_page *cur = spiffs_get_cache_page_hdr(fs, cache, *link);
+    if (cur == cp) {
+      *link = cp->hnext;
+      break;
+    }
+    link = &cur->hnext;
+  }
+  cp->hnext = SPIFFS_CACHE_NO_PAGE;
+}
+
 // returns cached page for give page index, or null if no such cached page
 static spiffs_cache_page *spiffs_cache_page_get(spiffs *fs, spiffs_page_ix pix) {
   spiffs_cache *cache = spiffs_get_cache(fs);
-  if ((cache->cpage_use_map & cache->cpage_use_mask) == 0) return 0;
-  int i;
-  for (i = 0; i < cache->cpage_count; i++) {
-    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
-    if ((cache->cpage_use_map & (1<<i)) &&
-        (cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) == 0 &&
-        cp->pix == pix ) {
-      //SPIFFS_CACHE_DBG("CACHE_GET: have cache page "_SPIPRIi" for "_SPIPRIpg"\n", i, pix);
+  if (cache->cpage_used == 0) return 0;
+  u16_t ix = *spiffs_cache_bucket(cache, pix);
+  while (ix != SPIFFS_CACHE_NO_PAGE) {
+    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, ix);
+    if (cp->pix == pix) {
+      //SPIFFS_CACHE_DBG("CACHE_GET: have cache page "_SPIPRIi" for "_SPIPRIpg"\n", ix, pix);
       cp->last_access = cache->last_access;
       return cp;
     }
+    ix = cp->hnext;
   }
   //SPIFFS_CACHE_DBG("CACHE_GET: no cache for "_SPIPRIpg"\n", pix);
   return 0;
@@ -34,13 +60,16 @@ static s32_t spiffs_cache_page_free(spiffs *fs, int ix, u8_t write_back) {
   s32_t res = SPIFFS_OK;
   spiffs_cache *cache = spiffs_get_cache(fs);
   spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, ix);
-  if (cache->cpage_use_map & (1<<ix)) {
+  if (cp->flags & SPIFFS_CACHE_FLAG_INUSE) {
     if (write_back &&
         (cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) == 0 &&
         (cp->flags & SPIFFS_CACHE_FLAG_DIRTY)) {
       u8_t *mem =  spiffs_get_cache_page(fs, cache, ix);
       SPIFFS_CACHE_DBG("CACHE_FREE: write cache page "_SPIPRIi" pix "_SPIPRIpg"\n", ix, cp->pix);
       res = SPIFFS_HAL_WRITE(fs, SPIFFS_PAGE_TO_PADDR(fs, cp->pix), SPIFFS_CFG_LOG_PAGE_SZ(fs), mem);
+#if SPIFFS_CACHE_STATS
+      fs->cache_writebacks++;
+#endif
     }
 
 #if SPIFFS_CACHE_WR
@@ -50,56 +79,90 @@ static s32_t spiffs_cache_page_free(spiffs *fs, int ix, u8_t write_back) {
 #endif
     {
       SPIFFS_CACHE_DBG("CACHE_FREE: free cache page "_SPIPRIi" pix "_SPIPRIpg"\n", ix, cp->pix);
+      spiffs_cache_hash_remove(fs, cp);
+      if (cp->flags & SPIFFS_CACHE_FLAG_META) {
+        cache->cpage_meta--;
+      }
     }
-    cache->cpage_use_map &= ~(1 << ix);
+    cache->cpage_used--;
     cp->flags = 0;
   }
 
   return res;
 }
 
-// removes the oldest accessed cached page
-static s32_t spiffs_cache_page_remove_oldest(spiffs *fs, u8_t flag_mask, u8_t flags) {
-  s32_t res = SPIFFS_OK;
+// returns the oldest accessed read cache page of given class (lookup/index
+// or data pages), or -1 if there is none
+static int spiffs_cache_page_oldest(spiffs *fs, u8_t meta) {
   spiffs_cache *cache = spiffs_get_cache(fs);
-
-  if ((cache->cpage_use_map & cache->cpage_use_mask) != cache->cpage_use_mask) {
-    // at least one free cpage
-    return SPIFFS_OK;
-  }
-
-  // all busy, scan thru all to find the cpage which has oldest access
   int i;
   int cand_ix = -1;
   u32_t oldest_val = 0;
   for (i = 0; i < cache->cpage_count; i++) {
     spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
-    if ((cache->last_access - cp->last_access) > oldest_val &&
-        (cp->flags & flag_mask) == flags) {
+    if ((cp->flags & (SPIFFS_CACHE_FLAG_INUSE | SPIFFS_CACHE_FLAG_TYPE_WR)) != SPIFFS_CACHE_FLAG_INUSE ||
+        ((cp->flags & SPIFFS_CACHE_FLAG_META) != 0) != meta) {
+      continue;
+    }
+    if (cand_ix < 0 || (cache->last_access - cp->last_access) > oldest_val) {
       oldest_val = cache->last_access - cp->last_access;
       cand_ix = i;
     }
   }
+  return cand_ix;
+}
+
+// makes room for a new cache page if the cache is full. Only read cache
+// pages are evicted. When the cache page is wanted for an object lookup or
+// index page (meta), data pages are evicted first until lookup and index
+// pages fill their share of the cache; after that they replace each other.
+// Data pages always replace data pages while there are any, unless lookup
+// and index pages exceed their share.
+static s32_t spiffs_cache_page_remove_oldest(spiffs *fs, u8_t meta) {
+  spiffs_cache *cache = spiffs_get_cache(fs);
 
-  if (cand_ix >= 0) {
-    res = spiffs_cache_page_free(fs, cand_ix, 1);
+  if (cache->cpage_used < cache->cpage_count) {
+    // at least one free cpage
+    return SPIFFS_OK;
   }
 
-  return res;
+  u8_t victim_meta;
+  if (cache->cpage_meta > cache->cpage_meta_max) {
+    victim_meta = 1;
+  } else if (meta) {
+    victim_meta = cache->cpage_meta == cache->cpage_meta_max;
+  } else {
+    victim_meta = 0;
+  }
+
+  int cand_ix = spiffs_cache_page_oldest(fs, victim_meta);
+  if (cand_ix < 0) {
+    cand_ix = spiffs_cache_page_oldest(fs, !victim_meta);
+  }
+  if (cand_ix < 0) {
+    return SPIFFS_OK;
+  }
+
+#if SPIFFS_CACHE_STATS
+  fs->cache_evictions++;
+#endif
+  return spiffs_cache_page_free(fs, cand_ix, 1);
 }
 
 // allocates a new cached page and returns it, or null if all cache pages are busy
 static spiffs_cache_page *spiffs_cache_page_allocate(spiffs *fs) {
   spiffs_cache *cache = spiffs_get_cache(fs);
-  if (cache->cpage_use_map == 0xffffffff) {
+  if (cache->cpage_used >= cache->cpage_count) {
     // out of cache memory
     return 0;
   }
   int i;
   for (i = 0; i < cache->cpage_count; i++) {
-    if ((cache->cpage_use_map & (1<<i)) == 0) {
-      spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
-      cache->cpage_use_map |= (1<<i);
+    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
+    if ((cp->flags & SPIFFS_CACHE_FLAG_INUSE) == 0) {
+      cache->cpage_used++;
+      cp->flags = SPIFFS_CACHE_FLAG_INUSE;
+      cp->hnext = SPIFFS_CACHE_NO_PAGE;
       cp->last_access = cache->last_access;
       //SPIFFS_CACHE_DBG("CACHE_ALLO: allocated cache page "_SPIPRIi"\n", i);
       return cp;
@@ -150,12 +213,28 @@ s32_t spiffs_phys_rd(
 #endif
     // this operation will always free one cache page (unless all already free),
     // the result code stems from the write operation of the possibly freed cache page
-    res = spiffs_cache_page_remove_oldest(fs, SPIFFS_CACHE_FLAG_TYPE_WR, 0);
+    u8_t class_flag;
+    switch (op & SPIFFS_OP_TYPE_MASK) {
+    case SPIFFS_OP_T_OBJ_LU:
+      class_flag = SPIFFS_CACHE_FLAG_OBJLU;
+      break;
+    case SPIFFS_OP_T_OBJ_IX:
+      class_flag = SPIFFS_CACHE_FLAG_OBJIX;
+      break;
+    default:
+      class_flag = SPIFFS_CACHE_FLAG_DATA;
+      break;
+    }
+    res = spiffs_cache_page_remove_oldest(fs, (class_flag & SPIFFS_CACHE_FLAG_META) != 0);
 
     cp = spiffs_cache_page_allocate(fs);
     if (cp) {
-      cp->flags = SPIFFS_CACHE_FLAG_WRTHRU;
+      cp->flags |= SPIFFS_CACHE_FLAG_WRTHRU | class_flag;
       cp->pix = SPIFFS_PADDR_TO_PAGE(fs, addr);
+      spiffs_cache_hash_add(fs, cp);
+      if (class_flag & SPIFFS_CACHE_FLAG_META) {
+        cache->cpage_meta++;
+      }
       SPIFFS_CACHE_DBG("CACHE_ALLO: allocated cache page "_SPIPRIi" for pix "_SPIPRIpg "\n", cp->ix, cp->pix);
 
       s32_t res2 = SPIFFS_HAL_READ(fs,
@@ -227,7 +306,7 @@ s32_t spiffs_phys_wr(
 spiffs_cache_page *spiffs_cache_page_get_by_fd(spiffs *fs, spiffs_fd *fd) {
   spiffs_cache *cache = spiffs_get_cache(fs);
 
-  if ((cache->cpage_use_map & cache->cpage_use_mask) == 0) {
+  if (cache->cpage_used == 0) {
     // all cpages free, no cpage cannot be assigned to obj_id
     return 0;
   }
@@ -235,7 +314,7 @@ spiffs_cache_page *spiffs_cache_page_get_by_fd(spiffs *fs, spiffs_fd *fd) {
   int i;
   for (i = 0; i < cache->cpage_count; i++) {
     spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
-    if ((cache->cpage_use_map & (1<<i)) &&
+    if ((cp->flags & SPIFFS_CACHE_FLAG_INUSE) &&
         (cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) &&
         cp->obj_id == fd->obj_id) {
       return cp;
@@ -250,14 +329,14 @@ spiffs_cache_page *spiffs_cache_page_get_by_fd(spiffs *fs, spiffs_fd *fd) {
 spiffs_cache_page *spiffs_cache_page_allocate_by_fd(spiffs *fs, spiffs_fd *fd) {
   // before this function is called, it is ensured that there is no already existing
   // cache page with same object id
-  spiffs_cache_page_remove_oldest(fs, SPIFFS_CACHE_FLAG_TYPE_WR, 0);
+  spiffs_cache_page_remove_oldest(fs, 0);
   spiffs_cache_page *cp = spiffs_cache_page_allocate(fs);
   if (cp == 0) {
     // could not get cache page
     return 0;
   }
 
-  cp->flags = SPIFFS_CACHE_FLAG_TYPE_WR;
+  cp->flags |= SPIFFS_CACHE_FLAG_TYPE_WR;
   cp->obj_id = fd->obj_id;
   fd->cache_page = cp;
   SPIFFS_CACHE_DBG("CACHE_ALLO: allocated cache page "_SPIPRIi" for fd "_SPIPRIfd ":"_SPIPRIid "\n", cp->ix, fd->file_nbr, fd->obj_id);
@@ -286,33 +365,35 @@ void spiffs_cache_fd_release(spiffs *fs, spiffs_cache_page *cp) {
 void spiffs_cache_init(spiffs *fs) {
   if (fs->cache == 0) return;
   u32_t sz = fs->cache_size;
-  u32_t cache_mask = 0;
   int i;
-  int cache_entries =
-      (sz - sizeof(spiffs_cache)) / (SPIFFS_CACHE_PAGE_SIZE(fs));
-  if (cache_entries <= 0) return;
-
-  for (i = 0; i < cache_entries; i++) {
-    cache_mask <<= 1;
-    cache_mask |= 1;
+  if (sz <= sizeof(spiffs_cache)) return;
+  u32_t cache_entries =
+      (sz - sizeof(spiffs_cache)) / (SPIFFS_CACHE_PAGE_COST(fs));
+  if (cache_entries == 0) return;
+  if (cache_entries >= SPIFFS_CACHE_NO_PAGE) {
+    cache_entries = SPIFFS_CACHE_NO_PAGE - 1;
   }
 
   spiffs_cache cache;
   memset(&cache, 0, sizeof(spiffs_cache));
   cache.cpage_count = cache_entries;
+  cache.cpage_meta_max = (cache_entries * SPIFFS_CACHE_META_SHARE) / 100;
+  if (cache.cpage_meta_max == 0) {
+    cache.cpage_meta_max = 1;
+  }
   cache.cpages = (u8_t *)((u8_t *)fs->cache + sizeof(spiffs_cache));
-
-  cache.cpage_use_map = 0xffffffff;
-  cache.cpage_use_mask = cache_mask;
+  cache.hbuckets = (u16_t *)(cache.cpages + cache_entries * SPIFFS_CACHE_PAGE_SIZE(fs));
   _SPIFFS_MEMCPY(fs->cache, &cache, sizeof(spiffs_cache));
 
   spiffs_cache *c = spiffs_get_cache(fs);
 
   memset(c->cpages, 0, c->cpage_count * SPIFFS_CACHE_PAGE_SIZE(fs));
 
-  c->cpage_use_map &= ~(c->cpage_use_mask);
   for (i = 0; i < cache.cpage_count; i++) {
-    spiffs_get_cache_page_hdr(fs, c, i)->ix = i;
+    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, c, i);
+    cp->ix = i;
+    cp->hnext = SPIFFS_CACHE_NO_PAGE;
+    c->hbuckets[i] = SPIFFS_CACHE_NO_PAGE;
   }
 }
 
@@ -457,12 +457,16 @@ static s32_t spiffs_lookup_check_validate(spiffs *fs, spiffs_obj_id lu_obj_id, s
 
 static s32_t spiffs_lookup_check_v(spiffs *fs, spiffs_obj_id obj_id, spiffs_block_ix cur_block, int cur_entry,
     const void *user_const_p, void *user_var_p) {
-  (void)user_const_p;
   (void)user_var_p;
+  const spiffs_block_ix *end_block = (const spiffs_block_ix *)user_const_p;
   s32_t res = SPIFFS_OK;
   spiffs_page_header p_hdr;
   spiffs_page_ix cur_pix = SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, cur_block, cur_entry);
 
+  if (cur_block >= *end_block) {
+    return SPIFFS_VIS_END;
+  }
+
   CHECK_CB(fs, SPIFFS_CHECK_LOOKUP, SPIFFS_CHECK_PROGRESS,
       (cur_block * 256)/fs->block_count, 0);
 
@@ -483,19 +487,32 @@ static s32_t spiffs_lookup_check_v(spiffs *fs, spiffs_obj_id obj_id, spiffs_bloc
 }
 
 
+// Checks the object look up of blocks from *block up to end_block,
+// *block is advanced to end_block when done
+static s32_t spiffs_lookup_consistency_check_i(spiffs *fs, spiffs_block_ix *block, spiffs_block_ix end_block) {
+  s32_t res;
+
+  res = spiffs_obj_lu_find_entry_visitor(fs, *block, 0, SPIFFS_VIS_NO_WRAP, 0, spiffs_lookup_check_v,
+      &end_block, 0, 0, 0);
+  if (res == SPIFFS_VIS_END) {
+    res = SPIFFS_OK;
+  }
+  if (res == SPIFFS_OK) {
+    *block = end_block;
+  }
+  return res;
+}
+
 // Scans all object look up. For each entry, corresponding page header is checked for validity.
 // If an object index header page is found, this is also checked
 s32_t spiffs_lookup_consistency_check(spiffs *fs, u8_t check_all_objects) {
   (void)check_all_objects;
   s32_t res = SPIFFS_OK;
+  spiffs_block_ix block = 0;
 
   CHECK_CB(fs, SPIFFS_CHECK_LOOKUP, SPIFFS_CHECK_PROGRESS, 0, 0);
 
-  res = spiffs_obj_lu_find_entry_visitor(fs, 0, 0, 0, 0, spiffs_lookup_check_v, 0, 0, 0, 0);
-
-  if (res == SPIFFS_VIS_END) {
-    res = SPIFFS_OK;
-  }
+  res = spiffs_lookup_consistency_check_i(fs, &block, fs->block_count);
 
   if (res != SPIFFS_OK) {
     CHECK_CB(fs, SPIFFS_CHECK_LOOKUP, SPIFFS_CHECK_ERROR, res, 0);
@@ -518,23 +535,35 @@ s32_t spiffs_lookup_consistency_check(spiffs *fs, u8_t check_all_objects) {
 //  * x000 free, unreferenced, not index
 //  * x011 used, referenced only once, not index
 //  * x101 used, unreferenced, index
-// The working memory might not fit all pages so several scans might be needed
-static s32_t spiffs_page_consistency_check_i(spiffs *fs) {
+// The working memory might not fit all pages so several scans might be needed.
+// Resumes at *pix_offset_p and *block_p, visits at most *budget blocks and
+// stores the position back when the budget runs out.
+static s32_t spiffs_page_consistency_check_i(spiffs *fs, u8_t *map, u32_t map_size,
+    u32_t *pix_offset_p, spiffs_block_ix *block_p, u32_t *budget) {
   const u32_t bits = 4;
-  const u32_t pages_per_scan = SPIFFS_CFG_LOG_PAGE_SZ(fs) * 8 / bits;
+  // no use for a bitmap beyond the last page
+  const u32_t pages_per_scan = MIN(map_size * 8 / bits, SPIFFS_MAX_PAGES(fs));
 
   s32_t res = SPIFFS_OK;
-  spiffs_page_ix pix_offset = 0;
+  u32_t pix_offset = *pix_offset_p;
+  spiffs_block_ix cur_block = *block_p;
 
   // for each range of pages fitting into work memory
   while (pix_offset < SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count) {
     // set this flag to abort all checks and rescan the page range
     u8_t restart = 0;
-    memset(fs->work, 0, SPIFFS_CFG_LOG_PAGE_SZ(fs));
+    if (cur_block == 0) {
+      memset(map, 0, pages_per_scan * bits / 8);
+    }
 
-    spiffs_block_ix cur_block = 0;
     // build consistency bitmap for id range traversing all blocks
     while (!restart && cur_block < fs->block_count) {
+      if (*budget == 0) {
+        *pix_offset_p = pix_offset;
+        *block_p = cur_block;
+        return res;
+      }
+      (*budget)--;
       CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_PROGRESS,
           (pix_offset*256)/(SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count) +
           ((((cur_block * pages_per_scan * 256)/ (SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count))) / fs->block_count),
@@ -559,14 +588,14 @@ static s32_t spiffs_page_consistency_check_i(spiffs *fs) {
         if (within_range &&
             (p_hdr.flags & SPIFFS_PH_FLAG_DELET) && (p_hdr.flags & SPIFFS_PH_FLAG_USED) == 0) {
           // used
-          fs->work[pix_byte_ix] |= (1<<(pix_bit_ix + 0));
+          map[pix_byte_ix] |= (1<<(pix_bit_ix + 0));
         }
         if ((p_hdr.flags & SPIFFS_PH_FLAG_DELET) &&
             (p_hdr.flags & SPIFFS_PH_FLAG_IXDELE) &&
             (p_hdr.flags & (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_USED)) == 0) {
           // found non-deleted index
           if (within_range) {
-            fs->work[pix_byte_ix] |= (1<<(pix_bit_ix + 2));
+            map[pix_byte_ix] |= (1<<(pix_bit_ix + 2));
           }
 
           // load non-deleted index
@@ -693,7 +722,7 @@ static s32_t spiffs_page_consistency_check_i(spiffs *fs) {
                 // mark rpix as referenced
                 const u32_t rpix_byte_ix = (rpix - pix_offset) / (8/bits);
                 const u8_t rpix_bit_ix = (rpix & ((8/bits)-1)) * bits;
-                if (fs->work[rpix_byte_ix] & (1<<(rpix_bit_ix + 1))) {
+                if (map[rpix_byte_ix] & (1<<(rpix_bit_ix + 1))) {
                   SPIFFS_CHECK_DBG("PA: pix "_SPIPRIpg" multiple referenced from page "_SPIPRIpg"\n",
                       rpix, cur_pix);
                   // Here, we should have fixed all broken references - getting this means there
@@ -709,7 +738,7 @@ static s32_t spiffs_page_consistency_check_i(spiffs *fs) {
                   SPIFFS_CHECK_RES(res);
                   restart = 1;
                 }
-                fs->work[rpix_byte_ix] |= (1<<(rpix_bit_ix + 1));
+                map[rpix_byte_ix] |= (1<<(rpix_bit_ix + 1));
               }
             }
           } // for all index entries
@@ -728,9 +757,10 @@ static s32_t spiffs_page_consistency_check_i(spiffs *fs) {
 
       u32_t byte_ix;
       u8_t bit_ix;
-      for (byte_ix = 0; !restart && byte_ix < SPIFFS_CFG_LOG_PAGE_SZ(fs); byte_ix++) {
+      for (byte_ix = 0; !restart && byte_ix < map_size &&
+          pix_offset + byte_ix * (8/bits) < SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count; byte_ix++) {
         for (bit_ix = 0; !restart && bit_ix < 8/bits; bit_ix ++) {
-          u8_t bitmask = (fs->work[byte_ix] >> (bit_ix * bits)) & 0x7;
+          u8_t bitmask = (map[byte_ix] >> (bit_ix * bits)) & 0x7;
           spiffs_page_ix cur_pix = pix_offset + byte_ix * (8/bits) + bit_ix;
 
           // 000 ok - free, unreferenced, not index
@@ -856,14 +886,20 @@ static s32_t spiffs_page_consistency_check_i(spiffs *fs) {
     if (!restart) {
       pix_offset += pages_per_scan;
     }
+    cur_block = 0;
   } // while page range not reached end
+  *pix_offset_p = pix_offset;
+  *block_p = 0;
   return res;
 }
 
 // Checks consistency amongst all pages and fixes irregularities
 s32_t spiffs_page_consistency_check(spiffs *fs) {
+  u32_t pix_offset = 0;
+  spiffs_block_ix block = 0;
+  u32_t budget = (u32_t)-1;
   CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_PROGRESS, 0, 0);
-  s32_t res = spiffs_page_consistency_check_i(fs);
+  s32_t res = spiffs_page_consistency_check_i(fs, fs->work, SPIFFS_CFG_LOG_PAGE_SZ(fs), &pix_offset, &block, &budget);
   if (res != SPIFFS_OK) {
     CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_ERROR, res, 0);
   }
@@ -874,27 +910,62 @@ s32_t spiffs_page_consistency_check(spiffs *fs) {
 //---------------------------------------
 // Object index consistency
 
-// searches for given object id in temporary object id index,
-// returns the index or -1
-static int spiffs_object_index_search(spiffs *fs, spiffs_obj_id obj_id) {
+// temporary object index memory of the index check
+typedef struct {
+  // blocks from here on are left for a later run
+  spiffs_block_ix end_block;
+  u8_t *table;
+  u32_t table_size;
+  // fifo position when the table is too small to be a bitmap
+  u32_t *log_ix;
+} spiffs_check_index;
+
+// a table this large holds two bits for every possible object id:
+// bit 0 reachable, bit 1 unreachable
+#define SPIFFS_CHECK_INDEX_BITMAP_SZ    (SPIFFS_OBJ_ID_IX_FLAG / 4)
+
+// returns 1 if given object id was registered as reachable, 0 if as
+// unreachable or -1 if not in temporary object id index
+static int spiffs_object_index_search(spiffs_check_index *ix, spiffs_obj_id obj_id) {
   u32_t i;
-  spiffs_obj_id *obj_table = (spiffs_obj_id *)fs->work;
+  spiffs_obj_id *obj_table = (spiffs_obj_id *)ix->table;
   obj_id &= ~SPIFFS_OBJ_ID_IX_FLAG;
-  for (i = 0; i < SPIFFS_CFG_LOG_PAGE_SZ(fs) / sizeof(spiffs_obj_id); i++) {
+  if (ix->table_size >= SPIFFS_CHECK_INDEX_BITMAP_SZ) {
+    u8_t bits = (ix->table[obj_id / 4] >> ((obj_id & 3) * 2)) & 3;
+    return bits == 0 ? -1 : (bits & 1);
+  }
+  for (i = 0; i < ix->table_size / sizeof(spiffs_obj_id); i++) {
     if ((obj_table[i] & ~SPIFFS_OBJ_ID_IX_FLAG) == obj_id) {
-      return i;
+      return (obj_table[i] & SPIFFS_OBJ_ID_IX_FLAG) ? 0 : 1;
     }
   }
   return -1;
 }
 
+static void spiffs_object_index_register(spiffs_check_index *ix, spiffs_obj_id obj_id, u8_t reachable) {
+  spiffs_obj_id *obj_table = (spiffs_obj_id *)ix->table;
+  obj_id &= ~SPIFFS_OBJ_ID_IX_FLAG;
+  if (ix->table_size >= SPIFFS_CHECK_INDEX_BITMAP_SZ) {
+    ix->table[obj_id / 4] |= (reachable ? 1 : 2) << ((obj_id & 3) * 2);
+    return;
+  }
+  obj_table[*ix->log_ix] = reachable ? obj_id : (obj_id | SPIFFS_OBJ_ID_IX_FLAG);
+  (*ix->log_ix)++;
+  if (*ix->log_ix >= ix->table_size / sizeof(spiffs_obj_id)) {
+    *ix->log_ix = 0;
+  }
+}
+
 static s32_t spiffs_object_index_consistency_check_v(spiffs *fs, spiffs_obj_id obj_id, spiffs_block_ix cur_block,
     int cur_entry, const void *user_const_p, void *user_var_p) {
   (void)user_const_p;
   s32_t res_c = SPIFFS_VIS_COUNTINUE;
   s32_t res = SPIFFS_OK;
-  u32_t *log_ix = (u32_t*)user_var_p;
-  spiffs_obj_id *obj_table = (spiffs_obj_id *)fs->work;
+  spiffs_check_index *ix = (spiffs_check_index *)user_var_p;
+
+  if (cur_block >= ix->end_block) {
+    return SPIFFS_VIS_END;
+  }
 
   CHECK_CB(fs, SPIFFS_CHECK_INDEX, SPIFFS_CHECK_PROGRESS,
       (cur_block * 256)/fs->block_count, 0);
@@ -926,18 +997,14 @@ static s32_t spiffs_object_index_consistency_check_v(spiffs *fs, spiffs_obj_id o
 
     if (p_hdr.span_ix == 0) {
       // objix header page, register objid as reachable
-      int r = spiffs_object_index_search(fs, obj_id);
+      int r = spiffs_object_index_search(ix, obj_id);
       if (r == -1) {
         // not registered, do it
-        obj_table[*log_ix] = obj_id & ~SPIFFS_OBJ_ID_IX_FLAG;
-        (*log_ix)++;
-        if (*log_ix >= SPIFFS_CFG_LOG_PAGE_SZ(fs) / sizeof(spiffs_obj_id)) {
-          *log_ix = 0;
-        }
+        spiffs_object_index_register(ix, obj_id, 1);
       }
     } else { // span index
       // objix page, see if header can be found
-      int r = spiffs_object_index_search(fs, obj_id);
+      int r = spiffs_object_index_search(ix, obj_id);
       u8_t delete = 0;
       if (r == -1) {
         // not in temporary index, try finding it
@@ -946,24 +1013,17 @@ static s32_t spiffs_object_index_consistency_check_v(spiffs *fs, spiffs_obj_id o
         res_c = SPIFFS_VIS_COUNTINUE_RELOAD;
         if (res == SPIFFS_OK) {
           // found, register as reachable
-          obj_table[*log_ix] = obj_id & ~SPIFFS_OBJ_ID_IX_FLAG;
+          spiffs_object_index_register(ix, obj_id, 1);
         } else if (res == SPIFFS_ERR_NOT_FOUND) {
           // not found, register as unreachable
           delete = 1;
-          obj_table[*log_ix] = obj_id | SPIFFS_OBJ_ID_IX_FLAG;
+          spiffs_object_index_register(ix, obj_id, 0);
         } else {
           SPIFFS_CHECK_RES(res);
         }
-        (*log_ix)++;
-        if (*log_ix >= SPIFFS_CFG_LOG_PAGE_SZ(fs) / sizeof(spiffs_obj_id)) {
-          *log_ix = 0;
-        }
-      } else {
-        // in temporary index, check reachable flag
-        if ((obj_table[r] & SPIFFS_OBJ_ID_IX_FLAG)) {
-          // registered as unreachable
-          delete = 1;
-        }
+      } else if (r == 0) {
+        // registered as unreachable
+        delete = 1;
       }
 
       if (delete) {
@@ -979,6 +1039,28 @@ static s32_t spiffs_object_index_consistency_check_v(spiffs *fs, spiffs_obj_id o
   return res_c;
 }
 
+// Checks the index pages of blocks from *block up to end_block, the
+// temporary object index must be cleared before the first block
+static s32_t spiffs_object_index_consistency_check_i(spiffs *fs, u8_t *table, u32_t table_size,
+    u32_t *log_ix, spiffs_block_ix *block, spiffs_block_ix end_block) {
+  s32_t res;
+  spiffs_check_index ix;
+
+  ix.end_block = end_block;
+  ix.table = table;
+  ix.table_size = table_size;
+  ix.log_ix = log_ix;
+  res = spiffs_obj_lu_find_entry_visitor(fs, *block, 0, SPIFFS_VIS_NO_WRAP, 0, spiffs_object_index_consistency_check_v,
+      0, &ix, 0, 0);
+  if (res == SPIFFS_VIS_END) {
+    res = SPIFFS_OK;
+  }
+  if (res == SPIFFS_OK) {
+    *block = end_block;
+  }
+  return res;
+}
+
 // Removes orphaned and partially deleted index pages.
 // Scans for index pages. When an index page is found, corresponding index header is searched for.
 // If no such page exists, the index page cannot be reached as no index header exists and must be
@@ -989,15 +1071,14 @@ s32_t spiffs_object_index_consistency_check(spiffs *fs) {
   // fs->work is used for a temporary object index memory, listing found object ids and
   // indicating whether they can be reached or not. Acting as a fifo if object ids cannot fit.
   // In the temporary object index memory, SPIFFS_OBJ_ID_IX_FLAG bit is used to indicate
-  // a reachable/unreachable object id.
+  // a reachable/unreachable object id. A memory of SPIFFS_CHECK_INDEX_BITMAP_SZ bytes is
+  // used as a bitmap instead, which never has to fall back on searching the flash twice.
   memset(fs->work, 0, SPIFFS_CFG_LOG_PAGE_SZ(fs));
   u32_t obj_id_log_ix = 0;
+  spiffs_block_ix block = 0;
   CHECK_CB(fs, SPIFFS_CHECK_INDEX, SPIFFS_CHECK_PROGRESS, 0, 0);
-  res = spiffs_obj_lu_find_entry_visitor(fs, 0, 0, 0, 0, spiffs_object_index_consistency_check_v, 0, &obj_id_log_ix,
-        0, 0);
-  if (res == SPIFFS_VIS_END) {
-    res = SPIFFS_OK;
-  }
+  res = spiffs_object_index_consistency_check_i(fs, fs->work, SPIFFS_CFG_LOG_PAGE_SZ(fs),
+      &obj_id_log_ix, &block, fs->block_count);
   if (res != SPIFFS_OK) {
     CHECK_CB(fs, SPIFFS_CHECK_INDEX, SPIFFS_CHECK_ERROR, res, 0);
   }
@@ -1005,4 +1086,79 @@ s32_t spiffs_object_index_consistency_check(spiffs *fs) {
   return res;
 }
 
+//---------------------------------------
+// Stepped check
+
+// phases following SPIFFS_CHECK_PAGE
+#define SPIFFS_CHECK_PHASE_SCAN   (SPIFFS_CHECK_PAGE + 1)
+#define SPIFFS_CHECK_PHASE_DONE   (SPIFFS_CHECK_PAGE + 2)
+
+void spiffs_check_begin(spiffs *fs, spiffs_check_state *st, void *map, u32_t map_size) {
+  if (map == 0 || map_size < SPIFFS_CFG_LOG_PAGE_SZ(fs)) {
+    map = fs->work;
+    map_size = SPIFFS_CFG_LOG_PAGE_SZ(fs);
+  }
+  // whole object ids for the index check, pairs of pages for the page check
+  map_size &= ~(sizeof(spiffs_obj_id) - 1);
+  memset(st, 0, sizeof(spiffs_check_state));
+  st->map = (u8_t *)map;
+  st->map_size = map_size;
+  st->phase = SPIFFS_CHECK_LOOKUP;
+}
+
+// Runs the same checks as SPIFFS_check, visiting at most budget blocks.
+// A phase failing is reported through the check callback and skipped, as
+// SPIFFS_check does. Returns 1 if there is more to do, 0 when done.
+s32_t spiffs_check_step(spiffs *fs, spiffs_check_state *st, u32_t budget) {
+  s32_t res = SPIFFS_OK;
+  spiffs_block_ix end_block;
+
+  while (budget > 0 && st->phase != SPIFFS_CHECK_PHASE_DONE) {
+    if (st->block == 0 && st->pix_offset == 0 && st->phase != SPIFFS_CHECK_PHASE_SCAN) {
+      CHECK_CB(fs, st->phase, SPIFFS_CHECK_PROGRESS, 0, 0);
+      if (st->phase == SPIFFS_CHECK_INDEX) {
+        memset(st->map, 0, st->map_size);
+        st->log_ix = 0;
+      }
+    }
+    end_block = st->block + MIN(budget, (u32_t)(fs->block_count - st->block));
+
+    switch (st->phase) {
+    case SPIFFS_CHECK_LOOKUP:
+      budget -= end_block - st->block;
+      res = spiffs_lookup_consistency_check_i(fs, &st->block, end_block);
+      break;
+    case SPIFFS_CHECK_INDEX:
+      budget -= end_block - st->block;
+      res = spiffs_object_index_consistency_check_i(fs, st->map, st->map_size, &st->log_ix,
+          &st->block, end_block);
+      break;
+    case SPIFFS_CHECK_PAGE:
+      res = spiffs_page_consistency_check_i(fs, st->map, st->map_size, &st->pix_offset, &st->block, &budget);
+      if (res == SPIFFS_OK && st->pix_offset < SPIFFS_PAGES_PER_BLOCK(fs) * fs->block_count) {
+        continue;
+      }
+      break;
+    default:
+      budget--;
+      res = spiffs_obj_lu_scan(fs);
+      st->phase = SPIFFS_CHECK_PHASE_DONE;
+      SPIFFS_CHECK_RES(res);
+      continue;
+    }
+
+    if (res != SPIFFS_OK) {
+      CHECK_CB(fs, st->phase, SPIFFS_CHECK_ERROR, res, 0);
+    } else if (st->block < fs->block_count && st->phase != SPIFFS_CHECK_PAGE) {
+      continue;
+    }
+    CHECK_CB(fs, st->phase, SPIFFS_CHECK_PROGRESS, 256, 0);
+    st->phase++;
+    st->block = 0;
+    st->pix_offset = 0;
+  }
+
+  return st->phase == SPIFFS_CHECK_PHASE_DONE ? 0 : 1;
+}
+
 #endif // !SPIFFS_READ_ONLY
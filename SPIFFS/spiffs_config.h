@@ -87,7 +87,7 @@ typedef unsigned char u8_t;
 // for filedescriptor and cache buffers. Once decided for a configuration,
 // this can be disabled to reduce flash.
 #ifndef SPIFFS_BUFFER_HELP
-#define SPIFFS_BUFFER_HELP 0
+#define SPIFFS_BUFFER_HELP 1
 #endif
 
 // Enables/disable memory read caching of nucleus file system operations.
@@ -105,6 +105,15 @@ typedef unsigned char u8_t;
 #ifndef SPIFFS_CACHE_STATS
 #define SPIFFS_CACHE_STATS 1
 #endif
+
+// Percentage of the read cache that object lookup and object index pages
+// may occupy before they are evicted in favour of each other rather than
+// of data pages. Lookup pages are revisited by almost every operation while
+// data pages are mostly streamed once, so keeping them apart stops a large
+// sequential read from flushing the lookup pages out of the cache.
+#ifndef SPIFFS_CACHE_META_SHARE
+#define SPIFFS_CACHE_META_SHARE 50
+#endif
 #endif
 
 // Always check header of each accessed page to ensure consistent state.
@@ -181,6 +190,16 @@ typedef unsigned char u8_t;
 #define SPIFFS_USE_MAGIC (0)
 #endif
 
+// Enable this to keep a summary of the filesystem state (free blocks, deleted
+// pages, erase count, object id high-water mark) in the last physical erase
+// block of the partition. The summary is written on a clean SPIFFS_unmount and
+// lets the next SPIFFS_mount skip the full object lookup scan. It is consumed
+// by the mount that reads it, so after a power loss the mount falls back to the
+// full scan. Reserves one logical block, changing this requires a reformat.
+#ifndef SPIFFS_MOUNT_SUMMARY
+#define SPIFFS_MOUNT_SUMMARY 1
+#endif
+
 #if SPIFFS_USE_MAGIC
 // Only valid when SPIFFS_USE_MAGIC is enabled. If SPIFFS_USE_MAGIC_LENGTH is
 // enabled, the magic will also be dependent on the length of the filesystem.
@@ -18,7 +18,9 @@ u32_t SPIFFS_buffer_bytes_for_filedescs(spiffs *fs, u32_t num_descs) {
 }
 #if SPIFFS_CACHE
 u32_t SPIFFS_buffer_bytes_for_cache(spiffs *fs, u32_t num_pages) {
-  return sizeof(spiffs_cache) + num_pages * (sizeof(spiffs_cache_page) + SPIFFS_CFG_LOG_PAGE_SZ(fs));
+  u32_t sz = sizeof(spiffs_cache) + num_pages * SPIFFS_CACHE_PAGE_COST(fs);
+  // SPIFFS_mount trims the cache size to pointer alignment, leave room for it
+  return (sz + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
 }
 #endif
 #endif
@@ -52,6 +54,14 @@ s32_t SPIFFS_format(spiffs *fs) {
     bix++;
   }
 
+#if SPIFFS_MOUNT_SUMMARY
+  res = spiffs_summary_erase(fs);
+  if (res != SPIFFS_OK) {
+    res = SPIFFS_ERR_ERASE_FAIL;
+  }
+  SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+#endif
+
   SPIFFS_UNLOCK(fs);
 
   return 0;
@@ -90,7 +100,12 @@ s32_t SPIFFS_mount(spiffs *fs, spiffs_config *config, u8_t *work,
   memset(fs, 0, sizeof(spiffs));
   _SPIFFS_MEMCPY(&fs->cfg, config, sizeof(spiffs_config));
   fs->user_data = user_data;
+#if SPIFFS_MOUNT_SUMMARY
+  // last erase block keeps the mount summary
+  fs->block_count = (SPIFFS_CFG_PHYS_SZ(fs) - SPIFFS_CFG_PHYS_ERASE_SZ(fs)) / SPIFFS_CFG_LOG_BLOCK_SZ(fs);
+#else
   fs->block_count = SPIFFS_CFG_PHYS_SZ(fs) / SPIFFS_CFG_LOG_BLOCK_SZ(fs);
+#endif
   fs->work = &work[0];
   fs->lu_work = &work[SPIFFS_CFG_LOG_PAGE_SZ(fs)];
   memset(fd_space, 0, fd_space_size);
@@ -118,7 +133,7 @@ s32_t SPIFFS_mount(spiffs *fs, spiffs_config *config, u8_t *work,
 
 #if SPIFFS_CACHE
   fs->cache = cache;
-  fs->cache_size = (cache_size > (SPIFFS_CFG_LOG_PAGE_SZ(fs)*32)) ? SPIFFS_CFG_LOG_PAGE_SZ(fs)*32 : cache_size;
+  fs->cache_size = cache_size;
   spiffs_cache_init(fs);
 #endif
 
@@ -131,7 +146,14 @@ s32_t SPIFFS_mount(spiffs *fs, spiffs_config *config, u8_t *work,
 
   fs->config_magic = SPIFFS_CONFIG_MAGIC;
 
+#if SPIFFS_MOUNT_SUMMARY
+  res = spiffs_summary_load(fs);
+  if (res != SPIFFS_OK) {
+    res = spiffs_obj_lu_scan(fs);
+  }
+#else
   res = spiffs_obj_lu_scan(fs);
+#endif
   SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
 
   SPIFFS_DBG("page index byte len:         "_SPIPRIi"\r\n", (u32_t)SPIFFS_CFG_LOG_PAGE_SZ(fs));
@@ -167,6 +189,11 @@ void SPIFFS_unmount(spiffs *fs) {
       spiffs_fd_return(fs, cur_fd->file_nbr);
     }
   }
+#if SPIFFS_MOUNT_SUMMARY && !SPIFFS_READ_ONLY
+  if (spiffs_summary_store(fs) != SPIFFS_OK) {
+    SPIFFS_DBG("unmount: failed to store summary\n");
+  }
+#endif
   fs->mounted = 0;
 
   SPIFFS_UNLOCK(fs);
@@ -521,6 +548,9 @@ s32_t SPIFFS_write(spiffs *fs, spiffs_file fh, void *buf, s32_t len) {
           res = spiffs_hydro_write(fs, fd,
               spiffs_get_cache_page(fs, spiffs_get_cache(fs), fd->cache_page->ix),
               fd->cache_page->offset, fd->cache_page->size);
+#if SPIFFS_CACHE_STATS
+          fs->cache_writebacks++;
+#endif
           spiffs_cache_fd_release(fs, fd->cache_page);
           SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
         } else {
@@ -578,6 +608,9 @@ s32_t SPIFFS_write(spiffs *fs, spiffs_file fh, void *buf, s32_t len) {
         res = spiffs_hydro_write(fs, fd,
             spiffs_get_cache_page(fs, spiffs_get_cache(fs), fd->cache_page->ix),
             fd->cache_page->offset, fd->cache_page->size);
+#if SPIFFS_CACHE_STATS
+        fs->cache_writebacks++;
+#endif
         spiffs_cache_fd_release(fs, fd->cache_page);
         SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
         // data written below
@@ -864,6 +897,9 @@ static s32_t spiffs_fflush_cache(spiffs *fs, spiffs_file fh) {
       if (res < SPIFFS_OK) {
         fs->err_code = res;
       }
+#if SPIFFS_CACHE_STATS
+      fs->cache_writebacks++;
+#endif
       spiffs_cache_fd_release(fs, fd->cache_page);
     }
   }
@@ -1163,6 +1199,41 @@ s32_t SPIFFS_check(spiffs *fs) {
 #endif // SPIFFS_READ_ONLY
 }
 
+s32_t SPIFFS_check_begin(spiffs *fs, spiffs_check_state *st, void *map, u32_t map_size) {
+  SPIFFS_API_DBG("%s "_SPIPRIi"\n", __func__, map_size);
+#if SPIFFS_READ_ONLY
+  (void)fs; (void)st; (void)map; (void)map_size;
+  return SPIFFS_ERR_RO_NOT_IMPL;
+#else
+  SPIFFS_API_CHECK_CFG(fs);
+  SPIFFS_API_CHECK_MOUNT(fs);
+  SPIFFS_LOCK(fs);
+
+  spiffs_check_begin(fs, st, map, map_size);
+
+  SPIFFS_UNLOCK(fs);
+  return SPIFFS_OK;
+#endif // SPIFFS_READ_ONLY
+}
+
+s32_t SPIFFS_check_step(spiffs *fs, spiffs_check_state *st, u32_t blocks) {
+  SPIFFS_API_DBG("%s "_SPIPRIi"\n", __func__, blocks);
+#if SPIFFS_READ_ONLY
+  (void)fs; (void)st; (void)blocks;
+  return SPIFFS_ERR_RO_NOT_IMPL;
+#else
+  s32_t res;
+  SPIFFS_API_CHECK_CFG(fs);
+  SPIFFS_API_CHECK_MOUNT(fs);
+  SPIFFS_LOCK(fs);
+
+  res = spiffs_check_step(fs, st, blocks);
+
+  SPIFFS_UNLOCK(fs);
+  return res;
+#endif // SPIFFS_READ_ONLY
+}
+
 s32_t SPIFFS_info(spiffs *fs, u32_t *total, u32_t *used) {
   SPIFFS_API_DBG("%s\n", __func__);
   s32_t res = SPIFFS_OK;
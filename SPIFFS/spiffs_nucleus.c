@@ -336,6 +336,7 @@ static s32_t spiffs_obj_lu_scan_v(
     fs->stats_p_deleted++;
   } else {
     fs->stats_p_allocated++;
+    fs->max_obj_id = MAX(fs->max_obj_id, obj_id & ~SPIFFS_OBJ_ID_IX_FLAG);
   }
 
   return SPIFFS_VIS_COUNTINUE;
@@ -422,6 +423,7 @@ s32_t spiffs_obj_lu_scan(
   fs->free_blocks = 0;
   fs->stats_p_allocated = 0;
   fs->stats_p_deleted = 0;
+  fs->max_obj_id = 0;
 
   res = spiffs_obj_lu_find_entry_visitor(fs,
       0,
@@ -443,6 +445,167 @@ s32_t spiffs_obj_lu_scan(
   return res;
 }
 
+#if SPIFFS_MOUNT_SUMMARY
+static u32_t spiffs_summary_checksum(const spiffs_summary *sum) {
+  const u32_t *w = (const u32_t *)sum;
+  u32_t cs = SPIFFS_SUMMARY_MAGIC;
+  u32_t i;
+  for (i = 0; i < offsetof(spiffs_summary, checksum) / sizeof(u32_t); i++) {
+    if (i == offsetof(spiffs_summary, valid) / sizeof(u32_t)) continue;
+    cs = ((cs << 5) | (cs >> 27)) ^ w[i];
+  }
+  return cs;
+}
+
+// Finds the last written summary slot, -1 if the summary area is empty
+static s32_t spiffs_summary_find_last(
+    spiffs *fs,
+    int *slot) {
+  s32_t res;
+  int i;
+  int slots = SPIFFS_CFG_PHYS_ERASE_SZ(fs) / sizeof(spiffs_summary);
+  u32_t magic;
+
+  *slot = -1;
+  for (i = 0; i < slots; i++) {
+    res = SPIFFS_HAL_READ(fs, SPIFFS_SUMMARY_PADDR(fs) + i * sizeof(spiffs_summary),
+        sizeof(u32_t), (u8_t *)&magic);
+    SPIFFS_CHECK_RES(res);
+    if (magic == 0xffffffff) {
+      break;
+    }
+    *slot = i;
+  }
+  return SPIFFS_OK;
+}
+
+static s32_t spiffs_summary_erase_counts(
+    spiffs *fs,
+    u32_t *first,
+    u32_t *last) {
+  s32_t res;
+  spiffs_obj_id erase_count;
+
+  res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+      0, SPIFFS_ERASE_COUNT_PADDR(fs, 0),
+      sizeof(spiffs_obj_id), (u8_t *)&erase_count);
+  SPIFFS_CHECK_RES(res);
+  *first = erase_count;
+  res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+      0, SPIFFS_ERASE_COUNT_PADDR(fs, fs->block_count - 1),
+      sizeof(spiffs_obj_id), (u8_t *)&erase_count);
+  SPIFFS_CHECK_RES(res);
+  *last = erase_count;
+  return SPIFFS_OK;
+}
+
+// Restores the counters of spiffs_obj_lu_scan from the summary written by the
+// last clean unmount. The summary is marked consumed so that it is trusted
+// only once, returns SPIFFS_ERR_NO_SUMMARY if a full scan is needed.
+s32_t spiffs_summary_load(
+    spiffs *fs) {
+  s32_t res;
+  int slot;
+  spiffs_summary sum;
+  u32_t erase_count_first, erase_count_last;
+
+  res = spiffs_summary_find_last(fs, &slot);
+  SPIFFS_CHECK_RES(res);
+  if (slot < 0) {
+    return SPIFFS_ERR_NO_SUMMARY;
+  }
+  res = SPIFFS_HAL_READ(fs, SPIFFS_SUMMARY_PADDR(fs) + slot * sizeof(spiffs_summary),
+      sizeof(spiffs_summary), (u8_t *)&sum);
+  SPIFFS_CHECK_RES(res);
+
+  if (sum.magic != SPIFFS_SUMMARY_MAGIC ||
+      sum.valid != 0xffffffff ||
+      sum.checksum != spiffs_summary_checksum(&sum) ||
+      sum.log_page_size != SPIFFS_CFG_LOG_PAGE_SZ(fs) ||
+      sum.log_block_size != SPIFFS_CFG_LOG_BLOCK_SZ(fs) ||
+      sum.block_count != fs->block_count ||
+      sum.use_magic != SPIFFS_USE_MAGIC) {
+    SPIFFS_DBG("mount: no valid summary in slot "_SPIPRIi"\n", slot);
+    return SPIFFS_ERR_NO_SUMMARY;
+  }
+
+  res = spiffs_summary_erase_counts(fs, &erase_count_first, &erase_count_last);
+  SPIFFS_CHECK_RES(res);
+  if (sum.erase_count_first != erase_count_first ||
+      sum.erase_count_last != erase_count_last) {
+    SPIFFS_DBG("mount: summary does not match erase counts\n");
+    return SPIFFS_ERR_NO_SUMMARY;
+  }
+
+#if !SPIFFS_READ_ONLY
+  u32_t consumed = 0;
+  res = SPIFFS_HAL_WRITE(fs, SPIFFS_SUMMARY_PADDR(fs) + slot * sizeof(spiffs_summary) +
+      offsetof(spiffs_summary, valid), sizeof(u32_t), (u8_t *)&consumed);
+  SPIFFS_CHECK_RES(res);
+#endif
+
+  fs->free_blocks = sum.free_blocks;
+  fs->stats_p_allocated = sum.stats_p_allocated;
+  fs->stats_p_deleted = sum.stats_p_deleted;
+  fs->free_cursor_block_ix = sum.free_cursor_block_ix;
+  fs->free_cursor_obj_lu_entry = sum.free_cursor_obj_lu_entry;
+  fs->max_erase_count = sum.max_erase_count;
+  fs->max_obj_id = sum.max_obj_id;
+
+  SPIFFS_DBG("mount: restored summary from slot "_SPIPRIi"\n", slot);
+  return SPIFFS_OK;
+}
+
+#if !SPIFFS_READ_ONLY
+// Appends a summary of the current state to the summary area, erasing the
+// area first when it is full
+s32_t spiffs_summary_store(
+    spiffs *fs) {
+  s32_t res;
+  int slot;
+  spiffs_summary sum;
+
+  memset(&sum, 0xff, sizeof(spiffs_summary));
+  sum.magic = SPIFFS_SUMMARY_MAGIC;
+  sum.log_page_size = SPIFFS_CFG_LOG_PAGE_SZ(fs);
+  sum.log_block_size = SPIFFS_CFG_LOG_BLOCK_SZ(fs);
+  sum.block_count = fs->block_count;
+  sum.free_blocks = fs->free_blocks;
+  sum.stats_p_allocated = fs->stats_p_allocated;
+  sum.stats_p_deleted = fs->stats_p_deleted;
+  sum.free_cursor_block_ix = fs->free_cursor_block_ix;
+  sum.free_cursor_obj_lu_entry = fs->free_cursor_obj_lu_entry;
+  sum.max_erase_count = fs->max_erase_count;
+  sum.max_obj_id = fs->max_obj_id;
+  sum.use_magic = SPIFFS_USE_MAGIC;
+  res = spiffs_summary_erase_counts(fs, &sum.erase_count_first, &sum.erase_count_last);
+  SPIFFS_CHECK_RES(res);
+  sum.checksum = spiffs_summary_checksum(&sum);
+
+  res = spiffs_summary_find_last(fs, &slot);
+  SPIFFS_CHECK_RES(res);
+  slot++;
+  if (slot >= (int)(SPIFFS_CFG_PHYS_ERASE_SZ(fs) / sizeof(spiffs_summary))) {
+    res = spiffs_summary_erase(fs);
+    SPIFFS_CHECK_RES(res);
+    slot = 0;
+  }
+
+  res = SPIFFS_HAL_WRITE(fs, SPIFFS_SUMMARY_PADDR(fs) + slot * sizeof(spiffs_summary),
+      sizeof(spiffs_summary), (u8_t *)&sum);
+  SPIFFS_CHECK_RES(res);
+  return res;
+}
+
+// Drops all summaries, needed whenever the blocks are changed without
+// going through a mount, i.e. on format
+s32_t spiffs_summary_erase(
+    spiffs *fs) {
+  return SPIFFS_HAL_ERASE(fs, SPIFFS_SUMMARY_PADDR(fs), SPIFFS_CFG_PHYS_ERASE_SZ(fs));
+}
+#endif // !SPIFFS_READ_ONLY
+#endif // SPIFFS_MOUNT_SUMMARY
+
 #if !SPIFFS_READ_ONLY
 // Find free object lookup entry
 // Iterate over object lookup pages in each block until a free object id entry is found
@@ -947,6 +1110,7 @@ s32_t spiffs_object_create(
   SPIFFS_CHECK_RES(res);
 
   fs->stats_p_allocated++;
+  fs->max_obj_id = MAX(fs->max_obj_id, obj_id & ~SPIFFS_OBJ_ID_IX_FLAG);
 
   // write empty object index page
   oix_hdr.p_hdr.obj_id = obj_id;
@@ -2152,6 +2316,11 @@ s32_t spiffs_obj_lu_find_free_obj_id(spiffs *fs, spiffs_obj_id *obj_id, const u8
   if (state.max_obj_id & SPIFFS_OBJ_ID_IX_FLAG) {
     state.max_obj_id = ((spiffs_obj_id)-1) & ~SPIFFS_OBJ_ID_IX_FLAG;
   }
+  // no id above the high-water mark is in use, so the range up to the first
+  // of them always holds a free id and often fits the bitmap right away
+  if ((u32_t)fs->max_obj_id + 1 < state.max_obj_id) {
+    state.max_obj_id = fs->max_obj_id + 1;
+  }
   state.compaction = 0;
   state.conflicting_name = conflicting_name;
   while (res == SPIFFS_OK && free_obj_id == SPIFFS_OBJ_ID_FREE) {
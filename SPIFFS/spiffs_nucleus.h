@@ -169,6 +169,10 @@
 
 #define SPIFFS_CONFIG_MAGIC             (0x20090315)
 
+#if SPIFFS_MOUNT_SUMMARY
+#define SPIFFS_SUMMARY_MAGIC            (0x20220901)
+#endif
+
 #if SPIFFS_SINGLETON == 0
 #define SPIFFS_CFG_LOG_PAGE_SZ(fs) \
   ((fs)->cfg.log_page_size)
@@ -235,6 +239,12 @@
 // always in the physical second last entry of the last object lookup page
 #define SPIFFS_MAGIC_PADDR(fs, bix) \
   ( SPIFFS_BLOCK_TO_PADDR(fs, bix) + SPIFFS_OBJ_LOOKUP_PAGES(fs) * SPIFFS_CFG_LOG_PAGE_SZ(fs) - sizeof(spiffs_obj_id)*2 )
+#if SPIFFS_MOUNT_SUMMARY
+// returns physical address of the mount summary area,
+// always the last physical erase block of the partition
+#define SPIFFS_SUMMARY_PADDR(fs) \
+  ( SPIFFS_CFG_PHYS_ADDR(fs) + SPIFFS_CFG_PHYS_SZ(fs) - SPIFFS_CFG_PHYS_ERASE_SZ(fs) )
+#endif
 // checks if there is any room for magic in the object luts
 #define SPIFFS_CHECK_MAGIC_POSSIBLE(fs) \
   ( (SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs) % (SPIFFS_CFG_LOG_PAGE_SZ(fs)/sizeof(spiffs_obj_id))) * sizeof(spiffs_obj_id) \
@@ -383,8 +393,14 @@
 #define SPIFFS_CACHE_FLAG_OBJLU       (1<<2)
 #define SPIFFS_CACHE_FLAG_OBJIX       (1<<3)
 #define SPIFFS_CACHE_FLAG_DATA        (1<<4)
+#define SPIFFS_CACHE_FLAG_INUSE       (1<<5)
 #define SPIFFS_CACHE_FLAG_TYPE_WR     (1<<7)
 
+#define SPIFFS_CACHE_FLAG_META \
+  (SPIFFS_CACHE_FLAG_OBJLU | SPIFFS_CACHE_FLAG_OBJIX)
+
+#define SPIFFS_CACHE_NO_PAGE          (0xffff)
+
 #define SPIFFS_CACHE_PAGE_SIZE(fs) \
   (sizeof(spiffs_cache_page) + SPIFFS_CFG_LOG_PAGE_SZ(fs))
 
@@ -397,6 +413,10 @@
 #define spiffs_get_cache_page(fs, c, ix) \
   ((u8_t *)(&((c)->cpages[(ix) * SPIFFS_CACHE_PAGE_SIZE(fs)])) + sizeof(spiffs_cache_page))
 
+// bytes needed for one cache page including its hash bucket
+#define SPIFFS_CACHE_PAGE_COST(fs) \
+  (SPIFFS_CACHE_PAGE_SIZE(fs) + sizeof(u16_t))
+
 
 
 #pragma anon_unions
@@ -405,7 +425,9 @@ typedef struct {
   // cache flags
   u8_t flags;
   // cache page index
-  u8_t ix;
+  u16_t ix;
+  // next cache page in same hash bucket, SPIFFS_CACHE_NO_PAGE ends chain
+  u16_t hnext;
   // last access of this cache page
   u32_t last_access;
   union {
@@ -430,10 +452,16 @@ typedef struct {
 
 // cache struct
 typedef struct {
-  u8_t cpage_count;
+  u16_t cpage_count;
+  // number of cache pages in use
+  u16_t cpage_used;
+  // number of read cache pages holding object lookup or index pages
+  u16_t cpage_meta;
+  // soft limit of cpage_meta, see SPIFFS_CACHE_META_SHARE
+  u16_t cpage_meta_max;
   u32_t last_access;
-  u32_t cpage_use_map;
-  u32_t cpage_use_mask;
+  // page index hash, one bucket per cache page
+  u16_t *hbuckets;
   u8_t *cpages;
 } spiffs_cache;
 
@@ -520,6 +548,33 @@ typedef struct SPIFFS_PACKED {
  u8_t _align[4 - ((sizeof(spiffs_page_header)&3)==0 ? 4 : (sizeof(spiffs_page_header)&3))];
 } spiffs_page_object_ix;
 
+#if SPIFFS_MOUNT_SUMMARY
+// clean unmount summary, appended to the summary area on each unmount
+typedef struct {
+  // SPIFFS_SUMMARY_MAGIC if written
+  u32_t magic;
+  // 0xffffffff until consumed by a mount, then programmed to zero
+  u32_t valid;
+  u32_t log_page_size;
+  u32_t log_block_size;
+  u32_t block_count;
+  u32_t free_blocks;
+  u32_t stats_p_allocated;
+  u32_t stats_p_deleted;
+  u32_t free_cursor_block_ix;
+  u32_t free_cursor_obj_lu_entry;
+  u32_t max_erase_count;
+  u32_t max_obj_id;
+  // SPIFFS_USE_MAGIC at unmount time
+  u32_t use_magic;
+  // erase counts of first and last block, catches the partition being
+  // erased or reused behind our back
+  u32_t erase_count_first;
+  u32_t erase_count_last;
+  u32_t checksum;
+} spiffs_summary;
+#endif
+
 // callback func for object lookup visitor
 typedef s32_t (*spiffs_visitor_f)(spiffs *fs, spiffs_obj_id id, spiffs_block_ix bix, int ix_entry,
     const void *user_const_p, void *user_var_p);
@@ -602,6 +657,17 @@ s32_t spiffs_probe(
 s32_t spiffs_obj_lu_scan(
     spiffs *fs);
 
+#if SPIFFS_MOUNT_SUMMARY
+s32_t spiffs_summary_load(
+    spiffs *fs);
+
+s32_t spiffs_summary_store(
+    spiffs *fs);
+
+s32_t spiffs_summary_erase(
+    spiffs *fs);
+#endif // SPIFFS_MOUNT_SUMMARY
+
 s32_t spiffs_obj_lu_find_free_obj_id(
     spiffs *fs,
     spiffs_obj_id *obj_id,
@@ -822,6 +888,17 @@ s32_t spiffs_page_consistency_check(
 s32_t spiffs_object_index_consistency_check(
     spiffs *fs);
 
+void spiffs_check_begin(
+    spiffs *fs,
+    spiffs_check_state *st,
+    void *map,
+    u32_t map_size);
+
+s32_t spiffs_check_step(
+    spiffs *fs,
+    spiffs_check_state *st,
+    u32_t budget);
+
 // memcpy macro,
 // checked in test builds, otherwise plain memcpy (unless already defined)
 #ifdef _SPIFFS_TEST
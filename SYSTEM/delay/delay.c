@@ -34,6 +34,7 @@ extern BaseType_t xTaskGetSchedulerState(void);
 
 void SysTick_Handler(void)
 {
+    delay_get_ms();                                            //count the CYCCNT wraps while main() waits
     if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) //??????
     {
         xPortSysTickHandler();
@@ -48,6 +49,9 @@ void delay_init(u16 SYSCLK)
     reload = SYSCLK;
     reload *= 1000000 / configTICK_RATE_HZ;    //?? configTICK_RATE_HZ ??????
     fac_ms = 1000 / configTICK_RATE_HZ;        //?? OS ?????????
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; //DWT cycle counter for delay_get_ms()
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
     SysTick->CTRL |= SysTick_CTRL_TICKINT_Msk; //?? SYSTICK ??
     SysTick->LOAD = reload;                    //? 1/configTICK_RATE_HZ ???
     SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;  //?? SYSTICK
@@ -88,6 +92,32 @@ void delay_ms(u32 nms)
     delay_us((u32)(nms * 1000)); //??????
 }
 
+//ms since delay_init() from the DWT cycle counter. HAL_GetTick() stays 0: SysTick
+//only drives FreeRTOS, whose scheduler is not started, and cannot preempt the
+//USMART commands (TIM4) anyway. A CYCCNT wrap (10.7s at 400MHz) is only counted
+//when this runs at least once per wrap, SysTick_Handler calls it every tick.
+u32 delay_get_ms(void)
+{
+    static u32 last, ms, rest;
+    u32 primask = __get_PRIMASK();
+    u32 cyc, d, cpm = fac_us * 1000;
+
+    if (!cpm)
+        return 0;
+    __disable_irq();
+    cyc = DWT->CYCCNT;
+    d = cyc - last;
+    last = cyc;
+    ms += d / cpm;
+    rest += d % cpm;
+    if (rest >= cpm) {
+        ms++;
+        rest -= cpm;
+    }
+    __set_PRIMASK(primask);
+    return ms;
+}
+
 void delay_xms(u32 nms)
 {
     u32 i;
@@ -21,5 +21,6 @@ void delay_init(u16 SYSCLK);
 void delay_xms(u32 nms);
 void delay_ms(u32 nms);
 void delay_us(u32 nus);
+u32 delay_get_ms(void);			//ms clock from the DWT cycle counter, HAL_GetTick() does not run
 #endif
 
@@ -1,6 +1,51 @@
 #include "nfvfs.h"
 #include "lfs.h"
 #include "delay.h"
+#include "sys.h"
+#include "malloc.h"
+#include "spiffs_brigde.h"
+#include "jesfs.h"
+#include "w25qxx.h"
+#include "w25qxx_async.h"
+#include "nordev.h"
+#include "nfvfs_async.h"
+#include "nfvfs_replay.h"
+
+#define BENCH_CHUNK_SIZE 256
+
+static uint8_t bench_buf[BENCH_CHUNK_SIZE];
+
+/* cycle counter of the core, wraps after ~10s at 400MHz so only
+ * time single operations with it and sum the deltas up */
+static void bench_timer_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t bench_cycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+static uint32_t bench_us(uint64_t cycles)
+{
+    return (uint32_t)(cycles / (SystemCoreClock / 1000000));
+}
+
+/* KB/s from a byte count and elapsed cycles */
+static uint32_t bench_kbps(uint64_t bytes, uint64_t cycles)
+{
+    uint32_t us = bench_us(cycles);
+    return us ? (uint32_t)(bytes * 1000000 / 1024 / us) : 0;
+}
+
+static uint32_t bench_rand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
 
 void basic_storage_test(const char *fsname, int loop)
 {
@@ -56,3 +101,1266 @@ void basic_storage_test(const char *fsname, int loop)
         delay_ms(2000);
     }
 }
+
+static int bench_check_phase = -1;
+
+static void bench_check_progress(int phase, int progress)
+{
+    if (phase != bench_check_phase) {
+        printf("\r\ncheck phase %d: ", phase);
+        bench_check_phase = phase;
+    }
+    if (progress % 64 == 0)
+        printf("%d%% ", progress * 100 / 256);
+}
+
+/* SPIFFS consistency check run in steps, map_kb of SDRAM for the check
+ * bitmaps (0 uses the spiffs work buffer), reports the total time and
+ * the longest step which bounds how long the caller goes unserviced */
+void spiffs_check_benchmark(int map_kb, int blocks_per_step)
+{
+    struct nfvfs *fs;
+    void *map = NULL;
+    uint32_t t, step_cycles, max_cycles = 0;
+    uint64_t total_cycles = 0;
+    int ret, steps = 0;
+
+    fs = get_nfvfs("spiffs");
+    if (!fs) {
+        printf("\r\nFailed to get spiffs, making sure you have register it\r\n");
+        return;
+    }
+
+    if (map_kb > 0) {
+        map = mymalloc(SRAMEX, map_kb * 1024);
+        if (!map) {
+            printf("no SDRAM for %dKB check map\r\n", map_kb);
+            return;
+        }
+    }
+
+    bench_timer_init();
+    nfvfs_mount(fs);
+    bench_check_phase = -1;
+    ret = spiffs_check_begin_wrp(map, map_kb * 1024, bench_check_progress);
+    while (ret == 1 || (ret == 0 && steps == 0)) {
+        t = bench_cycles();
+        ret = spiffs_check_step_wrp(blocks_per_step);
+        step_cycles = bench_cycles() - t;
+        total_cycles += step_cycles;
+        if (step_cycles > max_cycles)
+            max_cycles = step_cycles;
+        steps++;
+    }
+
+    printf("\r\ncheck %s: map %dKB, %d steps, total %d ms, longest step %d us\r\n",
+           ret == 0 ? "done" : "failed", map_kb, steps,
+           bench_us(total_cycles) / 1000, bench_us(max_cycles));
+
+    nfvfs_umount(fs);
+    if (map)
+        myfree(SRAMEX, map);
+}
+
+/* SPIFFS throughput against the number of cache pages, the cache is
+ * placed in SDRAM and grown by a factor of 4 from 4 pages to max_pages */
+void spiffs_cache_benchmark(int max_pages, int file_kb)
+{
+    struct nfvfs *fs;
+    void *cache;
+    uint32_t size, seed, t;
+    uint64_t wr_cycles, seq_cycles, rnd_cycles;
+    int pages, fd, i, chunks, reads;
+
+    fs = get_nfvfs("spiffs");
+    if (!fs) {
+        printf("\r\nFailed to get spiffs, making sure you have register it\r\n");
+        return;
+    }
+
+    bench_timer_init();
+    chunks = file_kb * 1024 / BENCH_CHUNK_SIZE;
+    reads = file_kb * 16;
+    for (i = 0; i < BENCH_CHUNK_SIZE; i++)
+        bench_buf[i] = i;
+
+    printf("pages\twrite KB/s\tseq read KB/s\trand read op/s\r\n");
+    for (pages = 4; pages <= max_pages; pages *= 4) {
+        size = spiffs_cache_bytes(pages);
+        cache = mymalloc(SRAMEX, size);
+        if (!cache) {
+            printf("no SDRAM for %d cache pages (%d bytes)\r\n", pages, size);
+            break;
+        }
+        if (spiffs_cache_config(cache, size) < 0) {
+            myfree(SRAMEX, cache);
+            break;
+        }
+        nfvfs_mount(fs);
+
+        wr_cycles = 0;
+        fd = nfvfs_open(fs, "cache.bin", O_RDWR | O_CREAT | O_TRUNC, S_ISREG);
+        for (i = 0; i < chunks && fd >= 0; i++) {
+            t = bench_cycles();
+            nfvfs_write(fs, fd, bench_buf, BENCH_CHUNK_SIZE);
+            wr_cycles += bench_cycles() - t;
+        }
+        spiffs_cache_stats_reset();
+
+        seq_cycles = 0;
+        nfvfs_lseek(fs, fd, 0, NFVFS_SEEK_SET);
+        for (i = 0; i < chunks && fd >= 0; i++) {
+            t = bench_cycles();
+            nfvfs_read(fs, fd, bench_buf, BENCH_CHUNK_SIZE);
+            seq_cycles += bench_cycles() - t;
+        }
+
+        rnd_cycles = 0;
+        seed = 1;
+        for (i = 0; i < reads && fd >= 0; i++) {
+            t = bench_cycles();
+            nfvfs_lseek(fs, fd, bench_rand(&seed) % (file_kb * 1024 - 64), NFVFS_SEEK_SET);
+            nfvfs_read(fs, fd, bench_buf, 64);
+            rnd_cycles += bench_cycles() - t;
+        }
+        nfvfs_close(fs, fd);
+
+        printf("%d\t%d\t\t%d\t\t%d\r\n", pages,
+               bench_kbps((uint64_t)chunks * BENCH_CHUNK_SIZE, wr_cycles),
+               bench_kbps((uint64_t)chunks * BENCH_CHUNK_SIZE, seq_cycles),
+               bench_us(rnd_cycles) ? (int)((uint64_t)reads * 1000000 / bench_us(rnd_cycles)) : 0);
+        spiffs_cache_stats();
+
+        nfvfs_umount(fs);
+        spiffs_cache_config(NULL, 0);
+        myfree(SRAMEX, cache);
+    }
+}
+
+/* average cycles of one JESFS fs_open() of an existing and a missing name */
+static void jesfs_open_time(int nfiles, uint32_t *hit, uint32_t *miss)
+{
+    static FS_DESC desc;
+    char name[16];
+    uint32_t t;
+    uint64_t hit_cycles = 0, miss_cycles = 0;
+    int i;
+
+    sprintf(name, "f%04d", nfiles - 1);
+    for (i = 0; i < 16; i++) {
+        t = bench_cycles();
+        fs_open(&desc, name, SF_OPEN_READ);
+        hit_cycles += bench_cycles() - t;
+        fs_close(&desc);
+
+        t = bench_cycles();
+        fs_open(&desc, "missing", SF_OPEN_READ);
+        miss_cycles += bench_cycles() - t;
+    }
+    *hit = (uint32_t)(hit_cycles / 16);
+    *miss = (uint32_t)(miss_cycles / 16);
+}
+
+/* JESFS fs_open() latency against the number of files, with and without
+ * the RAM name index, the file count grows by a factor of 4 from 16 */
+void jesfs_open_benchmark(int max_files)
+{
+    static FS_DESC desc;
+    struct nfvfs *fs;
+    char name[16];
+    uint32_t scan_hit, scan_miss, idx_hit, idx_miss;
+    int files, created = 0, ret, i;
+
+    fs = get_nfvfs("jesfs");
+    if (!fs) {
+        printf("\r\nFailed to get jesfs, making sure you have register it\r\n");
+        return;
+    }
+
+    bench_timer_init();
+    nfvfs_mount(fs);
+
+    printf("files\tscan hit us\tscan miss us\tindex hit us\tindex miss us\r\n");
+    for (files = 16; files <= max_files; files *= 4) {
+        for (; created < files; created++) {
+            sprintf(name, "f%04d", created);
+            ret = fs_open(&desc, name, SF_OPEN_CREATE | SF_OPEN_WRITE);
+            if (ret) {
+                printf("create %s failed: %d\r\n", name, ret);
+                goto out;
+            }
+            fs_close(&desc);
+        }
+
+        fs_name_index_enable(0);
+        jesfs_open_time(files, &scan_hit, &scan_miss);
+        fs_name_index_enable(1);
+        jesfs_open_time(files, &idx_hit, &idx_miss);
+
+        printf("%d\t%d\t\t%d\t\t%d\t\t%d\r\n", files,
+               bench_us(scan_hit), bench_us(scan_miss),
+               bench_us(idx_hit), bench_us(idx_miss));
+    }
+
+out:
+    for (i = 0; i < created; i++) {
+        sprintf(name, "f%04d", i);
+        if (fs_open(&desc, name, SF_OPEN_READ) == 0)
+            fs_delete(&desc);
+    }
+    nfvfs_umount(fs);
+}
+
+/* JESFS small appends (logger records) with and without the write
+ * combining buffer, records/s and the time of the final fs_close() */
+void jesfs_record_benchmark(int records, int record_size)
+{
+    static FS_DESC desc;
+    static uint8_t wbuf[SF_WBUF_SIZE];
+    struct nfvfs *fs;
+    uint32_t t, close_cycles;
+    uint64_t wr_cycles;
+    int mode, i, ret;
+
+    fs = get_nfvfs("jesfs");
+    if (!fs) {
+        printf("\r\nFailed to get jesfs, making sure you have register it\r\n");
+        return;
+    }
+    if (record_size <= 0 || record_size > BENCH_CHUNK_SIZE) {
+        printf("record size 1..%d\r\n", BENCH_CHUNK_SIZE);
+        return;
+    }
+
+    bench_timer_init();
+    nfvfs_mount(fs);
+    for (i = 0; i < record_size; i++)
+        bench_buf[i] = i;
+
+    printf("buffer\trecords/s\tKB/s\tclose us\r\n");
+    for (mode = 0; mode < 2; mode++) {
+        ret = fs_open(&desc, "records.bin", SF_OPEN_CREATE | SF_OPEN_WRITE);
+        if (ret) {
+            printf("open failed: %d\r\n", ret);
+            break;
+        }
+        if (mode)
+            fs_write_buffer(&desc, wbuf);
+
+        wr_cycles = 0;
+        for (i = 0; i < records; i++) {
+            bench_buf[0] = (uint8_t)i;
+            t = bench_cycles();
+            ret = fs_write(&desc, bench_buf, record_size);
+            wr_cycles += bench_cycles() - t;
+            if (ret) {
+                printf("write failed: %d\r\n", ret);
+                break;
+            }
+        }
+        t = bench_cycles();
+        fs_close(&desc);
+        close_cycles = bench_cycles() - t;
+
+        printf("%s\t%d\t\t%d\t%d\r\n", mode ? "on" : "off",
+               bench_us(wr_cycles) ? (int)((uint64_t)i * 1000000 / bench_us(wr_cycles)) : 0,
+               bench_kbps((uint64_t)i * record_size, wr_cycles), bench_us(close_cycles));
+    }
+
+    if (fs_open(&desc, "records.bin", SF_OPEN_READ) == 0)
+        fs_delete(&desc);
+    nfvfs_umount(fs);
+}
+
+/* JESFS worst case fs_write() latency when the allocation reaches sectors
+ * that still have to be erased. The file is rewritten rounds times, so
+ * rounds * file_kb should exceed the flash size to wrap the allocation.
+ * With budget_ms > 0 fs_maintenance() runs between the rounds */
+void jesfs_erase_benchmark(int file_kb, int rounds, int budget_ms)
+{
+    static FS_DESC desc;
+    struct nfvfs *fs;
+    uint32_t t, cycles, max_cycles = 0;
+    uint64_t wr_cycles = 0;
+    int round, i, ret, stalls = 0;
+
+    fs = get_nfvfs("jesfs");
+    if (!fs) {
+        printf("\r\nFailed to get jesfs, making sure you have register it\r\n");
+        return;
+    }
+
+    bench_timer_init();
+    nfvfs_mount(fs);
+    for (i = 0; i < BENCH_CHUNK_SIZE; i++)
+        bench_buf[i] = i;
+
+    for (round = 0; round < rounds; round++) {
+        ret = fs_open(&desc, "erase.bin", SF_OPEN_CREATE | SF_OPEN_WRITE);
+        if (ret) {
+            printf("open failed: %d\r\n", ret);
+            break;
+        }
+        for (i = 0; i < file_kb * 1024 / BENCH_CHUNK_SIZE; i++) {
+            t = bench_cycles();
+            ret = fs_write(&desc, bench_buf, BENCH_CHUNK_SIZE);
+            cycles = bench_cycles() - t;
+            if (ret) {
+                printf("write failed: %d\r\n", ret);
+                break;
+            }
+            wr_cycles += cycles;
+            if (cycles > max_cycles)
+                max_cycles = cycles;
+            if (bench_us(cycles) > 10000)
+                stalls++;
+        }
+        fs_close(&desc);
+        if (budget_ms > 0)
+            fs_maintenance(budget_ms);
+    }
+
+    printf("budget %d ms: %d KB written, %d KB/s, longest write %d us, %d writes > 10 ms\r\n",
+           budget_ms, round * file_kb, bench_kbps((uint64_t)round * file_kb * 1024, wr_cycles),
+           bench_us(max_cycles), stalls);
+    nfvfs_umount(fs);
+}
+
+static uint32_t bench_crc32(const uint8_t *p, uint32_t len, uint32_t crc)
+{
+    int i;
+
+    while (len--) {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return crc;
+}
+
+/* raw W25QXX page programming with and without the deferred busy wait.
+ * Before every page a CRC32 over it and work_us of delay stand in for
+ * preparing the data. The last kb KB of the flash are overwritten! */
+void w25qxx_pipeline_benchmark(int kb, int work_us)
+{
+    uint32_t base, addr, crc, t;
+    uint64_t cycles;
+    u8 pipeline = W25QXX_Pipeline;
+    int mode, i;
+
+    kb = (kb + 3) & ~3;
+    base = W25QXX_Geo.size - kb * 1024;
+    bench_timer_init();
+
+    printf("pipeline\tKB/s\tus/page\r\n");
+    for (mode = 0; mode < 2; mode++) {
+        for (addr = base; addr < base + kb * 1024; addr += W25Q256_ERASE_GRAN)
+            W25QXX_Erase_Sector(addr / W25Q256_ERASE_GRAN);
+        W25QXX_Pipeline = mode;
+
+        crc = 0xFFFFFFFF;
+        t = bench_cycles();
+        cycles = 0;
+        for (addr = base; addr < base + kb * 1024; addr += BENCH_CHUNK_SIZE) {
+            for (i = 0; i < BENCH_CHUNK_SIZE; i++)
+                bench_buf[i] = (uint8_t)(addr + i);
+            crc = bench_crc32(bench_buf, BENCH_CHUNK_SIZE, crc);
+            if (work_us > 0)
+                delay_us(work_us);
+            W25QXX_Write_NoCheck(bench_buf, addr, BENCH_CHUNK_SIZE);
+            cycles += bench_cycles() - t;
+            t = bench_cycles();
+        }
+        W25QXX_Sync();
+        cycles += bench_cycles() - t;
+
+        printf("%s\t\t%d\t%d\r\n", mode ? "on" : "off", bench_kbps((uint64_t)kb * 1024, cycles),
+               bench_us(cycles) / (kb * 1024 / BENCH_CHUNK_SIZE));
+    }
+    W25QXX_Pipeline = pipeline;
+}
+
+struct bench_vol {
+    JESFS_PART part;
+    JESFS_DEV dev;
+    JESFS_VOL vol;
+    FS_DESC desc;
+};
+
+/* 1..vols JesFs volumes on partitions at the end of the flash, each with a
+ * file of file_kb KB, written and read back chunk by chunk in turn.
+ * The last vols * (file_kb + 64) KB of the flash are overwritten! */
+void jesfs_multi_benchmark(int vols, int file_kb)
+{
+    struct bench_vol *bv;
+    uint32_t part_size, t;
+    uint64_t wr_cycles, rd_cycles;
+    int n, v, i, j, ret = 0;
+
+    bv = mymalloc(SRAMEX, vols * sizeof(struct bench_vol));
+    if (!bv) {
+        printf("%s: no memory for %d volumes\r\n", __func__, vols);
+        return;
+    }
+    part_size = ((uint32_t)file_kb + 64) * 1024 & ~(SF_SECTOR_PH - 1);
+    for (v = 0; v < vols; v++) {
+        bv[v].part.base = W25QXX_Geo.size - (v + 1) * part_size;
+        bv[v].part.size = part_size;
+        sflash_dev_part(&bv[v].dev, &bv[v].part);
+        fsv_init(&bv[v].vol, &bv[v].dev);
+    }
+    bench_timer_init();
+
+    printf("volumes\twrite KB/s\tread KB/s\r\n");
+    for (n = 1; n <= vols && !ret; n++) {
+        for (v = 0; v < n && !ret; v++) {
+            fsv_start(&bv[v].vol, FS_START_NORMAL);
+            ret = fsv_format(&bv[v].vol, FS_FORMAT_SOFT);
+            if (!ret)
+                ret = fsv_open(&bv[v].vol, &bv[v].desc, "multi.bin", SF_OPEN_CREATE | SF_OPEN_WRITE);
+        }
+        if (ret) {
+            printf("volume %d: %d\r\n", v - 1, ret);
+            break;
+        }
+
+        wr_cycles = 0;
+        for (i = 0; i < file_kb * 1024 / BENCH_CHUNK_SIZE && !ret; i++) {
+            for (v = 0; v < n && !ret; v++) {
+                for (j = 0; j < BENCH_CHUNK_SIZE; j++)
+                    bench_buf[j] = (uint8_t)(i + j + v);
+                t = bench_cycles();
+                ret = fs_write(&bv[v].desc, bench_buf, BENCH_CHUNK_SIZE);
+                wr_cycles += bench_cycles() - t;
+            }
+        }
+        for (v = 0; v < n; v++) {
+            fs_close(&bv[v].desc);
+            if (!ret)
+                ret = fsv_open(&bv[v].vol, &bv[v].desc, "multi.bin", SF_OPEN_READ);
+        }
+        if (ret) {
+            printf("write failed: %d\r\n", ret);
+            break;
+        }
+
+        rd_cycles = 0;
+        for (i = 0; i < file_kb * 1024 / BENCH_CHUNK_SIZE && !ret; i++) {
+            for (v = 0; v < n && !ret; v++) {
+                t = bench_cycles();
+                if (fs_read(&bv[v].desc, bench_buf, BENCH_CHUNK_SIZE) != BENCH_CHUNK_SIZE)
+                    ret = -1;
+                rd_cycles += bench_cycles() - t;
+                for (j = 0; j < BENCH_CHUNK_SIZE && !ret; j++) {
+                    if (bench_buf[j] != (uint8_t)(i + j + v))
+                        ret = -1;
+                }
+            }
+        }
+        for (v = 0; v < n; v++)
+            fs_close(&bv[v].desc);
+        if (ret) {
+            printf("verify failed on volume %d at chunk %d\r\n", v - 1, i - 1);
+            break;
+        }
+
+        printf("%d\t%d\t\t%d\r\n", n, bench_kbps((uint64_t)n * file_kb * 1024, wr_cycles),
+               bench_kbps((uint64_t)n * file_kb * 1024, rd_cycles));
+    }
+    myfree(SRAMEX, bv);
+}
+
+/* fill pct % of the volume with 16 KB files, every 3rd deleted again */
+static int bench_jesfs_fill(JESFS_VOL *vol, int pct)
+{
+    static FS_DESC desc;
+    char name[16];
+    uint32_t limit, used = 0;
+    int f, i, ret;
+
+    limit = (uint64_t)vol->info.available_disk_size * pct / 100;
+    for (f = 0; used + 16 * 1024 + SF_SECTOR_PH <= limit; f++) {
+        sprintf(name, "fill%d.bin", f);
+        ret = fsv_open(vol, &desc, name, SF_OPEN_CREATE | SF_OPEN_WRITE);
+        if (ret)
+            return ret;
+        for (i = 0; i < 16 * 1024 / BENCH_CHUNK_SIZE; i++) {
+            memset(bench_buf, f + i, BENCH_CHUNK_SIZE);
+            ret = fs_write(&desc, bench_buf, BENCH_CHUNK_SIZE);
+            if (ret)
+                return ret;
+        }
+        fs_close(&desc);
+        if (f % 3 == 2 && fsv_open(vol, &desc, name, SF_OPEN_READ) == 0)
+            fs_delete(&desc);
+        used += 16 * 1024 + SF_SECTOR_PH;
+    }
+    return 0;
+}
+
+/* format time of fs_format(FS_FORMAT_SOFT) and fs_format_fast() with a
+ * buf_kb KB blank check buffer on a part_kb KB volume filled 0..100 %.
+ * A time must stay below one CYCCNT wrap (10.7s at 400MHz).
+ * The last part_kb KB of the flash are overwritten! */
+void jesfs_format_benchmark(int part_kb, int buf_kb)
+{
+    static JESFS_PART part;
+    static JESFS_DEV dev;
+    static JESFS_VOL vol;
+    uint32_t *buf, t, soft_ms, fast_ms;
+    int pct, ret;
+
+    buf = mymalloc(SRAMEX, buf_kb * 1024);
+    if (!buf) {
+        printf("%s: no memory for %d KB\r\n", __func__, buf_kb);
+        return;
+    }
+    part.size = ((uint32_t)part_kb * 1024 + 65535) & ~65535;
+    part.base = W25QXX_Geo.size - part.size;
+    sflash_dev_part(&dev, &part);
+    fsv_init(&vol, &dev);
+    fsv_start(&vol, FS_START_NORMAL);
+    ret = fsv_format_fast(&vol, buf, buf_kb * 1024);
+    bench_timer_init();
+
+    printf("fill %%\tsoft ms\tfast ms\r\n");
+    for (pct = 0; pct <= 100 && !ret; pct += 25) {
+        ret = bench_jesfs_fill(&vol, pct);
+        if (ret)
+            break;
+        t = bench_cycles();
+        ret = fsv_format(&vol, FS_FORMAT_SOFT);
+        soft_ms = bench_us(bench_cycles() - t) / 1000;
+        if (ret)
+            break;
+
+        ret = bench_jesfs_fill(&vol, pct);
+        if (ret)
+            break;
+        t = bench_cycles();
+        ret = fsv_format_fast(&vol, buf, buf_kb * 1024);
+        fast_ms = bench_us(bench_cycles() - t) / 1000;
+        if (ret)
+            break;
+        printf("%d\t%d\t%d\r\n", pct, soft_ms, fast_ms);
+    }
+    if (ret)
+        printf("%s: failed at %d %%: %d\r\n", __func__, pct, ret);
+    myfree(SRAMEX, buf);
+}
+
+/* cold mount time of a part_kb KB volume with files files, with the
+ * full sector scan and restored from the snapshot, and a check that the
+ * restored state is the scanned one. From about 500 files on a 32 MB
+ * volume the snapshot takes both sectors of the area (e.g. 16384, 1000).
+ * The last part_kb KB of the flash are overwritten! */
+void jesfs_mount_benchmark(int part_kb, int files)
+{
+    static JESFS_PART part;
+    static JESFS_DEV dev;
+    static JESFS_VOL vol;
+    static FS_DESC desc;
+    char name[16];
+    uint32_t t, scan_cycles, snap_cycles;
+    uint32_t scan_avail, scan_lusect;
+    int i, ret, scan_files;
+
+    part.size = (uint32_t)part_kb * 1024 & ~(SF_SECTOR_PH - 1);
+    part.base = W25QXX_Geo.size - part.size;
+    sflash_dev_part(&dev, &part);
+    fsv_init(&vol, &dev);
+    fsv_start(&vol, FS_START_NORMAL);
+    ret = fsv_format_fast(&vol, NULL, 0);
+    for (i = 0; i < files && !ret; i++) {
+        sprintf(name, "m%04d", i);
+        ret = fsv_open(&vol, &desc, name, SF_OPEN_CREATE | SF_OPEN_WRITE);
+        if (!ret)
+            ret = fs_write(&desc, bench_buf, BENCH_CHUNK_SIZE);
+        fs_close(&desc);
+    }
+    if (ret) {
+        printf("%s: setup failed: %d\r\n", __func__, ret);
+        return;
+    }
+    bench_timer_init();
+
+    // a change after fs_start() leaves the snapshot invalid: full scan
+    fsv_init(&vol, &dev);
+    t = bench_cycles();
+    ret = fsv_start(&vol, FS_START_NORMAL);
+    scan_cycles = bench_cycles() - t;
+    scan_files = vol.info.files_active;
+    scan_avail = vol.info.available_disk_size;
+    scan_lusect = vol.info.lusect_adr;
+    if (!ret)
+        ret = fsv_snapshot(&vol);
+
+    fsv_init(&vol, &dev);
+    t = bench_cycles();
+    if (!ret)
+        ret = fsv_start(&vol, FS_START_NORMAL);
+    snap_cycles = bench_cycles() - t;
+    if (ret) {
+        printf("%s: failed: %d\r\n", __func__, ret);
+        return;
+    }
+    if (vol.info.files_active != scan_files || vol.info.available_disk_size != scan_avail ||
+        vol.info.lusect_adr != scan_lusect) {
+        printf("%s: restored state differs from the scan\r\n", __func__);
+    }
+    printf("%d KB, %d files: scan %d us, snapshot %d us (%s)\r\n", part_kb, files,
+           bench_us(scan_cycles), bench_us(snap_cycles), vol.snap_valid ? "restored" : "scanned");
+}
+
+/* latency of 256 byte reads while sectors of the flash are erased, with
+ * the reads waiting for the erase and suspending it. A read is issued
+ * every gap_us during the erase of each sector.
+ * The last sectors sectors of the flash are erased! */
+void w25qxx_suspend_benchmark(int sectors, int gap_us)
+{
+    uint32_t base, t, cycles, max_cycles, start;
+    uint64_t sum_cycles, erase_cycles;
+    u8 suspend = W25QXX_Suspend;
+    int mode, s, reads;
+
+    base = W25QXX_Geo.size / W25Q256_ERASE_GRAN - sectors;
+    bench_timer_init();
+
+    printf("suspend\treads\tavg us\tmax us\terase ms/sector\r\n");
+    for (mode = 0; mode < 2; mode++) {
+        W25QXX_Suspend = mode;
+        reads = 0;
+        sum_cycles = 0;
+        max_cycles = 0;
+        erase_cycles = 0;
+        for (s = 0; s < sectors; s++) {
+            start = bench_cycles();
+            W25QXX_Erase_Sector_Start(base + s);
+            do {
+                delay_us(gap_us);
+                t = bench_cycles();
+                W25QXX_Read(bench_buf, (base - 1) * W25Q256_ERASE_GRAN + (reads & 15) * BENCH_CHUNK_SIZE, BENCH_CHUNK_SIZE);
+                cycles = bench_cycles() - t;
+                sum_cycles += cycles;
+                if (cycles > max_cycles)
+                    max_cycles = cycles;
+                reads++;
+            } while (W25QXX_Erase_Running());
+            erase_cycles += bench_cycles() - start;
+        }
+        printf("%s\t%d\t%d\t%d\t%d\r\n", mode ? "on" : "off", reads, bench_us(sum_cycles / reads),
+               bench_us(max_cycles), bench_us(erase_cycles / sectors) / 1000);
+    }
+    W25QXX_Suspend = suspend;
+}
+
+/* sectors erases, each followed by work_us of CPU work and a 256 byte
+ * read: synchronous, and as asynchronous requests polled between slices
+ * of the work (what the flash task does once the scheduler runs).
+ * The last sectors sectors of the flash are erased! */
+void w25qxx_async_benchmark(int sectors, int work_us)
+{
+    static W25QXX_REQ erase, read;
+    uint32_t base, t, start, rd_start;
+    uint64_t rd_cycles, total_cycles;
+    int mode, s, w;
+
+    if (W25QXX_Async_Init(configMAX_PRIORITIES - 2)) {
+        printf("%s: no memory for the flash task\r\n", __func__);
+        return;
+    }
+    base = W25QXX_Geo.size / W25Q256_ERASE_GRAN - sectors;
+    bench_timer_init();
+
+    printf("mode\ttotal ms\tread us\r\n");
+    for (mode = 0; mode < 2; mode++) {
+        rd_cycles = 0;
+        total_cycles = 0;
+        for (s = 0; s < sectors; s++) {
+            start = bench_cycles();     /* per sector, the total may exceed a CYCCNT wrap */
+            if (!mode) {
+                W25QXX_Erase_Sector(base + s);
+                delay_us(work_us);
+                t = bench_cycles();
+                W25QXX_Read(bench_buf, (base - 1) * W25Q256_ERASE_GRAN, BENCH_CHUNK_SIZE);
+                rd_cycles += bench_cycles() - t;
+                total_cycles += bench_cycles() - start;
+                continue;
+            }
+            erase.op = W25QXX_REQ_ERASE;
+            erase.addr = (base + s) * W25Q256_ERASE_GRAN;
+            W25QXX_Async_Submit(&erase);
+            read.op = W25QXX_REQ_READ;
+            read.addr = (base - 1) * W25Q256_ERASE_GRAN;
+            read.buf = bench_buf;
+            read.len = BENCH_CHUNK_SIZE;
+            for (w = 0; w < work_us; w += 100) {
+                delay_us(100);
+                W25QXX_Async_Poll();
+            }
+            rd_start = bench_cycles();
+            W25QXX_Async_Submit(&read);
+            while (!read.complete)
+                W25QXX_Async_Poll();
+            rd_cycles += bench_cycles() - rd_start;
+            W25QXX_Async_Flush(); //the next erase reuses the request
+            total_cycles += bench_cycles() - start;
+        }
+        printf("%s\t%d\t\t%d\r\n", mode ? "async" : "sync", bench_us(total_cycles) / 1000,
+               bench_us(rd_cycles / sectors));
+    }
+}
+
+/* Read throughput of kb KB from the start of the flash in 4K reads, for
+ * each read command at SPI clocks from 25 to 100MHz. The normal read
+ * command is skipped above its 50MHz limit. */
+void w25qxx_read_benchmark(int kb)
+{
+    static const u32 prescalers[] = {SPI_BAUDRATEPRESCALER_8, SPI_BAUDRATEPRESCALER_4, SPI_BAUDRATEPRESCALER_2};
+    u8 read_mode = W25QXX_ReadMode;
+    uint32_t crc, ref_crc = 0, t, addr, hz;
+    uint64_t cycles;
+    uint8_t *buf;
+    int p, mode;
+
+    buf = mymalloc(SRAMIN, W25Q256_ERASE_GRAN);
+    if (!buf) {
+        printf("%s: no memory\r\n", __func__);
+        return;
+    }
+    bench_timer_init();
+
+    printf("MHz\tcommand\tKB/s\tdata\r\n");
+    for (p = 0; p < sizeof(prescalers) / sizeof(prescalers[0]); p++) {
+        for (mode = W25QXX_READ_NORMAL; mode <= W25QXX_READ_FAST; mode++) {
+            W25QXX_ReadMode = mode;
+            hz = W25QXX_SetSpeed(prescalers[p]);
+            if (W25QXX_ReadMode != mode)
+                continue;
+            crc = 0;
+            cycles = 0;
+            for (addr = 0; addr < kb * 1024; addr += W25Q256_ERASE_GRAN) {
+                t = bench_cycles();
+                W25QXX_Read(buf, addr, W25Q256_ERASE_GRAN);
+                cycles += bench_cycles() - t;
+                crc = bench_crc32(buf, W25Q256_ERASE_GRAN, crc);
+            }
+            if (!p && !mode)
+                ref_crc = crc;
+            printf("%d\t%s\t%d\t%s\r\n", hz / 1000000, mode ? "fast" : "normal",
+                   bench_kbps(kb * 1024, cycles), crc == ref_crc ? "ok" : "BAD");
+        }
+    }
+    W25QXX_SetSpeed(SPI_BAUDRATEPRESCALER_8);
+    W25QXX_ReadMode = read_mode;
+    myfree(SRAMIN, buf);
+}
+
+/* geometry the bridges are configured from */
+void w25qxx_geometry_info(void)
+{
+    static const char *const fr[] = {"1-1-2", "1-2-2", "1-1-4", "1-4-4"};
+    int i;
+
+    printf("%s: id %04X, %d KB, page %d, %d byte address\r\n", W25QXX_Geo.sfdp ? "sfdp" : "default",
+           W25QXX_TYPE, W25QXX_Geo.size / 1024, W25QXX_Geo.page_size, W25QXX_Geo.addr_bytes);
+    for (i = 0; i < W25QXX_Geo.erase_n; i++)
+        printf("erase %d KB: cmd %02X, typ %d ms\r\n", W25QXX_Geo.erase[i].size / 1024,
+               W25QXX_Geo.erase[i].cmd, W25QXX_Geo.erase[i].typ_ms);
+    printf("fast read: 1-1-1");
+    for (i = 0; i < 4; i++) {
+        if (W25QXX_Geo.fast_read & (1 << i))
+            printf(" %s", fr[i]);
+    }
+    printf("\r\n");
+}
+
+/* sequential erase + program and interleaved read/erase/program of kb KB
+ * on a single device and on a two member interleave stripe. The members
+ * are the W25QXX and the QSPI NOR with NORDEV_QSPI, otherwise two
+ * partitions at the end of the W25QXX (same chip: shows the overhead of
+ * the layer only, no parallelism) */
+static void nordev_bench_run(const char *name, NORDEV *dev, u32 len)
+{
+    uint32_t t, seed = len, crc = 0, mix_crc = 0, ref_crc = 0;
+    uint64_t seq_cycles, mix_cycles = 0;
+    uint8_t rd[BENCH_CHUNK_SIZE];
+    u32 addr, i;
+
+    for (i = 0; i < BENCH_CHUNK_SIZE; i++)
+        bench_buf[i] = bench_rand(&seed);
+    for (addr = 0; addr < len; addr += BENCH_CHUNK_SIZE)
+        ref_crc = bench_crc32(bench_buf, BENCH_CHUNK_SIZE, ref_crc);
+
+    /* in steps, the whole run may exceed a CYCCNT wrap */
+    t = bench_cycles();
+    NORDEV_Erase(dev, 0, len);
+    seq_cycles = bench_cycles() - t;
+    for (addr = 0; addr < len; addr += BENCH_CHUNK_SIZE) {
+        t = bench_cycles();
+        NORDEV_Prog(dev, addr, bench_buf, BENCH_CHUNK_SIZE);
+        seq_cycles += bench_cycles() - t;
+    }
+    t = bench_cycles();
+    NORDEV_Sync(dev);
+    seq_cycles += bench_cycles() - t;
+
+    /* read the next unit back while this one erases, then program this one:
+     * on a stripe the next unit is on the other chip */
+    for (addr = 0; addr < len; addr += dev->erase_size) {
+        t = bench_cycles();
+        if (!addr) {
+            for (i = 0; i < dev->erase_size; i += BENCH_CHUNK_SIZE) {
+                NORDEV_Read(dev, i, rd, BENCH_CHUNK_SIZE);
+                mix_crc = bench_crc32(rd, BENCH_CHUNK_SIZE, mix_crc);
+            }
+            NORDEV_Erase(dev, 0, dev->erase_size);
+        }
+        if (addr + dev->erase_size < len) {
+            for (i = 0; i < dev->erase_size; i += BENCH_CHUNK_SIZE) {
+                NORDEV_Read(dev, addr + dev->erase_size + i, rd, BENCH_CHUNK_SIZE);
+                mix_crc = bench_crc32(rd, BENCH_CHUNK_SIZE, mix_crc);
+            }
+        }
+        for (i = 0; i < dev->erase_size; i += BENCH_CHUNK_SIZE)
+            NORDEV_Prog(dev, addr + i, bench_buf, BENCH_CHUNK_SIZE);
+        if (addr + dev->erase_size < len)
+            NORDEV_Erase(dev, addr + dev->erase_size, dev->erase_size);
+        mix_cycles += bench_cycles() - t;
+    }
+    t = bench_cycles();
+    NORDEV_Sync(dev);
+    mix_cycles += bench_cycles() - t;
+
+    for (addr = 0; addr < len; addr += BENCH_CHUNK_SIZE) {
+        NORDEV_Read(dev, addr, rd, BENCH_CHUNK_SIZE);
+        crc = bench_crc32(rd, BENCH_CHUNK_SIZE, crc);
+    }
+    printf("%s\t%d\t%d\t%d\t%s\r\n", name, bench_us(seq_cycles) / 1000, bench_kbps(len, seq_cycles),
+           bench_us(mix_cycles) / 1000,
+           crc == ref_crc && mix_crc == ref_crc ? "ok" : "BAD");
+}
+
+void nordev_stripe_benchmark(int kb)
+{
+    static NORDEV_PART single, half[2];
+    static NORDEV_STRIPE stripe;
+    NORDEV *member[2];
+    u32 len = ((u32)kb * 1024) & ~(2 * 4096 - 1);
+
+    if (!len || 2 * len > NORDEV_W25QXX.size) {
+        printf("%s: %d KB does not fit\r\n", __func__, kb);
+        return;
+    }
+    NORDEV_Part_Init(&single, &NORDEV_W25QXX, NORDEV_W25QXX.size - len, len);
+#ifdef NORDEV_QSPI
+    NORDEV_Part_Init(&half[0], &NORDEV_W25QXX, NORDEV_W25QXX.size - len / 2, len / 2);
+    NORDEV_Part_Init(&half[1], &NORDEV_Norflash, 0, len / 2);
+#else
+    printf("QSPI NOR not in the build (NORDEV_QSPI), striping two W25QXX partitions\r\n");
+    NORDEV_Part_Init(&half[0], &NORDEV_W25QXX, NORDEV_W25QXX.size - 2 * len, len / 2);
+    NORDEV_Part_Init(&half[1], &NORDEV_W25QXX, NORDEV_W25QXX.size - 2 * len + len / 2, len / 2);
+#endif
+    member[0] = &half[0].dev;
+    member[1] = &half[1].dev;
+    if (NORDEV_Stripe_Init(&stripe, member, 2, NORDEV_INTERLEAVE)) {
+        printf("%s: stripe init failed\r\n", __func__);
+        return;
+    }
+
+    bench_timer_init();
+    printf("device\tseq ms\tKB/s\tmix ms\tdata\r\n");
+    nordev_bench_run("single", &single.dev, len);
+    nordev_bench_run("stripe", &stripe.dev, len);
+}
+
+/* records small writes, a sequential read back and as many random record
+ * reads on fsname, without and with the nfvfs page cache */
+void nfvfs_cache_benchmark(const char *fsname, int records, int record_size)
+{
+    struct nfvfs *fs;
+    struct nfvfs_cache_stat st;
+    uint32_t seed, t;
+    uint64_t wr_cycles, seq_cycles, rnd_cycles;
+    int on, fd, i;
+
+    fs = get_nfvfs(fsname);
+    if (!fs) {
+        printf("\r\nFailed to get %s, making sure you have register it\r\n", fsname);
+        return;
+    }
+    if (record_size <= 0 || record_size > BENCH_CHUNK_SIZE || records <= 0) {
+        printf("%s: record size 1..%d\r\n", __func__, BENCH_CHUNK_SIZE);
+        return;
+    }
+
+    bench_timer_init();
+    for (i = 0; i < BENCH_CHUNK_SIZE; i++)
+        bench_buf[i] = i;
+
+    printf("cache\twrite KB/s\tseq read KB/s\trand read op/s\r\n");
+    for (on = 0; on <= 1; on++) {
+        nfvfs_cache_enable(on);
+        nfvfs_mount(fs);
+
+        wr_cycles = 0;
+        fd = nfvfs_open(fs, "cache.bin", O_RDWR | O_CREAT | O_TRUNC, S_ISREG);
+        for (i = 0; i < records && fd >= 0; i++) {
+            t = bench_cycles();
+            nfvfs_write(fs, fd, bench_buf, record_size);
+            wr_cycles += bench_cycles() - t;
+        }
+        t = bench_cycles();
+        nfvfs_fsync(fs, fd);
+        wr_cycles += bench_cycles() - t;
+
+        seq_cycles = 0;
+        nfvfs_lseek(fs, fd, 0, NFVFS_SEEK_SET);
+        for (i = 0; i < records && fd >= 0; i++) {
+            t = bench_cycles();
+            nfvfs_read(fs, fd, bench_buf, record_size);
+            seq_cycles += bench_cycles() - t;
+        }
+
+        rnd_cycles = 0;
+        seed = 1;
+        for (i = 0; i < records && fd >= 0; i++) {
+            t = bench_cycles();
+            nfvfs_lseek(fs, fd, bench_rand(&seed) % records * record_size, NFVFS_SEEK_SET);
+            nfvfs_read(fs, fd, bench_buf, record_size);
+            rnd_cycles += bench_cycles() - t;
+        }
+
+        printf("%s\t%d\t\t%d\t\t%d\r\n", on ? "on" : "off",
+               bench_kbps((uint64_t)records * record_size, wr_cycles),
+               bench_kbps((uint64_t)records * record_size, seq_cycles),
+               bench_us(rnd_cycles) ? (int)((uint64_t)records * 1000000 / bench_us(rnd_cycles)) : 0);
+        if (on && nfvfs_cache_stat(fd, &st) == 0)
+            printf("read hits %d, misses %d, writes merged %d, through %d, page writes %d\r\n",
+                   st.read_hits, st.read_misses, st.write_merged, st.write_through, st.flushes);
+        nfvfs_close(fs, fd);
+        nfvfs_umount(fs);
+    }
+    nfvfs_cache_enable(0);
+}
+
+/* records of an 8 byte header, payload bytes and a CRC written as three
+ * nfvfs_write calls and as one nfvfs_writev */
+void nfvfs_writev_benchmark(const char *fsname, int records, int payload)
+{
+    struct nfvfs *fs;
+    struct nfvfs_iovec iov[3];
+    uint32_t hdr[2], crc = 0, t;
+    uint64_t cycles;
+    int vec, fd, i;
+
+    fs = get_nfvfs(fsname);
+    if (!fs) {
+        printf("\r\nFailed to get %s, making sure you have register it\r\n", fsname);
+        return;
+    }
+    if (payload <= 0 || payload > BENCH_CHUNK_SIZE || records <= 0) {
+        printf("%s: payload 1..%d\r\n", __func__, BENCH_CHUNK_SIZE);
+        return;
+    }
+
+    bench_timer_init();
+    for (i = 0; i < BENCH_CHUNK_SIZE; i++)
+        bench_buf[i] = i;
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = bench_buf;
+    iov[1].iov_len = payload;
+    iov[2].iov_base = &crc;
+    iov[2].iov_len = sizeof(crc);
+
+    printf("calls\trecords/s\tKB/s\r\n");
+    nfvfs_mount(fs);
+    for (vec = 0; vec <= 1; vec++) {
+        cycles = 0;
+        fd = nfvfs_open(fs, "records.bin", O_RDWR | O_CREAT | O_TRUNC, S_ISREG);
+        for (i = 0; i < records && fd >= 0; i++) {
+            hdr[0] = i;
+            hdr[1] = payload;
+            crc = bench_crc32(bench_buf, payload, 0);
+            t = bench_cycles();
+            if (vec) {
+                nfvfs_writev(fs, fd, iov, 3);
+            } else {
+                nfvfs_write(fs, fd, hdr, sizeof(hdr));
+                nfvfs_write(fs, fd, bench_buf, payload);
+                nfvfs_write(fs, fd, &crc, sizeof(crc));
+            }
+            cycles += bench_cycles() - t;
+        }
+        t = bench_cycles();
+        nfvfs_close(fs, fd);
+        cycles += bench_cycles() - t;
+        printf("%s\t%d\t\t%d\r\n", vec ? "writev" : "write x3",
+               bench_us(cycles) ? (int)((uint64_t)records * 1000000 / bench_us(cycles)) : 0,
+               bench_kbps((uint64_t)records * (payload + 12), cycles));
+    }
+    nfvfs_umount(fs);
+}
+
+/* heavy logging: records 4 KB log writes, each followed by work_us of
+ * application work and a 64 byte read of a config file. Synchronous, and
+ * with the log writes as low and the reads as high priority async requests,
+ * polled between slices of the work (what the I/O task does once the
+ * scheduler runs). stall: time the application waits per record */
+void nfvfs_async_benchmark(const char *fsname, int records, int work_us)
+{
+    static struct nfvfs_req log[4], seek, rd;
+    struct nfvfs *fs;
+    struct nfvfs_req *req;
+    uint8_t *logbuf, cfg[64];
+    uint32_t start, t, t2, stall, max_stall;
+    uint64_t rd_cycles, total_cycles;
+    int mode, i, w, fd_log, fd_cfg;
+
+    fs = get_nfvfs(fsname);
+    if (!fs) {
+        printf("\r\nFailed to get %s, making sure you have register it\r\n", fsname);
+        return;
+    }
+    if (nfvfs_async_init(tskIDLE_PRIORITY + 1)) {
+        printf("%s: no memory for the I/O task\r\n", __func__);
+        return;
+    }
+    logbuf = mymalloc(SRAMEX, 4096);
+    if (!logbuf) {
+        printf("%s: no memory\r\n", __func__);
+        return;
+    }
+    for (i = 0; i < 4096; i++)
+        logbuf[i] = i;
+    bench_timer_init();
+
+    nfvfs_mount(fs);
+    fd_cfg = nfvfs_open(fs, "config.bin", O_RDWR | O_CREAT | O_TRUNC, S_ISREG);
+    nfvfs_write(fs, fd_cfg, logbuf, sizeof(cfg));
+    nfvfs_fsync(fs, fd_cfg);
+
+    printf("mode\ttotal ms\tread us\tmax stall us\r\n");
+    for (mode = 0; mode < 2 && fd_cfg >= 0; mode++) {
+        fd_log = nfvfs_open(fs, "log.bin", O_RDWR | O_CREAT | O_TRUNC, S_ISREG);
+        rd_cycles = 0;
+        max_stall = 0;
+        total_cycles = 0;
+        for (i = 0; i < records && fd_log >= 0; i++) {
+            start = bench_cycles();     /* per record, the total may exceed a CYCCNT wrap */
+            if (!mode) {
+                delay_us(work_us);
+                t = bench_cycles();
+                nfvfs_write(fs, fd_log, logbuf, 4096);
+                nfvfs_lseek(fs, fd_cfg, 0, NFVFS_SEEK_SET);
+                t2 = bench_cycles();
+                nfvfs_read(fs, fd_cfg, cfg, sizeof(cfg));
+                rd_cycles += bench_cycles() - t2;
+                stall = bench_cycles() - t;
+            } else {
+                req = &log[i % 4];
+                t = bench_cycles();
+                while (i >= 4 && !req->complete)
+                    nfvfs_async_poll();
+                memset(req, 0, sizeof(*req));
+                req->op = NFVFS_REQ_WRITE;
+                req->prio = NFVFS_PRIO_LOW;
+                req->nfvfs = fs;
+                req->fd = fd_log;
+                req->buf = logbuf;
+                req->size = 4096;
+                nfvfs_async_submit(req);
+                stall = bench_cycles() - t;
+                for (w = 0; w < work_us; w += 100) {
+                    delay_us(100);
+                    nfvfs_async_poll();
+                }
+                t2 = bench_cycles();
+                memset(&seek, 0, sizeof(seek));
+                seek.op = NFVFS_REQ_LSEEK;
+                seek.prio = NFVFS_PRIO_HIGH;
+                seek.nfvfs = fs;
+                seek.fd = fd_cfg;
+                seek.whence = NFVFS_SEEK_SET;
+                rd = seek;
+                rd.op = NFVFS_REQ_READ;
+                rd.buf = cfg;
+                rd.size = sizeof(cfg);
+                nfvfs_async_submit(&seek);
+                nfvfs_async_submit(&rd);
+                while (!rd.complete)
+                    nfvfs_async_poll();
+                rd_cycles += bench_cycles() - t2;
+                stall += bench_cycles() - t2;
+            }
+            if (stall > max_stall)
+                max_stall = stall;
+            total_cycles += bench_cycles() - start;
+        }
+        start = bench_cycles();
+        nfvfs_async_flush();
+        total_cycles += bench_cycles() - start;
+        nfvfs_close(fs, fd_log);
+        printf("%s\t%d\t\t%d\t%d\r\n", mode ? "async" : "sync", bench_us(total_cycles) / 1000,
+               records ? bench_us(rd_cycles / records) : 0, bench_us(max_stall));
+    }
+    nfvfs_close(fs, fd_cfg);
+    nfvfs_umount(fs);
+    myfree(SRAMEX, logbuf);
+}
+
+/* CRC of a whole file read in 4 KB pieces into SDRAM and through
+ * nfvfs_mmap: zero copy on romfs, a copy on the other fs */
+void nfvfs_mmap_benchmark(const char *fsname, const char *path)
+{
+    struct nfvfs *fs;
+    const uint8_t *map;
+    uint8_t *buf;
+    uint32_t size, pos, t, crc, map_crc;
+    uint64_t rd_cycles, map_cycles;
+    int fd, ret;
+
+    fs = get_nfvfs(fsname);
+    if (!fs) {
+        printf("\r\nFailed to get %s, making sure you have register it\r\n", fsname);
+        return;
+    }
+    buf = mymalloc(SRAMEX, 4096);
+    if (!buf) {
+        printf("%s: no memory\r\n", __func__);
+        return;
+    }
+    bench_timer_init();
+    nfvfs_mount(fs);
+    fd = nfvfs_open(fs, path, O_RDONLY, S_ISREG);
+    if (fd < 0) {
+        printf("%s: no %s\r\n", __func__, path);
+        goto out;
+    }
+    size = nfvfs_lseek(fs, fd, 0, NFVFS_SEEK_END);
+
+    crc = 0;
+    t = bench_cycles();
+    nfvfs_lseek(fs, fd, 0, NFVFS_SEEK_SET);
+    for (pos = 0; pos < size; pos += ret) {
+        ret = nfvfs_read(fs, fd, buf, 4096);
+        if (ret <= 0)
+            break;
+        crc = bench_crc32(buf, ret, crc);
+    }
+    rd_cycles = bench_cycles() - t;
+
+    t = bench_cycles();
+    map = nfvfs_mmap(fs, fd, 0, size);
+    map_crc = map ? bench_crc32(map, size, 0) : 0;
+    map_cycles = bench_cycles() - t;
+
+    printf("%s: %d bytes\r\nread\t%d us\r\nmmap\t%d us, %s\r\ndata\t%s\r\n", path, size,
+           bench_us(rd_cycles), bench_us(map_cycles),
+           !map ? "failed" : (uint32_t)map >= 0x90000000 ? "zero copy" : "copied to SDRAM",
+           map && crc == map_crc ? "ok" : "BAD");
+    nfvfs_munmap(fs, map);
+    nfvfs_close(fs, fd);
+out:
+    nfvfs_umount(fs);
+    myfree(SRAMEX, buf);
+}
+
+/* writers appenders of one log file, each writing a 64 byte record and
+ * fsyncing it per round, as async requests: every fsync committed, and
+ * with fsyncs grouped over window_ms */
+void nfvfs_group_benchmark(const char *fsname, int writers, int rounds, int window_ms)
+{
+    static struct nfvfs_req wr[8], fsync[8];
+    struct nfvfs *fs;
+    uint32_t start, ms, fsyncs, commits;
+    uint64_t cycles;
+    int grouped, fd, r, w;
+
+    fs = get_nfvfs(fsname);
+    if (!fs) {
+        printf("\r\nFailed to get %s, making sure you have register it\r\n", fsname);
+        return;
+    }
+    if (writers <= 0 || writers > 8) {
+        printf("%s: writers 1..8\r\n", __func__);
+        return;
+    }
+    if (nfvfs_async_init(tskIDLE_PRIORITY + 1)) {
+        printf("%s: no memory for the I/O task\r\n", __func__);
+        return;
+    }
+    for (r = 0; r < 64; r++)
+        bench_buf[r] = r;
+    bench_timer_init();
+
+    nfvfs_mount(fs);
+    printf("window\ttotal ms\trecords/s\tfsyncs\tcommits\r\n");
+    for (grouped = 0; grouped <= 1; grouped++) {
+        fd = nfvfs_open(fs, "telemetry.log", O_RDWR | O_CREAT | O_TRUNC, S_ISREG);
+        if (fd < 0)
+            break;
+        nfvfs_async_group(grouped ? window_ms : 0);
+        nfvfs_async_group_stat(&fsyncs, &commits);
+        cycles = 0;
+        for (r = 0; r < rounds; r++) {
+            start = bench_cycles();     /* per round, the total may exceed a CYCCNT wrap */
+            for (w = 0; w < writers; w++) {
+                memset(&wr[w], 0, sizeof(wr[w]));
+                wr[w].op = NFVFS_REQ_WRITE;
+                wr[w].prio = NFVFS_PRIO_LOW;
+                wr[w].nfvfs = fs;
+                wr[w].fd = fd;
+                wr[w].buf = bench_buf;
+                wr[w].size = 64;
+                fsync[w] = wr[w];
+                fsync[w].op = NFVFS_REQ_FSYNC;
+                nfvfs_async_submit(&wr[w]);
+                nfvfs_async_submit(&fsync[w]);
+            }
+            nfvfs_async_flush();
+            cycles += bench_cycles() - start;
+        }
+        ms = bench_us(cycles) / 1000;
+        nfvfs_async_group_stat(&fsyncs, &commits);
+        printf("%d\t%d\t\t%d\t\t%d\t%d\r\n", grouped ? window_ms : 0, ms,
+               bench_us(cycles) ? (int)((uint64_t)rounds * writers * 1000000 / bench_us(cycles)) : 0,
+               fsyncs, commits);
+        nfvfs_close(fs, fd);
+    }
+    nfvfs_async_group(0);
+    nfvfs_umount(fs);
+}
+
+/* the captured or loaded workload (nfvfs_capture_start/load) on fsname,
+ * timing 1: with the captured gaps between the calls, 0: back to back */
+void nfvfs_replay_benchmark(const char *fsname, int timing)
+{
+    static const char *const classes[] = {"read", "write", "other"};
+    struct nfvfs_replay_stat st;
+    struct nfvfs *fs;
+    int c;
+
+    fs = get_nfvfs(fsname);
+    if (!fs) {
+        printf("\r\nFailed to get %s, making sure you have register it\r\n", fsname);
+        return;
+    }
+
+    nfvfs_mount(fs);
+    if (nfvfs_replay(fs, timing, &st) == 0) {
+        printf("\r\nreplay on %s, %s: %d calls in %d ms, %d failed, %d skipped\r\n", fsname,
+               timing ? "captured timing" : "full speed", st.ops, st.us / 1000, st.errors, st.skipped);
+        printf("read %d KB, %d KB/s, write %d KB, %d KB/s\r\n",
+               st.read_bytes / 1024, st.us ? (uint32_t)((uint64_t)st.read_bytes * 1000000 / 1024 / st.us) : 0,
+               st.write_bytes / 1024, st.us ? (uint32_t)((uint64_t)st.write_bytes * 1000000 / 1024 / st.us) : 0);
+        printf("calls\tn\tp50 us\tp90 us\tp99 us\tmax us\r\n");
+        for (c = 0; c < NFVFS_REPLAY_CLASSES; c++)
+            printf("%s\t%d\t%d\t%d\t%d\t%d\r\n", classes[c], st.lat[c].n, st.lat[c].p50,
+                   st.lat[c].p90, st.lat[c].p99, st.lat[c].max);
+        printf("flash: %d reads, %d programs, %d erases, %d waits\r\n", st.flash[0], st.flash[1],
+               st.flash[2], st.flash[3]);
+    }
+    nfvfs_umount(fs);
+}
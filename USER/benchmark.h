@@ -20,5 +20,25 @@
 
 
 void basic_storage_test(const char *fsname, int loop);
+void spiffs_cache_benchmark(int max_pages, int file_kb);
+void spiffs_check_benchmark(int map_kb, int blocks_per_step);
+void jesfs_open_benchmark(int max_files);
+void jesfs_record_benchmark(int records, int record_size);
+void jesfs_erase_benchmark(int file_kb, int rounds, int budget_ms);
+void w25qxx_pipeline_benchmark(int kb, int work_us);
+void jesfs_multi_benchmark(int vols, int file_kb);
+void jesfs_format_benchmark(int part_kb, int buf_kb);
+void jesfs_mount_benchmark(int part_kb, int files);
+void w25qxx_suspend_benchmark(int sectors, int gap_us);
+void w25qxx_async_benchmark(int sectors, int work_us);
+void w25qxx_read_benchmark(int kb);
+void w25qxx_geometry_info(void);
+void nordev_stripe_benchmark(int kb);
+void nfvfs_cache_benchmark(const char *fsname, int records, int record_size);
+void nfvfs_writev_benchmark(const char *fsname, int records, int payload);
+void nfvfs_async_benchmark(const char *fsname, int records, int work_us);
+void nfvfs_mmap_benchmark(const char *fsname, const char *path);
+void nfvfs_group_benchmark(const char *fsname, int writers, int rounds, int window_ms);
+void nfvfs_replay_benchmark(const char *fsname, int timing);
 
 #endif /* __BENCHMARK_H */
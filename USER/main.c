@@ -11,9 +11,13 @@
 #include "usart.h"
 #include "usmart.h"
 #include "w25qxx.h"
+#include "nordev.h"
 #include "lfs_brigde.h"
 #include "spiffs_brigde.h"
 #include "jesfs_brigde.h"
+#include "romfs_brigde.h"
+#include "ramfs_brigde.h"
+#include "fatfs_brigde.h"
 #include "nfvfs.h"
 
 void board_init(void)
@@ -28,6 +32,7 @@ void board_init(void)
     KEY_Init();
     SDRAM_Init();
     W25QXX_Init();
+    NORDEV_Init();
     my_mem_init(SRAMIN);
     my_mem_init(SRAMEX);
     my_mem_init(SRAM12);
@@ -42,6 +47,9 @@ void fs_registration(void)
     register_nfvfs("littlefs", &lfs_ops, NULL);
     register_nfvfs("spiffs", &spiffs_ops, NULL);
     register_nfvfs("jesfs", &jesfs_ops, NULL);
+    register_nfvfs("romfs", &romfs_ops, NULL);
+    register_nfvfs("ramfs", &ramfs_ops, NULL);
+    register_nfvfs("fatfs", &fatfs_ops, NULL);
 }
 
 extern u8 usmart_sys_cmd_exe(u8 *str);
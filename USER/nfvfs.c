@@ -1,10 +1,240 @@
 #include "nfvfs.h"
 #include "FreeRTOS.h"
 #include "string.h"
+#include "malloc.h"
+#include "nfvfs_trace.h"
+#ifdef NFVFS_CACHE
+#include "sys.h"
+#include "delay.h"
+#endif
 
 struct nfvfs_fentry ftable[NF_MAX_OPEN_FILES];
 struct nfvfs nfvfs_guard;
 
+/* mappings made by nfvfs_mmap, copy: SDRAM to free at munmap */
+static struct {
+    const void *addr;
+    uint8_t copy;
+} nfvfs_maps[NFVFS_MAX_MAPS];
+
+#ifdef NFVFS_CACHE
+struct nfvfs_cache {
+    struct nfvfs *nfvfs;
+    uint32_t pos;                       /* file position of the caller */
+    uint32_t fs_pos;                    /* file position of the fs */
+    uint32_t off;                       /* file offset of page[0] */
+    uint32_t len;                       /* valid bytes in page */
+    uint32_t last;                      /* end of the last read, for read ahead */
+    uint32_t dirty_tick;
+    uint8_t dirty;                      /* page holds data to write at off */
+    struct nfvfs_cache_stat stat;
+    uint8_t page[NFVFS_CACHE_PAGE];
+};
+
+#define NFVFS_CACHE_NOPOS   0xFFFFFFFF
+
+static int nfvfs_cache_on;
+
+void nfvfs_cache_enable(int on)
+{
+    nfvfs_cache_on = on;
+}
+
+static struct nfvfs_cache *nfvfs_cache_alloc(struct nfvfs *nfvfs, int flags, int mode)
+{
+    struct nfvfs_cache *c;
+
+    if (!nfvfs_cache_on || !S_IFREG(mode) || IF_O_APPEND(flags))
+        return NULL;
+    c = mymalloc(SRAMEX, sizeof(struct nfvfs_cache));
+    if (!c)
+        return NULL;            /* uncached */
+    memset(c, 0, sizeof(struct nfvfs_cache) - NFVFS_CACHE_PAGE);
+    c->nfvfs = nfvfs;
+    return c;
+}
+
+/* move the fs to the position of the caller */
+static int nfvfs_cache_seek(struct nfvfs_cache *c, int fentry, uint32_t pos)
+{
+    int ret;
+
+    if (c->fs_pos == pos)
+        return 0;
+    ret = c->nfvfs->super.op.lseek(fentry, pos, NFVFS_SEEK_SET);
+    if (ret < 0)
+        return ret;
+    c->fs_pos = pos;
+    return 0;
+}
+
+static int nfvfs_cache_flush(struct nfvfs_cache *c, int fentry)
+{
+    int ret;
+
+    if (!c->dirty)
+        return 0;
+    ret = nfvfs_cache_seek(c, fentry, c->off);
+    if (ret < 0)
+        return ret;
+    ret = c->nfvfs->super.op.write(fentry, c->page, c->len);
+    if (ret < 0) {
+        c->fs_pos = NFVFS_CACHE_NOPOS;  /* fs position unknown, seek again */
+        return ret;
+    }
+    c->fs_pos += ret;
+    if (ret < c->len) {
+        /* fs full, the rest stays dirty for the next flush */
+        memmove(c->page, c->page + ret, c->len - ret);
+        c->off += ret;
+        c->len -= ret;
+        return -1;
+    }
+    c->dirty = 0;
+    c->len = 0;
+    c->stat.flushes++;
+    return 0;
+}
+
+void nfvfs_cache_age(void)
+{
+    int i;
+
+    for (i = 0; i < NF_MAX_OPEN_FILES; i++) {
+        if (ftable[i].used && ftable[i].cache && ftable[i].cache->dirty &&
+            delay_get_ms() - ftable[i].cache->dirty_tick >= NFVFS_CACHE_AGE_MS)
+            nfvfs_cache_flush(ftable[i].cache, i);
+    }
+}
+
+int nfvfs_cache_stat(int fd, struct nfvfs_cache_stat *st)
+{
+    struct nfvfs_fentry *entry = ftable_get_entry(fd);
+
+    if (!entry || !entry->cache)
+        return -1;
+    *st = entry->cache->stat;
+    return 0;
+}
+
+static int nfvfs_cache_read(struct nfvfs_cache *c, int fentry, uint8_t *buf, uint32_t size)
+{
+    uint32_t done = 0, n;
+    int ret;
+
+    ret = nfvfs_cache_flush(c, fentry);
+    if (ret < 0)
+        return ret;
+    if (c->pos >= c->off && c->pos + size <= c->off + c->len)
+        c->stat.read_hits++;
+    else
+        c->stat.read_misses++;
+
+    while (done < size) {
+        if (c->pos >= c->off && c->pos < c->off + c->len) {
+            n = c->off + c->len - c->pos;
+            if (n > size - done)
+                n = size - done;
+            memcpy(buf + done, c->page + (c->pos - c->off), n);
+            c->pos += n;
+            done += n;
+            continue;
+        }
+        ret = nfvfs_cache_seek(c, fentry, c->pos);
+        if (ret < 0)
+            break;
+        if (size - done >= NFVFS_CACHE_PAGE) {
+            /* large reads go around the page */
+            ret = c->nfvfs->super.op.read(fentry, buf + done, size - done);
+            if (ret > 0) {
+                c->fs_pos += ret;
+                c->pos += ret;
+                done += ret;
+            }
+            break;
+        }
+        n = c->pos == c->last ? NFVFS_CACHE_PAGE : NFVFS_CACHE_RA_MIN;
+        if (n < size - done)
+            n = size - done;
+        c->len = 0;
+        ret = c->nfvfs->super.op.read(fentry, c->page, n);
+        if (ret <= 0)
+            break;              /* error or end of file */
+        c->off = c->pos;
+        c->len = ret;
+        c->fs_pos += ret;
+    }
+    c->last = c->pos;
+    return done ? done : ret;
+}
+
+static int nfvfs_cache_write(struct nfvfs_cache *c, int fentry, const uint8_t *buf, uint32_t size)
+{
+    int ret;
+
+    if (c->dirty && c->pos == c->off + c->len && c->len + size <= NFVFS_CACHE_PAGE) {
+        memcpy(c->page + c->len, buf, size);
+        c->len += size;
+        c->pos += size;
+        c->stat.write_merged++;
+        return size;
+    }
+    ret = nfvfs_cache_flush(c, fentry);
+    if (ret < 0)
+        return ret;
+    c->len = 0;                 /* read data may be overwritten */
+
+    if (size >= NFVFS_CACHE_PAGE) {
+        ret = nfvfs_cache_seek(c, fentry, c->pos);
+        if (ret == 0)
+            ret = c->nfvfs->super.op.write(fentry, (void *)buf, size);
+        if (ret > 0) {
+            c->fs_pos += ret;
+            c->pos += ret;
+        }
+        c->stat.write_through++;
+        return ret;
+    }
+    memcpy(c->page, buf, size);
+    c->off = c->pos;
+    c->len = size;
+    c->dirty = 1;
+    c->dirty_tick = delay_get_ms();     /* HAL_GetTick() does not run */
+    c->pos += size;
+    c->stat.write_merged++;
+    return size;
+}
+
+static int nfvfs_cache_lseek(struct nfvfs_cache *c, int fentry, int offset, int whence)
+{
+    int ret;
+
+    switch (whence) {
+    case NFVFS_SEEK_SET:
+        break;
+    case NFVFS_SEEK_CUR:
+        offset += c->pos;
+        break;
+    case NFVFS_SEEK_END:
+        /* only the fs knows the size */
+        ret = nfvfs_cache_flush(c, fentry);
+        if (ret < 0)
+            return ret;
+        ret = c->nfvfs->super.op.lseek(fentry, offset, NFVFS_SEEK_END);
+        if (ret < 0)
+            return ret;
+        c->fs_pos = c->pos = ret;
+        return ret;
+    default:
+        return -1;
+    }
+    if (offset < 0)
+        return -1;
+    c->pos = offset;
+    return offset;
+}
+#endif
+
 static int translate_fd_fentry(int fd)
 {
     int i;
@@ -68,97 +298,273 @@ int nfvfs_mount(struct nfvfs *nfvfs)
 
 int nfvfs_umount(struct nfvfs *nfvfs)
 {
+#ifdef NFVFS_CACHE
+    int i;
+
+    /* files left open */
+    for (i = 0; i < NF_MAX_OPEN_FILES; i++) {
+        if (ftable[i].used && ftable[i].cache && ftable[i].cache->nfvfs == nfvfs)
+            nfvfs_cache_flush(ftable[i].cache, i);
+    }
+#endif
     return nfvfs->super.op.unmount();
 }
 
 int nfvfs_open(struct nfvfs *nfvfs, const char *path, int flags, int mode)
 {
+    uint32_t tr = NFVFS_TRACE_BEGIN(NFVFS_TR_OPEN, -1, (flags & 0xFFFF) | (uint32_t)mode << 16);
     int fd;
     int i;
     int fentry;
 
+    NFVFS_TRACE_ARG(tr, 0, path);
+
     for (i = 0; i < NF_MAX_OPEN_FILES; i++) {
         if (!ftable[i].used) {
             fentry = i;
             nfvfs->context.in_data = &fentry;
             fd = nfvfs->super.op.open(path, flags, mode, &nfvfs->context);
             if (fd < 0)
-                return fd;
+                return NFVFS_TRACE_END(tr, fd);
             ftable[i].used = 1;
             ftable[i].fd = fd;
             ftable[i].mode = mode;
             ftable[i].f = nfvfs->context.out_data;
-            return i;
+#ifdef NFVFS_CACHE
+            ftable[i].cache = nfvfs_cache_alloc(nfvfs, flags, mode);
+#endif
+            return NFVFS_TRACE_END(tr, i);
         }
     }
 
-    return -1;
+    return NFVFS_TRACE_END(tr, -1);
 }
 
 int nfvfs_close(struct nfvfs *nfvfs, int fd)
 {
+    uint32_t tr = NFVFS_TRACE_BEGIN(NFVFS_TR_CLOSE, fd, 0);
     int ret = 0;
     int fentry = translate_fd_fentry(fd);
     
     if (fentry < 0 || !ftable[fentry].used)
-        return -1;
-    
+        return NFVFS_TRACE_END(tr, -1);
+
+#ifdef NFVFS_CACHE
+    if (ftable[fentry].cache) {
+        ret = nfvfs_cache_flush(ftable[fentry].cache, fentry);
+        if (ret < 0)
+            return NFVFS_TRACE_END(tr, ret);
+    }
+#endif
     ret = nfvfs->super.op.close(fentry);
     if (ret < 0)
-        return ret;
+        return NFVFS_TRACE_END(tr, ret);
     ftable[fentry].used = 0;
+#ifdef NFVFS_CACHE
+    if (ftable[fentry].cache) {
+        myfree(SRAMEX, ftable[fentry].cache);
+        ftable[fentry].cache = NULL;
+    }
+#endif
     
-    return ret;
+    return NFVFS_TRACE_END(tr, ret);
 }
 
 int nfvfs_read(struct nfvfs *nfvfs, int fd, void *buf, int size)
 {
+    uint32_t tr = NFVFS_TRACE_BEGIN(NFVFS_TR_READ, fd, size);
     int ret = 0;
     int fentry = translate_fd_fentry(fd);
     
     if (fentry < 0 || !ftable[fentry].used)
-        return -1;
+        return NFVFS_TRACE_END(tr, -1);
 
+#ifdef NFVFS_CACHE
+    nfvfs_cache_age();
+    if (ftable[fentry].cache)
+        return NFVFS_TRACE_END(tr, nfvfs_cache_read(ftable[fentry].cache, fentry, buf, size));
+#endif
     ret = nfvfs->super.op.read(fentry, buf, size);
     if (ret < 0)
-        return ret;
+        return NFVFS_TRACE_END(tr, ret);
     
-    return ret;
+    return NFVFS_TRACE_END(tr, ret);
 }
 
 int nfvfs_write(struct nfvfs *nfvfs, int fd, void *buf, int size)
 {
+    uint32_t tr = NFVFS_TRACE_BEGIN(NFVFS_TR_WRITE, fd, size);
     int ret = 0;
     int fentry = translate_fd_fentry(fd);
     
     if (fentry < 0 || !ftable[fentry].used)
-        return -1;
+        return NFVFS_TRACE_END(tr, -1);
     
+#ifdef NFVFS_CACHE
+    nfvfs_cache_age();
+    if (ftable[fentry].cache)
+        return NFVFS_TRACE_END(tr, nfvfs_cache_write(ftable[fentry].cache, fentry, buf, size));
+#endif
     ret = nfvfs->super.op.write(fentry, buf, size);
     if (ret < 0)
-        return ret;
+        return NFVFS_TRACE_END(tr, ret);
     
-    return ret;
+    return NFVFS_TRACE_END(tr, ret);
+}
+
+/* io vectors: through the page cache, the fs readv/writev, or gathered
+ * into one call when small (records of header, payload and CRC) */
+static int nfvfs_iov_total(const struct nfvfs_iovec *iov, int iovcnt)
+{
+    uint32_t total = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++)
+        total += iov[i].iov_len;
+    return total;
+}
+
+int nfvfs_readv(struct nfvfs *nfvfs, int fd, const struct nfvfs_iovec *iov, int iovcnt)
+{
+    uint32_t tr = NFVFS_TRACE_BEGIN(NFVFS_TR_READV, fd, iovcnt);
+    uint8_t gather[NFVFS_IOV_GATHER];
+    int fentry = translate_fd_fentry(fd);
+    int total, ret, done = 0, cached = 0, i;
+
+    if (fentry < 0 || !ftable[fentry].used || iovcnt < 0)
+        return NFVFS_TRACE_END(tr, -1);
+
+#ifdef NFVFS_CACHE
+    nfvfs_cache_age();
+    cached = ftable[fentry].cache != NULL;
+#endif
+    total = nfvfs_iov_total(iov, iovcnt);
+    if (!cached && nfvfs->super.op.readv)
+        return NFVFS_TRACE_END(tr, nfvfs->super.op.readv(fentry, iov, iovcnt));
+
+    if (!cached && total <= NFVFS_IOV_GATHER) {
+        ret = nfvfs->super.op.read(fentry, gather, total);
+        if (ret <= 0)
+            return NFVFS_TRACE_END(tr, ret);
+        for (i = 0; i < iovcnt && done < ret; i++) {
+            total = ret - done < iov[i].iov_len ? ret - done : iov[i].iov_len;
+            memcpy(iov[i].iov_base, gather + done, total);
+            done += total;
+        }
+        return NFVFS_TRACE_END(tr, done);
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+#ifdef NFVFS_CACHE
+        if (cached)
+            ret = nfvfs_cache_read(ftable[fentry].cache, fentry, iov[i].iov_base, iov[i].iov_len);
+        else
+#endif
+        ret = nfvfs->super.op.read(fentry, iov[i].iov_base, iov[i].iov_len);
+        if (ret < 0)
+            return NFVFS_TRACE_END(tr, done ? done : ret);
+        done += ret;
+        if (ret < iov[i].iov_len)
+            break;              /* end of file */
+    }
+    return NFVFS_TRACE_END(tr, done);
+}
+
+int nfvfs_writev(struct nfvfs *nfvfs, int fd, const struct nfvfs_iovec *iov, int iovcnt)
+{
+    uint32_t tr = NFVFS_TRACE_BEGIN(NFVFS_TR_WRITEV, fd, iovcnt);
+    uint8_t gather[NFVFS_IOV_GATHER];
+    int fentry = translate_fd_fentry(fd);
+    int total, ret, done = 0, cached = 0, i;
+
+    if (fentry < 0 || !ftable[fentry].used || iovcnt < 0)
+        return NFVFS_TRACE_END(tr, -1);
+
+#ifdef NFVFS_CACHE
+    nfvfs_cache_age();
+    cached = ftable[fentry].cache != NULL;
+#endif
+    total = nfvfs_iov_total(iov, iovcnt);
+    if (!cached && nfvfs->super.op.writev)
+        return NFVFS_TRACE_END(tr, nfvfs->super.op.writev(fentry, iov, iovcnt));
+
+    if (!cached && total <= NFVFS_IOV_GATHER) {
+        for (i = 0; i < iovcnt; i++) {
+            memcpy(gather + done, iov[i].iov_base, iov[i].iov_len);
+            done += iov[i].iov_len;
+        }
+        return NFVFS_TRACE_END(tr, nfvfs->super.op.write(fentry, gather, total));
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+#ifdef NFVFS_CACHE
+        if (cached)
+            ret = nfvfs_cache_write(ftable[fentry].cache, fentry, iov[i].iov_base, iov[i].iov_len);
+        else
+#endif
+        ret = nfvfs->super.op.write(fentry, iov[i].iov_base, iov[i].iov_len);
+        if (ret < 0)
+            return NFVFS_TRACE_END(tr, done ? done : ret);
+        done += ret;
+        if (ret < iov[i].iov_len)
+            break;              /* fs full */
+    }
+    return NFVFS_TRACE_END(tr, done);
 }
 
 int nfvfs_lseek(struct nfvfs *nfvfs, int fd, int offset, int whence)
 {
+    uint32_t tr = NFVFS_TRACE_BEGIN(NFVFS_TR_LSEEK, fd, offset);
     int ret = 0;
     int fentry = translate_fd_fentry(fd);
     
+    NFVFS_TRACE_ARG(tr, whence, NULL);
     if (fentry < 0 || !ftable[fentry].used)
-        return -1;
+        return NFVFS_TRACE_END(tr, -1);
     
+#ifdef NFVFS_CACHE
+    if (ftable[fentry].cache)
+        return NFVFS_TRACE_END(tr, nfvfs_cache_lseek(ftable[fentry].cache, fentry, offset, whence));
+#endif
     ret = nfvfs->super.op.lseek(fd, offset, whence);
     if (ret < 0)
-        return ret;
+        return NFVFS_TRACE_END(tr, ret);
     
-    return ret;
+    return NFVFS_TRACE_END(tr, ret);
+}
+
+int nfvfs_fsync(struct nfvfs *nfvfs, int fd)
+{
+    uint32_t tr = NFVFS_TRACE_BEGIN(NFVFS_TR_FSYNC, fd, 0);
+    int fentry = translate_fd_fentry(fd);
+    
+    if (fentry < 0 || !ftable[fentry].used)
+        return NFVFS_TRACE_END(tr, -1);
+
+#ifdef NFVFS_CACHE
+    if (ftable[fentry].cache) {
+        int ret = nfvfs_cache_flush(ftable[fentry].cache, fentry);
+        if (ret < 0)
+            return NFVFS_TRACE_END(tr, ret);
+    }
+#endif
+
+    /* nothing is cached if the fs does not implement it */
+    if (!nfvfs->super.op.fsync)
+        return NFVFS_TRACE_END(tr, 0);
+    
+    return NFVFS_TRACE_END(tr, nfvfs->super.op.fsync(fentry));
 }
 
 int nfvfs_unlink(struct nfvfs *nfvfs, const char *path)
 {
-    return nfvfs->super.op.unlink(path);
+    uint32_t tr = NFVFS_TRACE_BEGIN(NFVFS_TR_UNLINK, -1, 0);
+
+    NFVFS_TRACE_ARG(tr, 0, path);
+    if (!nfvfs->super.op.unlink)
+        return NFVFS_TRACE_END(tr, -1);
+
+    return NFVFS_TRACE_END(tr, nfvfs->super.op.unlink(path));
 }
 
 int nfvfs_readdir(struct nfvfs *nfvfs, int fd, struct nfvfs_dentry *buf)
@@ -179,6 +585,131 @@ int nfvfs_list(struct nfvfs *nfvfs, int fd, int (*action)(const char *name, void
     return ret;
 }
 
+/* close the fds entries before the failed one opened and no entry closed */
+static void nfvfs_batch_undo(struct nfvfs *nfvfs, struct nfvfs_batch *batch, int failed)
+{
+    int i, k;
+
+    for (i = 0; i < failed; i++) {
+        if (batch[i].op != NFVFS_BATCH_OPEN || batch[i].ret < 0)
+            continue;
+        for (k = i + 1; k < failed; k++) {
+            if (batch[k].op == NFVFS_BATCH_CLOSE &&
+                (batch[k].fd == NFVFS_BATCH_FD(i) || batch[k].fd == batch[i].ret))
+                break;
+        }
+        if (k == failed)
+            nfvfs_close(nfvfs, batch[i].ret);
+    }
+}
+
+/* entries run in order until one fails, fds opened by the batch can be
+ * passed to the later entries as NFVFS_BATCH_FD(i). After a failure the
+ * fds the batch opened are closed again. */
+int nfvfs_batch(struct nfvfs *nfvfs, struct nfvfs_batch *batch, int n)
+{
+    struct nfvfs_batch *b;
+    int i, fd;
+
+    for (i = 0; i < n; i++) {
+        b = &batch[i];
+        fd = b->fd;
+        if (b->op != NFVFS_BATCH_OPEN && b->op != NFVFS_BATCH_UNLINK && fd <= NFVFS_BATCH_FD(0)) {
+            if (NFVFS_BATCH_FD(0) - fd >= i) {
+                b->ret = -1;    /* not an earlier entry */
+                nfvfs_batch_undo(nfvfs, batch, i);
+                return i;
+            }
+            fd = batch[NFVFS_BATCH_FD(0) - fd].ret;
+        }
+        switch (b->op) {
+        case NFVFS_BATCH_OPEN:
+            b->ret = nfvfs_open(nfvfs, b->path, b->flags, b->mode);
+            break;
+        case NFVFS_BATCH_CLOSE:
+            b->ret = nfvfs_close(nfvfs, fd);
+            break;
+        case NFVFS_BATCH_READ:
+            b->ret = nfvfs_read(nfvfs, fd, b->buf, b->size);
+            break;
+        case NFVFS_BATCH_WRITE:
+            b->ret = nfvfs_write(nfvfs, fd, b->buf, b->size);
+            break;
+        case NFVFS_BATCH_LSEEK:
+            b->ret = nfvfs_lseek(nfvfs, fd, b->size, b->flags);
+            break;
+        case NFVFS_BATCH_FSYNC:
+            b->ret = nfvfs_fsync(nfvfs, fd);
+            break;
+        case NFVFS_BATCH_UNLINK:
+            b->ret = nfvfs_unlink(nfvfs, b->path);
+            break;
+        default:
+            b->ret = -1;
+            break;
+        }
+        if (b->ret < 0) {
+            nfvfs_batch_undo(nfvfs, batch, i);
+            return i;
+        }
+    }
+    return n;
+}
+
+const void *nfvfs_mmap(struct nfvfs *nfvfs, int fd, uint32_t offset, uint32_t len)
+{
+    const void *addr = NULL;
+    void *copy = NULL;
+    int fentry = translate_fd_fentry(fd);
+    int i, ret, pos;
+
+    if (fentry < 0 || !ftable[fentry].used)
+        return NULL;
+    for (i = 0; i < NFVFS_MAX_MAPS && nfvfs_maps[i].addr; i++)
+        ;
+    if (i == NFVFS_MAX_MAPS)
+        return NULL;
+
+    if (!nfvfs->super.op.mmap || nfvfs->super.op.mmap(fentry, offset, len, &addr) < 0) {
+        /* not contiguous: read it once into SDRAM, the caller's file
+         * position stays where it was */
+        pos = nfvfs_lseek(nfvfs, fd, 0, NFVFS_SEEK_CUR);
+        if (pos < 0)
+            return NULL;
+        copy = mymalloc(SRAMEX, len);
+        if (!copy)
+            return NULL;
+        ret = nfvfs_lseek(nfvfs, fd, offset, NFVFS_SEEK_SET);
+        if (ret >= 0)
+            ret = nfvfs_read(nfvfs, fd, copy, len);
+        if (nfvfs_lseek(nfvfs, fd, pos, NFVFS_SEEK_SET) < 0)
+            ret = -1;
+        if (ret != len) {
+            myfree(SRAMEX, copy);
+            return NULL;
+        }
+        addr = copy;
+    }
+    nfvfs_maps[i].addr = addr;
+    nfvfs_maps[i].copy = copy != NULL;
+    return addr;
+}
+
+int nfvfs_munmap(struct nfvfs *nfvfs, const void *addr)
+{
+    int i;
+
+    for (i = 0; i < NFVFS_MAX_MAPS; i++) {
+        if (addr && nfvfs_maps[i].addr == addr) {
+            if (nfvfs_maps[i].copy)
+                myfree(SRAMEX, (void *)addr);
+            nfvfs_maps[i].addr = NULL;
+            return 0;
+        }
+    }
+    return -1;
+}
+
 struct nfvfs_fentry *ftable_get_entry(int fd)
 {
     if (fd < 0 || fd >= NF_MAX_OPEN_FILES)
@@ -23,6 +23,24 @@
 #define NF_MAX_NAME_LEN   32
 #define NF_MAX_OPEN_FILES 32
 
+/* Page cache between the nfvfs calls and the fs, one page in SDRAM per
+ * regular file opened while it is enabled (nfvfs_cache_enable). Reads are
+ * read ahead by a page when sequential, small writes are collected in the
+ * page and written on fsync/close, when they leave the page or when older
+ * than NFVFS_CACHE_AGE_MS. The fs sees the seeks late: an unsupported
+ * seek fails at the write of the page. O_APPEND files are not cached. */
+#define NFVFS_CACHE
+#define NFVFS_CACHE_PAGE   4096
+#define NFVFS_CACHE_RA_MIN 256     /* read ahead of a random read */
+#define NFVFS_CACHE_AGE_MS 1000
+
+#define NFVFS_IOV_GATHER   256     /* readv/writev up to this go to the fs as one */
+
+/* nfvfs_mmap: a pointer to the file data from the fs (QSPI window, zero
+ * copy), else a copy in SDRAM read through the fd, whose file position is
+ * restored. Read only, the copy does not see later writes. */
+#define NFVFS_MAX_MAPS     8
+
 enum NFVFS_FILE_FLAGS
 {
     O_RDONLY = 0x1,         // Open a file as read only
@@ -64,8 +82,47 @@ struct nfvfs_fentry {
     uint8_t used;
     int mode;
     void *f;
+    struct nfvfs_cache *cache;          /* NULL: not cached */
 }; 
 
+struct nfvfs_iovec {
+    void *iov_base;
+    uint32_t iov_len;
+};
+
+enum NFVFS_BATCH_OP
+{
+    NFVFS_BATCH_OPEN,        // path, flags, mode
+    NFVFS_BATCH_CLOSE,       // fd
+    NFVFS_BATCH_READ,        // fd, buf, size
+    NFVFS_BATCH_WRITE,       // fd, buf, size
+    NFVFS_BATCH_LSEEK,       // fd, size (offset), flags (whence)
+    NFVFS_BATCH_FSYNC,       // fd
+    NFVFS_BATCH_UNLINK,      // path
+};
+
+/* fd argument: the fd opened by entry i of the same batch */
+#define NFVFS_BATCH_FD(i) (-2 - (i))
+
+struct nfvfs_batch {
+    uint8_t op;
+    int fd;
+    const char *path;
+    int flags;
+    int mode;
+    void *buf;
+    int size;
+    int ret;                            /* result of the call */
+};
+
+struct nfvfs_cache_stat {
+    uint32_t read_hits;                 /* reads served from the page */
+    uint32_t read_misses;               /* reads that went to the fs */
+    uint32_t write_merged;              /* writes collected in the page */
+    uint32_t write_through;             /* writes of a page or more, to the fs */
+    uint32_t flushes;                   /* pages written to the fs */
+};
+
 struct nfvfs_dentry {
     uint8_t type;
     const char *name;
@@ -83,6 +140,8 @@ struct nfvfs_operations {
     int (*close)(int fd);
     int (*read)(int fd, void *buf, uint32_t size);
     int (*write)(int fd, void *buf, uint32_t size);
+    int (*readv)(int fd, const struct nfvfs_iovec *iov, int iovcnt);   /* optional */
+    int (*writev)(int fd, const struct nfvfs_iovec *iov, int iovcnt);  /* optional */
     int (*lseek)(int fd, uint32_t offset, int whence);
     int (*unlink)(const char *path);
     int (*rename)(const char *oldpath, const char *newpath);
@@ -107,7 +166,7 @@ struct nfvfs_operations {
     int (*sync)(void);
     int (*syncfs)(int fd);
     int (*ioctl)(int fd, int request, void *argp);
-    int (*mmap)(void *addr, int len, int prot, int flags, int fd, int offset);
+    int (*mmap)(int fd, uint32_t offset, uint32_t len, const void **addr);  /* contiguous data only */
 };
 
 
@@ -133,11 +192,23 @@ int nfvfs_open(struct nfvfs *, const char *path, int flags, int mode);
 int nfvfs_close(struct nfvfs *, int fd);
 int nfvfs_read(struct nfvfs *, int fd, void *buf, int size);
 int nfvfs_write(struct nfvfs *, int fd, void *buf, int size);
+int nfvfs_readv(struct nfvfs *, int fd, const struct nfvfs_iovec *iov, int iovcnt);
+int nfvfs_writev(struct nfvfs *, int fd, const struct nfvfs_iovec *iov, int iovcnt);
 int nfvfs_lseek(struct nfvfs *, int fd, int offset, int whence);
+int nfvfs_fsync(struct nfvfs *, int fd);
 int nfvfs_unlink(struct nfvfs *, const char *path);
 int nfvfs_readdir(struct nfvfs *, int fd, struct nfvfs_dentry *buf);
 int nfvfs_list(struct nfvfs *nfvfs, int fd, int (*action)(const char *name, void *data), void *data);
+int nfvfs_batch(struct nfvfs *, struct nfvfs_batch *batch, int n);  /* n, or the entry that failed, its fds closed */
+const void *nfvfs_mmap(struct nfvfs *, int fd, uint32_t offset, uint32_t len);  /* NULL: failed */
+int nfvfs_munmap(struct nfvfs *, const void *addr);
 
 struct nfvfs_fentry *ftable_get_entry(int fd);
 
+#ifdef NFVFS_CACHE
+void nfvfs_cache_enable(int on);        /* for the files opened afterwards */
+int nfvfs_cache_stat(int fd, struct nfvfs_cache_stat *st);  /* -1: not cached */
+void nfvfs_cache_age(void);             /* write pages older than NFVFS_CACHE_AGE_MS */
+#endif
+
 #endif /* __NFVFS_H */
@@ -0,0 +1,312 @@
+#include "nfvfs_async.h"
+#include "string.h"
+#include "sys.h"
+#include "delay.h"
+
+static QueueHandle_t nfvfs_async_queue[2];  /* by NFVFS_PRIO_xx */
+static TaskHandle_t nfvfs_async_task;
+static struct nfvfs_req *nfvfs_async_cur;   /* low priority write in chunks */
+static struct nfvfs_req *nfvfs_async_next;  /* high priority request of the file of cur */
+static volatile uint32_t nfvfs_async_flight; /* submitted, not done */
+
+/* fsyncs held per filesystem until the window ends */
+static struct {
+    struct nfvfs *nfvfs;
+    uint32_t deadline;                  /* delay_get_ms(), HAL_GetTick() does not run */
+    struct nfvfs_req *head;
+} nfvfs_async_groups[NFVFS_ASYNC_GROUPS];
+static uint32_t nfvfs_async_window;     /* ms */
+static uint32_t nfvfs_async_fsyncs, nfvfs_async_commits;
+
+/* nfvfs_async_flight last: a flush must not return while done() still runs */
+static void nfvfs_async_complete(struct nfvfs_req *req)
+{
+    if (req->done)
+        req->done(req);
+    req->complete = 1;
+    if (req->cq)
+        xQueueSend(req->cq, &req, 0);
+    if (req->notify)
+        xTaskNotifyGive(req->notify);
+    taskENTER_CRITICAL();
+    nfvfs_async_flight--;
+    taskEXIT_CRITICAL();
+}
+
+/* next chunk of a low priority write, 0: done */
+static int nfvfs_async_chunk(struct nfvfs_req *req)
+{
+    int n, ret;
+
+    n = req->size - req->pos;
+    if (n > NFVFS_ASYNC_CHUNK)
+        n = NFVFS_ASYNC_CHUNK;
+    ret = nfvfs_write(req->nfvfs, req->fd, (uint8_t *)req->buf + req->pos, n);
+    if (ret < 0) {
+        req->ret = req->pos ? req->pos : ret;
+        return 0;
+    }
+    req->pos += ret;
+    req->ret = req->pos;
+    return ret == n && req->pos < req->size;
+}
+
+/* add a fsync to the group of its filesystem, 0: no group free */
+static int nfvfs_async_hold(struct nfvfs_req *req)
+{
+    int i, free = -1;
+
+    if (!nfvfs_async_window)
+        return 0;
+    for (i = 0; i < NFVFS_ASYNC_GROUPS; i++) {
+        if (nfvfs_async_groups[i].head && nfvfs_async_groups[i].nfvfs == req->nfvfs)
+            break;
+        if (!nfvfs_async_groups[i].head && free < 0)
+            free = i;
+    }
+    if (i == NFVFS_ASYNC_GROUPS) {
+        if (free < 0)
+            return 0;
+        i = free;
+        nfvfs_async_groups[i].nfvfs = req->nfvfs;
+        nfvfs_async_groups[i].deadline = delay_get_ms() + nfvfs_async_window;
+    }
+    req->next = nfvfs_async_groups[i].head;
+    nfvfs_async_groups[i].head = req;
+    return 1;
+}
+
+/* one fsync per file of the group, every request gets the result of its file */
+static void nfvfs_async_commit(int g)
+{
+    struct nfvfs_req *req, *prev, *next;
+
+    for (req = nfvfs_async_groups[g].head; req; req = req->next) {
+        for (prev = nfvfs_async_groups[g].head; prev != req && prev->fd != req->fd; prev = prev->next)
+            ;
+        if (prev != req) {
+            req->ret = prev->ret;
+        } else {
+            req->ret = nfvfs_fsync(req->nfvfs, req->fd);
+            nfvfs_async_commits++;
+        }
+    }
+    req = nfvfs_async_groups[g].head;
+    nfvfs_async_groups[g].head = NULL;
+    for (; req; req = next) {
+        next = req->next;
+        nfvfs_async_complete(req);
+    }
+}
+
+/* commit the groups whose window ended, returns ms to the next end */
+static uint32_t nfvfs_async_groups_due(void)
+{
+    uint32_t wait = 0xFFFFFFFF, left, now = delay_get_ms();
+    int i;
+
+    for (i = 0; i < NFVFS_ASYNC_GROUPS; i++) {
+        if (!nfvfs_async_groups[i].head)
+            continue;
+        left = nfvfs_async_groups[i].deadline - now;
+        if ((int32_t)left <= 0 || !nfvfs_async_window) {
+            nfvfs_async_commit(i);
+            continue;
+        }
+        if (left < wait)
+            wait = left;
+    }
+    return wait;
+}
+
+/* requests waiting in the groups */
+static uint32_t nfvfs_async_held(void)
+{
+    struct nfvfs_req *req;
+    uint32_t n = 0;
+    int i;
+
+    for (i = 0; i < NFVFS_ASYNC_GROUPS; i++) {
+        for (req = nfvfs_async_groups[i].head; req; req = req->next)
+            n++;
+    }
+    return n;
+}
+
+static void nfvfs_async_exec(struct nfvfs_req *req)
+{
+    switch (req->op) {
+    case NFVFS_REQ_READ:
+        req->ret = nfvfs_read(req->nfvfs, req->fd, req->buf, req->size);
+        break;
+    case NFVFS_REQ_WRITE:
+        if (req->prio == NFVFS_PRIO_LOW && req->size > NFVFS_ASYNC_CHUNK) {
+            req->pos = 0;
+            if (nfvfs_async_chunk(req)) {
+                nfvfs_async_cur = req;
+                return;
+            }
+            break;
+        }
+        req->ret = nfvfs_write(req->nfvfs, req->fd, req->buf, req->size);
+        break;
+    case NFVFS_REQ_LSEEK:
+        req->ret = nfvfs_lseek(req->nfvfs, req->fd, req->size, req->whence);
+        break;
+    case NFVFS_REQ_FSYNC:
+        nfvfs_async_fsyncs++;
+        if (nfvfs_async_hold(req))
+            return;
+        req->ret = nfvfs_fsync(req->nfvfs, req->fd);
+        nfvfs_async_commits++;
+        break;
+    default:
+        req->ret = -1;
+        break;
+    }
+    nfvfs_async_complete(req);
+}
+
+int nfvfs_async_poll(void)
+{
+    struct nfvfs_req *req, *cur = nfvfs_async_cur;
+
+    if (!nfvfs_async_queue[0])
+        return nfvfs_async_flight;
+
+    nfvfs_async_groups_due();
+    if (cur) {
+        /* high priority requests between the chunks, not of the same file */
+        if (!nfvfs_async_next && xQueueReceive(nfvfs_async_queue[NFVFS_PRIO_HIGH], &req, 0) == pdTRUE) {
+            if (req->nfvfs == cur->nfvfs && req->fd == cur->fd)
+                nfvfs_async_next = req;
+            else
+                nfvfs_async_exec(req);
+            return nfvfs_async_flight;
+        }
+        if (!nfvfs_async_chunk(cur)) {
+            nfvfs_async_cur = NULL;
+            nfvfs_async_complete(cur);
+        }
+        return nfvfs_async_flight;
+    }
+
+    if (nfvfs_async_next) {
+        req = nfvfs_async_next;
+        nfvfs_async_next = NULL;
+    } else if (xQueueReceive(nfvfs_async_queue[NFVFS_PRIO_HIGH], &req, 0) != pdTRUE &&
+               xQueueReceive(nfvfs_async_queue[NFVFS_PRIO_LOW], &req, 0) != pdTRUE) {
+        return nfvfs_async_flight;
+    }
+    nfvfs_async_exec(req);
+    return nfvfs_async_flight;
+}
+
+/* sleeps until a submit or the end of a group window, writes aged cache
+ * pages meanwhile */
+static void nfvfs_async_main(void *arg)
+{
+    uint32_t wait;
+
+    for (;;) {
+        if (nfvfs_async_poll() > nfvfs_async_held())
+            continue;
+        wait = nfvfs_async_groups_due();
+#ifdef NFVFS_CACHE
+        if (wait > NFVFS_CACHE_AGE_MS)
+            wait = NFVFS_CACHE_AGE_MS;
+        if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait) + 1))
+            nfvfs_cache_age();
+#else
+        ulTaskNotifyTake(pdTRUE, wait == 0xFFFFFFFF ? portMAX_DELAY : pdMS_TO_TICKS(wait) + 1);
+#endif
+    }
+}
+
+int nfvfs_async_init(UBaseType_t priority)
+{
+    int i;
+
+    if (nfvfs_async_queue[0])
+        return 0;
+    for (i = 0; i < 2; i++) {
+        nfvfs_async_queue[i] = xQueueCreate(NFVFS_ASYNC_DEPTH, sizeof(struct nfvfs_req *));
+        if (!nfvfs_async_queue[i])
+            goto fail;
+    }
+    if (xTaskCreate(nfvfs_async_main, "nfvfs", NFVFS_ASYNC_STACK, NULL, priority, &nfvfs_async_task) != pdPASS)
+        goto fail;
+    return 0;
+
+fail:
+    for (i = 0; i < 2; i++) {
+        if (nfvfs_async_queue[i])
+            vQueueDelete(nfvfs_async_queue[i]);
+        nfvfs_async_queue[i] = NULL;
+    }
+    return -1;
+}
+
+int nfvfs_async_submit(struct nfvfs_req *req)
+{
+    if (!nfvfs_async_queue[0] || req->prio > NFVFS_PRIO_LOW)
+        return -1;
+    req->complete = 0;
+    taskENTER_CRITICAL();
+    nfvfs_async_flight++;
+    taskEXIT_CRITICAL();
+    if (xQueueSend(nfvfs_async_queue[req->prio], &req, 0) != pdTRUE) {
+        taskENTER_CRITICAL();
+        nfvfs_async_flight--;
+        taskEXIT_CRITICAL();
+        return -1;
+    }
+    if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+        xTaskNotifyGive(nfvfs_async_task);
+    return 0;
+}
+
+void nfvfs_async_flush(void)
+{
+    while (nfvfs_async_flight) {
+        if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+            vTaskDelay(1);
+        else
+            nfvfs_async_poll();
+    }
+}
+
+void nfvfs_async_group(int window_ms)
+{
+    nfvfs_async_window = window_ms > 0 ? window_ms : 0;
+}
+
+void nfvfs_async_group_stat(uint32_t *fsyncs, uint32_t *commits)
+{
+    *fsyncs = nfvfs_async_fsyncs;
+    *commits = nfvfs_async_commits;
+    nfvfs_async_fsyncs = 0;
+    nfvfs_async_commits = 0;
+}
+
+int nfvfs_async_fsync(struct nfvfs *nfvfs, int fd)
+{
+    struct nfvfs_req req;
+
+    memset(&req, 0, sizeof(req));
+    req.op = NFVFS_REQ_FSYNC;
+    req.prio = NFVFS_PRIO_LOW;
+    req.nfvfs = nfvfs;
+    req.fd = fd;
+    if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+        req.notify = xTaskGetCurrentTaskHandle();
+    if (nfvfs_async_submit(&req))
+        return -1;
+    while (!req.complete) {
+        if (req.notify)
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        else
+            nfvfs_async_poll();
+    }
+    return req.ret;
+}
@@ -0,0 +1,85 @@
+// Copyright (C) 2022 Deadpool
+//
+// Asynchronous front-end of the Nor Flash-based Virtual File System
+//
+// NORENV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// NORENV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NORENV.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __NFVFS_ASYNC_H
+#define __NFVFS_ASYNC_H
+
+#include "nfvfs.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+/* nfvfs_async_submit() returns at once, one I/O task executes the requests
+ * with the nfvfs calls, high priority requests before all queued low
+ * priority ones. Low priority writes are split in NFVFS_ASYNC_CHUNK bytes,
+ * so a high priority request waits for one chunk at most (requests of the
+ * same file wait for the whole write). The filesystems are not reentrant:
+ * while requests are in flight, do not call nfvfs directly
+ * (nfvfs_async_flush() first). Before the scheduler runs,
+ * nfvfs_async_poll() from a loop does the work of the task.
+ *
+ * Group commit (nfvfs_async_group): fsync requests are held for window ms
+ * from the first one of a filesystem, other requests go on meanwhile. Then
+ * every file of the group gets one fsync and all waiters complete with its
+ * result, so appenders that fsync each record share the commits. */
+
+enum NFVFS_REQ_OP
+{
+    NFVFS_REQ_READ,          // size bytes of fd to buf
+    NFVFS_REQ_WRITE,         // size bytes of buf to fd
+    NFVFS_REQ_LSEEK,         // size (offset), whence
+    NFVFS_REQ_FSYNC,
+};
+
+enum NFVFS_REQ_PRIO
+{
+    NFVFS_PRIO_HIGH,         // latency critical, overtakes queued low requests
+    NFVFS_PRIO_LOW,          // bulk
+};
+
+#define NFVFS_ASYNC_DEPTH 16    /* requests per priority queue */
+#define NFVFS_ASYNC_STACK 512   /* I/O task stack (words) */
+#define NFVFS_ASYNC_CHUNK 1024
+#define NFVFS_ASYNC_GROUPS 4    /* filesystems with fsyncs held at the same time */
+
+struct nfvfs_req {
+    uint8_t op;                         /* NFVFS_REQ_xx */
+    uint8_t prio;                       /* NFVFS_PRIO_xx */
+    struct nfvfs *nfvfs;
+    int fd;
+    void *buf;
+    int size;
+    int whence;
+    int ret;                            /* result of the nfvfs call */
+    void (*done)(struct nfvfs_req *req);  /* called when done (I/O task), or NULL */
+    TaskHandle_t notify;                /* task notified (xTaskNotifyGive) when done, or NULL */
+    QueueHandle_t cq;                   /* completion queue, gets the req pointer, or NULL */
+    void *priv;                         /* for the submitter */
+    volatile uint8_t complete;          /* set when done */
+    int pos;                            /* internal: bytes written */
+    struct nfvfs_req *next;             /* internal: fsync group */
+};
+
+int nfvfs_async_init(UBaseType_t priority);     /* queues and I/O task, 0 or -1 */
+int nfvfs_async_submit(struct nfvfs_req *req);  /* 0 or -1 (queue full), req must stay valid until done */
+int nfvfs_async_poll(void);                     /* one step without the task, returns requests in flight */
+void nfvfs_async_flush(void);                   /* wait until all requests are done */
+void nfvfs_async_group(int window_ms);          /* group commit window, 0: fsync at once */
+int nfvfs_async_fsync(struct nfvfs *nfvfs, int fd);  /* fsync request, waits for it */
+void nfvfs_async_group_stat(uint32_t *fsyncs, uint32_t *commits);  /* since the last call */
+
+#endif /* __NFVFS_ASYNC_H */
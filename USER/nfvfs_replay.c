@@ -0,0 +1,367 @@
+#include "nfvfs_replay.h"
+#include "sys.h"
+#include "malloc.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+static uint8_t *nfvfs_cap_buf;          /* SDRAM */
+static uint32_t nfvfs_cap_size;         /* of the buffer */
+static uint32_t nfvfs_cap_len;          /* bytes of records */
+static uint32_t nfvfs_cap_count;
+static uint32_t nfvfs_cap_lost;
+static uint8_t nfvfs_cap_on;
+
+/* replay clock, us since nfvfs_replay_clock_start(): the cycle counter
+ * summed up, so a single call may take up to a wrap (~10s) */
+static uint32_t nfvfs_replay_cyc, nfvfs_replay_rem, nfvfs_replay_now;
+
+static void nfvfs_replay_clock_start(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    nfvfs_replay_cyc = DWT->CYCCNT;
+    nfvfs_replay_rem = 0;
+    nfvfs_replay_now = 0;
+}
+
+static uint32_t nfvfs_replay_clock(void)
+{
+    uint32_t cyc = DWT->CYCCNT, mhz = SystemCoreClock / 1000000;
+
+    nfvfs_replay_rem += cyc - nfvfs_replay_cyc;
+    nfvfs_replay_cyc = cyc;
+    nfvfs_replay_now += nfvfs_replay_rem / mhz;
+    nfvfs_replay_rem %= mhz;
+    return nfvfs_replay_now;
+}
+
+/* a buffer for size bytes of records, the old capture is dropped */
+static int nfvfs_capture_alloc(uint32_t size)
+{
+    if (nfvfs_cap_buf)
+        myfree(SRAMEX, nfvfs_cap_buf);
+    nfvfs_cap_len = nfvfs_cap_count = nfvfs_cap_lost = 0;
+    nfvfs_cap_size = 0;
+    nfvfs_cap_buf = mymalloc(SRAMEX, size ? size : 4);
+    if (!nfvfs_cap_buf) {
+        printf("%s: no memory for %d bytes\r\n", __func__, size);
+        return -1;
+    }
+    nfvfs_cap_size = size;
+    return 0;
+}
+
+int nfvfs_capture_start(int kb)
+{
+    if (kb <= 0)
+        return -1;
+    nfvfs_capture_stop();
+    if (nfvfs_capture_alloc(kb * 1024) < 0)
+        return -1;
+    if (nfvfs_trace_capture(1) < 0)
+        return -1;
+    nfvfs_cap_on = 1;
+    return 0;
+}
+
+void nfvfs_capture_stop(void)
+{
+    if (!nfvfs_cap_on)
+        return;
+    nfvfs_trace_capture(0);
+    nfvfs_cap_on = 0;
+    printf("nfvfs capture: %d calls, %d bytes, %d lost\r\n", nfvfs_cap_count, nfvfs_cap_len, nfvfs_cap_lost);
+}
+
+void nfvfs_capture_add(const struct nfvfs_cap_rec *rec, const char *path)
+{
+    struct nfvfs_cap_rec *r;
+    uint32_t path_len = path ? strlen(path) + 1 : 0;
+    uint32_t size;
+
+    if (path_len > 255)
+        path_len = 255;
+    size = sizeof(*rec) + ((path_len + 3) & ~3);
+    if (!nfvfs_cap_buf || nfvfs_cap_len + size > nfvfs_cap_size) {
+        nfvfs_cap_lost++;
+        return;
+    }
+    r = (struct nfvfs_cap_rec *)(nfvfs_cap_buf + nfvfs_cap_len);
+    memcpy(r, rec, sizeof(*rec));
+    r->path_len = path_len;
+    memset(r + 1, 0, size - sizeof(*rec));
+    if (path_len)
+        memcpy(r + 1, path, path_len - 1);
+    nfvfs_cap_len += size;
+    nfvfs_cap_count++;
+}
+
+int nfvfs_capture_save(const char *fsname, const char *path)
+{
+    struct nfvfs_cap_hdr hdr;
+    struct nfvfs *fs;
+    int fd, ret;
+
+    fs = get_nfvfs(fsname);
+    if (!fs) {
+        printf("\r\nFailed to get %s, making sure you have register it\r\n", fsname);
+        return -1;
+    }
+    nfvfs_capture_stop();
+    if (!nfvfs_cap_buf) {
+        printf("%s: nothing captured\r\n", __func__);
+        return -1;
+    }
+
+    hdr.magic = NFVFS_CAP_MAGIC;
+    hdr.count = nfvfs_cap_count;
+    hdr.size = nfvfs_cap_len;
+    hdr.lost = nfvfs_cap_lost;
+    nfvfs_mount(fs);
+    fd = nfvfs_open(fs, path, O_WRONLY | O_CREAT | O_TRUNC, S_ISREG);
+    if (fd < 0) {
+        printf("%s: can not create %s on %s\r\n", __func__, path, fsname);
+        nfvfs_umount(fs);
+        return -1;
+    }
+    ret = nfvfs_write(fs, fd, &hdr, sizeof(hdr));
+    if (ret == sizeof(hdr))
+        ret = nfvfs_write(fs, fd, nfvfs_cap_buf, nfvfs_cap_len);
+    nfvfs_close(fs, fd);
+    nfvfs_umount(fs);
+    if (ret != nfvfs_cap_len) {
+        printf("%s: write to %s failed\r\n", __func__, path);
+        return -1;
+    }
+    return 0;
+}
+
+int nfvfs_capture_load(const char *fsname, const char *path)
+{
+    struct nfvfs_cap_hdr hdr;
+    struct nfvfs *fs;
+    int fd, ret = -1;
+
+    fs = get_nfvfs(fsname);
+    if (!fs) {
+        printf("\r\nFailed to get %s, making sure you have register it\r\n", fsname);
+        return -1;
+    }
+    nfvfs_capture_stop();
+
+    nfvfs_mount(fs);
+    fd = nfvfs_open(fs, path, O_RDONLY, S_ISREG);
+    if (fd < 0) {
+        printf("%s: can not open %s on %s\r\n", __func__, path, fsname);
+        nfvfs_umount(fs);
+        return -1;
+    }
+    if (nfvfs_read(fs, fd, &hdr, sizeof(hdr)) != sizeof(hdr) || hdr.magic != NFVFS_CAP_MAGIC) {
+        printf("%s: %s is no capture\r\n", __func__, path);
+    } else if (nfvfs_capture_alloc(hdr.size) == 0) {
+        if (nfvfs_read(fs, fd, nfvfs_cap_buf, hdr.size) == hdr.size) {
+            nfvfs_cap_len = hdr.size;
+            nfvfs_cap_count = hdr.count;
+            nfvfs_cap_lost = hdr.lost;
+            ret = 0;
+        } else {
+            printf("%s: %s is truncated\r\n", __func__, path);
+        }
+    }
+    nfvfs_close(fs, fd);
+    nfvfs_umount(fs);
+    return ret;
+}
+
+/* the file image, 32 bytes a line between the header line and "end" */
+void nfvfs_capture_dump(void)
+{
+    struct nfvfs_cap_hdr hdr;
+    uint32_t i;
+
+    nfvfs_capture_stop();
+    hdr.magic = NFVFS_CAP_MAGIC;
+    hdr.count = nfvfs_cap_count;
+    hdr.size = nfvfs_cap_len;
+    hdr.lost = nfvfs_cap_lost;
+    printf("nfvfs capture %d records, %d bytes\r\n", nfvfs_cap_count, sizeof(hdr) + nfvfs_cap_len);
+    for (i = 0; i < sizeof(hdr); i++)
+        printf("%02X", ((uint8_t *)&hdr)[i]);
+    for (i = 0; i < nfvfs_cap_len; i++) {
+        if ((sizeof(hdr) + i) % 32 == 0)
+            printf("\r\n");
+        printf("%02X", nfvfs_cap_buf[i]);
+    }
+    printf("\r\nend\r\n");
+}
+
+static int nfvfs_replay_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int nfvfs_replay_class(uint8_t op)
+{
+    if (op == NFVFS_TR_READ || op == NFVFS_TR_READV)
+        return NFVFS_REPLAY_READ;
+    if (op == NFVFS_TR_WRITE || op == NFVFS_TR_WRITEV)
+        return NFVFS_REPLAY_WRITE;
+    return NFVFS_REPLAY_META;
+}
+
+/* bytes a read/write record moves in the replay */
+static int nfvfs_replay_size(const struct nfvfs_cap_rec *r)
+{
+    if (r->op == NFVFS_TR_READ || r->op == NFVFS_TR_WRITE)
+        return r->arg;
+    if (r->op == NFVFS_TR_READV || r->op == NFVFS_TR_WRITEV)
+        return r->ret;
+    return 0;
+}
+
+int nfvfs_replay(struct nfvfs *nfvfs, int timing, struct nfvfs_replay_stat *st)
+{
+    const struct nfvfs_cap_rec *r;
+    uint32_t *lat[NFVFS_REPLAY_CLASSES];
+    uint32_t flash[NFVFS_TR_FLASH_OPS];
+    int map[NF_MAX_OPEN_FILES];
+    uint32_t pos, due = 0, t, n;
+    int size, max = 0, fd, ret, c, i;
+    const char *path;
+    uint8_t *buf;
+
+    if (nfvfs_cap_on) {
+        printf("%s: capture running\r\n", __func__);
+        return -1;
+    }
+    if (!nfvfs_cap_count) {
+        printf("%s: nothing captured or loaded\r\n", __func__);
+        return -1;
+    }
+
+    memset(st, 0, sizeof(*st));
+    for (pos = 0; pos < nfvfs_cap_len; pos += sizeof(*r) + ((r->path_len + 3) & ~3)) {
+        r = (const struct nfvfs_cap_rec *)(nfvfs_cap_buf + pos);
+        size = nfvfs_replay_size(r);
+        if (size > max)
+            max = size;
+        st->lat[nfvfs_replay_class(r->op)].n++;
+    }
+    buf = mymalloc(SRAMEX, max ? max : 4);
+    for (c = 0; c < NFVFS_REPLAY_CLASSES; c++)
+        lat[c] = mymalloc(SRAMEX, st->lat[c].n ? st->lat[c].n * sizeof(uint32_t) : 4);
+    if (!buf || !lat[NFVFS_REPLAY_READ] || !lat[NFVFS_REPLAY_WRITE] || !lat[NFVFS_REPLAY_META]) {
+        printf("%s: no memory\r\n", __func__);
+        ret = -1;
+        goto out;
+    }
+    for (i = 0; i < max; i++)
+        buf[i] = i;
+    for (i = 0; i < NF_MAX_OPEN_FILES; i++)
+        map[i] = -1;
+    for (c = 0; c < NFVFS_REPLAY_CLASSES; c++)
+        st->lat[c].n = 0;
+
+    nfvfs_trace_flash(flash);
+    nfvfs_replay_clock_start();
+    for (pos = 0; pos < nfvfs_cap_len; pos += sizeof(*r) + ((r->path_len + 3) & ~3)) {
+        r = (const struct nfvfs_cap_rec *)(nfvfs_cap_buf + pos);
+        path = r->path_len ? (const char *)(r + 1) : "";
+        /* the gap before the first call is not part of the workload */
+        if (timing && pos) {
+            due += r->delta_us;
+            while (nfvfs_replay_clock() < due)
+                ;
+        }
+
+        fd = -1;
+        if (r->op != NFVFS_TR_OPEN && r->op != NFVFS_TR_UNLINK) {
+            if (r->fd < 0 || r->fd >= NF_MAX_OPEN_FILES || map[r->fd] < 0) {
+                st->skipped++;
+                continue;
+            }
+            fd = map[r->fd];
+        }
+        size = nfvfs_replay_size(r);
+        t = nfvfs_replay_clock();
+        switch (r->op) {
+        case NFVFS_TR_OPEN:
+            ret = nfvfs_open(nfvfs, path, r->arg & 0xFFFF, (uint32_t)r->arg >> 16);
+            if (r->ret >= 0 && r->ret < NF_MAX_OPEN_FILES)
+                map[r->ret] = ret;
+            break;
+        case NFVFS_TR_CLOSE:
+            ret = nfvfs_close(nfvfs, fd);
+            map[r->fd] = -1;
+            break;
+        case NFVFS_TR_READ:
+        case NFVFS_TR_READV:
+            ret = size > 0 ? nfvfs_read(nfvfs, fd, buf, size) : 0;
+            if (ret > 0)
+                st->read_bytes += ret;
+            break;
+        case NFVFS_TR_WRITE:
+        case NFVFS_TR_WRITEV:
+            ret = size > 0 ? nfvfs_write(nfvfs, fd, buf, size) : 0;
+            if (ret > 0)
+                st->write_bytes += ret;
+            break;
+        case NFVFS_TR_LSEEK:
+            ret = nfvfs_lseek(nfvfs, fd, r->arg, r->arg2);
+            break;
+        case NFVFS_TR_FSYNC:
+            ret = nfvfs_fsync(nfvfs, fd);
+            break;
+        case NFVFS_TR_UNLINK:
+            if (!nfvfs->super.op.unlink) {
+                st->skipped++;  /* not an error of this fs */
+                continue;
+            }
+            ret = nfvfs_unlink(nfvfs, path);
+            break;
+        default:
+            st->skipped++;
+            continue;
+        }
+        t = nfvfs_replay_clock() - t;
+        c = nfvfs_replay_class(r->op);
+        lat[c][st->lat[c].n++] = t;
+        st->ops++;
+        if (ret < 0)
+            st->errors++;
+    }
+    st->us = nfvfs_replay_clock();
+
+    /* files the capture left open */
+    for (i = 0; i < NF_MAX_OPEN_FILES; i++) {
+        if (map[i] >= 0)
+            nfvfs_close(nfvfs, map[i]);
+    }
+    nfvfs_trace_flash(st->flash);
+    for (i = 0; i < NFVFS_TR_FLASH_OPS; i++)
+        st->flash[i] -= flash[i];
+
+    for (c = 0; c < NFVFS_REPLAY_CLASSES; c++) {
+        n = st->lat[c].n;
+        if (!n)
+            continue;
+        qsort(lat[c], n, sizeof(uint32_t), nfvfs_replay_cmp);
+        st->lat[c].p50 = lat[c][(n - 1) * 50 / 100];
+        st->lat[c].p90 = lat[c][(n - 1) * 90 / 100];
+        st->lat[c].p99 = lat[c][(n - 1) * 99 / 100];
+        st->lat[c].max = lat[c][n - 1];
+    }
+    ret = 0;
+out:
+    for (c = 0; c < NFVFS_REPLAY_CLASSES; c++) {
+        if (lat[c])
+            myfree(SRAMEX, lat[c]);
+    }
+    if (buf)
+        myfree(SRAMEX, buf);
+    return ret;
+}
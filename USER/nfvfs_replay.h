@@ -0,0 +1,89 @@
+// Copyright (C) 2022 Deadpool
+//
+// Capture and replay of nfvfs workloads
+//
+// NORENV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// NORENV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NORENV.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __NFVFS_REPLAY_H
+#define __NFVFS_REPLAY_H
+
+#include "nfvfs.h"
+#include "nfvfs_trace.h"
+
+/* Between nfvfs_capture_start() and nfvfs_capture_stop() the nfvfs calls
+ * of the application go to a buffer in SDRAM (trace points of
+ * nfvfs_trace.h), with their arguments, results and the time since the
+ * previous call. nfvfs_capture_save() stores it as a file on any
+ * filesystem, nfvfs_capture_dump() prints it for SCRIPT/nfvtrace.py.
+ * nfvfs_replay() runs the captured or loaded calls against another
+ * filesystem, at full speed or with the captured gaps, and measures them.
+ *
+ * File: struct nfvfs_cap_hdr, then count records of struct nfvfs_cap_rec,
+ * each followed by path_len bytes of path (with the 0) padded to 4. */
+
+#define NFVFS_CAP_MAGIC 0x5456464E     /* "NFVT" */
+
+struct nfvfs_cap_hdr {
+    uint32_t magic;
+    uint32_t count;          // records
+    uint32_t size;           // bytes of the records
+    uint32_t lost;           // calls not captured, buffer full
+};
+
+struct nfvfs_cap_rec {
+    uint8_t op;              // NFVFS_TR_xx
+    int8_t fd;
+    uint8_t path_len;
+    uint8_t arg2;            // lseek: whence
+    uint32_t delta_us;       // since the previous call began
+    int32_t arg;             // as struct nfvfs_trace_rec
+    int32_t ret;
+};
+
+enum NFVFS_REPLAY_CLASS
+{
+    NFVFS_REPLAY_READ,       // read, readv
+    NFVFS_REPLAY_WRITE,      // write, writev
+    NFVFS_REPLAY_META,       // everything else
+    NFVFS_REPLAY_CLASSES,
+};
+
+struct nfvfs_replay_lat {
+    uint32_t n;
+    uint32_t p50, p90, p99, max;  // us
+};
+
+struct nfvfs_replay_stat {
+    uint32_t ops;
+    uint32_t errors;         // calls failed in the replay
+    uint32_t skipped;        // on a file not opened in the replay
+    uint32_t read_bytes, write_bytes;
+    uint32_t us;             // whole replay
+    struct nfvfs_replay_lat lat[NFVFS_REPLAY_CLASSES];
+    uint32_t flash[NFVFS_TR_FLASH_OPS];  // W25QXX commands by NFVFS_TR_FLASH_xx
+};
+
+int nfvfs_capture_start(int kb);    /* buffer of kb KB, 0 or -1 */
+void nfvfs_capture_stop(void);
+int nfvfs_capture_save(const char *fsname, const char *path);
+int nfvfs_capture_load(const char *fsname, const char *path);
+void nfvfs_capture_dump(void);      /* file image as hex */
+void nfvfs_capture_add(const struct nfvfs_cap_rec *rec, const char *path);  /* nfvfs_trace.c */
+
+/* the calls of the capture on a mounted nfvfs, timing 1: with the captured
+ * gaps (no catching up if the replay is slower), 0: back to back. readv and
+ * writev are replayed as one read/write of the bytes they moved. */
+int nfvfs_replay(struct nfvfs *nfvfs, int timing, struct nfvfs_replay_stat *st);
+
+#endif /* __NFVFS_REPLAY_H */
@@ -0,0 +1,209 @@
+#include "nfvfs_trace.h"
+#include "nfvfs_replay.h"
+#include "sys.h"
+#include "delay.h"
+#include "stdio.h"
+#include "string.h"
+
+#ifdef NFVFS_TRACE
+static struct nfvfs_trace_rec nfvfs_trace_ring[NFVFS_TRACE_RECORDS];
+static volatile uint32_t nfvfs_trace_head;  /* next seq */
+static volatile uint32_t nfvfs_trace_cur = NFVFS_TRACE_NONE;  /* nfvfs call running */
+static uint32_t nfvfs_trace_outer[NFVFS_TRACE_DEPTH];           /* cur of the calls around it */
+static volatile uint8_t nfvfs_trace_depth;
+static volatile uint8_t nfvfs_trace_on;
+static uint32_t nfvfs_trace_flash_ops[NFVFS_TR_FLASH_OPS];
+
+/* capture: the nfvfs call running, completed by nfvfs_trace_end() */
+static volatile uint8_t nfvfs_trace_cap;
+static uint32_t nfvfs_trace_cap_seq = NFVFS_TRACE_NONE;
+static struct nfvfs_cap_rec nfvfs_trace_cap_rec;
+static const char *nfvfs_trace_cap_path;
+static uint32_t nfvfs_trace_cap_cyc, nfvfs_trace_cap_ms;    /* begin of the last call */
+
+static void nfvfs_trace_dwt(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static void nfvfs_trace_cap_begin(uint32_t seq, uint8_t op, int fd, uint32_t arg)
+{
+    struct nfvfs_cap_rec *r = &nfvfs_trace_cap_rec;
+    uint32_t cyc = DWT->CYCCNT, ms = delay_get_ms();
+
+    /* cycles for the resolution, delay_get_ms() for gaps longer than the
+     * counter wraps (HAL_GetTick() does not run) */
+    if (ms - nfvfs_trace_cap_ms < 4000)
+        r->delta_us = (cyc - nfvfs_trace_cap_cyc) / (SystemCoreClock / 1000000);
+    else
+        r->delta_us = (ms - nfvfs_trace_cap_ms) * 1000;
+    nfvfs_trace_cap_cyc = cyc;
+    nfvfs_trace_cap_ms = ms;
+    r->op = op;
+    r->fd = fd;
+    r->path_len = 0;
+    r->arg2 = 0;
+    r->arg = arg;
+    r->ret = 0;
+    nfvfs_trace_cap_path = NULL;
+    nfvfs_trace_cap_seq = seq;
+}
+
+uint32_t nfvfs_trace_begin(uint8_t op, int fd, uint32_t arg)
+{
+    struct nfvfs_trace_rec *rec;
+    uint32_t seq;
+
+    if (op >= NFVFS_TR_FLASH && op < NFVFS_TR_FLASH + NFVFS_TR_FLASH_OPS)
+        nfvfs_trace_flash_ops[op - NFVFS_TR_FLASH]++;
+    if (!nfvfs_trace_on && !nfvfs_trace_cap)
+        return NFVFS_TRACE_NONE;
+    do {
+        seq = __LDREXW(&nfvfs_trace_head);
+    } while (__STREXW(seq + 1, &nfvfs_trace_head));
+
+    rec = &nfvfs_trace_ring[seq & (NFVFS_TRACE_RECORDS - 1)];
+    rec->end = 0;
+    rec->seq = seq;
+    rec->parent = nfvfs_trace_cur;
+    rec->op = op;
+    rec->fd = fd;
+    rec->arg = arg;
+    rec->ret = 0;
+    if (op < NFVFS_TR_FLASH) {
+        /* the application's calls only, not those nfvfs makes itself */
+        if (nfvfs_trace_cap && nfvfs_trace_cur == NFVFS_TRACE_NONE)
+            nfvfs_trace_cap_begin(seq, op, fd, arg);
+        /* deeper calls stay children of the innermost one kept */
+        if (nfvfs_trace_depth < NFVFS_TRACE_DEPTH) {
+            nfvfs_trace_outer[nfvfs_trace_depth++] = nfvfs_trace_cur;
+            nfvfs_trace_cur = seq;
+        }
+    }
+    rec->start = DWT->CYCCNT;
+    return seq;
+}
+
+void nfvfs_trace_arg(uint32_t seq, int arg2, const char *path)
+{
+    if (seq == NFVFS_TRACE_NONE || seq != nfvfs_trace_cap_seq)
+        return;
+    nfvfs_trace_cap_rec.arg2 = arg2;
+    nfvfs_trace_cap_path = path;
+}
+
+int nfvfs_trace_end(uint32_t seq, int ret)
+{
+    struct nfvfs_trace_rec *rec;
+    uint32_t end = DWT->CYCCNT;
+
+    if (seq == NFVFS_TRACE_NONE)
+        return ret;
+    /* back to the calling nfvfs call, the record may be overwritten by
+     * the flash commands of a long call */
+    if (seq == nfvfs_trace_cur && nfvfs_trace_depth)
+        nfvfs_trace_cur = nfvfs_trace_outer[--nfvfs_trace_depth];
+    if (seq == nfvfs_trace_cap_seq) {
+        nfvfs_trace_cap_seq = NFVFS_TRACE_NONE;
+        nfvfs_trace_cap_rec.ret = ret;
+        if (nfvfs_trace_cap)
+            nfvfs_capture_add(&nfvfs_trace_cap_rec, nfvfs_trace_cap_path);
+    }
+    rec = &nfvfs_trace_ring[seq & (NFVFS_TRACE_RECORDS - 1)];
+    if (rec->seq != seq)
+        return ret;     /* overwritten meanwhile */
+    rec->ret = ret;
+    rec->end = end ? end : 1;
+    return ret;
+}
+#endif
+
+void nfvfs_trace_start(void)
+{
+#ifdef NFVFS_TRACE
+    nfvfs_trace_dwt();
+    nfvfs_trace_on = 0;
+    memset(nfvfs_trace_ring, 0, sizeof(nfvfs_trace_ring));
+    nfvfs_trace_head = 0;
+    nfvfs_trace_cur = NFVFS_TRACE_NONE;
+    nfvfs_trace_depth = 0;
+    nfvfs_trace_on = 1;
+#else
+    printf("%s: built without NFVFS_TRACE\r\n", __func__);
+#endif
+}
+
+void nfvfs_trace_stop(void)
+{
+#ifdef NFVFS_TRACE
+    nfvfs_trace_on = 0;
+#endif
+}
+
+void nfvfs_trace_flash(uint32_t ops[NFVFS_TR_FLASH_OPS])
+{
+#ifdef NFVFS_TRACE
+    memcpy(ops, nfvfs_trace_flash_ops, sizeof(nfvfs_trace_flash_ops));
+#else
+    memset(ops, 0, NFVFS_TR_FLASH_OPS * sizeof(uint32_t));
+#endif
+}
+
+int nfvfs_trace_capture(int on)
+{
+#ifdef NFVFS_TRACE
+    if (on) {
+        nfvfs_trace_dwt();
+        nfvfs_trace_cap_cyc = DWT->CYCCNT;
+        nfvfs_trace_cap_ms = delay_get_ms();
+    }
+    nfvfs_trace_cap_seq = NFVFS_TRACE_NONE;
+    nfvfs_trace_cap = on;
+    return 0;
+#else
+    printf("%s: built without NFVFS_TRACE\r\n", __func__);
+    return on ? -1 : 0;
+#endif
+}
+
+/* oldest record first; CSV for spreadsheets, hex for a host decoder of
+ * struct nfvfs_trace_rec (little endian, 28 bytes) */
+void nfvfs_trace_dump(int csv)
+{
+#ifdef NFVFS_TRACE
+    static const char *const names[] = {"open", "close", "read", "write", "lseek", "fsync", "unlink", "readv", "writev"};
+    static const char *const flash_names[] = {"flash_read", "flash_prog", "flash_erase", "flash_wait"};
+    struct nfvfs_trace_rec *rec;
+    const uint8_t *p;
+    uint32_t seq, first, head = nfvfs_trace_head;
+    uint8_t on = nfvfs_trace_on;
+    int i;
+
+    nfvfs_trace_on = 0;
+    first = head > NFVFS_TRACE_RECORDS ? head - NFVFS_TRACE_RECORDS : 0;
+    if (csv)
+        printf("seq,parent,op,fd,arg,ret,start,cycles\r\n");
+    else
+        printf("nfvfs trace %d records of %d bytes, %d MHz\r\n", head - first,
+               sizeof(struct nfvfs_trace_rec), SystemCoreClock / 1000000);
+    for (seq = first; seq != head; seq++) {
+        rec = &nfvfs_trace_ring[seq & (NFVFS_TRACE_RECORDS - 1)];
+        if (!csv) {
+            for (p = (const uint8_t *)rec, i = 0; i < sizeof(*rec); i++)
+                printf("%02X", p[i]);
+            printf("\r\n");
+            continue;
+        }
+        printf("%d,%d,%s,%d,%u,%d,%u,%u\r\n", rec->seq,
+               rec->parent == NFVFS_TRACE_NONE ? -1 : (int)rec->parent,
+               rec->op >= NFVFS_TR_FLASH ? (rec->op - NFVFS_TR_FLASH < 4 ? flash_names[rec->op - NFVFS_TR_FLASH] : "?")
+                                          : (rec->op < 9 ? names[rec->op] : "?"),
+               rec->fd, rec->arg, rec->ret, rec->start, rec->end ? rec->end - rec->start : 0);
+    }
+    nfvfs_trace_on = on;
+#else
+    printf("%s: built without NFVFS_TRACE\r\n", __func__);
+#endif
+}
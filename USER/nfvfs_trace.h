@@ -0,0 +1,88 @@
+// Copyright (C) 2022 Deadpool
+//
+// Operation trace of the Nor Flash-based Virtual File System
+//
+// NORENV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// NORENV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NORENV.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __NFVFS_TRACE_H
+#define __NFVFS_TRACE_H
+
+#include <stdint.h>
+
+/* Ring of the last NFVFS_TRACE_RECORDS nfvfs calls and W25QXX commands with
+ * DWT cycle stamps, started by nfvfs_trace_start(). A record is reserved
+ * with LDREX/STREX when the operation begins and completed when it ends,
+ * the flash records name the nfvfs call they run in (parent). Page programs
+ * return before the chip is done: their time shows in the next wait record.
+ * The W25QXX commands are also counted while the ring is off
+ * (nfvfs_trace_flash). Without NFVFS_TRACE the trace points compile to
+ * nothing. */
+#define NFVFS_TRACE
+#define NFVFS_TRACE_RECORDS 256     /* power of 2 */
+#define NFVFS_TRACE_NONE    0xFFFFFFFF
+#define NFVFS_TRACE_DEPTH   4       /* nested nfvfs calls with their own parent */
+
+enum NFVFS_TRACE_OP
+{
+    NFVFS_TR_OPEN,           // arg: flags | mode << 16
+    NFVFS_TR_CLOSE,
+    NFVFS_TR_READ,           // arg: size
+    NFVFS_TR_WRITE,          // arg: size
+    NFVFS_TR_LSEEK,          // arg: offset
+    NFVFS_TR_FSYNC,
+    NFVFS_TR_UNLINK,
+    NFVFS_TR_READV,          // arg: iovcnt
+    NFVFS_TR_WRITEV,         // arg: iovcnt
+    NFVFS_TR_FLASH = 0x10,   // flash commands from here, fd: -1
+    NFVFS_TR_FLASH_READ = NFVFS_TR_FLASH,   // arg: address, ret: length
+    NFVFS_TR_FLASH_PROG,     // arg: address, ret: length
+    NFVFS_TR_FLASH_ERASE,    // arg: address, ret: command
+    NFVFS_TR_FLASH_WAIT,     // busy wait
+};
+
+#define NFVFS_TR_FLASH_OPS 4
+
+struct nfvfs_trace_rec {
+    uint32_t seq;            // record number
+    uint32_t parent;         // seq of the nfvfs call, NFVFS_TRACE_NONE: outside
+    uint8_t op;              // NFVFS_TR_xx
+    int8_t fd;
+    uint16_t reserved;
+    uint32_t arg;
+    int32_t ret;
+    uint32_t start;          // DWT->CYCCNT
+    uint32_t end;            // 0: not ended (yet)
+};
+
+#ifdef NFVFS_TRACE
+uint32_t nfvfs_trace_begin(uint8_t op, int fd, uint32_t arg);   /* seq or NFVFS_TRACE_NONE */
+int nfvfs_trace_end(uint32_t seq, int ret);                     /* returns ret */
+#define NFVFS_TRACE_BEGIN(op, fd, arg) nfvfs_trace_begin(op, fd, arg)
+#define NFVFS_TRACE_END(seq, ret)      nfvfs_trace_end(seq, ret)
+/* whence of lseek and the path of open/unlink for the capture */
+void nfvfs_trace_arg(uint32_t seq, int arg2, const char *path);
+#define NFVFS_TRACE_ARG(seq, arg2, path) nfvfs_trace_arg(seq, arg2, path)
+#else
+#define NFVFS_TRACE_BEGIN(op, fd, arg) NFVFS_TRACE_NONE
+#define NFVFS_TRACE_END(seq, ret)      ((void)(seq), (ret))
+#define NFVFS_TRACE_ARG(seq, arg2, path) ((void)(seq))
+#endif
+
+void nfvfs_trace_start(void);           /* clear and record */
+void nfvfs_trace_stop(void);
+void nfvfs_trace_dump(int csv);         /* 1: CSV, 0: records as hex */
+void nfvfs_trace_flash(uint32_t ops[NFVFS_TR_FLASH_OPS]);  /* W25QXX commands so far by NFVFS_TR_FLASH_xx */
+int nfvfs_trace_capture(int on);        /* nfvfs calls to nfvfs_capture_add(), 0 or -1 */
+
+#endif /* __NFVFS_TRACE_H */
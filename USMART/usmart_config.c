@@ -10,6 +10,11 @@
 #include "sys.h"
 #include "w25qxx.h"
 #include "benchmark.h"
+#include "nfvfs_trace.h"
+#include "nfvfs_replay.h"
+#include "ramfs_brigde.h"
+#include "norftl.h"
+#include "jesfs.h"
 
 //бʼ(ûԼ)
 //ûֱҪִеĺҴ
@@ -20,6 +25,40 @@ struct _m_usmart_nametab usmart_nametab[] =
         (void *)write_addr, "void write_addr(u32 addr,u32 val)",
 #endif
         (void *)basic_storage_test, "void basic_storage_test(const char *fsname, int loop)",
+        (void *)spiffs_cache_benchmark, "void spiffs_cache_benchmark(int max_pages, int file_kb)",
+        (void *)spiffs_check_benchmark, "void spiffs_check_benchmark(int map_kb, int blocks_per_step)",
+        (void *)jesfs_open_benchmark, "void jesfs_open_benchmark(int max_files)",
+        (void *)jesfs_record_benchmark, "void jesfs_record_benchmark(int records, int record_size)",
+        (void *)jesfs_erase_benchmark, "void jesfs_erase_benchmark(int file_kb, int rounds, int budget_ms)",
+        (void *)fs_maintenance, "short fs_maintenance(u32 budget_ms)",
+        (void *)w25qxx_pipeline_benchmark, "void w25qxx_pipeline_benchmark(int kb, int work_us)",
+        (void *)jesfs_multi_benchmark, "void jesfs_multi_benchmark(int vols, int file_kb)",
+        (void *)jesfs_format_benchmark, "void jesfs_format_benchmark(int part_kb, int buf_kb)",
+        (void *)jesfs_mount_benchmark, "void jesfs_mount_benchmark(int part_kb, int files)",
+        (void *)w25qxx_suspend_benchmark, "void w25qxx_suspend_benchmark(int sectors, int gap_us)",
+        (void *)w25qxx_async_benchmark, "void w25qxx_async_benchmark(int sectors, int work_us)",
+        (void *)w25qxx_read_benchmark, "void w25qxx_read_benchmark(int kb)",
+        (void *)w25qxx_geometry_info, "void w25qxx_geometry_info(void)",
+        (void *)nordev_stripe_benchmark, "void nordev_stripe_benchmark(int kb)",
+        (void *)nfvfs_cache_benchmark, "void nfvfs_cache_benchmark(const char *fsname, int records, int record_size)",
+        (void *)nfvfs_writev_benchmark, "void nfvfs_writev_benchmark(const char *fsname, int records, int payload)",
+        (void *)nfvfs_async_benchmark, "void nfvfs_async_benchmark(const char *fsname, int records, int work_us)",
+        (void *)nfvfs_mmap_benchmark, "void nfvfs_mmap_benchmark(const char *fsname, const char *path)",
+        (void *)nfvfs_group_benchmark, "void nfvfs_group_benchmark(const char *fsname, int writers, int rounds, int window_ms)",
+        (void *)nfvfs_trace_start, "void nfvfs_trace_start(void)",
+        (void *)nfvfs_trace_stop, "void nfvfs_trace_stop(void)",
+        (void *)nfvfs_trace_dump, "void nfvfs_trace_dump(int csv)",
+        (void *)nfvfs_capture_start, "int nfvfs_capture_start(int kb)",
+        (void *)nfvfs_capture_stop, "void nfvfs_capture_stop(void)",
+        (void *)nfvfs_capture_save, "int nfvfs_capture_save(const char *fsname, const char *path)",
+        (void *)nfvfs_capture_load, "int nfvfs_capture_load(const char *fsname, const char *path)",
+        (void *)nfvfs_capture_dump, "void nfvfs_capture_dump(void)",
+        (void *)nfvfs_replay_benchmark, "void nfvfs_replay_benchmark(const char *fsname, int timing)",
+        (void *)ramfs_set_snapshot, "int ramfs_set_snapshot(int dev, int kb)",
+        (void *)ramfs_snapshot, "int ramfs_snapshot(void)",
+        (void *)ramfs_info, "void ramfs_info(void)",
+        (void *)NORFTL_Info, "void NORFTL_Info(void)",
+        (void *)NORFTL_Poll, "u8 NORFTL_Poll(void)",
         (void *)delay_ms, "void delay_ms(u16 nms)",
         (void *)delay_us, "void delay_us(u32 nus)"
 	};